@@ -0,0 +1,568 @@
+/**
+ * @file AsyncIO_Bench.c
+ * @author Alex Hoffman
+ * @date 19 October 2020
+ * @brief Throughput and latency benchmark for the AsyncIO library
+ *
+ * @verbatim
+   ----------------------------------------------------------------------
+    Copyright (C) Alexander Hoffman, 2020
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+@endverbatim
+ *
+ * Messages are sent over loopback UDP, TCP or a POSIX message queue from a
+ * plain pthread at a fixed rate. Each message carries its sequence number and
+ * send time. The AsyncIO callback timestamps each arrival and hands it to a
+ * FreeRTOS task through a lock-free queue, the task then timestamps it again.
+ * The two latencies reported are send to callback and send to FreeRTOS task.
+ *
+ * Usage:
+ *   AsyncIO_Bench [-p udp|tcp|mq] [-r rate,...] [-s size,...] [-d seconds]
+ *
+ * Rates are in messages per second, 0 meaning as fast as possible. Every
+ * combination of the given rates and payload sizes is run in turn. Results
+ * are printed to stderr, AsyncIO's own logging goes to stdout and can be
+ * discarded with >/dev/null.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "AsyncIO.h"
+
+#define mainGENERIC_STACK_SIZE ((unsigned short)2560)
+
+#define BENCH_UDP_PORT 5555
+#define BENCH_TCP_PORT 5655
+#define BENCH_MQ_NAME "FreeRTOS_Bench_MQ"
+#define BENCH_MQ_MAX_MSG 10
+
+#define BENCH_MAX_RUNS 16
+#define BENCH_QUEUE_SIZE 4096 // Must be a power of two
+#define BENCH_MAX_SAMPLES (1 << 20)
+#define BENCH_DRAIN_MS 500
+#define BENCH_MIN_PAYLOAD 48
+#define BENCH_MAX_PAYLOAD 8000
+
+#define NS_IN_SECOND 1000000000ULL
+
+typedef enum { BENCH_UDP, BENCH_TCP, BENCH_MQ } bench_proto_e;
+
+static const char *bench_proto_names[] = { "udp", "tcp", "mq" };
+
+typedef struct {
+    uint64_t seq;
+    uint64_t t_send;
+    uint64_t t_cb;
+} bench_sample_t;
+
+/** Bounded multi-producer single-consumer queue, see D. Vyukov's MPMC queue */
+typedef struct {
+    atomic_size_t seq;
+    bench_sample_t sample;
+} bench_cell_t;
+
+static bench_cell_t bench_queue[BENCH_QUEUE_SIZE];
+static atomic_size_t bench_enqueue_pos;
+static size_t bench_dequeue_pos;
+
+static atomic_ullong bench_queue_overruns;
+static atomic_ullong bench_bad_msgs;
+
+static struct {
+    bench_proto_e proto;
+    unsigned int rates[BENCH_MAX_RUNS];
+    unsigned int rate_count;
+    size_t sizes[BENCH_MAX_RUNS];
+    unsigned int size_count;
+    unsigned int duration;
+} bench_config = { .proto = BENCH_UDP,
+                   .rates = { 1000 },
+                   .rate_count = 1,
+                   .sizes = { 64 },
+                   .size_count = 1,
+                   .duration = 5
+                 };
+
+typedef struct {
+    bench_proto_e proto;
+    unsigned int rate;
+    size_t size;
+    unsigned int port;
+
+    atomic_int done;
+    uint64_t sent;
+    uint64_t send_errors;
+    uint64_t t_start;
+    uint64_t t_end;
+} bench_run_t;
+
+static uint64_t *cb_latencies;
+static uint64_t *task_latencies;
+
+static uint64_t benchNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * NS_IN_SECOND + ts.tv_nsec;
+}
+
+static void benchQueueInit(void)
+{
+    for (size_t i = 0; i < BENCH_QUEUE_SIZE; i++) {
+        atomic_store(&bench_queue[i].seq, i);
+    }
+    atomic_store(&bench_enqueue_pos, 0);
+    bench_dequeue_pos = 0;
+}
+
+static int benchQueuePush(bench_sample_t *sample)
+{
+    size_t pos = atomic_load_explicit(&bench_enqueue_pos,
+                                      memory_order_relaxed);
+    bench_cell_t *cell;
+    intptr_t diff;
+
+    for (;;) {
+        cell = &bench_queue[pos & (BENCH_QUEUE_SIZE - 1)];
+        diff = (intptr_t)atomic_load_explicit(&cell->seq,
+                                              memory_order_acquire) -
+               (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &bench_enqueue_pos, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return -1;
+        }
+        else {
+            pos = atomic_load_explicit(&bench_enqueue_pos,
+                                       memory_order_relaxed);
+        }
+    }
+
+    cell->sample = *sample;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    return 0;
+}
+
+static int benchQueuePop(bench_sample_t *sample)
+{
+    bench_cell_t *cell =
+        &bench_queue[bench_dequeue_pos & (BENCH_QUEUE_SIZE - 1)];
+
+    if (atomic_load_explicit(&cell->seq, memory_order_acquire) !=
+        bench_dequeue_pos + 1) {
+        return -1;
+    }
+
+    *sample = cell->sample;
+    atomic_store_explicit(&cell->seq, bench_dequeue_pos + BENCH_QUEUE_SIZE,
+                          memory_order_release);
+    bench_dequeue_pos++;
+
+    return 0;
+}
+
+static void benchCallback(size_t recv_size, char *buffer, void *args)
+{
+    bench_sample_t sample = { 0 };
+    char *end;
+
+    sample.t_cb = benchNow();
+
+    sample.seq = strtoull(buffer, &end, 10);
+    if (*end != ':') {
+        atomic_fetch_add(&bench_bad_msgs, 1);
+        return;
+    }
+    sample.t_send = strtoull(end + 1, &end, 10);
+    if (*end != ':') {
+        atomic_fetch_add(&bench_bad_msgs, 1);
+        return;
+    }
+
+    if (benchQueuePush(&sample)) {
+        atomic_fetch_add(&bench_queue_overruns, 1);
+    }
+}
+
+/** Messages are text such that the MQ's strlen based put can carry them */
+static void benchFillMessage(char *msg, size_t size, uint64_t seq)
+{
+    int len = snprintf(msg, size + 1, "%" PRIu64 ":%" PRIu64 ":", seq,
+                       benchNow());
+
+    memset(msg + len, 'x', size - len);
+    msg[size] = '\0';
+}
+
+static void *benchSender(void *arg)
+{
+    bench_run_t *run = (bench_run_t *)arg;
+    char *msg = calloc(run->size + 1, sizeof(char));
+    uint64_t period = run->rate ? NS_IN_SECOND / run->rate : 0;
+    uint64_t next, end;
+    struct timespec ts;
+    sigset_t set;
+    int ret;
+
+    /** Leave the FreeRTOS port and AsyncIO signals to their own threads */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    if (msg == NULL) {
+        goto out;
+    }
+
+    run->t_start = next = benchNow();
+    end = run->t_start + (uint64_t)bench_config.duration * NS_IN_SECOND;
+
+    while (next < end) {
+        benchFillMessage(msg, run->size, run->sent);
+
+        switch (run->proto) {
+            case BENCH_UDP:
+                ret = aIOSocketPut(UDP, NULL, run->port, msg, run->size);
+                break;
+            case BENCH_TCP:
+                ret = aIOSocketPut(TCP, NULL, run->port, msg, run->size);
+                break;
+            case BENCH_MQ:
+                ret = aIOMessageQueuePut(BENCH_MQ_NAME, msg);
+                break;
+            default:
+                ret = -1;
+                break;
+        }
+
+        if (ret) {
+            run->send_errors++;
+        }
+        run->sent++;
+
+        if (period) {
+            next += period;
+            ts.tv_sec = next / NS_IN_SECOND;
+            ts.tv_nsec = next % NS_IN_SECOND;
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+                                   NULL) == EINTR)
+                ;
+        }
+        else {
+            next = benchNow();
+        }
+    }
+
+    free(msg);
+out:
+    run->t_end = benchNow();
+    atomic_store(&run->done, 1);
+
+    return NULL;
+}
+
+static int benchCompare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double benchPercentile(uint64_t *samples, size_t count, double p)
+{
+    if (!count) {
+        return 0;
+    }
+
+    return samples[(size_t)(p * (count - 1))] / 1000.0;
+}
+
+static void benchReport(bench_run_t *run, size_t received,
+                        uint64_t t_last_recv)
+{
+    double elapsed = (t_last_recv > run->t_start ?
+                      t_last_recv - run->t_start :
+                      run->t_end - run->t_start) /
+                     (double)NS_IN_SECOND;
+    size_t samples = received < BENCH_MAX_SAMPLES ? received :
+                     BENCH_MAX_SAMPLES;
+
+    qsort(cb_latencies, samples, sizeof(uint64_t), benchCompare);
+    qsort(task_latencies, samples, sizeof(uint64_t), benchCompare);
+
+    fprintf(stderr,
+            "%-4s %6zu %8u %9" PRIu64 " %9zu %8" PRIu64 " %8" PRIu64
+            " %10.0f %12.0f | %8.1f %8.1f %8.1f | %8.1f %8.1f %8.1f\n",
+            bench_proto_names[run->proto], run->size, run->rate, run->sent,
+            received, run->sent - received, run->send_errors,
+            received / elapsed, received * run->size / elapsed,
+            benchPercentile(cb_latencies, samples, 0.5),
+            benchPercentile(cb_latencies, samples, 0.99),
+            benchPercentile(cb_latencies, samples, 0.999),
+            benchPercentile(task_latencies, samples, 0.5),
+            benchPercentile(task_latencies, samples, 0.99),
+            benchPercentile(task_latencies, samples, 0.999));
+
+    if (atomic_load(&bench_queue_overruns) || atomic_load(&bench_bad_msgs))
+        fprintf(stderr,
+                "     %llu samples lost to full queue, %llu malformed\n",
+                atomic_load(&bench_queue_overruns),
+                atomic_load(&bench_bad_msgs));
+}
+
+static aIO_handle_t benchOpen(bench_run_t *run)
+{
+    switch (run->proto) {
+        case BENCH_UDP:
+            return aIOOpenUDPSocket(NULL, run->port, run->size,
+                                    benchCallback, NULL);
+        case BENCH_TCP:
+            return aIOOpenTCPSocket(NULL, run->port, run->size,
+                                    benchCallback, NULL);
+        case BENCH_MQ:
+            return aIOOpenMessageQueue(BENCH_MQ_NAME, BENCH_MQ_MAX_MSG,
+                                       run->size, benchCallback, NULL);
+        default:
+            return NULL;
+    }
+}
+
+static void benchRun(bench_run_t *run)
+{
+    bench_sample_t sample;
+    aIO_handle_t conn;
+    pthread_t sender;
+    size_t received = 0;
+    uint64_t t_last_recv = 0, t_task, t_done = 0;
+
+    if (run->proto == BENCH_MQ && run->size > MQ_MSGSIZE) {
+        fprintf(stderr, "%-4s %6zu %8u skipped, exceeds MQ_MSGSIZE (%d)\n",
+                bench_proto_names[run->proto], run->size, run->rate,
+                MQ_MSGSIZE);
+        return;
+    }
+
+    benchQueueInit();
+    atomic_store(&bench_queue_overruns, 0);
+    atomic_store(&bench_bad_msgs, 0);
+
+    conn = benchOpen(run);
+    if (conn == NULL) {
+        fprintf(stderr, "Failed to open %s connection\n",
+                bench_proto_names[run->proto]);
+        return;
+    }
+
+    if (pthread_create(&sender, NULL, benchSender, run)) {
+        fprintf(stderr, "Failed to create sender thread\n");
+        aIOCloseConn(conn);
+        return;
+    }
+
+    for (;;) {
+        while (!benchQueuePop(&sample)) {
+            t_task = benchNow();
+            if (received < BENCH_MAX_SAMPLES) {
+                cb_latencies[received] = sample.t_cb - sample.t_send;
+                task_latencies[received] = t_task - sample.t_send;
+            }
+            t_last_recv = sample.t_cb;
+            received++;
+        }
+
+        if (atomic_load(&run->done)) {
+            if (!t_done) {
+                t_done = benchNow();
+            }
+            if (received >= run->sent ||
+                benchNow() - t_done > BENCH_DRAIN_MS * 1000000ULL) {
+                break;
+            }
+        }
+
+        vTaskDelay(1);
+    }
+
+    pthread_join(sender, NULL);
+    aIOCloseConn(conn);
+
+    benchReport(run, received, t_last_recv);
+}
+
+void vBenchTask(void *pvParameters)
+{
+    bench_run_t run;
+    unsigned int port_offset = 0;
+
+    fprintf(stderr,
+            "%-4s %6s %8s %9s %9s %8s %8s %10s %12s | %26s | %26s\n",
+            "", "size", "rate", "sent", "recv", "drops", "errors",
+            "msgs/s", "bytes/s", "callback p50/p99/p999 us",
+            "task p50/p99/p999 us");
+
+    for (unsigned int s = 0; s < bench_config.size_count; s++)
+        for (unsigned int r = 0; r < bench_config.rate_count; r++) {
+            memset(&run, 0, sizeof(run));
+            run.proto = bench_config.proto;
+            run.size = bench_config.sizes[s];
+            run.rate = bench_config.rates[r];
+            /** Fresh port per run, avoids lingering sockets of the last */
+            run.port = (run.proto == BENCH_TCP ? BENCH_TCP_PORT :
+                        BENCH_UDP_PORT) + port_offset++;
+
+            benchRun(&run);
+        }
+
+    free(cb_latencies);
+    free(task_latencies);
+
+    aIODeinit();
+
+    exit(EXIT_SUCCESS);
+}
+
+static unsigned int benchParseList(char *list, unsigned long *out)
+{
+    unsigned int count = 0;
+    char *tok, *save = NULL;
+
+    for (tok = strtok_r(list, ",", &save); tok && count < BENCH_MAX_RUNS;
+         tok = strtok_r(NULL, ",", &save)) {
+        out[count++] = strtoul(tok, NULL, 10);
+    }
+
+    return count;
+}
+
+static void benchUsage(char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-p udp|tcp|mq] [-r rate,...] [-s size,...] "
+            "[-d seconds]\n",
+            name);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long list[BENCH_MAX_RUNS];
+    unsigned int count;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:r:s:d:h")) != -1) {
+        switch (opt) {
+            case 'p':
+                if (!strcmp(optarg, "udp")) {
+                    bench_config.proto = BENCH_UDP;
+                }
+                else if (!strcmp(optarg, "tcp")) {
+                    bench_config.proto = BENCH_TCP;
+                }
+                else if (!strcmp(optarg, "mq")) {
+                    bench_config.proto = BENCH_MQ;
+                }
+                else {
+                    goto err_usage;
+                }
+                break;
+            case 'r':
+                count = benchParseList(optarg, list);
+                for (unsigned int i = 0; i < count; i++) {
+                    bench_config.rates[i] = list[i];
+                }
+                bench_config.rate_count = count;
+                break;
+            case 's':
+                count = benchParseList(optarg, list);
+                for (unsigned int i = 0; i < count; i++) {
+                    if (list[i] < BENCH_MIN_PAYLOAD ||
+                        list[i] > BENCH_MAX_PAYLOAD) {
+                        fprintf(stderr,
+                                "Payload sizes must be %d-%d bytes\n",
+                                BENCH_MIN_PAYLOAD, BENCH_MAX_PAYLOAD);
+                        goto err_usage;
+                    }
+                    bench_config.sizes[i] = list[i];
+                }
+                bench_config.size_count = count;
+                break;
+            case 'd':
+                bench_config.duration = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                goto err_usage;
+        }
+    }
+
+    if (!bench_config.rate_count || !bench_config.size_count ||
+        !bench_config.duration) {
+        goto err_usage;
+    }
+
+    cb_latencies = calloc(BENCH_MAX_SAMPLES, sizeof(uint64_t));
+    task_latencies = calloc(BENCH_MAX_SAMPLES, sizeof(uint64_t));
+    if (cb_latencies == NULL || task_latencies == NULL) {
+        fprintf(stderr, "Failed to allocate latency samples\n");
+        goto err_alloc;
+    }
+
+    if (xTaskCreate(vBenchTask, "BenchTask", mainGENERIC_STACK_SIZE * 2,
+                    NULL, configMAX_PRIORITIES - 1, NULL) != pdPASS) {
+        fprintf(stderr, "Failed to create benchmark task\n");
+        goto err_alloc;
+    }
+
+    vTaskStartScheduler();
+
+    return EXIT_SUCCESS;
+
+err_alloc:
+    free(cb_latencies);
+    free(task_latencies);
+    return EXIT_FAILURE;
+err_usage:
+    benchUsage(argv[0]);
+    return EXIT_FAILURE;
+}
+
+// cppcheck-suppress unusedFunction
+__attribute__((unused)) void vMainQueueSendPassed(void)
+{
+}
+
+// cppcheck-suppress unusedFunction
+__attribute__((unused)) void vApplicationIdleHook(void)
+{
+    struct timespec xTimeToSleep = { .tv_sec = 0, .tv_nsec = 1000000 };
+
+    nanosleep(&xTimeToSleep, NULL);
+}
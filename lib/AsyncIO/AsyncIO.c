@@ -3,7 +3,7 @@
  * @author Alex Hoffman
  * @date 20 January 2020
  * @brief A single file asyncronous UNIX communications library to perform
- * UDP, TCP and POSIX message queue communications.
+ * UDP, TCP, POSIX message queue, shared memory and serial communications.
  *
  * @verbatim
    ----------------------------------------------------------------------
@@ -36,6 +36,19 @@
 #include <stdint.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <limits.h>
+#include <pty.h>
+#include <termios.h>
+#include <time.h>
 
 #include "AsyncIO.h"
 
@@ -44,37 +57,118 @@
             __FILE__, __LINE__, __func__);
 
 void *aIOTCPHandler(void *conn);
+static void aIOSharedMemUnmapPeers(void);
 
 typedef enum {
     NONE = 0,
     SOCKET,
     MSG_QUEUE,
+    SHARED_MEM,
     SERIAL,
     NO_OF_CONN_TYPES
 } aIO_conn_e;
 
 typedef struct {
-    int fd;
+    int fd; // -1 once a TCP listener is closed
     aIO_socket_e type;
     struct sockaddr_in addr;
+    atomic_uint closed;
+    struct aIO_tcp_client *clients; // Accepted TCP clients, under the lock
 } aIO_socket_t;
 
 typedef struct {
     mqd_t fd;
+    mqd_t tx_fd; // Blocking descriptor aIOMessageQueuePut() writes through
     char *name;
     struct sigevent ev;
+    struct aIO *next; // Next MQ opened by this process
 } aIO_mq_t;
 
+#define SHM_MAGIC 0x61494f53 // "aIOS"
+
+/**
+ * Layout of a shared memory segment, the header is followed by slot_count
+ * slots of slot_stride bytes, each holding a uint32_t frame length followed by
+ * up to slot_size bytes of frame data and a terminating null byte.
+ *
+ * Producers serialise on the process shared lock, the single consumer only
+ * ever advances tail. seq is bumped for every frame and is the futex word the
+ * consumer sleeps on.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t slot_size;
+    uint32_t slot_count;
+    uint32_t slot_stride;
+    pthread_mutex_t lock;
+    pid_t owner; // Receiving process
+    atomic_uint closed;
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint seq;
+    atomic_uint waiting;
+    atomic_uint dropped; // Frames refused as the ring was full
+    atomic_uint oversized; // Frames refused as they exceeded slot_size
+} aIO_shm_header_t;
+
 typedef struct {
-    //TODO
+    int fd;
+    char *name;
+    aIO_shm_header_t *hdr;
+    size_t map_size;
+    /** Geometry as set up, the header's copy can be written by any peer */
+    uint32_t slot_size;
+    uint32_t slot_count;
+    size_t slot_stride;
+    atomic_uint running;
+} aIO_shm_t;
+
+/** Segments mapped by aIOSharedMemPut(), kept mapped between calls */
+typedef struct aIO_shm_peer {
+    char *name;
+    aIO_shm_header_t *hdr;
+    size_t map_size;
+    struct aIO_shm_peer *next;
+} aIO_shm_peer_t;
+
+/** Start bit, 8 data bits and a stop bit */
+#define SERIAL_BITS_PER_BYTE 10
+#define NS_IN_SECOND 1000000000ULL
+
+typedef struct {
+    int fd;
+    int peer_fd; // Held open for PTYs so the master never sees a hang up
+    int wake_fd;
+    char *peer_name;
+    unsigned int baud; // 0 disables baud rate emulation
+    atomic_uint running;
+
+    pthread_mutex_t tx_lock;
+    struct timespec rx_next;
+    struct timespec tx_next;
+
+    atomic_ullong tx_bytes;
 } aIO_serial_t;
 
 typedef union {
     aIO_socket_t socket;
     aIO_mq_t mq;
+    aIO_shm_t shm;
     aIO_serial_t tty;
 } aIO_attr;
 
+/** Counterparts of aIO_stats_t, only ever touched with relaxed atomics */
+typedef struct {
+    atomic_ullong rx_msgs;
+    atomic_ullong rx_bytes;
+    atomic_ullong truncations;
+    atomic_ullong recv_errors;
+    atomic_ullong overruns;
+    atomic_ullong callbacks;
+    atomic_ullong callback_ns;
+    atomic_ullong callback_max_ns;
+} aIO_counters_t;
+
 typedef struct aIO {
     aIO_conn_e type;
 
@@ -86,73 +180,282 @@ typedef struct aIO {
 
     void (*callback)(size_t, char *, void *);
     void *args;
-    struct aIO *next;
+
+    int fd; // Registry key
+    atomic_uint ref_count; // Registry holds one reference until closed
+    atomic_uint handler_frees; // Freed by its handler thread once it is done
+
+    aIO_counters_t stats;
 
     pthread_mutex_t lock;
 } aIO_t;
 
-typedef struct {
+typedef struct aIO_tcp_client {
     int client_fd;
-    size_t buffer_size;
-
-    void (*callback)(size_t, char *, void *);
-    void *args;
+    aIO_t *conn; // Referenced until the client thread exits
+    struct aIO_tcp_client *next;
 } aIO_tcp_client;
 
-aIO_t head = { .type = NONE, .lock = PTHREAD_MUTEX_INITIALIZER };
+/**
+ * Connections are indexed by their file descriptor, as the kernel hands out
+ * the lowest free descriptor the table stays dense. Lookups are lock free:
+ * readers announce themselves in the slot's reader count of the slot's current
+ * generation while they take a reference. Closers unpublish the slot, start a
+ * new generation and wait for the readers of the previous one to leave before
+ * dropping the registry's reference. Readers arriving meanwhile count against
+ * the new generation, such that constant traffic cannot starve a closer.
+ */
+typedef struct {
+    _Atomic(aIO_t *) conn;
+    atomic_uint generation;
+    atomic_uint readers[2];
+} aIO_slot_t;
+
+static aIO_slot_t aIO_registry[AIO_MAX_FDS];
+
+/** MQs opened by this process, each holds a reference while listed */
+static aIO_t *aIO_mq_list = NULL;
+static pthread_mutex_t aIO_mq_lock = PTHREAD_MUTEX_INITIALIZER;
+
 pthread_cond_t aIO_quit_conn = PTHREAD_COND_INITIALIZER;
 pthread_mutex_t aIO_quit_lock = PTHREAD_MUTEX_INITIALIZER;
 
-aIO_t *getLastConnection(void)
+static void aIOFutexWake(atomic_uint *word)
 {
-    aIO_t *iterator;
+    syscall(SYS_futex, word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
 
-    for (iterator = &head; iterator->next; iterator = iterator->next) {
-        ;
+static void aIODestroyConn(aIO_t *conn)
+{
+    switch (conn->type) {
+        case SOCKET:
+            printf("Deinit socket %d\n",
+                   ntohs(conn->attr.socket.addr.sin_port));
+            if (conn->attr.socket.fd != -1 && close(conn->attr.socket.fd)) {
+                fprintf(stderr, "Failed to close socket\n");
+                PRINT_CHECK;
+            }
+            break;
+        case MSG_QUEUE:
+            printf("Deinit MQ %s\n", conn->attr.mq.name);
+            mq_close(conn->attr.mq.tx_fd);
+            mq_close(conn->attr.mq.fd);
+            mq_unlink(conn->attr.mq.name);
+            free(conn->attr.mq.name);
+            break;
+        case SHARED_MEM:
+            printf("Deinit SHM %s\n", conn->attr.shm.name);
+            atomic_store(&conn->attr.shm.hdr->closed, 1);
+            munmap(conn->attr.shm.hdr, conn->attr.shm.map_size);
+            close(conn->attr.shm.fd);
+            shm_unlink(conn->attr.shm.name);
+            free(conn->attr.shm.name);
+            break;
+        case SERIAL:
+            printf("Deinit serial %s\n", conn->attr.tty.peer_name ?
+                   conn->attr.tty.peer_name : "");
+            close(conn->attr.tty.fd);
+            if (conn->attr.tty.peer_fd != -1) {
+                close(conn->attr.tty.peer_fd);
+            }
+            close(conn->attr.tty.wake_fd);
+            pthread_mutex_destroy(&conn->attr.tty.tx_lock);
+            free(conn->attr.tty.peer_name);
+            break;
+        default:
+            break;
     }
 
-    return iterator;
+    pthread_mutex_destroy(&conn->lock);
+    free(conn->buffer);
+    free(conn);
 }
 
-static aIO_t *findConnection(aIO_conn_e type, void *arg)
+static void aIOFreeConn(aIO_t *conn)
 {
-    aIO_t *prev = &head;
-    aIO_t *curr;
+    if (conn->type == SHARED_MEM || conn->type == SERIAL) {
+        /** Closed from within the callback, the handler thread still */
+        /**     holds the lock and reads the ring or line, it frees the */
+        /**     connection once it has returned from the callback */
+        if (pthread_equal(conn->thread, pthread_self())) {
+            atomic_store(&conn->handler_frees, 1);
+            return;
+        }
+        pthread_join(conn->thread, NULL);
+    }
 
-    pthread_mutex_lock(&prev->lock);
-    while ((curr = prev->next) != NULL) {
-        pthread_mutex_lock(&curr->lock);
-        switch (type) {
-            case SOCKET:
-                if (curr->type == type) {
-                    if (curr->attr.socket.fd == *(int *)arg) {
-                        pthread_mutex_unlock(&prev->lock);
-                        pthread_mutex_unlock(&curr->lock);
-                        return curr;
-                    }
-                }
+    aIODestroyConn(conn);
+}
+
+static int aIORegisterConn(aIO_t *conn, int fd)
+{
+    aIO_t *expected = NULL;
+
+    if (fd < 0 || fd >= AIO_MAX_FDS) {
+        fprintf(stderr, "FD %d exceeds AIO_MAX_FDS (%d)\n", fd,
+                AIO_MAX_FDS);
+        return -1;
+    }
+
+    conn->fd = fd;
+    atomic_store(&conn->ref_count, 1);
+
+    if (!atomic_compare_exchange_strong(&aIO_registry[fd].conn, &expected,
+                                        conn)) {
+        fprintf(stderr, "FD %d is already registered\n", fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int aIOUnregisterConn(aIO_t *conn)
+{
+    aIO_t *expected = conn;
+    aIO_slot_t *slot;
+    unsigned int generation;
+
+    if (conn->fd < 0 || conn->fd >= AIO_MAX_FDS) {
+        return -1;
+    }
+
+    slot = &aIO_registry[conn->fd];
+
+    if (!atomic_compare_exchange_strong(&slot->conn, &expected, NULL)) {
+        return -1;
+    }
+
+    /** Grace period, readers that saw the old slot value are done after this */
+    generation = atomic_fetch_add(&slot->generation, 1) & 1;
+    while (atomic_load(&slot->readers[generation])) {
+        sched_yield();
+    }
+
+    return 0;
+}
+
+/** Returns a referenced connection, must be released with aIOPutConn() */
+static aIO_t *aIOGetConn(int fd)
+{
+    aIO_t *conn;
+    aIO_slot_t *slot;
+    unsigned int refs, generation;
+
+    if (fd < 0 || fd >= AIO_MAX_FDS) {
+        return NULL;
+    }
+
+    slot = &aIO_registry[fd];
+    generation = atomic_load(&slot->generation) & 1;
+    atomic_fetch_add(&slot->readers[generation], 1);
+
+    conn = atomic_load(&slot->conn);
+    if (conn) {
+        refs = atomic_load(&conn->ref_count);
+        do {
+            if (refs == 0) {
+                conn = NULL;
                 break;
-            //TODO
-            case MSG_QUEUE:
-            case SERIAL:
-            case NONE:
-            default:
-                pthread_mutex_unlock(&prev->lock);
-                pthread_mutex_unlock(&curr->lock);
-                return NULL;
+            }
+        } while (!atomic_compare_exchange_weak(&conn->ref_count, &refs,
+                                               refs + 1));
+    }
+
+    atomic_fetch_sub(&slot->readers[generation], 1);
+
+    return conn;
+}
+
+static void aIOPutConn(aIO_t *conn)
+{
+    if (atomic_fetch_sub(&conn->ref_count, 1) == 1) {
+        aIOFreeConn(conn);
+    }
+}
+
+static void aIOStatAdd(atomic_ullong *counter, unsigned long long val)
+{
+    atomic_fetch_add_explicit(counter, val, memory_order_relaxed);
+}
+
+static void aIOStatRecv(aIO_t *conn, size_t bytes)
+{
+    aIOStatAdd(&conn->stats.rx_msgs, 1);
+    aIOStatAdd(&conn->stats.rx_bytes, bytes);
+}
+
+/** Runs the connection's callback, accounting the time spent in it */
+static void aIORunCallback(aIO_t *conn, size_t recv_size, char *buffer)
+{
+    struct timespec start, end;
+    unsigned long long ns, max;
+
+    if (conn->callback == NULL) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    (conn->callback)(recv_size, buffer, conn->args);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    ns = (end.tv_sec - start.tv_sec) * NS_IN_SECOND + end.tv_nsec -
+         start.tv_nsec;
+
+    aIOStatAdd(&conn->stats.callbacks, 1);
+    aIOStatAdd(&conn->stats.callback_ns, ns);
+
+    max = atomic_load_explicit(&conn->stats.callback_max_ns,
+                               memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(
+               &conn->stats.callback_max_ns, &max, ns,
+               memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+static void aIOMessageQueueUnlist(aIO_t *conn)
+{
+    aIO_t **iterator;
+
+    pthread_mutex_lock(&aIO_mq_lock);
+    for (iterator = &aIO_mq_list; *iterator;
+         iterator = &(*iterator)->attr.mq.next) {
+        if (*iterator == conn) {
+            *iterator = conn->attr.mq.next;
+            break;
         }
-        pthread_mutex_unlock(&prev->lock);
-        prev = curr;
     }
-    pthread_mutex_unlock(&prev->lock);
-    return NULL;
+    pthread_mutex_unlock(&aIO_mq_lock);
 }
 
-//TODO move this into functions that are calable such that connections can be
-//closed during runtime
+/**
+ * Closes a TCP listener right away instead of once its clients disconnected,
+ * such that the port is released. The clients are shut down, their threads
+ * exit and drop their references.
+ */
+static void aIOTCPShutdown(aIO_t *conn)
+{
+    aIO_tcp_client *client;
+
+    /** Waits for an accept loop that is running */
+    pthread_mutex_lock(&conn->lock);
+
+    atomic_store(&conn->attr.socket.closed, 1);
+
+    close(conn->attr.socket.fd);
+    conn->attr.socket.fd = -1;
+
+    /** Client descriptors are only closed once unlisted, under the lock */
+    for (client = conn->attr.socket.clients; client; client = client->next) {
+        shutdown(client->client_fd, SHUT_RDWR);
+    }
+
+    pthread_mutex_unlock(&conn->lock);
+}
 
 void aIOCloseConn(aIO_handle_t conn)
 {
+    int fs;
+
     if (conn == NULL) {
         fprintf(stderr, "Trying to close a NULL connection\n");
         PRINT_CHECK;
@@ -161,41 +464,133 @@ void aIOCloseConn(aIO_handle_t conn)
 
     aIO_t *del = (aIO_t *)conn;
 
+    /** Stop further notifications before unpublishing the connection */
     switch (del->type) {
         case SOCKET:
-            printf("Deinit socket %d\n",
-                   ntohs(del->attr.socket.addr.sin_port));
-            if (close(del->attr.socket.fd)) {
-                fprintf(stderr, "Failed to close socket\n");
-                PRINT_CHECK;
-                return;
+            if ((fs = fcntl(del->attr.socket.fd, F_GETFL)) != -1) {
+                fcntl(del->attr.socket.fd, F_SETFL, fs & ~O_ASYNC);
             }
-            free(del->buffer);
-            free(del);
             break;
         case MSG_QUEUE:
-            printf("Deinit MQ %s\n", del->attr.mq.name);
-            mq_close(del->attr.mq.fd);
-            mq_unlink(del->attr.mq.name);
-            free(del->attr.mq.name);
-            free(del->buffer);
-            free(del);
+            mq_notify(del->attr.mq.fd, NULL);
+            aIOMessageQueueUnlist(del);
+            break;
+        case SHARED_MEM:
+            atomic_store(&del->attr.shm.running, 0);
+            atomic_fetch_add(&del->attr.shm.hdr->seq, 1);
+            aIOFutexWake(&del->attr.shm.hdr->seq);
+            break;
+        case SERIAL:
+            atomic_store(&del->attr.tty.running, 0);
+            eventfd_write(del->attr.tty.wake_fd, 1);
             break;
         default:
             break;
     }
+
+    if (aIOUnregisterConn(del)) {
+        fprintf(stderr, "Connection on FD %d is not open\n", del->fd);
+        return;
+    }
+
+    if (del->type == SOCKET && del->attr.socket.type == TCP) {
+        aIOTCPShutdown(del);
+    }
+
+    /** Freed once the last in-flight callback has returned */
+    aIOPutConn(del);
 }
 
 void aIODeinit(void)
 {
-    aIO_t *iterator;
+    aIO_t *conn;
+    int fd;
+
+    for (fd = 0; fd < AIO_MAX_FDS; fd++) {
+        if ((conn = atomic_load(&aIO_registry[fd].conn))) {
+            aIOCloseConn((aIO_handle_t)conn);
+        }
+    }
+
+    aIOSharedMemUnmapPeers();
+}
+
+int aIOGetStats(aIO_handle_t conn, aIO_stats_t *stats)
+{
+    aIO_t *c = (aIO_t *)conn;
+
+    if (c == NULL || stats == NULL) {
+        return -1;
+    }
+
+#define AIO_STAT(NAME)                                                        \
+    stats->NAME = atomic_load_explicit(&c->stats.NAME, memory_order_relaxed)
+    AIO_STAT(rx_msgs);
+    AIO_STAT(rx_bytes);
+    AIO_STAT(truncations);
+    AIO_STAT(recv_errors);
+    AIO_STAT(overruns);
+    AIO_STAT(callbacks);
+    AIO_STAT(callback_ns);
+    AIO_STAT(callback_max_ns);
+#undef AIO_STAT
+
+    return 0;
+}
+
+static void aIOConnName(aIO_t *conn, char *name, size_t size)
+{
+    switch (conn->type) {
+        case SOCKET:
+            snprintf(name, size, "%s:%d",
+                     conn->attr.socket.type == UDP ? "udp" : "tcp",
+                     ntohs(conn->attr.socket.addr.sin_port));
+            break;
+        case MSG_QUEUE:
+            snprintf(name, size, "mq:%s", conn->attr.mq.name);
+            break;
+        case SHARED_MEM:
+            snprintf(name, size, "shm:%s", conn->attr.shm.name);
+            break;
+        case SERIAL:
+            snprintf(name, size, "tty:%s", conn->attr.tty.peer_name);
+            break;
+        default:
+            snprintf(name, size, "?");
+            break;
+    }
+}
+
+void aIODumpStats(void)
+{
+    aIO_stats_t stats;
+    char name[64];
+    aIO_t *conn;
+    int fd;
 
-    if (head.next) {
-        for (iterator = head.next; iterator;) {
-            aIO_t *del = iterator;
-            iterator = iterator->next;
-            aIOCloseConn((aIO_handle_t)del);
+    printf("%-4s %-24s %10s %12s %8s %8s %8s %10s %10s\n", "FD", "Conn",
+           "Msgs", "Bytes", "Trunc", "Errors", "Overrun", "CB avg us",
+           "CB max us");
+
+    for (fd = 0; fd < AIO_MAX_FDS; fd++) {
+        if (atomic_load(&aIO_registry[fd].conn) == NULL) {
+            continue;
+        }
+        if ((conn = aIOGetConn(fd)) == NULL) {
+            continue;
         }
+
+        aIOGetStats((aIO_handle_t)conn, &stats);
+        aIOConnName(conn, name, sizeof(name));
+
+        printf("%-4d %-24s %10llu %12llu %8llu %8llu %8llu %10.1f %10.1f\n",
+               fd, name, stats.rx_msgs, stats.rx_bytes, stats.truncations,
+               stats.recv_errors, stats.overruns,
+               stats.callbacks ?
+               stats.callback_ns / (double)stats.callbacks / 1000 : 0,
+               stats.callback_max_ns / 1000.0);
+
+        aIOPutConn(conn);
     }
 }
 
@@ -211,7 +606,8 @@ aIO_t *createAsyncIO(aIO_conn_e type, size_t buffer_size,
     }
 
     ret->buffer_size = buffer_size;
-    ret->buffer = (char *)calloc(ret->buffer_size, sizeof(char));
+    /** One extra byte such that received data can always be null terminated */
+    ret->buffer = (char *)calloc(ret->buffer_size + 1, sizeof(char));
     if (ret->buffer == NULL) {
         fprintf(stderr, "Failed to allocate AIO buffer");
         PRINT_CHECK;
@@ -221,6 +617,7 @@ aIO_t *createAsyncIO(aIO_conn_e type, size_t buffer_size,
     ret->type = type;
     ret->callback = callback;
     ret->args = args;
+    ret->fd = -1;
 
     if (pthread_mutex_init(&ret->lock, NULL)) {
         fprintf(stderr, "Failed to init AIO mutex");
@@ -240,13 +637,22 @@ err_aio:
 
 static void aIOMQSigHandler(union sigval sv)
 {
-    aIO_t *conn = (aIO_t *)sv.sival_ptr;
+    aIO_t *conn = aIOGetConn(sv.sival_int);
+
+    if (conn == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&conn->lock);
 
-    ssize_t bytes_read = mq_receive(conn->attr.mq.fd, conn->buffer,
-                                    conn->buffer_size, NULL);
+    ssize_t bytes_read;
+    struct mq_attr attr;
 
-    if (bytes_read > 0) {
-        (conn->callback)(bytes_read, conn->buffer, conn->args);
+    /** A full MQ means senders have been refused or blocked, no message */
+    /**     was lost, this counts how often the queue was found full */
+    if (!mq_getattr(conn->attr.mq.fd, &attr) &&
+        attr.mq_curmsgs >= attr.mq_maxmsg) {
+        aIOStatAdd(&conn->stats.overruns, 1);
     }
 
     /** reprime MQ notifications */
@@ -254,15 +660,66 @@ static void aIOMQSigHandler(union sigval sv)
         fprintf(stderr, "Failed to notify MQ '%s'", conn->attr.mq.name);
         PRINT_CHECK;
     }
+
+    /** Notifications only fire on an empty queue becoming non-empty, so */
+    /**     drain it, having reprimed first such that no message is missed */
+    while ((bytes_read = mq_receive(conn->attr.mq.fd, conn->buffer,
+                                    conn->buffer_size, NULL)) > 0) {
+        aIOStatRecv(conn, bytes_read);
+        conn->buffer[bytes_read] = '\0';
+        aIORunCallback(conn, bytes_read, conn->buffer);
+    }
+    if (bytes_read < 0 && errno != EAGAIN) {
+        aIOStatAdd(&conn->stats.recv_errors, 1);
+    }
+
+    pthread_mutex_unlock(&conn->lock);
+
+    aIOPutConn(conn);
+}
+
+/** Returns a referenced connection of a MQ opened by this process, or NULL */
+static aIO_t *aIOFindMessageQueue(char *full_name)
+{
+    aIO_t *conn;
+
+    pthread_mutex_lock(&aIO_mq_lock);
+    for (conn = aIO_mq_list; conn; conn = conn->attr.mq.next) {
+        if (!strcmp(conn->attr.mq.name, full_name)) {
+            /** Listed connections still hold the registry's reference */
+            atomic_fetch_add(&conn->ref_count, 1);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&aIO_mq_lock);
+
+    return conn;
 }
 
 int aIOMessageQueuePut(char *mq_name, char *buffer)
 {
     mqd_t mq;
+    aIO_t *local;
     char *full_name = calloc(strlen(mq_name) + 2, sizeof(char));
     strcpy(full_name + 1, mq_name);
     full_name[0] = '/';
 
+    /** Closing any descriptor of a MQ drops this process's mq_notify */
+    /**     registration on it, local MQs are written through a descriptor */
+    /**     kept open alongside the connection's */
+    local = aIOFindMessageQueue(full_name);
+    if (local) {
+        free(full_name);
+        if (-1 == mq_send(local->attr.mq.tx_fd, buffer, strlen(buffer), 0)) {
+            printf("Unable to send to MQ: %s, errno: %d\n", mq_name, errno);
+            aIOPutConn(local);
+            return -1;
+        }
+        aIOPutConn(local);
+        printf("Sent to MQ: %s\n", mq_name);
+        return 0;
+    }
+
     mq = mq_open(full_name, O_WRONLY);
 
     free(full_name);
@@ -353,17 +810,15 @@ aIO_handle_t aIOOpenMessageQueue(char *name, long max_msg_num,
                                  void (*callback)(size_t, char *, void *),
                                  void *args)
 {
-    aIO_t *conn = getLastConnection();
-
-    conn->next = createAsyncIO(MSG_QUEUE, max_msg_size, callback, args);
-    if (conn->next == NULL) {
+    aIO_t *conn = createAsyncIO(MSG_QUEUE, max_msg_size, callback, args);
+    if (conn == NULL) {
         fprintf(stderr, "Failed to allocate MQ IO for MQ '%s'\n", name);
         goto error_IO;
     }
 
-    pthread_mutex_lock(&conn->next->lock);
+    pthread_mutex_lock(&conn->lock);
 
-    aIO_mq_t *mq = &conn->next->attr.mq;
+    aIO_mq_t *mq = &conn->attr.mq;
 
     size_t str_len = strlen(name);
 
@@ -383,10 +838,6 @@ aIO_handle_t aIOOpenMessageQueue(char *name, long max_msg_num,
     attr.mq_msgsize = max_msg_size < MQ_MSGSIZE ? max_msg_size : MQ_MSGSIZE;
     attr.mq_curmsgs = 0;
 
-    /** sigval struct that is passed to handler. sival_ptr is used to pass pointer  */
-    /**     to structure containing MQ information */
-    sv.sival_ptr = conn->next;
-
     /** Create MQ */
     if (-1 == (mq->fd = mq_open(mq->name, O_CREAT | O_RDONLY | O_NONBLOCK,
                                 0644, &attr))) {
@@ -394,8 +845,22 @@ aIO_handle_t aIOOpenMessageQueue(char *name, long max_msg_num,
         goto error_open;
     }
 
+    /** Puts block on a full MQ, as they do for MQs of other processes */
+    if (-1 == (mq->tx_fd = mq_open(mq->name, O_WRONLY))) {
+        fprintf(stderr, "Couldn't open MQ '%s' for writing\n", mq->name);
+        goto error_tx_open;
+    }
+
+    if (aIORegisterConn(conn, mq->fd)) {
+        goto error_register;
+    }
+
+    /** sigval struct that is passed to handler. sival_int is used to pass the */
+    /**     MQ's descriptor which is looked up in the connection registry */
+    sv.sival_int = mq->fd;
+
     /** sigevent needed to enable to passing of si_value to the handler */
-    conn->next->attr.mq.ev.sigev_notify = SIGEV_THREAD;
+    mq->ev.sigev_notify = SIGEV_THREAD;
     mq->ev.sigev_signo = SIGIO;
     mq->ev.sigev_value = sv;
     /** used by SIGEV_THREAD */
@@ -407,19 +872,30 @@ aIO_handle_t aIOOpenMessageQueue(char *name, long max_msg_num,
         goto error_notify;
     }
 
-    pthread_mutex_unlock(&conn->next->lock);
+    pthread_mutex_lock(&aIO_mq_lock);
+    mq->next = aIO_mq_list;
+    aIO_mq_list = conn;
+    pthread_mutex_unlock(&aIO_mq_lock);
+
+    pthread_mutex_unlock(&conn->lock);
 
     printf("MQ '%s' opened and notified\n", name);
 
-    return (aIO_handle_t)conn->next;
+    return (aIO_handle_t)conn;
 
 error_notify:
+    aIOUnregisterConn(conn);
+error_register:
+    mq_close(mq->tx_fd);
+error_tx_open:
+    mq_close(mq->fd);
 error_open:
     free(mq->name);
 error_name:
-    free(conn->next);
-    conn->next = NULL;
-    pthread_mutex_unlock(&conn->next->lock);
+    pthread_mutex_unlock(&conn->lock);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn->buffer);
+    free(conn);
 error_IO:
     return NULL;
 }
@@ -428,7 +904,7 @@ static void aIOSocketSigHandler(int signal, siginfo_t *info, void *context)
 {
     ssize_t read_size;
     int server_fd = info->si_fd;
-    aIO_t *conn = findConnection(SOCKET, &server_fd);
+    aIO_t *conn = aIOGetConn(server_fd);
 
     if (conn == NULL) {
         fprintf(stderr, "Failed to find connection");
@@ -438,69 +914,122 @@ static void aIOSocketSigHandler(int signal, siginfo_t *info, void *context)
 
     pthread_mutex_lock(&conn->lock);
 
+    /** Closed while waiting for the lock */
+    if (atomic_load(&conn->attr.socket.closed)) {
+        goto out;
+    }
+
     switch (conn->attr.socket.type) {
-        case UDP:
-            while ((read_size = recv(server_fd, conn->buffer,
-                                     conn->buffer_size, 0)) > 0) {
-                conn->buffer[read_size <= conn->buffer_size ?
-                                       read_size :
-                                       conn->buffer_size] = '\0';
-                if (conn->callback)
-                    (conn->callback)(read_size, conn->buffer,
-                                     conn->args);
+        case UDP: {
+            char cbuf[CMSG_SPACE(sizeof(uint32_t))];
+            struct iovec iov = { .iov_base = conn->buffer,
+                       .iov_len = conn->buffer_size
+            };
+            struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+            struct cmsghdr *cmsg;
+
+            for (;;) {
+                msg.msg_control = cbuf;
+                msg.msg_controllen = sizeof(cbuf);
+
+                /** MSG_TRUNC returns the datagram's full length */
+                read_size = recvmsg(server_fd, &msg, MSG_TRUNC);
+                if (read_size <= 0) {
+                    if (read_size < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (read_size < 0 && errno != EAGAIN &&
+                        errno != EWOULDBLOCK) {
+                        aIOStatAdd(&conn->stats.recv_errors, 1);
+                    }
+                    break;
+                }
+
+                /** Kernel's count of datagrams dropped on a full socket */
+                for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+                     cmsg = CMSG_NXTHDR(&msg, cmsg))
+                    if (cmsg->cmsg_level == SOL_SOCKET &&
+                        cmsg->cmsg_type == SO_RXQ_OVFL) {
+                        uint32_t dropped;
+                        memcpy(&dropped, CMSG_DATA(cmsg),
+                               sizeof(dropped));
+                        atomic_store_explicit(&conn->stats.overruns,
+                                              dropped,
+                                              memory_order_relaxed);
+                    }
+
+                aIOStatRecv(conn, read_size);
+                if ((size_t)read_size > conn->buffer_size) {
+                    aIOStatAdd(&conn->stats.truncations, 1);
+                    read_size = conn->buffer_size;
+                }
+
+                conn->buffer[read_size] = '\0';
+                aIORunCallback(conn, read_size, conn->buffer);
             }
-            break;
+        } break;
         case TCP: {
             int client_fd;
             struct sockaddr_in client;
             socklen_t client_size = sizeof(struct sockaddr_in);
             while ((client_fd =
                         accept(server_fd, (struct sockaddr *)&client,
-                               &client_size)) > 0) {
+                               &client_size)) >= 0 ||
+                   errno == EINTR) {
+                /** Leaving early would strand the rest of the backlog */
+                if (client_fd < 0) {
+                    continue;
+                }
                 pthread_t handler_thread;
                 aIO_tcp_client *new_client = (aIO_tcp_client *)calloc(1,
                                              sizeof(aIO_tcp_client));
                 new_client->client_fd = client_fd;
-                new_client->buffer_size = conn->buffer_size;
-                new_client->callback = conn->callback;
-                new_client->args = conn->args;
+                new_client->conn = conn;
+                /** Already holding a reference, so the count is non-zero */
+                atomic_fetch_add(&conn->ref_count, 1);
 
                 if (pthread_create(&handler_thread, NULL, aIOTCPHandler,
                                    (void *)new_client)) {
                     fprintf(stderr,
                             "Failed to create TCP handler thread");
                     PRINT_CHECK;
+                    close(client_fd);
                     free(new_client);
-                    return;
+                    aIOPutConn(conn);
+                    break;
                 }
+
+                new_client->next = conn->attr.socket.clients;
+                conn->attr.socket.clients = new_client;
             }
         } break;
         default:
             break;
     }
 
+out:
     pthread_mutex_unlock(&conn->lock);
+
+    aIOPutConn(conn);
 }
 
 aIO_handle_t aIOOpenUDPSocket(char *s_addr, in_port_t port, size_t buffer_size,
                               void (*callback)(size_t, char *, void *),
                               void *args)
 {
-    aIO_t *conn = getLastConnection();
-
-    conn->next = createAsyncIO(SOCKET, buffer_size, callback, args);
-    if (conn->next == NULL) {
+    aIO_t *conn = createAsyncIO(SOCKET, buffer_size, callback, args);
+    if (conn == NULL) {
         fprintf(stderr,
                 "Failed to allocate UDP IO on port %" PRIu16 "\n",
                 (uint16_t)port);
         goto error_IO;
     }
 
-    conn->next->attr.socket.type = UDP;
+    conn->attr.socket.type = UDP;
 
-    pthread_mutex_lock(&conn->next->lock);
+    pthread_mutex_lock(&conn->lock);
 
-    aIO_socket_t *s_udp = &conn->next->attr.socket;
+    aIO_socket_t *s_udp = &conn->attr.socket;
 
     s_udp->addr.sin_family = AF_INET;
     s_udp->addr.sin_addr.s_addr =
@@ -518,8 +1047,19 @@ aIO_handle_t aIOOpenUDPSocket(char *s_addr, in_port_t port, size_t buffer_size,
     printf("Opened socket on port %" PRIu16 " with FD: %d\n", port,
            s_udp->fd);
 
+    if (aIORegisterConn(conn, s_udp->fd)) {
+        goto error_register;
+    }
+
     struct sigaction act = { 0 };
     int fs;
+    int on = 1;
+
+    /** Not fatal, only the kernel drop count in the stats is lost */
+    if (setsockopt(s_udp->fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on))) {
+        fprintf(stderr, "Failed to enable drop counting on UDP port %" PRIu16
+                "\n", (uint16_t)port);
+    }
 
     act.sa_flags = SA_SIGINFO | SA_RESTART;
     act.sa_sigaction = aIOSocketSigHandler;
@@ -556,40 +1096,76 @@ aIO_handle_t aIOOpenUDPSocket(char *s_addr, in_port_t port, size_t buffer_size,
         goto error_fcntl;
     }
 
-    pthread_mutex_unlock(&conn->next->lock);
+    pthread_mutex_unlock(&conn->lock);
 
-    return (aIO_handle_t)conn->next;
+    return (aIO_handle_t)conn;
 
 error_fcntl:
+    aIOUnregisterConn(conn);
+error_register:
     close(s_udp->fd);
 error_socket:
-    free(conn->next);
-    conn->next = NULL;
-    pthread_mutex_unlock(&conn->next->lock);
+    pthread_mutex_unlock(&conn->lock);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn->buffer);
+    free(conn);
 error_IO:
     return NULL;
 }
 
 void *aIOTCPHandler(void *conn)
 {
-    ssize_t read_size;
+    ssize_t read_size = 0;
+    sigset_t set;
+    aIO_tcp_client **iterator;
     aIO_tcp_client *client = (aIO_tcp_client *)conn;
+    aIO_t *server = client->conn;
     int client_fd = client->client_fd;
-    char *buffer = (char *)calloc(client->buffer_size, sizeof(char));
+
+    pthread_detach(pthread_self());
+
+    /** SIGIO's handler allocates, it must not interrupt us mid calloc */
+    sigemptyset(&set);
+    sigaddset(&set, SIGIO);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    char *buffer = (char *)calloc(server->buffer_size + 1, sizeof(char));
     if (buffer == NULL) {
         fprintf(stderr, "Failed to handle TCP\n");
         PRINT_CHECK;
-        return NULL;
+        goto out;
+    }
+
+    while (!atomic_load(&server->attr.socket.closed) &&
+           ((read_size = recv(client_fd, buffer, server->buffer_size, 0)) >
+            0 ||
+            (read_size < 0 && errno == EINTR))) {
+        if (read_size < 0) {
+            continue;
+        }
+        aIOStatRecv(server, read_size);
+        buffer[read_size] = '\0';
+        aIORunCallback(server, read_size, buffer);
+    }
+    if (read_size < 0) {
+        aIOStatAdd(&server->stats.recv_errors, 1);
     }
 
-    while ((read_size = recv(client_fd, buffer, client->buffer_size, 0)))
-        if (client->callback) {
-            (client->callback)(read_size, buffer, client->args);
+out:
+    pthread_mutex_lock(&server->lock);
+    for (iterator = &server->attr.socket.clients; *iterator;
+         iterator = &(*iterator)->next) {
+        if (*iterator == client) {
+            *iterator = client->next;
+            break;
         }
+    }
+    pthread_mutex_unlock(&server->lock);
 
     close(client_fd);
     free(buffer);
-    free((aIO_tcp_client *)conn);
+    free(client);
+    aIOPutConn(server);
 
     return NULL;
 }
@@ -598,21 +1174,19 @@ aIO_handle_t aIOOpenTCPSocket(char *s_addr, in_port_t port, size_t buffer_size,
                               void (*callback)(size_t, char *, void *),
                               void *args)
 {
-    aIO_t *conn = getLastConnection();
-
-    conn->next = createAsyncIO(SOCKET, buffer_size, callback, args);
-    if (conn->next == NULL) {
+    aIO_t *conn = createAsyncIO(SOCKET, buffer_size, callback, args);
+    if (conn == NULL) {
         fprintf(stderr,
                 "Failed to allocate TCP IO on port %" PRIu16 "\n",
                 (uint16_t)port);
         goto error_IO;
     }
 
-    conn->next->attr.socket.type = TCP;
+    conn->attr.socket.type = TCP;
 
-    pthread_mutex_lock(&conn->next->lock);
+    pthread_mutex_lock(&conn->lock);
 
-    aIO_socket_t *s_tcp = &conn->next->attr.socket;
+    aIO_socket_t *s_tcp = &conn->attr.socket;
 
     s_tcp->addr.sin_family = AF_INET;
     s_tcp->addr.sin_addr.s_addr = s_addr ? inet_addr(s_addr) : INADDR_ANY;
@@ -634,12 +1208,16 @@ aIO_handle_t aIOOpenTCPSocket(char *s_addr, in_port_t port, size_t buffer_size,
         fprintf(stderr,
                 "Failed to set socket options on port %" PRIu16 "\n",
                 (uint16_t)port);
-        goto error_socket;
+        goto error_register;
     }
 
     printf("Opened socket on port %d with FD: %d\n", port, s_tcp->fd);
 
-    struct sigaction act = { 0 };
+    if (aIORegisterConn(conn, s_tcp->fd)) {
+        goto error_register;
+    }
+
+    struct sigaction act = { 0 };
     int fs;
 
     act.sa_flags = SA_SIGINFO | SA_RESTART;
@@ -677,23 +1255,713 @@ aIO_handle_t aIOOpenTCPSocket(char *s_addr, in_port_t port, size_t buffer_size,
         goto error_fcntl;
     }
 
-    if (listen(s_tcp->fd, 1) < 0) {
+    if (listen(s_tcp->fd, SOMAXCONN) < 0) {
         fprintf(stderr, "Failed to listen on TCP port %" PRIu16 "\n",
                 (uint16_t)port);
         goto error_fcntl;
     }
 
-    pthread_mutex_unlock(&conn->next->lock);
+    pthread_mutex_unlock(&conn->lock);
 
-    return (aIO_handle_t)conn->next;
+    return (aIO_handle_t)conn;
 
 error_fcntl:
+    aIOUnregisterConn(conn);
+error_register:
     close(s_tcp->fd);
 error_socket:
-    free(conn->next);
-    conn->next = NULL;
-    pthread_mutex_unlock(&conn->next->lock);
+    pthread_mutex_unlock(&conn->lock);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn->buffer);
+    free(conn);
+error_IO:
+    PRINT_CHECK;
+    return NULL;
+}
+
+static aIO_shm_peer_t *aIO_shm_peers = NULL;
+static pthread_mutex_t aIO_shm_peers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *aIOSharedMemName(char *name)
+{
+    char *full_name = calloc(strlen(name) + 2, sizeof(char));
+
+    if (full_name == NULL) {
+        return NULL;
+    }
+
+    strcpy(full_name + 1, name);
+    full_name[0] = '/';
+
+    return full_name;
+}
+
+static int aIOSharedMemLock(aIO_shm_header_t *hdr)
+{
+    int ret = pthread_mutex_lock(&hdr->lock);
+
+    /** A peer died while holding the lock, its frame was never published */
+    if (ret == EOWNERDEAD) {
+        pthread_mutex_consistent(&hdr->lock);
+        ret = 0;
+    }
+
+    return ret;
+}
+
+/**
+ * Removes a segment of the given name if its receiver closed it or died
+ * without doing so, returns 0 if the name is free to be used
+ */
+static int aIOSharedMemReclaim(char *full_name)
+{
+    aIO_shm_header_t *hdr;
+    struct stat sb;
+    int fd, stale = 0;
+
+    fd = shm_open(full_name, O_RDWR, 0);
+    if (fd == -1) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    if (!fstat(fd, &sb) && sb.st_size >= (off_t)sizeof(aIO_shm_header_t)) {
+        hdr = mmap(NULL, sizeof(aIO_shm_header_t), PROT_READ, MAP_SHARED, fd,
+                   0);
+        if (hdr != MAP_FAILED) {
+            stale = hdr->magic == SHM_MAGIC &&
+                    (atomic_load(&hdr->closed) ||
+                     (kill(hdr->owner, 0) == -1 && errno == ESRCH));
+            munmap(hdr, sizeof(aIO_shm_header_t));
+        }
+    }
+
+    close(fd);
+
+    if (!stale) {
+        return -1;
+    }
+
+    shm_unlink(full_name);
+
+    return 0;
+}
+
+static void *aIOSharedMemHandler(void *arg)
+{
+    aIO_t *conn = (aIO_t *)arg;
+    aIO_shm_t *shm = &conn->attr.shm;
+    aIO_shm_header_t *hdr = shm->hdr;
+    char *slots = (char *)(hdr + 1);
+    unsigned int tail = atomic_load(&hdr->tail);
+    unsigned int seq;
+
+    while (atomic_load(&shm->running)) {
+        seq = atomic_load(&hdr->seq);
+
+        while (tail != atomic_load(&hdr->head)) {
+            char *slot = slots + (tail % shm->slot_count) *
+                         shm->slot_stride;
+            uint32_t len = *(uint32_t *)slot;
+            char *data = slot + sizeof(uint32_t);
+
+            if (len > shm->slot_size) {
+                len = shm->slot_size;
+            }
+            data[len] = '\0';
+
+            aIOStatRecv(conn, len);
+
+            /** Frames are passed straight out of the ring, no extra copy */
+            pthread_mutex_lock(&conn->lock);
+            aIORunCallback(conn, len, data);
+            pthread_mutex_unlock(&conn->lock);
+
+            atomic_store(&hdr->tail, ++tail);
+
+            if (!atomic_load(&shm->running)) {
+                break;
+            }
+        }
+
+        /** Refused frames are counted by the producers */
+        atomic_store_explicit(&conn->stats.overruns,
+                              atomic_load(&hdr->dropped),
+                              memory_order_relaxed);
+        atomic_store_explicit(&conn->stats.truncations,
+                              atomic_load(&hdr->oversized),
+                              memory_order_relaxed);
+
+        atomic_store(&hdr->waiting, 1);
+        if (tail == atomic_load(&hdr->head) &&
+            atomic_load(&shm->running)) {
+            syscall(SYS_futex, &hdr->seq, FUTEX_WAIT, seq, NULL, NULL, 0);
+        }
+        atomic_store(&hdr->waiting, 0);
+    }
+
+    if (atomic_load(&conn->handler_frees)) {
+        pthread_detach(pthread_self());
+        aIODestroyConn(conn);
+    }
+
+    return NULL;
+}
+
+aIO_handle_t aIOOpenSharedMem(char *name, size_t buffer_size,
+                              void (*callback)(size_t, char *, void *),
+                              void *args)
+{
+    pthread_mutexattr_t lock_attr;
+
+    /** Frames are delivered from the ring, the connection needs no buffer */
+    aIO_t *conn = createAsyncIO(SHARED_MEM, 0, callback, args);
+    if (conn == NULL) {
+        fprintf(stderr, "Failed to allocate SHM IO for SHM '%s'\n", name);
+        goto error_IO;
+    }
+
+    pthread_mutex_lock(&conn->lock);
+
+    aIO_shm_t *shm = &conn->attr.shm;
+
+    shm->name = aIOSharedMemName(name);
+    if (shm->name == NULL) {
+        fprintf(stderr, "Failed to allocate name for SHM '%s'\n", name);
+        goto error_name;
+    }
+
+    /** Segments left behind by a previous run are reused, live ones not */
+    if (aIOSharedMemReclaim(shm->name)) {
+        fprintf(stderr, "SHM '%s' is in use by another receiver\n",
+                shm->name);
+        goto error_open;
+    }
+
+    shm->fd = shm_open(shm->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (shm->fd == -1) {
+        fprintf(stderr, "Couldn't open SHM '%s'\n", shm->name);
+        goto error_open;
+    }
+
+    size_t slot_stride = (sizeof(uint32_t) + buffer_size + 1 + 7) & ~7UL;
+    shm->map_size = sizeof(aIO_shm_header_t) + SHM_SLOT_COUNT * slot_stride;
+
+    if (ftruncate(shm->fd, shm->map_size)) {
+        fprintf(stderr, "Couldn't size SHM '%s'\n", shm->name);
+        goto error_map;
+    }
+
+    shm->hdr = mmap(NULL, shm->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    shm->fd, 0);
+    if (shm->hdr == MAP_FAILED) {
+        fprintf(stderr, "Couldn't map SHM '%s'\n", shm->name);
+        goto error_map;
+    }
+
+    shm->slot_size = buffer_size;
+    shm->slot_count = SHM_SLOT_COUNT;
+    shm->slot_stride = slot_stride;
+    shm->hdr->slot_size = shm->slot_size;
+    shm->hdr->slot_count = shm->slot_count;
+    shm->hdr->slot_stride = shm->slot_stride;
+    shm->hdr->owner = getpid();
+
+    pthread_mutexattr_init(&lock_attr);
+    pthread_mutexattr_setpshared(&lock_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&lock_attr, PTHREAD_MUTEX_ROBUST);
+    if (pthread_mutex_init(&shm->hdr->lock, &lock_attr)) {
+        fprintf(stderr, "Couldn't init lock of SHM '%s'\n", shm->name);
+        pthread_mutexattr_destroy(&lock_attr);
+        goto error_lock;
+    }
+    pthread_mutexattr_destroy(&lock_attr);
+
+    /** Peers only accept the segment once the header is complete */
+    atomic_thread_fence(memory_order_release);
+    shm->hdr->magic = SHM_MAGIC;
+
+    if (aIORegisterConn(conn, shm->fd)) {
+        goto error_register;
+    }
+
+    atomic_store(&shm->running, 1);
+
+    if (pthread_create(&conn->thread, NULL, aIOSharedMemHandler, conn)) {
+        fprintf(stderr, "Failed to create SHM handler thread\n");
+        goto error_thread;
+    }
+
+    pthread_mutex_unlock(&conn->lock);
+
+    printf("SHM '%s' opened with %d slots of %zu bytes\n", name,
+           SHM_SLOT_COUNT, buffer_size);
+
+    return (aIO_handle_t)conn;
+
+error_thread:
+    aIOUnregisterConn(conn);
+error_register:
+    pthread_mutex_destroy(&shm->hdr->lock);
+error_lock:
+    munmap(shm->hdr, shm->map_size);
+error_map:
+    close(shm->fd);
+    shm_unlink(shm->name);
+error_open:
+    free(shm->name);
+error_name:
+    pthread_mutex_unlock(&conn->lock);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn->buffer);
+    free(conn);
 error_IO:
     PRINT_CHECK;
     return NULL;
 }
+
+static void aIOSharedMemUnmapPeer(aIO_shm_peer_t *peer)
+{
+    munmap(peer->hdr, peer->map_size);
+    free(peer->name);
+    free(peer);
+}
+
+static void aIOSharedMemUnmapPeers(void)
+{
+    aIO_shm_peer_t *peer;
+
+    pthread_mutex_lock(&aIO_shm_peers_lock);
+    while ((peer = aIO_shm_peers) != NULL) {
+        aIO_shm_peers = peer->next;
+        aIOSharedMemUnmapPeer(peer);
+    }
+    pthread_mutex_unlock(&aIO_shm_peers_lock);
+}
+
+/** Must be called holding aIO_shm_peers_lock */
+static aIO_shm_peer_t *aIOSharedMemGetPeer(char *name)
+{
+    aIO_shm_peer_t **iterator;
+    aIO_shm_peer_t *peer;
+    struct stat sb;
+    int fd;
+
+    for (iterator = &aIO_shm_peers; *iterator;) {
+        peer = *iterator;
+        if (strcmp(peer->name, name)) {
+            iterator = &peer->next;
+            continue;
+        }
+
+        if (!atomic_load(&peer->hdr->closed)) {
+            return peer;
+        }
+
+        /** Receiver has closed the segment, it might have been reopened */
+        *iterator = peer->next;
+        aIOSharedMemUnmapPeer(peer);
+    }
+
+    peer = calloc(1, sizeof(aIO_shm_peer_t));
+    if (peer == NULL) {
+        goto error_alloc;
+    }
+
+    peer->name = strdup(name);
+    if (peer->name == NULL) {
+        goto error_name;
+    }
+
+    char *full_name = aIOSharedMemName(name);
+    if (full_name == NULL) {
+        goto error_full_name;
+    }
+
+    fd = shm_open(full_name, O_RDWR, 0);
+    free(full_name);
+    if (fd == -1) {
+        printf("Unable to open SHM '%s'\n", name);
+        goto error_full_name;
+    }
+
+    if (fstat(fd, &sb) || sb.st_size < (off_t)sizeof(aIO_shm_header_t)) {
+        printf("SHM '%s' is not initialised\n", name);
+        goto error_map;
+    }
+
+    peer->map_size = sb.st_size;
+    peer->hdr = mmap(NULL, peer->map_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    if (peer->hdr == MAP_FAILED) {
+        goto error_map;
+    }
+
+    if (peer->hdr->magic != SHM_MAGIC) {
+        printf("SHM '%s' is not initialised\n", name);
+        goto error_magic;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    close(fd);
+
+    peer->next = aIO_shm_peers;
+    aIO_shm_peers = peer;
+
+    return peer;
+
+error_magic:
+    munmap(peer->hdr, peer->map_size);
+error_map:
+    close(fd);
+error_full_name:
+    free(peer->name);
+error_name:
+    free(peer);
+error_alloc:
+    return NULL;
+}
+
+int aIOSharedMemPut(char *name, char *buffer, size_t buffer_size)
+{
+    aIO_shm_peer_t *peer;
+    aIO_shm_header_t *hdr;
+    unsigned int head;
+    char *slot;
+    int ret = -1;
+
+    pthread_mutex_lock(&aIO_shm_peers_lock);
+
+    peer = aIOSharedMemGetPeer(name);
+    if (peer == NULL) {
+        goto error_peer;
+    }
+
+    hdr = peer->hdr;
+
+    if (buffer_size > hdr->slot_size) {
+        printf("Frame of %zu bytes exceeds SHM '%s' slot size %u\n",
+               buffer_size, name, hdr->slot_size);
+        atomic_fetch_add(&hdr->oversized, 1);
+        goto error_peer;
+    }
+
+    if (aIOSharedMemLock(hdr)) {
+        goto error_peer;
+    }
+
+    head = atomic_load(&hdr->head);
+    if (head - atomic_load(&hdr->tail) >= hdr->slot_count) {
+        pthread_mutex_unlock(&hdr->lock);
+        atomic_fetch_add(&hdr->dropped, 1);
+        goto error_peer;
+    }
+
+    slot = (char *)(hdr + 1) + (head % hdr->slot_count) * hdr->slot_stride;
+    *(uint32_t *)slot = buffer_size;
+    memcpy(slot + sizeof(uint32_t), buffer, buffer_size);
+
+    atomic_store(&hdr->head, head + 1);
+
+    pthread_mutex_unlock(&hdr->lock);
+
+    atomic_fetch_add(&hdr->seq, 1);
+    if (atomic_load(&hdr->waiting)) {
+        aIOFutexWake(&hdr->seq);
+    }
+
+    ret = 0;
+
+error_peer:
+    pthread_mutex_unlock(&aIO_shm_peers_lock);
+    return ret;
+}
+
+/** Waits for the time the given number of bytes occupy the emulated line */
+static void aIOSerialPace(unsigned int baud, struct timespec *next,
+                          size_t bytes)
+{
+    struct timespec now;
+    unsigned long long ns;
+
+    if (!baud) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (next->tv_sec < now.tv_sec ||
+        (next->tv_sec == now.tv_sec && next->tv_nsec < now.tv_nsec)) {
+        *next = now;
+    }
+
+    ns = next->tv_nsec + bytes * SERIAL_BITS_PER_BYTE * NS_IN_SECOND / baud;
+    next->tv_sec += ns / NS_IN_SECOND;
+    next->tv_nsec = ns % NS_IN_SECOND;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL) ==
+           EINTR)
+        ;
+}
+
+static void *aIOSerialHandler(void *arg)
+{
+    aIO_t *conn = (aIO_t *)arg;
+    aIO_serial_t *tty = &conn->attr.tty;
+    struct pollfd fds[2] = { { .fd = tty->fd, .events = POLLIN },
+        { .fd = tty->wake_fd, .events = POLLIN }
+    };
+    ssize_t read_size = 0;
+
+    while (atomic_load(&tty->running)) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PRINT_CHECK;
+            break;
+        }
+
+        if (fds[1].revents) {
+            break;
+        }
+
+        if (fds[0].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+            if (atomic_load(&tty->running))
+                fprintf(stderr, "Serial %s hung up\n", tty->peer_name);
+            break;
+        }
+
+        pthread_mutex_lock(&conn->lock);
+        while (atomic_load(&tty->running) &&
+               (read_size = read(tty->fd, conn->buffer,
+                                 conn->buffer_size)) > 0) {
+            aIOStatRecv(conn, read_size);
+            aIOSerialPace(tty->baud, &tty->rx_next, read_size);
+            conn->buffer[read_size] = '\0';
+            aIORunCallback(conn, read_size, conn->buffer);
+        }
+        if (read_size < 0 && errno != EAGAIN && errno != EINTR) {
+            aIOStatAdd(&conn->stats.recv_errors, 1);
+        }
+        pthread_mutex_unlock(&conn->lock);
+    }
+
+    if (atomic_load(&conn->handler_frees)) {
+        pthread_detach(pthread_self());
+        aIODestroyConn(conn);
+    }
+
+    return NULL;
+}
+
+static speed_t aIOSerialSpeed(unsigned int baud)
+{
+    switch (baud) {
+        case 9600:
+            return B9600;
+        case 19200:
+            return B19200;
+        case 38400:
+            return B38400;
+        case 57600:
+            return B57600;
+        case 115200:
+            return B115200;
+        case 230400:
+            return B230400;
+        case 460800:
+            return B460800;
+        case 921600:
+            return B921600;
+        default:
+            return B0;
+    }
+}
+
+aIO_handle_t aIOOpenSerial(char *path, unsigned int baud, size_t buffer_size,
+                           void (*callback)(size_t, char *, void *),
+                           void *args)
+{
+    struct termios tio;
+    char pty_name[PATH_MAX];
+    int fs;
+
+    aIO_t *conn = createAsyncIO(SERIAL, buffer_size, callback, args);
+    if (conn == NULL) {
+        fprintf(stderr, "Failed to allocate serial IO for '%s'\n",
+                path ? path : "PTY");
+        goto error_IO;
+    }
+
+    pthread_mutex_lock(&conn->lock);
+
+    aIO_serial_t *tty = &conn->attr.tty;
+
+    tty->baud = baud;
+    tty->peer_fd = -1;
+
+    if (path == NULL) {
+        if (openpty(&tty->fd, &tty->peer_fd, pty_name, NULL, NULL)) {
+            fprintf(stderr, "Failed to open PTY pair\n");
+            goto error_open;
+        }
+        tty->peer_name = strdup(pty_name);
+    }
+    else {
+        tty->fd = open(path, O_RDWR | O_NOCTTY);
+        if (tty->fd == -1) {
+            fprintf(stderr, "Failed to open serial '%s'\n", path);
+            goto error_open;
+        }
+        tty->peer_name = strdup(path);
+    }
+
+    if (tty->peer_name == NULL) {
+        fprintf(stderr, "Failed to allocate serial name\n");
+        goto error_name;
+    }
+
+    /** Raw 8N1 line, no echo or line editing */
+    if (tcgetattr(tty->fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        if (aIOSerialSpeed(baud) != B0) {
+            cfsetspeed(&tio, aIOSerialSpeed(baud));
+        }
+        tcsetattr(tty->fd, TCSANOW, &tio);
+    }
+    if (tty->peer_fd != -1 && tcgetattr(tty->peer_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(tty->peer_fd, TCSANOW, &tio);
+    }
+
+    if ((fs = fcntl(tty->fd, F_GETFL)) == -1 ||
+        fcntl(tty->fd, F_SETFL, fs | O_NONBLOCK) == -1) {
+        fprintf(stderr, "Failed to set fd status\n");
+        goto error_name;
+    }
+
+    tty->wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (tty->wake_fd == -1) {
+        fprintf(stderr, "Failed to create serial wake up event\n");
+        goto error_name;
+    }
+
+    if (pthread_mutex_init(&tty->tx_lock, NULL)) {
+        fprintf(stderr, "Failed to init serial TX mutex\n");
+        goto error_tx_lock;
+    }
+
+    if (aIORegisterConn(conn, tty->fd)) {
+        goto error_register;
+    }
+
+    atomic_store(&tty->running, 1);
+
+    if (pthread_create(&conn->thread, NULL, aIOSerialHandler, conn)) {
+        fprintf(stderr, "Failed to create serial handler thread\n");
+        goto error_thread;
+    }
+
+    pthread_mutex_unlock(&conn->lock);
+
+    printf("Opened serial %s at %u baud with FD: %d\n", tty->peer_name,
+           baud, tty->fd);
+
+    return (aIO_handle_t)conn;
+
+error_thread:
+    aIOUnregisterConn(conn);
+error_register:
+    pthread_mutex_destroy(&tty->tx_lock);
+error_tx_lock:
+    close(tty->wake_fd);
+error_name:
+    free(tty->peer_name);
+    close(tty->fd);
+    if (tty->peer_fd != -1) {
+        close(tty->peer_fd);
+    }
+error_open:
+    pthread_mutex_unlock(&conn->lock);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn->buffer);
+    free(conn);
+error_IO:
+    PRINT_CHECK;
+    return NULL;
+}
+
+char *aIOSerialGetPeerName(aIO_handle_t conn)
+{
+    aIO_t *serial = (aIO_t *)conn;
+
+    if (serial == NULL || serial->type != SERIAL) {
+        return NULL;
+    }
+
+    return serial->attr.tty.peer_name;
+}
+
+int aIOSerialPut(aIO_handle_t conn, char *buffer, size_t buffer_size)
+{
+    aIO_t *serial = (aIO_t *)conn;
+    struct pollfd pfd;
+    size_t written = 0;
+    ssize_t ret;
+
+    if (serial == NULL || serial->type != SERIAL) {
+        fprintf(stderr, "Not a serial connection\n");
+        return -1;
+    }
+
+    aIO_serial_t *tty = &serial->attr.tty;
+
+    pfd.fd = tty->fd;
+    pfd.events = POLLOUT;
+
+    pthread_mutex_lock(&tty->tx_lock);
+
+    while (written < buffer_size) {
+        ret = write(tty->fd, buffer + written, buffer_size - written);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /** Line is backed up, give the other end a chance to drain it */
+            if (errno == EAGAIN &&
+                poll(&pfd, 1, SERIAL_TX_TIMEOUT_MS) > 0) {
+                continue;
+            }
+            fprintf(stderr, "Writing to serial %s failed\n",
+                    tty->peer_name);
+            PRINT_CHECK;
+            break;
+        }
+        written += ret;
+    }
+
+    atomic_fetch_add(&tty->tx_bytes, written);
+    aIOSerialPace(tty->baud, &tty->tx_next, written);
+
+    pthread_mutex_unlock(&tty->tx_lock);
+
+    return (written == buffer_size) ? 0 : -1;
+}
+
+int aIOSerialGetThroughput(aIO_handle_t conn, unsigned long long *rx_bytes,
+                           unsigned long long *tx_bytes)
+{
+    aIO_t *serial = (aIO_t *)conn;
+
+    if (serial == NULL || serial->type != SERIAL) {
+        return -1;
+    }
+
+    if (rx_bytes) {
+        *rx_bytes = atomic_load(&serial->stats.rx_bytes);
+    }
+    if (tx_bytes) {
+        *tx_bytes = atomic_load(&serial->attr.tty.tx_bytes);
+    }
+
+    return 0;
+}
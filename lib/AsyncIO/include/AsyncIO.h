@@ -3,7 +3,7 @@
  * @author Alex Hoffman
  * @date 20 January 2020
  * @brief A single file asyncronous UNIX communications library to perform
- * UDP, TCP and POSIX message queue communications.
+ * UDP, TCP, POSIX message queue, shared memory and serial communications.
  *
  * @verbatim
    ----------------------------------------------------------------------
@@ -34,7 +34,8 @@
  * of asynchronous communications channels that allow for passive IO through
  * the use of callbacks
  *
- * Focusing on sockets (UDP and TCP) and POSIX message queues, this API allows
+ * Focusing on sockets (UDP and TCP), POSIX message queues, POSIX shared
+ * memory and serial lines (TTYs and PTYs), this API allows
  * for the creation of the particular IO stream, registering a callback to the
  * stream that is automatically called when a communication event is triggered
  * on the stream. For example a UDP packet is send to the port that is bound
@@ -47,6 +48,31 @@
 #define MQ_MAXMSG 256
 #define MQ_MSGSIZE 256
 
+/**
+ * Number of frames a shared memory connection can buffer before
+ * aIOSharedMemPut() starts dropping frames
+ */
+#ifndef SHM_SLOT_COUNT
+#define SHM_SLOT_COUNT 64
+#endif //SHM_SLOT_COUNT
+
+/**
+ * Time in milliseconds aIOSerialPut() waits for a backed up serial line to
+ * drain before giving up
+ */
+#ifndef SERIAL_TX_TIMEOUT_MS
+#define SERIAL_TX_TIMEOUT_MS 100
+#endif //SERIAL_TX_TIMEOUT_MS
+
+/**
+ * Size of the connection registry. Connections are indexed by their file
+ * descriptor, descriptors at or above this value cannot be opened as an
+ * asynchronous connection.
+ */
+#ifndef AIO_MAX_FDS
+#define AIO_MAX_FDS 1024
+#endif //AIO_MAX_FDS
+
 /**
  * @brief Handle used to reference and opened asyncronour communications channel
  */
@@ -66,6 +92,30 @@ typedef enum { UDP, TCP } aIO_socket_e;
  */
 typedef void (*aIO_callback_t)(size_t recv_size, char *buffer, void *args);
 
+/**
+ * @brief Reception statistics of a connection, see aIOGetStats()
+ *
+ * What is counted as a message depends on the connection: a datagram for UDP,
+ * a recv(2) for TCP, a message for message queues, a frame for shared memory
+ * and a read(2) for serial connections.
+ */
+typedef struct aIO_stats {
+    unsigned long long rx_msgs; /**< Messages received */
+    unsigned long long rx_bytes; /**< Bytes received, before truncation */
+    unsigned long long
+    truncations; /**< Messages cut short by the connection's buffer size */
+    unsigned long long recv_errors; /**< Failed receive calls */
+    unsigned long long
+    overruns; /**< Messages lost before reaching the connection, eg. kernel
+                 drops on a full UDP socket buffer or a full ring buffer.
+                 Message queues lose no messages, their senders block or are
+                 refused, for them it counts the notifications that found the
+                 queue full. */
+    unsigned long long callbacks; /**< Number of callbacks run */
+    unsigned long long callback_ns; /**< Total time spent in callbacks */
+    unsigned long long callback_max_ns; /**< Longest callback */
+} aIO_stats_t;
+
 
 /**
  * @brief Function that closes all open connections
@@ -79,14 +129,40 @@ void aIODeinit(void);
 /**
  * @brief Closes a connection and frees all resources used by that connection
  *
+ * Connections can be closed at any time, also while a callback of the
+ * connection is running in another thread or from within the connection's own
+ * callback. The connection stops receiving new notifications immediately and
+ * its resources are free'd once the last running callback has returned. A TCP
+ * socket stops listening and disconnects its clients right away.
+ *
  * @param conn Handle to the connection that is to be closed
  */
-void aIOCloseConn(aIO_handle_t conn); //TODO
+void aIOCloseConn(aIO_handle_t conn);
+
+/**
+ * @brief Retrieves the reception statistics of a connection
+ *
+ * The counters are always kept and are updated with relaxed atomics, as such a
+ * snapshot might be torn across counters but each counter is exact.
+ *
+ * @param conn Handle to the connection
+ * @param stats Reference to where the statistics are to be stored
+ * @return returns 0 on success; on error, -1 is returned.
+ */
+int aIOGetStats(aIO_handle_t conn, aIO_stats_t *stats);
+
+/**
+ * @brief Prints the statistics of every open connection to stdout
+ */
+void aIODumpStats(void);
 
 /**
  * @brief Sends the data stored in buffer to the message queue with the provided
  * name
  *
+ * Blocks while the message queue is full, also for message queues opened by
+ * this process.
+ *
  * @param mq_name Name of the message queue to which the data is to be sent, note
  * that the message queue name does not require the preceeding '/' as this is
  * handled automatically
@@ -157,5 +233,104 @@ aIO_handle_t aIOOpenUDPSocket(char *s_addr, in_port_t port, size_t buffer_size,
 aIO_handle_t aIOOpenTCPSocket(char *s_addr, in_port_t port, size_t buffer_size,
                               aIO_callback_t callback, void *args);
 
+/**
+ * @brief Sends the data stored in buffer to the shared memory connection with
+ * the provided name
+ *
+ * The connection must have been opened using aIOOpenSharedMem(), either by this
+ * process or by another process on the same host. The segment is mapped on the
+ * first call and stays mapped for subsequent calls, such that each frame costs
+ * a single copy into the receiver's ring buffer.
+ *
+ * @param name Name of the shared memory connection, note that the name does not
+ * require the preceeding '/' as this is handled automatically
+ * @param buffer Reference to data to be sent
+ * @param buffer_size Length of the data to be sent in bytes, must not exceed
+ * the buffer size the connection was opened with
+ * @return returns 0 on success; on error or if the ring buffer is full, -1 is
+ * returned.
+ */
+int aIOSharedMemPut(char *name, char *buffer, size_t buffer_size);
+
+/**
+ * @brief Opens a shared memory connection
+ *
+ * Creates a named POSIX shared memory segment, see SHM_OVERVIEW(7), holding a
+ * ring buffer of SHM_SLOT_COUNT frames. Frames sent with aIOSharedMemPut() are
+ * passed to the callback directly from the ring buffer, the receiving thread is
+ * woken using a futex placed in the segment. Useful for exchanging data with
+ * processes running on the same host without going through the network stack.
+ *
+ * Opening fails while a receiver in this or another process holds a segment
+ * of the same name open. Segments left behind by a receiver that exited
+ * without closing them are replaced.
+ *
+ * @param name Name of the shared memory segment, note that the name does not
+ * require the preceeding '/' as this is handled automatically
+ * @param buffer_size Maximum size of a single frame in bytes
+ * @param callback Callback triggered for each received frame
+ * @param args Args passed to the specified callback
+ * @return Handle to the created connection, or NULL
+ */
+aIO_handle_t aIOOpenSharedMem(char *name, size_t buffer_size,
+                              aIO_callback_t callback, void *args);
+
+/**
+ * @brief Opens a serial connection on a TTY or on a newly created PTY pair
+ *
+ * Passing a path opens an existing TTY, eg. a USB UART adapter. Passing NULL
+ * creates a pseudo-terminal pair, see PTY(7), where the connection holds the
+ * master side. The slave side's path, retrieved with aIOSerialGetPeerName(),
+ * can be opened by other programs or by a second call to aIOOpenSerial() to
+ * test UART code locally.
+ *
+ * The line is put into raw mode. If a baud rate is given, reception and
+ * transmission are slowed down to the rate of an 8N1 line of that baud rate,
+ * allowing UART heavy code to be load tested under realistic timing.
+ *
+ * @param path Path to the TTY device, NULL to create a PTY pair
+ * @param baud Emulated baud rate, 0 for no rate limiting
+ * @param buffer_size Number of bytes to be reserved as a buffer for the connection
+ * @param callback Callback triggered each time data is received
+ * @param args Args passed to the specified callback
+ * @return Handle to the created connection, or NULL
+ */
+aIO_handle_t aIOOpenSerial(char *path, unsigned int baud, size_t buffer_size,
+                           aIO_callback_t callback, void *args);
+
+/**
+ * @brief Returns the path of the serial connection's other end
+ *
+ * @param conn Handle to the serial connection
+ * @return Path of the PTY slave for PTY pairs, the TTY's path otherwise. NULL
+ * on error.
+ */
+char *aIOSerialGetPeerName(aIO_handle_t conn);
+
+/**
+ * @brief Sends the data stored in buffer over a serial connection
+ *
+ * If the connection emulates a baud rate the call returns once the data would
+ * have been shifted out on the line.
+ *
+ * @param conn Handle to the serial connection
+ * @param buffer Reference to data to be sent
+ * @param buffer_size Length of the data to be send in bytes
+ * @return returns 0 on success; on error, -1 is returned.
+ */
+int aIOSerialPut(aIO_handle_t conn, char *buffer, size_t buffer_size);
+
+/**
+ * @brief Retrieves the number of bytes received and sent on a serial connection
+ *
+ * @param conn Handle to the serial connection
+ * @param rx_bytes Reference to where the received byte count is stored, can
+ * be NULL
+ * @param tx_bytes Reference to where the sent byte count is stored, can be NULL
+ * @return returns 0 on success; on error, -1 is returned.
+ */
+int aIOSerialGetThroughput(aIO_handle_t conn, unsigned long long *rx_bytes,
+                           unsigned long long *tx_bytes);
+
 /** @} */
 #endif
@@ -0,0 +1,591 @@
+/**
+ * @file TUM_Animation.c
+ * @brief Spritesheet animations drawn using TUM Draw
+ *
+ * @verbatim
+   ----------------------------------------------------------------------
+    Copyright (C) Alexander Hoffman, 2019
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+@endverbatim
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TUM_Animation.h"
+#include "TUM_Image.h"
+#include "TUM_Utils.h"
+
+typedef struct spritesheet_sequence {
+    char *name;
+    unsigned start_row;
+    unsigned start_col;
+    enum sprite_sequence_direction direction;
+    unsigned frames;
+    struct spritesheet_sequence *next;
+} spritesheet_sequence_t;
+
+typedef struct spritesheet {
+    loaded_image_t *image;
+    unsigned sprite_width;
+    unsigned sprite_height;
+    unsigned sprite_cols;
+    unsigned sprite_rows;
+} spritesheet_t;
+
+typedef struct animated_image {
+    spritesheet_t *spritesheet;
+    spritesheet_sequence_t *sequences;
+} animated_image_t;
+
+typedef struct animated_sequence_instance {
+    unsigned frame_period_ms;
+    unsigned current_frame;
+    unsigned prev_frame_timestamp;
+    unsigned cur_frame_timestamp;
+    animated_image_t *image;
+    spritesheet_sequence_t *sequence;
+} animated_sequence_instance_t;
+
+/**
+ * Animation manager, the live sprites are kept densely packed in sprites and
+ * referenced by stable ids through index
+ */
+typedef struct animation_manager_sprite {
+    animated_image_t *image;
+    spritesheet_sequence_t *sequence;
+    unsigned frame_period_ms;
+    unsigned current_frame;
+    unsigned elapsed_ms;
+    int x;
+    int y;
+    int id;
+} animation_manager_sprite_t;
+
+/** Sorts sprites into batches, see tumDrawAnimationManagerDraw() */
+typedef struct animation_manager_order {
+    loaded_image_t *image;
+    unsigned first; // Position of the first sprite using the image
+    unsigned pos;
+} animation_manager_order_t;
+
+typedef struct animation_manager {
+    animation_manager_sprite_t *sprites;
+    animation_manager_order_t *order; // Reused by each draw
+    unsigned count;
+    unsigned capacity;
+    int *index; // Sprite id to position in sprites, -1 if unused
+    int *free_ids;
+    unsigned free_count;
+    unsigned ids;
+} animation_manager_t;
+
+animation_handle_t tumDrawAnimationCreate(image_handle_t spritesheet,
+        unsigned sprite_cols,
+        unsigned sprite_rows)
+{
+    if (spritesheet == NULL) {
+        PRINT_ERROR("Creating animation requires a valid spritesheet");
+        goto err;
+    }
+
+    if (sprite_cols == 0) {
+        PRINT_ERROR("Spritesheet cols are not valid");
+        goto err;
+    }
+
+    if (sprite_rows == 0) {
+        PRINT_ERROR("Spritesheet rows are not valid");
+        goto err;
+    }
+
+    if (tumDrawGetLoadedImageState(spritesheet) != 1) {
+        PRINT_ERROR("Spritesheet has not finished loading");
+        goto err;
+    }
+
+    animated_image_t *ret = calloc(1, sizeof(animated_image_t));
+
+    if (ret == NULL) {
+        PRINT_ERROR("Allocating animation failed");
+        goto err;
+    }
+
+    ret->spritesheet = calloc(1, sizeof(spritesheet_t));
+
+    if (ret->spritesheet == NULL) {
+        PRINT_ERROR("Could not allocate spritesheet");
+        goto err_spritesheet;
+    }
+
+    ret->spritesheet->image = ((loaded_image_ref_t *)spritesheet)->image;
+    ret->spritesheet->sprite_cols = sprite_cols;
+    ret->spritesheet->sprite_rows = sprite_rows;
+    ret->spritesheet->sprite_width =
+        ret->spritesheet->image->w / sprite_cols;
+    ret->spritesheet->sprite_height =
+        ret->spritesheet->image->h / sprite_rows;
+
+    return (void *)ret;
+
+err_spritesheet:
+    free(ret);
+err:
+    return NULL;
+}
+
+int tumDrawAnimationAddSequence(
+    animation_handle_t animation, char *name, unsigned start_row,
+    unsigned start_col,
+    enum sprite_sequence_direction sprite_step_direction, unsigned frames)
+{
+    if (animation == NULL) {
+        PRINT_ERROR("Animation handle is not valid");
+        goto err;
+    }
+
+    if (name == NULL) {
+        PRINT_ERROR("Sequence requires a valid name");
+        goto err;
+    }
+
+    animated_image_t *anim = (animated_image_t *)animation;
+
+    spritesheet_sequence_t *seq = calloc(1, sizeof(spritesheet_sequence_t));
+    if (seq == NULL) {
+        PRINT_ERROR("Could not allocate animation sequence");
+        goto err;
+    }
+
+    seq->name = strdup(name);
+    if (seq->name == NULL) {
+        PRINT_ERROR("Could not allocate sequence name");
+        goto err_name;
+    }
+
+    seq->start_row = start_row;
+    seq->start_col = start_col;
+    seq->direction = sprite_step_direction;
+    seq->frames = frames;
+
+    if (anim->sequences == NULL) {
+        anim->sequences = seq;
+    }
+    else {
+        spritesheet_sequence_t *iterator = anim->sequences;
+
+        for (; iterator->next; iterator = iterator->next)
+            ;
+        iterator->next = seq;
+    }
+
+    return 0;
+
+err_name:
+    free(seq);
+err:
+    return -1;
+}
+
+static spritesheet_sequence_t *findSequence(animated_image_t *animation,
+        char *sequence_name)
+{
+    spritesheet_sequence_t *iterator;
+
+    for (iterator = animation->sequences; iterator;
+         iterator = iterator->next)
+        if (!strcmp(iterator->name, sequence_name)) {
+            return iterator;
+        }
+
+    return NULL;
+}
+
+/** Finds the top left corner of a sequence's frame within the spritesheet */
+static void spriteFrameOrigin(spritesheet_t *sheet,
+                              spritesheet_sequence_t *sequence,
+                              unsigned frame, int *c_x, int *c_y)
+{
+    switch (sequence->direction) {
+        case SPRITE_SEQUENCE_HORIZONTAL_POS:
+            *c_x = (sequence->start_col + frame) * sheet->sprite_width;
+            *c_y = sequence->start_row * sheet->sprite_height;
+            break;
+        case SPRITE_SEQUENCE_HORIZONTAL_NEG:
+            *c_x = (sequence->start_col - frame) * sheet->sprite_width;
+            *c_y = sequence->start_row * sheet->sprite_height;
+            break;
+        case SPRITE_SEQUENCY_VERTICAL_POS:
+            *c_x = sequence->start_col * sheet->sprite_width;
+            *c_y = (sequence->start_row + frame) * sheet->sprite_height;
+            break;
+        case SPRITE_SEQUENCY_VERTICAL_NEG:
+            *c_x = sequence->start_col * sheet->sprite_width;
+            *c_y = (sequence->start_row - frame) * sheet->sprite_height;
+            break;
+        default:
+            *c_x = *c_y = 0;
+            break;
+    }
+}
+
+sequence_handle_t
+tumDrawAnimationSequenceInstantiate(animation_handle_t animation,
+                                    char *sequence_name,
+                                    unsigned frame_period_ms)
+{
+    if (animation == NULL) {
+        PRINT_ERROR(
+            "Animation provided for sequence instantiation was invalid");
+        goto err;
+    }
+
+    if (sequence_name == NULL) {
+        PRINT_ERROR("Sequence name is invalid");
+        goto err;
+    }
+
+    if (frame_period_ms == 0) {
+        PRINT_ERROR("Sequence frame period cannot be zero");
+        goto err;
+    }
+
+    animated_sequence_instance_t *ret =
+        calloc(1, sizeof(animated_sequence_instance_t));
+    if (ret == NULL) {
+        PRINT_ERROR("Could not create sequence '%s' instance",
+                    sequence_name);
+        goto err;
+    }
+
+    ret->image = (animated_image_t *)animation;
+    ret->sequence = findSequence(ret->image, sequence_name);
+
+    if (ret->sequence == NULL) {
+        PRINT_ERROR("Could not find sequence '%s'", sequence_name);
+        goto err_sequence;
+    }
+
+    ret->frame_period_ms = frame_period_ms;
+
+    return ret;
+
+err_sequence:
+    free(ret);
+err:
+    return NULL;
+}
+
+int tumDrawAnimationDrawFrame(sequence_handle_t sequence, unsigned ms_timestep,
+                              int x, int y)
+{
+    if (sequence == NULL) {
+        PRINT_ERROR("Trying to draw invalid sequence");
+        goto err;
+    }
+
+    animated_sequence_instance_t *anim =
+        (animated_sequence_instance_t *)sequence;
+
+    anim->cur_frame_timestamp += ms_timestep;
+
+    if (anim->cur_frame_timestamp >
+        (anim->prev_frame_timestamp + anim->frame_period_ms)) {
+        anim->current_frame += ((anim->cur_frame_timestamp -
+                                 anim->prev_frame_timestamp) /
+                                anim->frame_period_ms);
+        anim->current_frame %= anim->sequence->frames;
+        anim->prev_frame_timestamp += (((anim->cur_frame_timestamp -
+                                         anim->prev_frame_timestamp) /
+                                        anim->frame_period_ms) *
+                                       anim->frame_period_ms);
+    }
+
+    spritesheet_t *sheet = anim->image->spritesheet;
+    int c_x, c_y;
+
+    spriteFrameOrigin(sheet, anim->sequence, anim->current_frame, &c_x, &c_y);
+
+    return tumDrawQueueImageCrop(sheet->image, x, y, c_x, c_y,
+                                 sheet->sprite_width, sheet->sprite_height);
+
+err:
+    return -1;
+}
+
+animation_manager_handle_t tumDrawAnimationManagerCreate(void)
+{
+    animation_manager_t *ret = calloc(1, sizeof(animation_manager_t));
+
+    if (ret == NULL) {
+        PRINT_ERROR("Allocating animation manager failed");
+    }
+
+    return ret;
+}
+
+void tumDrawAnimationManagerDelete(animation_manager_handle_t manager)
+{
+    animation_manager_t *mgr = (animation_manager_t *)manager;
+
+    if (mgr == NULL) {
+        return;
+    }
+
+    free(mgr->sprites);
+    free(mgr->order);
+    free(mgr->index);
+    free(mgr->free_ids);
+    free(mgr);
+}
+
+static int growAnimationManager(animation_manager_t *mgr)
+{
+    unsigned capacity = mgr->capacity ? mgr->capacity * 2 : 64;
+    animation_manager_sprite_t *sprites;
+    animation_manager_order_t *order;
+    int *index, *free_ids;
+
+    sprites = realloc(mgr->sprites, capacity * sizeof(*sprites));
+    if (sprites == NULL) {
+        return -1;
+    }
+    mgr->sprites = sprites;
+
+    order = realloc(mgr->order, capacity * sizeof(*order));
+    if (order == NULL) {
+        return -1;
+    }
+    mgr->order = order;
+
+    index = realloc(mgr->index, capacity * sizeof(*index));
+    if (index == NULL) {
+        return -1;
+    }
+    mgr->index = index;
+
+    free_ids = realloc(mgr->free_ids, capacity * sizeof(*free_ids));
+    if (free_ids == NULL) {
+        return -1;
+    }
+    mgr->free_ids = free_ids;
+
+    mgr->capacity = capacity;
+
+    return 0;
+}
+
+int tumDrawAnimationManagerAdd(animation_manager_handle_t manager,
+                               animation_handle_t animation,
+                               char *sequence_name, unsigned frame_period_ms,
+                               int x, int y)
+{
+    animation_manager_t *mgr = (animation_manager_t *)manager;
+    animation_manager_sprite_t *sprite;
+    spritesheet_sequence_t *sequence;
+    int id;
+
+    if (mgr == NULL || animation == NULL || sequence_name == NULL) {
+        PRINT_ERROR("Invalid animation manager sprite");
+        return -1;
+    }
+
+    if (frame_period_ms == 0) {
+        PRINT_ERROR("Sequence frame period cannot be zero");
+        return -1;
+    }
+
+    sequence = findSequence((animated_image_t *)animation, sequence_name);
+    if (sequence == NULL) {
+        PRINT_ERROR("Could not find sequence '%s'", sequence_name);
+        return -1;
+    }
+
+    if (mgr->count == mgr->capacity && growAnimationManager(mgr)) {
+        PRINT_ERROR("Growing animation manager failed");
+        return -1;
+    }
+
+    id = mgr->free_count ? mgr->free_ids[--mgr->free_count] : mgr->ids++;
+
+    sprite = &mgr->sprites[mgr->count];
+    sprite->image = (animated_image_t *)animation;
+    sprite->sequence = sequence;
+    sprite->frame_period_ms = frame_period_ms;
+    sprite->current_frame = 0;
+    sprite->elapsed_ms = 0;
+    sprite->x = x;
+    sprite->y = y;
+    sprite->id = id;
+
+    mgr->index[id] = mgr->count++;
+
+    return id;
+}
+
+int tumDrawAnimationManagerRemove(animation_manager_handle_t manager, int id)
+{
+    animation_manager_t *mgr = (animation_manager_t *)manager;
+    int pos;
+
+    if (mgr == NULL || id < 0 || id >= mgr->ids || mgr->index[id] < 0) {
+        return -1;
+    }
+
+    /** The last sprite takes the removed one's place */
+    pos = mgr->index[id];
+    mgr->sprites[pos] = mgr->sprites[--mgr->count];
+    mgr->index[mgr->sprites[pos].id] = pos;
+
+    mgr->index[id] = -1;
+    mgr->free_ids[mgr->free_count++] = id;
+
+    return 0;
+}
+
+int tumDrawAnimationManagerSetPosition(animation_manager_handle_t manager,
+                                       int id, int x, int y)
+{
+    animation_manager_t *mgr = (animation_manager_t *)manager;
+    animation_manager_sprite_t *sprite;
+
+    if (mgr == NULL || id < 0 || id >= mgr->ids || mgr->index[id] < 0) {
+        return -1;
+    }
+
+    sprite = &mgr->sprites[mgr->index[id]];
+    sprite->x = x;
+    sprite->y = y;
+
+    return 0;
+}
+
+void tumDrawAnimationManagerTick(animation_manager_handle_t manager,
+                                 unsigned ms_timestep)
+{
+    animation_manager_t *mgr = (animation_manager_t *)manager;
+    animation_manager_sprite_t *sprite, *end;
+    unsigned steps;
+
+    if (mgr == NULL) {
+        return;
+    }
+
+    for (sprite = mgr->sprites, end = sprite + mgr->count; sprite < end;
+         sprite++) {
+        sprite->elapsed_ms += ms_timestep;
+
+        /** Only divide once a frame actually changes */
+        if (sprite->elapsed_ms < sprite->frame_period_ms) {
+            continue;
+        }
+
+        steps = sprite->elapsed_ms / sprite->frame_period_ms;
+        sprite->elapsed_ms -= steps * sprite->frame_period_ms;
+        sprite->current_frame =
+            (sprite->current_frame + steps) % sprite->sequence->frames;
+    }
+}
+
+static int compareSpriteImage(const void *a, const void *b)
+{
+    const animation_manager_order_t *x = a, *y = b;
+
+    if (x->image != y->image) {
+        return (uintptr_t)x->image < (uintptr_t)y->image ? -1 : 1;
+    }
+
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+static int compareSpriteFirst(const void *a, const void *b)
+{
+    const animation_manager_order_t *x = a, *y = b;
+
+    if (x->first != y->first) {
+        return x->first < y->first ? -1 : 1;
+    }
+
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+int tumDrawAnimationManagerDraw(animation_manager_handle_t manager)
+{
+    animation_manager_t *mgr = (animation_manager_t *)manager;
+    animation_manager_order_t *order;
+    animation_manager_sprite_t *sprite;
+    sprite_batch_item_t *items;
+    spritesheet_t *sheet;
+    unsigned i, j, k;
+
+    if (mgr == NULL) {
+        return -1;
+    }
+
+    if (mgr->count == 0) {
+        return 0;
+    }
+
+    order = mgr->order;
+
+    /**
+     * Sprites are sorted by spritesheet image, then the images by their first
+     * sprite. Each spritesheet is drawn as one batch, as such the sprites of
+     * a spritesheet only keep their order among each other and are all drawn
+     * at the position of its first sprite, above or below the sprites of
+     * other spritesheets as a whole.
+     */
+    for (i = 0; i < mgr->count; i++) {
+        order[i].image = mgr->sprites[i].image->spritesheet->image;
+        order[i].pos = i;
+    }
+    qsort(order, mgr->count, sizeof(*order), compareSpriteImage);
+
+    for (i = 0; i < mgr->count; i++) {
+        order[i].first = i && order[i].image == order[i - 1].image ?
+                         order[i - 1].first : order[i].pos;
+    }
+    qsort(order, mgr->count, sizeof(*order), compareSpriteFirst);
+
+    /** One batch per spritesheet image, owned by its draw job */
+    for (i = 0; i < mgr->count; i = j) {
+        for (j = i + 1; j < mgr->count && order[j].image == order[i].image;
+             j++)
+            ;
+
+        items = malloc((j - i) * sizeof(sprite_batch_item_t));
+        if (items == NULL) {
+            PRINT_ERROR("Allocating sprite batch failed");
+            return -1;
+        }
+
+        for (k = i; k < j; k++) {
+            sprite = &mgr->sprites[order[k].pos];
+            sheet = sprite->image->spritesheet;
+            spriteFrameOrigin(sheet, sprite->sequence, sprite->current_frame,
+                              &items[k - i].src.x, &items[k - i].src.y);
+            items[k - i].src.w = items[k - i].dst.w = sheet->sprite_width;
+            items[k - i].src.h = items[k - i].dst.h = sheet->sprite_height;
+            items[k - i].dst.x = sprite->x;
+            items[k - i].dst.y = sprite->y;
+        }
+
+        if (tumDrawQueueSpriteBatch(order[i].image, items, j - i)) {
+            free(items);
+            return -1;
+        }
+    }
+
+    return 0;
+}
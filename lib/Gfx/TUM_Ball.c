@@ -118,11 +118,14 @@ void setBallSpeed(ball_t *ball, float dx, float dy, float max_speed,
 
 void setBallLocation(ball_t *ball, signed short x, signed short y)
 {
+    int screen_width = tumDrawGetScreenWidth();
+    int screen_height = tumDrawGetScreenHeight();
+
     if (x < ball->radius) {
         SET_BALL_COORD(x, ball->radius);
     }
-    else if (x > SCREEN_WIDTH - ball->radius) {
-        SET_BALL_COORD(x, SCREEN_WIDTH - ball->radius);
+    else if (x > screen_width - ball->radius) {
+        SET_BALL_COORD(x, screen_width - ball->radius);
     }
     else {
         SET_BALL_COORD(x, x)
@@ -131,8 +134,8 @@ void setBallLocation(ball_t *ball, signed short x, signed short y)
     if (y < ball->radius) {
         SET_BALL_COORD(y, ball->radius);
     }
-    else if (y > SCREEN_HEIGHT - ball->radius) {
-        SET_BALL_COORD(y, SCREEN_HEIGHT - ball->radius);
+    else if (y > screen_height - ball->radius) {
+        SET_BALL_COORD(y, screen_height - ball->radius);
     }
     else {
         SET_BALL_COORD(y, y)
@@ -0,0 +1,470 @@
+/**
+ * @file TUM_Capture.c
+ * @brief Frame capture encoder used by TUM Draw
+ *
+ * @verbatim
+   ----------------------------------------------------------------------
+    Copyright (C) Alexander Hoffman, 2019
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+@endverbatim
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL2/SDL.h"
+#include "SDL2/SDL_image.h"
+
+#include "TUM_Capture.h"
+#include "TUM_Stream.h"
+#include "TUM_Utils.h"
+
+#define PNG_NUMBER_LENGTH 16
+
+typedef enum {
+    CAPTURE_OPEN = 0,
+    CAPTURE_CLOSE,
+    CAPTURE_FRAME,
+} capture_job_type_t;
+
+typedef struct capture_job {
+    capture_job_type_t type;
+    tum_capture_frame_t *frame;
+    int flags;
+    char *filename; // Recording to be opened or screenshot to be written
+    tum_capture_format_e format;
+    unsigned int fps;
+    struct capture_job *next;
+} capture_job_t;
+
+static struct {
+    pthread_once_t once;
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // Signalled when a job is queued
+    pthread_cond_t idle; // Signalled once all queued jobs are done
+    capture_job_t *head;
+    capture_job_t *tail;
+    unsigned char busy;
+    unsigned char running;
+    tum_capture_frame_t frames[TUM_DRAW_CAPTURE_BUFFERS];
+    unsigned char in_use[TUM_DRAW_CAPTURE_BUFFERS];
+    atomic_uint dropped;
+} capture = {
+    .once = PTHREAD_ONCE_INIT,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER,
+};
+
+/** The current recording, only used by the encoder thread */
+static struct {
+    unsigned char active;
+    tum_capture_format_e format;
+    char *filename;
+    FILE *file;
+    unsigned int fps;
+    unsigned int count;
+    int w;
+    int h;
+    uint8_t *planes;
+    size_t planes_size;
+} recording = { 0 };
+
+static void closeRecording(void)
+{
+    if (recording.file) {
+        if (fclose(recording.file)) {
+            PRINT_ERROR("Failed to finish recording '%s'", recording.filename);
+        }
+        recording.file = NULL;
+    }
+
+    free(recording.filename);
+    recording.filename = NULL;
+    recording.active = 0;
+}
+
+static void openRecording(capture_job_t *job)
+{
+    closeRecording();
+
+    recording.format = job->format;
+    recording.fps = job->fps ? job->fps : 1;
+    recording.count = 0;
+    recording.filename = job->filename;
+    job->filename = NULL;
+
+    if (recording.format == TUM_CAPTURE_Y4M) {
+        recording.file = fopen(recording.filename, "wb");
+        if (recording.file == NULL) {
+            PRINT_ERROR("Failed to open recording '%s'", recording.filename);
+            return;
+        }
+    }
+
+    recording.active = 1;
+}
+
+static int writePNG(tum_capture_frame_t *frame, const char *filename)
+{
+    SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormatFrom(
+                            frame->pixels, frame->w, frame->h, 32,
+                            frame->w * sizeof(uint32_t),
+                            SDL_PIXELFORMAT_ARGB8888);
+    int ret = 0;
+
+    if (surf == NULL) {
+        PRINT_ERROR("Failed to create surface for '%s'", filename);
+        return -1;
+    }
+
+    if (IMG_SavePNG(surf, filename)) {
+        PRINT_ERROR("Failed to write '%s'", filename);
+        ret = -1;
+    }
+
+    SDL_FreeSurface(surf);
+
+    return ret;
+}
+
+/**
+ * Writes a frame as 4:2:0 YCbCr using BT.601's integer approximation, each
+ * chroma sample averaging a 2x2 block of pixels
+ */
+static int writeY4MFrame(tum_capture_frame_t *frame)
+{
+    int cw = (frame->w + 1) / 2, ch = (frame->h + 1) / 2;
+    size_t size = (size_t)frame->w * frame->h + 2 * (size_t)cw * ch;
+    uint8_t *y_plane, *u_plane, *v_plane, *tmp;
+    unsigned int r, g, b, n;
+    uint32_t pixel;
+    int x, y, dx, dy;
+
+    if (recording.count == 0) {
+        recording.w = frame->w;
+        recording.h = frame->h;
+        fprintf(recording.file, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg\n",
+                recording.w, recording.h, recording.fps);
+    }
+    else if (frame->w != recording.w || frame->h != recording.h) {
+        PRINT_ERROR("Frame size %d x %d differs from recording's %d x %d",
+                    frame->w, frame->h, recording.w, recording.h);
+        return -1;
+    }
+
+    if (recording.planes_size < size) {
+        tmp = realloc(recording.planes, size);
+        if (tmp == NULL) {
+            PRINT_ERROR("Failed to allocate Y4M planes");
+            return -1;
+        }
+        recording.planes = tmp;
+        recording.planes_size = size;
+    }
+
+    y_plane = recording.planes;
+    u_plane = y_plane + (size_t)frame->w * frame->h;
+    v_plane = u_plane + (size_t)cw * ch;
+
+    for (y = 0; y < frame->h; y++)
+        for (x = 0; x < frame->w; x++) {
+            pixel = frame->pixels[y * frame->w + x];
+            r = (pixel >> 16) & 0xFF;
+            g = (pixel >> 8) & 0xFF;
+            b = pixel & 0xFF;
+            y_plane[y * frame->w + x] =
+                ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        }
+
+    for (y = 0; y < ch; y++)
+        for (x = 0; x < cw; x++) {
+            r = g = b = n = 0;
+            for (dy = 0; dy < 2 && 2 * y + dy < frame->h; dy++)
+                for (dx = 0; dx < 2 && 2 * x + dx < frame->w; dx++) {
+                    pixel = frame->pixels[(2 * y + dy) * frame->w + 2 * x +
+                                                       dx];
+                    r += (pixel >> 16) & 0xFF;
+                    g += (pixel >> 8) & 0xFF;
+                    b += pixel & 0xFF;
+                    n++;
+                }
+            r = (r + n / 2) / n;
+            g = (g + n / 2) / n;
+            b = (b + n / 2) / n;
+            /** Offset by 128 * 256 to keep the sums positive */
+            u_plane[y * cw + x] =
+                (32896 + 112 * b - 38 * r - 74 * g) >> 8;
+            v_plane[y * cw + x] =
+                (32896 + 112 * r - 94 * g - 18 * b) >> 8;
+        }
+
+    if (fputs("FRAME\n", recording.file) == EOF ||
+        fwrite(recording.planes, 1, size, recording.file) != size) {
+        PRINT_ERROR("Failed to write to recording '%s'", recording.filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void recordFrame(tum_capture_frame_t *frame)
+{
+    char *filename;
+
+    if (recording.format == TUM_CAPTURE_Y4M) {
+        if (writeY4MFrame(frame) == 0) {
+            recording.count++;
+        }
+        return;
+    }
+
+    filename = malloc(strlen(recording.filename) + PNG_NUMBER_LENGTH);
+    if (filename == NULL) {
+        PRINT_ERROR("Failed to allocate PNG filename");
+        return;
+    }
+
+    sprintf(filename, "%s_%06u.png", recording.filename, recording.count);
+    if (writePNG(frame, filename) == 0) {
+        recording.count++;
+    }
+
+    free(filename);
+}
+
+static void handleCaptureJob(capture_job_t *job)
+{
+    unsigned int i;
+
+    switch (job->type) {
+        case CAPTURE_OPEN:
+            openRecording(job);
+            break;
+        case CAPTURE_CLOSE:
+            closeRecording();
+            break;
+        case CAPTURE_FRAME:
+            /** Screen textures need not be opaque, the frames shown are */
+            for (i = 0; i < (unsigned int)(job->frame->w * job->frame->h);
+                 i++) {
+                job->frame->pixels[i] |= 0xFF000000;
+            }
+            if (job->flags & TUM_CAPTURE_STREAM) {
+                tumStreamPushFrame(job->frame->pixels, job->frame->w,
+                                   job->frame->h);
+            }
+            if ((job->flags & TUM_CAPTURE_RECORD) && recording.active) {
+                recordFrame(job->frame);
+            }
+            if (job->filename) {
+                writePNG(job->frame, job->filename);
+            }
+            tumCaptureReleaseFrame(job->frame);
+            break;
+        default:
+            break;
+    }
+
+    free(job->filename);
+    free(job);
+}
+
+static void *captureThread(void *arg)
+{
+    capture_job_t *job;
+
+    tumUtilBlockSignals();
+
+    for (;;) {
+        pthread_mutex_lock(&capture.lock);
+        while (capture.head == NULL) {
+            capture.busy = 0;
+            pthread_cond_broadcast(&capture.idle);
+            pthread_cond_wait(&capture.cond, &capture.lock);
+        }
+        job = capture.head;
+        capture.head = job->next;
+        if (capture.head == NULL) {
+            capture.tail = NULL;
+        }
+        capture.busy = 1;
+        pthread_mutex_unlock(&capture.lock);
+
+        handleCaptureJob(job);
+    }
+
+    return NULL;
+}
+
+static void startCaptureThread(void)
+{
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, captureThread, NULL)) {
+        PRINT_ERROR("Failed to create capture thread, encoding in place");
+        return;
+    }
+    pthread_detach(thread);
+
+    capture.running = 1;
+}
+
+static void queueCaptureJob(capture_job_t *job)
+{
+    pthread_once(&capture.once, startCaptureThread);
+
+    if (!capture.running) {
+        handleCaptureJob(job);
+        return;
+    }
+
+    pthread_mutex_lock(&capture.lock);
+    if (capture.tail) {
+        capture.tail->next = job;
+    }
+    else {
+        capture.head = job;
+    }
+    capture.tail = job;
+    pthread_cond_signal(&capture.cond);
+    pthread_mutex_unlock(&capture.lock);
+}
+
+int tumCaptureOpen(const char *filename, tum_capture_format_e format,
+                   unsigned int fps)
+{
+    capture_job_t *job;
+
+    if (filename == NULL) {
+        return -1;
+    }
+
+    job = calloc(1, sizeof(capture_job_t));
+    if (job == NULL) {
+        PRINT_ERROR("Failed to allocate capture job");
+        return -1;
+    }
+
+    job->filename = strdup(filename);
+    if (job->filename == NULL) {
+        PRINT_ERROR("Failed to allocate capture job");
+        free(job);
+        return -1;
+    }
+
+    job->type = CAPTURE_OPEN;
+    job->format = format;
+    job->fps = fps;
+
+    queueCaptureJob(job);
+
+    return 0;
+}
+
+void tumCaptureClose(void)
+{
+    capture_job_t *job = calloc(1, sizeof(capture_job_t));
+
+    if (job == NULL) {
+        PRINT_ERROR("Failed to allocate capture job");
+        return;
+    }
+
+    job->type = CAPTURE_CLOSE;
+
+    queueCaptureJob(job);
+}
+
+tum_capture_frame_t *tumCaptureGetFrame(int w, int h)
+{
+    tum_capture_frame_t *frame = NULL;
+    uint32_t *tmp;
+    unsigned int i;
+
+    pthread_mutex_lock(&capture.lock);
+    for (i = 0; i < TUM_DRAW_CAPTURE_BUFFERS; i++)
+        if (!capture.in_use[i]) {
+            capture.in_use[i] = 1;
+            frame = &capture.frames[i];
+            break;
+        }
+    pthread_mutex_unlock(&capture.lock);
+
+    if (frame == NULL) {
+        atomic_fetch_add(&capture.dropped, 1);
+        return NULL;
+    }
+
+    if (frame->capacity < (unsigned int)(w * h)) {
+        tmp = realloc(frame->pixels, w * h * sizeof(uint32_t));
+        if (tmp == NULL) {
+            PRINT_ERROR("Failed to allocate %d x %d capture buffer", w, h);
+            tumCaptureReleaseFrame(frame);
+            atomic_fetch_add(&capture.dropped, 1);
+            return NULL;
+        }
+        frame->pixels = tmp;
+        frame->capacity = w * h;
+    }
+
+    frame->w = w;
+    frame->h = h;
+
+    return frame;
+}
+
+void tumCaptureReleaseFrame(tum_capture_frame_t *frame)
+{
+    pthread_mutex_lock(&capture.lock);
+    capture.in_use[frame - capture.frames] = 0;
+    pthread_mutex_unlock(&capture.lock);
+}
+
+void tumCaptureSubmitFrame(tum_capture_frame_t *frame, int flags,
+                           char *screenshot)
+{
+    capture_job_t *job = calloc(1, sizeof(capture_job_t));
+
+    if (job == NULL) {
+        PRINT_ERROR("Failed to allocate capture job");
+        tumCaptureReleaseFrame(frame);
+        free(screenshot);
+        atomic_fetch_add(&capture.dropped, 1);
+        return;
+    }
+
+    job->type = CAPTURE_FRAME;
+    job->frame = frame;
+    job->flags = flags;
+    job->filename = screenshot;
+
+    queueCaptureJob(job);
+}
+
+unsigned int tumCaptureGetDropped(void)
+{
+    return atomic_load(&capture.dropped);
+}
+
+void tumCaptureFlush(void)
+{
+    pthread_mutex_lock(&capture.lock);
+    while (capture.head || capture.busy) {
+        pthread_cond_wait(&capture.idle, &capture.lock);
+    }
+    pthread_mutex_unlock(&capture.lock);
+}
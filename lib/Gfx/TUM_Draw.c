@@ -22,8 +22,10 @@
 @endverbatim
  */
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL2_gfxPrimitives.h>
@@ -33,6 +35,10 @@
 
 #include "TUM_Draw.h"
 #include "TUM_Font.h"
+#include "TUM_Image.h"
+#include "TUM_Raster.h"
+#include "TUM_Capture.h"
+#include "TUM_Stream.h"
 #include "TUM_Utils.h"
 
 #define ONE_BYTE 8
@@ -49,6 +55,9 @@
 #define BLUE_PORTION(COLOUR) (COLOUR & 0x0000FF)
 #define ZERO_ALPHA 0
 
+/** SDL_RenderGeometry() is needed to batch thick lines and triangles */
+#define HAVE_RENDER_GEOMETRY SDL_VERSION_ATLEAST(2, 0, 18)
+
 typedef enum {
     DRAW_NONE = 0,
     DRAW_CLEAR,
@@ -61,28 +70,61 @@ typedef enum {
     DRAW_LINE,
     DRAW_POLY,
     DRAW_TRIANGLE,
-    DRAW_IMAGE,
     DRAW_LOADED_IMAGE,
     DRAW_LOADED_IMAGE_CROP,
-    DRAW_SCALED_IMAGE,
     DRAW_ARROW,
+    DRAW_SPRITE_BATCH,
+    DRAW_LAYER,
+    DRAW_JOB_TYPES,
 } draw_job_type_t;
 
-typedef struct loaded_image {
-    char *filename;
-    FILE *file;
-    SDL_Texture *tex;
-    SDL_RWops *ops;
-    SDL_Surface *surf;
-    int w;
-    int h;
-    float scale;
-    //TODO make this atomic
-    unsigned int ref_count;
-    unsigned char pending_free;
+_Static_assert(DRAW_JOB_TYPES == TUM_DRAW_JOB_TYPES,
+               "TUM_DRAW_JOB_TYPES must match draw_job_type_t");
+
+static const char *draw_job_type_names[DRAW_JOB_TYPES] = {
+    [DRAW_NONE] = "none",
+    [DRAW_CLEAR] = "clear",
+    [DRAW_ARC] = "arc",
+    [DRAW_ELLIPSE] = "ellipse",
+    [DRAW_TEXT] = "text",
+    [DRAW_RECT] = "rect",
+    [DRAW_FILLED_RECT] = "filled_rect",
+    [DRAW_CIRCLE] = "circle",
+    [DRAW_LINE] = "line",
+    [DRAW_POLY] = "poly",
+    [DRAW_TRIANGLE] = "triangle",
+    [DRAW_LOADED_IMAGE] = "image",
+    [DRAW_LOADED_IMAGE_CROP] = "image_crop",
+    [DRAW_ARROW] = "arrow",
+    [DRAW_SPRITE_BATCH] = "sprite_batch",
+    [DRAW_LAYER] = "layer",
+};
+
+/**
+ * Frame timings. Phases are summed up in phase_ns by whichever thread they
+ * happen in, the drawing thread times the jobs in cur_frame and moves the
+ * finished frame into the frames ring buffer.
+ */
+#define FRAME_DUMP_MAGIC "TUMF"
+#define FRAME_DUMP_VERSION 2
 
-    struct loaded_image *next;
-} loaded_image_t;
+typedef struct frame_dump_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t frame_size;
+    uint32_t count;
+} frame_dump_header_t;
+
+static struct {
+    _Atomic uint64_t phase_ns[TUM_FRAME_PHASES];
+    tum_frame_timing_t cur_frame;
+    uint64_t last_start;
+
+    pthread_mutex_t lock;
+    tum_frame_timing_t frames[TUM_DRAW_FRAME_HISTORY];
+    unsigned int head; // Next frame to be written
+    unsigned int count;
+} frame_timing = { .lock = PTHREAD_MUTEX_INITIALIZER };
 
 typedef struct loaded_image_crop {
     loaded_image_t *image;
@@ -94,39 +136,9 @@ typedef struct loaded_image_crop {
     int c_h;
 } loaded_image_crop_t;
 
-typedef struct spritesheet_sequence {
-    char *name;
-    unsigned start_row;
-    unsigned start_col;
-    enum sprite_sequence_direction direction;
-    unsigned frames;
-    struct spritesheet_sequence *next;
-} spritesheet_sequence_t;
-
-typedef struct spritesheet {
-    loaded_image_t *image;
-    unsigned sprite_width;
-    unsigned sprite_height;
-    unsigned sprite_cols;
-    unsigned sprite_rows;
-} spritesheet_t;
-
-typedef struct animated_image {
-    spritesheet_t *spritesheet;
-    spritesheet_sequence_t *sequences;
-} animated_image_t;
-
-typedef struct animated_sequence_instance {
-    unsigned frame_period_ms;
-    unsigned current_frame;
-    unsigned prev_frame_timestamp;
-    unsigned cur_frame_timestamp;
-    animated_image_t *image;
-    spritesheet_sequence_t *sequence;
-} animated_sequence_instance_t;
-
+/** Colours are unpacked once when a job is queued, see unpackColour() */
 typedef struct clear_data {
-    unsigned int colour;
+    SDL_Color colour;
 } clear_data_t;
 
 typedef struct arc_data {
@@ -135,7 +147,7 @@ typedef struct arc_data {
     signed short radius;
     signed short start;
     signed short end;
-    unsigned int colour;
+    SDL_Color colour;
 } arc_data_t;
 
 typedef struct ellipse_data {
@@ -143,7 +155,7 @@ typedef struct ellipse_data {
     signed short y;
     signed short rx;
     signed short ry;
-    unsigned int colour;
+    SDL_Color colour;
 } ellipse_data_t;
 
 typedef struct rect_data {
@@ -151,14 +163,14 @@ typedef struct rect_data {
     signed short y;
     signed short w;
     signed short h;
-    unsigned int colour;
+    SDL_Color colour;
 } rect_data_t;
 
 typedef struct circle_data {
     signed short x;
     signed short y;
     signed short radius;
-    unsigned int colour;
+    SDL_Color colour;
 } circle_data_t;
 
 typedef struct line_data {
@@ -167,44 +179,46 @@ typedef struct line_data {
     signed short x2;
     signed short y2;
     unsigned char thickness;
-    unsigned int colour;
+    SDL_Color colour;
 } line_data_t;
 
 typedef struct poly_data {
     coord_t *points;
     unsigned int n;
-    unsigned int colour;
+    SDL_Color colour;
 } poly_data_t;
 
 typedef struct triangle_data {
     coord_t *points;
-    unsigned int colour;
+    SDL_Color colour;
 } triangle_data_t;
 
-typedef struct image_data {
-    char *filename;
-    SDL_Texture *tex;
-    signed short x;
-    signed short y;
-} image_data_t;
-
 typedef struct loaded_image_data {
     loaded_image_t *img;
+    float scale;
     signed short x;
     signed short y;
 } loaded_image_data_t;
 
-typedef struct scaled_image_data {
-    image_data_t image;
-    float scale;
-} scaled_image_data_t;
+typedef struct sprite_batch_data {
+    loaded_image_t *image;
+    unsigned count;
+    sprite_batch_item_t *items;
+} sprite_batch_data_t;
+
+typedef struct layer_data {
+    struct draw_layer *layer;
+    signed short x;
+    signed short y;
+} layer_data_t;
 
 typedef struct text_data {
     char *str;
     signed short x;
     signed short y;
-    unsigned int colour;
-    TTF_Font *font;
+    SDL_Color colour;
+    font_handle_t font;
+    SDL_Surface *surf; // Rendered text, used by software rendering
 } text_data_t;
 
 typedef struct arrow_data {
@@ -214,7 +228,7 @@ typedef struct arrow_data {
     signed short y2;
     signed short head_length;
     unsigned char thickness;
-    unsigned int colour;
+    SDL_Color colour;
 } arrow_data_t;
 
 union data_u {
@@ -226,16 +240,17 @@ union data_u {
     line_data_t line;
     poly_data_t poly;
     triangle_data_t triangle;
-    image_data_t image;
     loaded_image_data_t loaded_image;
     loaded_image_crop_t loaded_image_crop;
-    scaled_image_data_t scaled_image;
     text_data_t text;
     arrow_data_t arrow;
+    sprite_batch_data_t sprite_batch;
+    layer_data_t layer;
 };
 
 typedef struct draw_job {
     draw_job_type_t type;
+    tum_blend_mode_e blend;
     union data_u *data;
 
     struct draw_job *next;
@@ -243,6 +258,214 @@ typedef struct draw_job {
 
 draw_job_t job_list_head = { 0 };
 
+/**
+ * Render-to-texture layer. Jobs recorded by a task between tumDrawLayerBegin()
+ * and tumDrawLayerEnd() are handed over through pending and kept in jobs, from
+ * which the drawing thread renders them into tex whenever the layer is dirty.
+ */
+typedef struct draw_layer {
+    SDL_Texture *tex;
+    int w;
+    int h;
+    draw_job_t recording; // Owned by the recording task
+    draw_job_t *recording_tail;
+    draw_job_t *pending;
+    unsigned char has_pending;
+    draw_job_t *jobs; // Owned by the drawing thread
+    atomic_uint dirty;
+    atomic_uint generation; // Bumped whenever the layer's content changes
+    atomic_uint ref_count; // Queued DRAW_LAYER jobs
+    unsigned char deleted;
+    pthread_mutex_t lock;
+    struct draw_layer *next;
+} draw_layer_t;
+
+static pthread_mutex_t layers_lock = PTHREAD_MUTEX_INITIALIZER;
+static draw_layer_t *layers = NULL;
+
+/** Layer being recorded by the calling task, if any */
+static __thread draw_layer_t *recording_layer = NULL;
+
+/** Blend mode of the jobs queued by the calling task */
+static __thread tum_blend_mode_e blend_mode = TUM_BLEND_BLEND;
+
+static const SDL_BlendMode sdl_blend_modes[] = {
+    [TUM_BLEND_BLEND] = SDL_BLENDMODE_BLEND,
+    [TUM_BLEND_NONE] = SDL_BLENDMODE_NONE,
+    [TUM_BLEND_ADD] = SDL_BLENDMODE_ADD,
+};
+
+#define STATE_BLEND 0x1
+#define STATE_COLOUR 0x2
+
+/**
+ * Blend mode of the job being rendered and a cache of the renderer's state,
+ * which is only changed when it differs between jobs. SDL2_gfx sets its own
+ * draw colour and blend mode with every primitive, see gfxColour(). The cache
+ * is invalidated at the start of each frame.
+ */
+static struct {
+    tum_blend_mode_e job;
+    unsigned char valid; // STATE_* known to be set
+    SDL_BlendMode blend;
+    SDL_Color colour;
+    SDL_Texture *texture; // Last texture drawn, NULL if unknown
+    SDL_BlendMode texture_blend;
+} render_state = { 0 };
+
+/**
+ * Logical resolution that is drawn in, the window's size and the scale frames
+ * are rendered at. Requested changes are applied by the drawing thread at the
+ * start of the next frame, such that a frame is drawn at a single resolution.
+ */
+static struct {
+    pthread_mutex_t lock;
+    int width; // Requested, as seen through tumDrawGetScreenWidth()
+    int height;
+    int window_width;
+    int window_height;
+    float scale;
+    unsigned char changed;
+    int w; // Applied, only used by the drawing thread
+    int h;
+    int render_w;
+    int render_h;
+    SDL_Texture *tex; // Low resolution screen, NULL if rendering at full scale
+} resolution = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .width = SCREEN_WIDTH,
+    .height = SCREEN_HEIGHT,
+    .window_width = SCREEN_WIDTH,
+    .window_height = SCREEN_HEIGHT,
+    .scale = 1.0,
+    .changed = 1,
+    .w = SCREEN_WIDTH,
+    .h = SCREEN_HEIGHT,
+    .render_w = SCREEN_WIDTH,
+    .render_h = SCREEN_HEIGHT,
+};
+
+/**
+ * Frame capture, frames are copied on the GPU into a ring of textures and only
+ * read back delay frames later, by when the GPU has finished rendering them
+ */
+#define CAPTURE_RING (TUM_DRAW_CAPTURE_MAX_DELAY + 1)
+
+typedef struct capture_slot {
+    SDL_Texture *tex;
+    int w;
+    int h;
+    int flags;
+    char *screenshot;
+} capture_slot_t;
+
+static struct {
+    pthread_mutex_t lock;
+    unsigned int session; // Set by each tumDrawCaptureStart(), 0 if stopped
+    unsigned int sessions;
+    char *filename;
+    tum_capture_format_e format;
+    unsigned int delay;
+    char *screenshot; // PNG file the next frame is written to
+    unsigned int open; // Session being recorded, drawing thread only
+    unsigned int open_delay;
+    capture_slot_t ring[CAPTURE_RING];
+    unsigned int head;
+    unsigned int pending;
+} frame_capture = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/** Reused by tumDrawDuplicateBuffer() */
+static struct {
+    uint32_t *pixels;
+    int w;
+    int h;
+    SDL_Texture *tex;
+} duplicate = { 0 };
+
+/**
+ * Retained mode, a frame's jobs are compared against the previous frame's and
+ * only the areas that changed are rendered again into a persistent texture
+ */
+typedef struct retained_job {
+    draw_job_t *job;
+    SDL_Rect bounds;
+    unsigned int hash;
+} retained_job_t;
+
+static struct {
+    atomic_uint enabled;
+    SDL_Texture *tex;
+    retained_job_t *frame;
+    retained_job_t *prev_frame;
+    unsigned int count;
+    unsigned int prev_count;
+    unsigned int capacity;
+    SDL_Rect damage[TUM_DRAW_DAMAGE_RECTS];
+    unsigned int damage_count;
+} retained = { 0 };
+
+/**
+ * Sorting of a frame's jobs by the state they need, see sortDrawJobs(). A
+ * job's state is the texture or layer it draws, its blend mode and colour.
+ */
+typedef struct sort_job {
+    draw_job_t *job;
+    SDL_Rect bounds;
+    const void *texture; // Image, atlas page or layer
+    SDL_Color colour;
+} sort_job_t;
+
+static struct {
+    atomic_uint enabled;
+    sort_job_t *jobs;
+    unsigned int *order; // Indices into jobs in the order they are drawn
+    unsigned int capacity;
+} job_sort = { 0 };
+
+/**
+ * Software rendering, the frame's jobs are rasterized into pixels on the CPU,
+ * split into tiles that are rasterized in parallel by the raster workers and
+ * the drawing thread. Each tile replays, in order and clipped to the tile, the
+ * jobs binned to it as their bounds intersect it. As no job can touch a pixel
+ * outside of its bounds the result is the same as replaying all jobs serially.
+ */
+typedef struct raster_bin {
+    unsigned int *jobs; // Indices into software.jobs, ascending
+    unsigned int count;
+    unsigned int capacity;
+} raster_bin_t;
+
+static struct {
+    atomic_uint enabled;
+    uint32_t *pixels;
+    SDL_Texture *tex;
+    pthread_mutex_t lock; // Protects pixels against readers
+    draw_job_t **jobs;
+    unsigned int count;
+    unsigned int capacity;
+    int x_offset;
+    int y_offset;
+    int w; // Size of pixels, the logical resolution when it was allocated
+    int h;
+    raster_bin_t *bins; // One per tile, NULL replays all jobs in each tile
+} software = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static struct {
+    pthread_once_t once;
+    unsigned int threads;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned int generation; // Incremented for each frame to be rasterized
+    unsigned int busy; // Workers still rasterizing the current frame
+    raster_bin_t *bins; // Bins of the current frame, if binned
+    atomic_uint next_tile;
+} raster_pool = { .once = PTHREAD_ONCE_INIT,
+                  .lock = PTHREAD_MUTEX_INITIALIZER,
+                  .start = PTHREAD_COND_INITIALIZER,
+                  .done = PTHREAD_COND_INITIALIZER
+                };
+
 struct global_offsets {
     int x;
     int y;
@@ -253,24 +476,121 @@ struct global_offsets global_offset = {
     .lock = PTHREAD_MUTEX_INITIALIZER,
 };
 
-pthread_mutex_t loaded_images_lock = PTHREAD_MUTEX_INITIALIZER;
-loaded_image_t loaded_images_list = { 0 };
-
-const int screen_height = SCREEN_HEIGHT;
-const int screen_width = SCREEN_WIDTH;
-
 SDL_Window *window = NULL;
 SDL_Renderer *renderer = NULL;
+/** Set by tumDrawInitHeadless(), there is no window or renderer */
+static unsigned char headless = 0;
 SDL_GLContext context = NULL;
 
 char *error_message = NULL;
 
-static uint32_t SwapBytes(unsigned int x)
+/** Unpacks an AARRGGBB colour as passed to the API, see TUM_ALPHA() */
+static SDL_Color unpackColour(unsigned int colour)
+{
+    SDL_Color ret = { RED_PORTION(colour), GREEN_PORTION(colour),
+                      BLUE_PORTION(colour),
+                      (colour & FOURTH_BYTE) >> THREE_BYTES
+                    };
+
+    if (ret.a == ZERO_ALPHA) {
+        ret.a = ALPHA_SOLID;
+    }
+
+    return ret;
+}
+
+/** Colour as used by software rendering */
+static uint32_t argbColour(SDL_Color colour)
+{
+    return (uint32_t)colour.a << THREE_BYTES |
+           (uint32_t)colour.r << TWO_BYTES | (uint32_t)colour.g << ONE_BYTE |
+           colour.b;
+}
+
+static void countStateChanges(unsigned int changed, unsigned int avoided)
+{
+    frame_timing.cur_frame.state_changes += changed;
+    frame_timing.cur_frame.state_changes_avoided += avoided;
+}
+
+static void invalidateRenderState(void)
+{
+    render_state.valid = 0;
+    render_state.texture = NULL;
+}
+
+static void setDrawBlendMode(SDL_BlendMode mode)
+{
+    if ((render_state.valid & STATE_BLEND) && render_state.blend == mode) {
+        countStateChanges(0, 1);
+        return;
+    }
+
+    SDL_SetRenderDrawBlendMode(renderer, mode);
+    render_state.blend = mode;
+    render_state.valid |= STATE_BLEND;
+    countStateChanges(1, 0);
+}
+
+static void setRenderColour(SDL_Color colour)
+{
+    if ((render_state.valid & STATE_COLOUR) &&
+        !memcmp(&render_state.colour, &colour, sizeof(colour))) {
+        countStateChanges(0, 1);
+        return;
+    }
+
+    SDL_SetRenderDrawColor(renderer, colour.r, colour.g, colour.b, colour.a);
+    render_state.colour = colour;
+    render_state.valid |= STATE_COLOUR;
+    countStateChanges(1, 0);
+}
+
+/** Sets the renderer's draw colour and blend mode for an SDL primitive */
+static void setDrawColour(SDL_Color colour)
+{
+    setRenderColour(colour);
+    setDrawBlendMode(sdl_blend_modes[render_state.job]);
+}
+
+/**
+ * Colour passed to SDL2_gfx, which draws opaque colours unblended and blends
+ * all others. Replacing is thus done by drawing opaque, adding is not possible.
+ * SDL2_gfx sets both the colour and blend mode, whether they changed or not.
+ */
+static SDL_Color gfxColour(SDL_Color colour)
+{
+    if (render_state.job == TUM_BLEND_NONE) {
+        colour.a = ALPHA_SOLID;
+    }
+
+    render_state.blend = colour.a == ALPHA_SOLID ? SDL_BLENDMODE_NONE
+                         : SDL_BLENDMODE_BLEND;
+    render_state.colour = colour;
+    render_state.valid |= STATE_BLEND | STATE_COLOUR;
+    countStateChanges(2, 0);
+
+    return colour;
+}
+
+/**
+ * Prepares a texture to be copied using the current job's blend mode.
+ * Consecutive copies from one texture are batched by SDL, a change of texture
+ * is thus counted as a state change as well.
+ */
+static void bindTexture(SDL_Texture *tex)
 {
-    return ((x & FIRST_BYTE) << THREE_BYTES) +
-           ((x & SECOND_BYTE) << ONE_BYTE) +
-           ((x & THIRD_BYTE) >> ONE_BYTE) +
-           ((x & FOURTH_BYTE) >> THREE_BYTES);
+    SDL_BlendMode mode = sdl_blend_modes[render_state.job];
+
+    if (render_state.texture == tex && render_state.texture_blend == mode) {
+        countStateChanges(0, 1);
+        return;
+    }
+
+    SDL_SetTextureBlendMode(tex, mode);
+    render_state.texture = tex;
+    render_state.texture_blend = mode;
+    countStateChanges(1, 0);
 }
 
 void setErrorMessage(char *msg)
@@ -293,17 +613,27 @@ void setErrorMessage(char *msg)
 static draw_job_t *pushDrawJob(void)
 {
     draw_job_t *iterator;
+    uint64_t start = tumUtilGetTimeNs();
     draw_job_t *job = calloc(1, sizeof(draw_job_t));
     if (job == NULL) {
         return NULL;
     }
 
+    if (recording_layer) {
+        recording_layer->recording_tail->next = job;
+        recording_layer->recording_tail = job;
+        goto out;
+    }
+
     for (iterator = &job_list_head; iterator->next;
          iterator = iterator->next)
         ;
 
     iterator->next = job;
 
+out:
+    tumDrawAddFrameTime(TUM_FRAME_RECORD, tumUtilGetTimeNs() - start);
+
     return job;
 }
 
@@ -323,353 +653,543 @@ static draw_job_t *popDrawJob(void)
     return ret;
 }
 
-static int _clearDisplay(unsigned int colour)
+/**
+ * Cache of the runs of pixels making up circles, ellipses and arcs, relative
+ * to their centre. A shape is rasterized once, exactly as software rendering
+ * would, and from then on drawn using a single SDL_RenderFillRects(). Only
+ * used by the drawing thread, the least recently used shape is evicted once
+ * TUM_DRAW_SHAPE_CACHE_SIZE shapes are cached.
+ */
+typedef enum {
+    SHAPE_CIRCLE = 0,
+    SHAPE_ELLIPSE,
+    SHAPE_ARC,
+} shape_type_t;
+
+#define SHAPE_CACHE_BUCKETS 64
+
+typedef struct shape {
+    shape_type_t type;
+    int params[3]; // Radius, radii or radius and normalized angles
+    SDL_Rect *rects;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned char failed;
+    struct shape *hash_next;
+    struct shape *lru_prev;
+    struct shape *lru_next;
+} shape_t;
+
+static struct {
+    shape_t *buckets[SHAPE_CACHE_BUCKETS];
+    shape_t *lru_head; // Most recently used
+    shape_t *lru_tail;
+    unsigned int count;
+    SDL_Rect *scratch; // Rects moved to where a shape is drawn
+    unsigned int scratch_capacity;
+} shape_cache = { 0 };
+
+static unsigned int shapeBucket(shape_type_t type, const int *params)
 {
-    SDL_SetRenderDrawColor(renderer, (colour >> 16) & 0xFF,
-                           (colour >> 8) & 0xFF, colour & 0xFF,
-                           ALPHA_SOLID);
-    SDL_RenderClear(renderer);
+    unsigned int hash = type, i;
 
-    return 0;
+    for (i = 0; i < 3; i++) {
+        hash = hash * 31 + (unsigned int)params[i];
+    }
+
+    return hash % SHAPE_CACHE_BUCKETS;
 }
 
-static int _drawRectangle(signed short x, signed short y, signed short w,
-                          signed short h, unsigned int colour)
+static void shapeLRURemove(shape_t *shape)
 {
-    rectangleColor(renderer, x + w, y, x, y + h,
-                   SwapBytes((colour << ONE_BYTE) | ALPHA_SOLID));
+    if (shape->lru_prev) {
+        shape->lru_prev->lru_next = shape->lru_next;
+    }
+    else {
+        shape_cache.lru_head = shape->lru_next;
+    }
 
-    return 0;
+    if (shape->lru_next) {
+        shape->lru_next->lru_prev = shape->lru_prev;
+    }
+    else {
+        shape_cache.lru_tail = shape->lru_prev;
+    }
 }
 
-static int _drawFilledRectangle(signed short x, signed short y, signed short w,
-                                signed short h, unsigned int colour)
+static void shapeLRUInsert(shape_t *shape)
 {
-    boxColor(renderer, x + w, y, x, y + h,
-             SwapBytes((colour << ONE_BYTE) | ALPHA_SOLID));
+    shape->lru_prev = NULL;
+    shape->lru_next = shape_cache.lru_head;
 
-    return 0;
+    if (shape_cache.lru_head) {
+        shape_cache.lru_head->lru_prev = shape;
+    }
+    else {
+        shape_cache.lru_tail = shape;
+    }
+    shape_cache.lru_head = shape;
 }
 
-static int _drawArc(signed short x, signed short y, signed short radius,
-                    signed short start, signed short end, unsigned int colour)
+static void freeShape(shape_t *shape)
 {
-    arcColor(renderer, x, y, radius, start, end,
-             SwapBytes((colour << ONE_BYTE) | ALPHA_SOLID));
+    shape_t **iterator =
+        &shape_cache.buckets[shapeBucket(shape->type, shape->params)];
 
-    return 0;
+    for (; *iterator; iterator = &(*iterator)->hash_next)
+        if (*iterator == shape) {
+            *iterator = shape->hash_next;
+            break;
+        }
+
+    shapeLRURemove(shape);
+    shape_cache.count--;
+    free(shape->rects);
+    free(shape);
 }
 
-static int _drawEllipse(signed short x, signed short y, signed short rx,
-                        signed short ry, unsigned int colour)
+/** Rows of equal runs are merged, eg. a circle's flat top and bottom */
+static void recordShapeRun(int x0, int x1, int y, void *arg)
 {
-    ellipseColor(renderer, x, y, rx, ry,
-                 SwapBytes((colour << ONE_BYTE) | ALPHA_SOLID));
+    shape_t *shape = arg;
+    SDL_Rect *last = shape->count ? &shape->rects[shape->count - 1] : NULL;
+    SDL_Rect *tmp;
 
-    return 0;
+    if (last && last->x == x0 && last->w == x1 - x0 &&
+        last->y + last->h == y) {
+        last->h++;
+        return;
+    }
+
+    if (shape->count == shape->capacity) {
+        tmp = realloc(shape->rects, (shape->capacity ? 2 * shape->capacity
+                                     : 64) * sizeof(SDL_Rect));
+        if (tmp == NULL) {
+            shape->failed = 1;
+            return;
+        }
+        shape->rects = tmp;
+        shape->capacity = shape->capacity ? 2 * shape->capacity : 64;
+    }
+
+    shape->rects[shape->count++] = (SDL_Rect) {
+        x0, y, x1 - x0, 1
+    };
 }
 
-static int _drawCircle(signed short x, signed short y, signed short radius,
-                       unsigned int colour)
+/**
+ * Gets a shape from the cache, rasterizing it if missing. NULL if the shape
+ * is too large to be cached or could not be rasterized.
+ */
+static shape_t *getShape(shape_type_t type, int a, int b, int c)
 {
-    filledCircleColor(renderer, x, y, radius,
-                      SwapBytes((colour << ONE_BYTE) | ALPHA_SOLID));
+    tum_raster_target_t target = {
+        .clip_x0 = -TUM_DRAW_SHAPE_MAX_RADIUS - 1,
+        .clip_y0 = -TUM_DRAW_SHAPE_MAX_RADIUS - 1,
+        .clip_x1 = TUM_DRAW_SHAPE_MAX_RADIUS + 2,
+        .clip_y1 = TUM_DRAW_SHAPE_MAX_RADIUS + 2,
+        .record = recordShapeRun,
+    };
+    int params[3] = { a, b, c };
+    unsigned int bucket;
+    shape_t *shape;
+
+    if (a < 0 || a > TUM_DRAW_SHAPE_MAX_RADIUS ||
+        (type == SHAPE_ELLIPSE && (b < 0 || b > TUM_DRAW_SHAPE_MAX_RADIUS))) {
+        return NULL;
+    }
 
-    return 0;
+    bucket = shapeBucket(type, params);
+
+    for (shape = shape_cache.buckets[bucket]; shape; shape = shape->hash_next)
+        if (shape->type == type && !memcmp(shape->params, params,
+                                           sizeof(params))) {
+            shapeLRURemove(shape);
+            shapeLRUInsert(shape);
+            return shape;
+        }
+
+    if (shape_cache.count >= TUM_DRAW_SHAPE_CACHE_SIZE) {
+        freeShape(shape_cache.lru_tail);
+    }
+
+    shape = calloc(1, sizeof(shape_t));
+    if (shape == NULL) {
+        PRINT_ERROR("Failed to allocate shape");
+        return NULL;
+    }
+    shape->type = type;
+    memcpy(shape->params, params, sizeof(params));
+    target.record_arg = shape;
+
+    switch (type) {
+        case SHAPE_CIRCLE:
+            tumRasterFilledCircle(&target, 0, 0, a, 0);
+            break;
+        case SHAPE_ELLIPSE:
+            tumRasterEllipse(&target, 0, 0, a, b, 0);
+            break;
+        case SHAPE_ARC:
+            tumRasterArc(&target, 0, 0, a, b, c, 0);
+            break;
+    }
+
+    if (shape->failed) {
+        PRINT_ERROR("Failed to rasterize shape");
+        free(shape->rects);
+        free(shape);
+        return NULL;
+    }
+
+    shape->hash_next = shape_cache.buckets[bucket];
+    shape_cache.buckets[bucket] = shape;
+    shapeLRUInsert(shape);
+    shape_cache.count++;
+
+    return shape;
 }
 
-static int _drawLine(signed short x1, signed short y1, signed short x2,
-                     signed short y2, unsigned char thickness,
-                     unsigned int colour)
+static int drawShape(shape_t *shape, int x, int y, SDL_Color colour)
+{
+    SDL_Rect *tmp;
+    unsigned int i;
+
+    if (shape->count > shape_cache.scratch_capacity) {
+        tmp = realloc(shape_cache.scratch, shape->count * sizeof(SDL_Rect));
+        if (tmp == NULL) {
+            PRINT_ERROR("Failed to grow shape buffer");
+            return -1;
+        }
+        shape_cache.scratch = tmp;
+        shape_cache.scratch_capacity = shape->count;
+    }
+
+    for (i = 0; i < shape->count; i++) {
+        shape_cache.scratch[i] = shape->rects[i];
+        shape_cache.scratch[i].x += x;
+        shape_cache.scratch[i].y += y;
+    }
+
+    setDrawColour(colour);
+
+    return SDL_RenderFillRects(renderer, shape_cache.scratch, shape->count);
+}
+
+#if HAVE_RENDER_GEOMETRY
+/**
+ * Thick lines and triangles of consecutive jobs sharing a blend mode, drawn
+ * using a single SDL_RenderGeometry() by flushGeometry() before anything else
+ * is drawn
+ */
+static struct {
+    SDL_Vertex *vertices;
+    int *indices;
+    unsigned int vertex_count;
+    unsigned int index_count;
+    unsigned int vertex_capacity;
+    unsigned int index_capacity;
+    tum_blend_mode_e blend;
+} geometry = { 0 };
+#endif //HAVE_RENDER_GEOMETRY
+
+/** Must be called before anything but batched geometry is drawn */
+static int flushGeometry(void)
 {
-    thickLineColor(renderer, x1, y1, x2, y2, thickness,
-                   SwapBytes((colour << ONE_BYTE) | ALPHA_SOLID));
+#if HAVE_RENDER_GEOMETRY
+    int ret;
+
+    if (geometry.vertex_count == 0) {
+        return 0;
+    }
+
+    setDrawBlendMode(sdl_blend_modes[geometry.blend]);
+    ret = SDL_RenderGeometry(renderer, NULL, geometry.vertices,
+                             geometry.vertex_count, geometry.indices,
+                             geometry.index_count);
+    if (ret) {
+        PRINT_SDL_ERROR("Failed to draw lines and triangles");
+    }
+    geometry.vertex_count = 0;
+    geometry.index_count = 0;
 
+    return ret;
+#else
     return 0;
+#endif //HAVE_RENDER_GEOMETRY
 }
 
-static int _drawPoly(coord_t *points, unsigned int n, int x_offset,
-                     int y_offset, signed short colour)
+#if HAVE_RENDER_GEOMETRY
+/**
+ * Adds a triangle or a quad, whose corners are given in order around it, to
+ * the batch, using the current job's blend mode
+ */
+static int addGeometry(const SDL_FPoint *corners, unsigned int n,
+                       SDL_Color colour)
 {
-    signed short *x_coords = calloc(1, sizeof(signed short) * n);
-    signed short *y_coords = calloc(1, sizeof(signed short) * n);
-    unsigned int i;
+    static const int quad[6] = { 0, 1, 2, 0, 2, 3 };
+    SDL_Vertex *vertices;
+    unsigned int i, capacity, index_count = n == 4 ? 6 : 3;
+    int *indices;
+
+    if (geometry.vertex_count && geometry.blend != render_state.job) {
+        flushGeometry();
+    }
+    geometry.blend = render_state.job;
 
-    for (i = 0; i < n; i++) {
-        x_coords[i] = points[i].x + x_offset;
-        y_coords[i] = points[i].y + y_offset;
+    if (geometry.vertex_count + n > geometry.vertex_capacity) {
+        capacity = geometry.vertex_capacity ? 2 * geometry.vertex_capacity
+                   : 256;
+        vertices = realloc(geometry.vertices, capacity * sizeof(SDL_Vertex));
+        if (vertices == NULL) {
+            return -1;
+        }
+        geometry.vertices = vertices;
+        geometry.vertex_capacity = capacity;
+    }
+    if (geometry.index_count + index_count > geometry.index_capacity) {
+        capacity = geometry.index_capacity ? 2 * geometry.index_capacity
+                   : 384;
+        indices = realloc(geometry.indices, capacity * sizeof(int));
+        if (indices == NULL) {
+            return -1;
+        }
+        geometry.indices = indices;
+        geometry.index_capacity = capacity;
     }
 
-    polygonColor(renderer, x_coords, y_coords, n,
-                 SwapBytes((colour << ONE_BYTE) | ALPHA_SOLID));
+    for (i = 0; i < index_count; i++)
+        geometry.indices[geometry.index_count++] =
+            geometry.vertex_count + quad[i];
 
-    free(x_coords);
-    free(y_coords);
+    for (i = 0; i < n; i++)
+        geometry.vertices[geometry.vertex_count++] = (SDL_Vertex) {
+        .position = corners[i], .color = colour
+    };
 
     return 0;
 }
+#endif //HAVE_RENDER_GEOMETRY
 
-static int _drawTriangle(coord_t *points, int x_offset, int y_offset,
-                         unsigned int colour)
+static int _clearDisplay(SDL_Color colour)
 {
-    filledTrigonColor(renderer, points[0].x + x_offset,
-                      points[0].y + y_offset, points[1].x + x_offset,
-                      points[1].y + y_offset, points[2].x + x_offset,
-                      points[2].y + y_offset,
-                      SwapBytes((colour << ONE_BYTE) | ALPHA_SOLID));
+    setRenderColour(colour);
+    SDL_RenderClear(renderer);
 
     return 0;
 }
 
-static SDL_Texture *loadImage(char *filename, SDL_Renderer *ren)
+/** Rectangles span x to x + w inclusive, as drawn by SDL2_gfx before */
+static SDL_Rect rectangleArea(int x, int y, int w, int h)
 {
-    SDL_Texture *tex =  IMG_LoadTexture(ren, tumUtilFindResourcePath(filename));
+    SDL_Rect rect = { w < 0 ? x + w : x, h < 0 ? y + h : y, abs(w) + 1,
+                      abs(h) + 1
+                    };
 
-    return tex;
+    return rect;
 }
 
-static int _renderCroppedImage(SDL_Texture *tex, SDL_Renderer *ren,
-                               signed short x, signed short y, signed short c_x,
-                               signed short c_y, int w, int h)
+static int _drawRectangle(signed short x, signed short y, signed short w,
+                          signed short h, SDL_Color colour)
 {
-    SDL_Rect src, dst;
-    src.x = c_x;
-    src.y = c_y;
-    src.w = w;
-    src.h = h;
-    dst.x = x;
-    dst.y = y;
-    dst.w = w;
-    dst.h = h;
-    return SDL_RenderCopy(ren, tex, &src, &dst);
+    SDL_Rect rect = rectangleArea(x, y, w, h);
+
+    setDrawColour(colour);
+
+    return SDL_RenderDrawRect(renderer, &rect);
 }
 
-static int _renderScaledImage(SDL_Texture *tex, SDL_Renderer *ren,
-                              signed short x, signed short y, int w, int h)
+static int _drawFilledRectangle(signed short x, signed short y, signed short w,
+                                signed short h, SDL_Color colour)
 {
-    SDL_Rect dst;
-    dst.w = w;
-    dst.h = h;
-    dst.x = x;
-    dst.y = y;
-    return SDL_RenderCopy(ren, tex, NULL, &dst);
+    SDL_Rect rect = rectangleArea(x, y, w, h);
+
+    setDrawColour(colour);
+
+    return SDL_RenderFillRect(renderer, &rect);
 }
 
-static int _getImageSize(char *filename, int *w, int *h)
+static int _drawArc(signed short x, signed short y, signed short radius,
+                    signed short start, signed short end, SDL_Color colour)
 {
-    SDL_Texture *tex = loadImage(filename, renderer);
-    if (tex == NULL) {
-        return -1;
+    shape_t *shape = getShape(SHAPE_ARC, radius, ((start % 360) + 360) % 360,
+                              ((end % 360) + 360) % 360);
+
+    if (shape) {
+        return drawShape(shape, x, y, colour);
     }
-    SDL_QueryTexture(tex, NULL, NULL, w, h);
-    SDL_DestroyTexture(tex);
+
+    colour = gfxColour(colour);
+    arcRGBA(renderer, x, y, radius, start, end, colour.r, colour.g, colour.b,
+            colour.a);
 
     return 0;
 }
 
-animation_handle_t tumDrawAnimationCreate(image_handle_t spritesheet,
-        unsigned sprite_cols,
-        unsigned sprite_rows)
+static int _drawEllipse(signed short x, signed short y, signed short rx,
+                        signed short ry, SDL_Color colour)
 {
-    if (spritesheet == NULL) {
-        PRINT_ERROR("Creating animation requires a valid spritesheet");
-        goto err;
+    shape_t *shape = getShape(SHAPE_ELLIPSE, rx, ry, 0);
+
+    if (shape) {
+        return drawShape(shape, x, y, colour);
     }
 
-    if (sprite_cols == 0) {
-        PRINT_ERROR("Spritesheet cols are not valid");
-        goto err;
-    }
-
-    if (sprite_rows == 0) {
-        PRINT_ERROR("Spritesheet rows are not valid");
-        goto err;
-    }
-
-    animated_image_t *ret = calloc(1, sizeof(animated_image_t));
+    colour = gfxColour(colour);
+    ellipseRGBA(renderer, x, y, rx, ry, colour.r, colour.g, colour.b,
+                colour.a);
 
-    if (ret == NULL) {
-        PRINT_ERROR("Allocating animation failed");
-        goto err;
-    }
+    return 0;
+}
 
-    ret->spritesheet = calloc(1, sizeof(spritesheet_t));
+static int _drawCircle(signed short x, signed short y, signed short radius,
+                       SDL_Color colour)
+{
+    shape_t *shape = getShape(SHAPE_CIRCLE, radius, 0, 0);
 
-    if (ret->spritesheet == NULL) {
-        PRINT_ERROR("Could not allocate spritesheet");
-        goto err_spritesheet;
+    if (shape) {
+        return drawShape(shape, x, y, colour);
     }
 
-    ret->spritesheet->image = spritesheet;
-    ret->spritesheet->sprite_cols = sprite_cols;
-    ret->spritesheet->sprite_rows = sprite_rows;
-    ret->spritesheet->sprite_width =
-        ret->spritesheet->image->w / sprite_cols;
-    ret->spritesheet->sprite_height =
-        ret->spritesheet->image->h / sprite_rows;
-
-    return (void *)ret;
+    colour = gfxColour(colour);
+    filledCircleRGBA(renderer, x, y, radius, colour.r, colour.g, colour.b,
+                     colour.a);
 
-err_spritesheet:
-    free(ret);
-err:
-    return NULL;
+    return 0;
 }
 
-int tumDrawAnimationAddSequence(
-    animation_handle_t animation, char *name, unsigned start_row,
-    unsigned start_col,
-    enum sprite_sequence_direction sprite_step_direction, unsigned frames)
+/**
+ * Thick lines are expanded into quads around the line between the pixel
+ * centres, with flat ends as drawn by SDL2_gfx, and batched
+ */
+static int _drawLine(signed short x1, signed short y1, signed short x2,
+                     signed short y2, unsigned char thickness,
+                     SDL_Color colour)
 {
-    if (animation == NULL) {
-        PRINT_ERROR("Animation handle is not valid");
-        goto err;
-    }
-
-    if (name == NULL) {
-        PRINT_ERROR("Sequence requires a valid name");
-        goto err;
-    }
-
-    animated_image_t *anim = (animated_image_t *)animation;
-
-    spritesheet_sequence_t *seq = calloc(1, sizeof(spritesheet_sequence_t));
-    if (seq == NULL) {
-        PRINT_ERROR("Could not allocate animation sequence");
-        goto err;
+    SDL_Rect square = { x1 - thickness / 2, y1 - thickness / 2, thickness,
+                        thickness
+                      };
+#if HAVE_RENDER_GEOMETRY
+    SDL_FPoint corners[4];
+    float dx = x2 - x1, dy = y2 - y1, len, nx, ny;
+#endif //HAVE_RENDER_GEOMETRY
+
+    if (thickness <= 1) {
+        flushGeometry();
+        setDrawColour(colour);
+        return SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
     }
 
-    seq->name = strdup(name);
-    if (seq->name == NULL) {
-        PRINT_ERROR("Could not allocate sequence name");
-        goto err_name;
+    /** A line without direction has no normal, drawn as by software */
+    if (x1 == x2 && y1 == y2) {
+        flushGeometry();
+        setDrawColour(colour);
+        return SDL_RenderFillRect(renderer, &square);
     }
 
-    seq->start_row = start_row;
-    seq->start_col = start_col;
-    seq->direction = sprite_step_direction;
-    seq->frames = frames;
-
-    if (anim->sequences == NULL) {
-        anim->sequences = seq;
+#if HAVE_RENDER_GEOMETRY
+    len = sqrtf(dx * dx + dy * dy);
+    nx = -dy * thickness / (2 * len);
+    ny = dx * thickness / (2 * len);
+
+    corners[0] = (SDL_FPoint) {
+        x1 + 0.5f + nx, y1 + 0.5f + ny
+    };
+    corners[1] = (SDL_FPoint) {
+        x2 + 0.5f + nx, y2 + 0.5f + ny
+    };
+    corners[2] = (SDL_FPoint) {
+        x2 + 0.5f - nx, y2 + 0.5f - ny
+    };
+    corners[3] = (SDL_FPoint) {
+        x1 + 0.5f - nx, y1 + 0.5f - ny
+    };
+
+    if (!addGeometry(corners, 4, colour)) {
+        return 0;
     }
-    else {
-        spritesheet_sequence_t *iterator = anim->sequences;
+#endif //HAVE_RENDER_GEOMETRY
 
-        for (; iterator->next; iterator = iterator->next)
-            ;
-        iterator->next = seq;
-    }
+    flushGeometry();
+    colour = gfxColour(colour);
+    thickLineRGBA(renderer, x1, y1, x2, y2, thickness, colour.r, colour.g,
+                  colour.b, colour.a);
 
     return 0;
-
-err_name:
-    free(seq);
-err:
-    return -1;
 }
 
-sequence_handle_t
-tumDrawAnimationSequenceInstantiate(animation_handle_t animation,
-                                    char *sequence_name,
-                                    unsigned frame_period_ms)
+static int _drawPoly(coord_t *points, unsigned int n, int x_offset,
+                     int y_offset, SDL_Color colour)
 {
-    if (animation == NULL) {
-        PRINT_ERROR(
-            "Animation provided for sequence instantiation was invalid");
-        goto err;
-    }
+    SDL_Point *outline;
+    unsigned int i;
+    int ret;
 
-    if (sequence_name == NULL) {
-        PRINT_ERROR("Sequence name is invalid");
-        goto err;
+    if (n == 0) {
+        return 0;
     }
 
-    if (frame_period_ms == 0) {
-        PRINT_ERROR("Sequence frame period cannot be zero");
-        goto err;
+    /** Closed by repeating the first corner */
+    outline = malloc((n + 1) * sizeof(SDL_Point));
+    if (outline == NULL) {
+        PRINT_ERROR("Failed to allocate polygon outline");
+        return -1;
     }
 
-    animated_sequence_instance_t *ret =
-        calloc(1, sizeof(animated_sequence_instance_t));
-    if (ret == NULL) {
-        PRINT_ERROR("Could not create sequence '%s' instance",
-                    sequence_name);
-        goto err;
+    for (i = 0; i <= n; i++) {
+        outline[i].x = points[i % n].x + x_offset;
+        outline[i].y = points[i % n].y + y_offset;
     }
 
-    ret->image = (animated_image_t *)animation;
-
-    spritesheet_sequence_t *iterator;
+    setDrawColour(colour);
+    ret = SDL_RenderDrawLines(renderer, outline, n + 1);
 
-    for (iterator = ret->image->sequences; iterator;
-         iterator = iterator->next)
-        if (!strcmp(iterator->name, sequence_name)) {
-            ret->sequence = iterator;
-            break;
-        }
-
-    if (ret->sequence == NULL) {
-        PRINT_ERROR("Could not find sequence '%s'", sequence_name);
-        goto err_sequence;
-    }
-
-    ret->frame_period_ms = frame_period_ms;
+    free(outline);
 
     return ret;
-
-err_sequence:
-    free(ret);
-err:
-    return NULL;
 }
 
-static int freeLoadedImage(loaded_image_t **img)
+static int _drawTriangle(coord_t *points, int x_offset, int y_offset,
+                         SDL_Color colour)
 {
-    int ret = -1;
-
-    pthread_mutex_lock(&loaded_images_lock);
-    loaded_image_t *iterator = &loaded_images_list;
-    loaded_image_t *delete;
-
-    for (; iterator->next; iterator = iterator->next)
-        if (iterator->next == *img) {
-            break;
-        }
-
-    if (iterator->next == *img) {
-        delete = iterator->next;
-
-        if (!iterator->next->next) {
-            iterator->next = NULL;
-        }
-        else {
-            iterator->next = delete->next;
-        }
+#if HAVE_RENDER_GEOMETRY
+    SDL_FPoint corners[3];
+    unsigned int i;
 
-        SDL_FreeSurface(delete->surf);
-        SDL_RWclose(delete->ops);
-        SDL_DestroyTexture(delete->tex);
-        free(delete->filename);
-        free(delete);
-        *img = (loaded_image_t *)NULL;
+    for (i = 0; i < 3; i++)
+        corners[i] = (SDL_FPoint) {
+        points[i].x + x_offset + 0.5f, points[i].y + y_offset + 0.5f
+    };
 
-        ret = 0;
+    if (!addGeometry(corners, 3, colour)) {
+        return 0;
     }
-    pthread_mutex_unlock(&loaded_images_lock);
+#endif //HAVE_RENDER_GEOMETRY
 
-    return ret;
+    flushGeometry();
+    colour = gfxColour(colour);
+    filledTrigonRGBA(renderer, points[0].x + x_offset,
+                     points[0].y + y_offset, points[1].x + x_offset,
+                     points[1].y + y_offset, points[2].x + x_offset,
+                     points[2].y + y_offset, colour.r, colour.g, colour.b,
+                     colour.a);
+
+    return 0;
 }
 
-static void vPutLoadedImage(image_handle_t img)
+static int _renderCroppedImage(SDL_Texture *tex, SDL_Renderer *ren,
+                               signed short x, signed short y, signed short c_x,
+                               signed short c_y, int w, int h)
 {
-    loaded_image_t *loaded_img = (loaded_image_t *)img;
-
-    loaded_img->ref_count--;
-
-    if (loaded_img->pending_free && !loaded_img->ref_count) {
-        freeLoadedImage((loaded_image_t **)&img);
-    }
+    SDL_Rect src, dst;
+    src.x = c_x;
+    src.y = c_y;
+    src.w = w;
+    src.h = h;
+    dst.x = x;
+    dst.y = y;
+    dst.w = w;
+    dst.h = h;
+    return SDL_RenderCopy(ren, tex, &src, &dst);
 }
 
 int xDrawLoadedImageCropped(loaded_image_t *img, SDL_Renderer *ren,
@@ -677,55 +1197,81 @@ int xDrawLoadedImageCropped(loaded_image_t *img, SDL_Renderer *ren,
                             signed short c_y, signed short c_w,
                             signed short c_h)
 {
-    return _renderCroppedImage(img->tex, ren, x, y, c_x, c_y, c_w, c_h);
-}
+    /** Images that are still loading are not drawn */
+    if (atomic_load(&img->state) != IMAGE_READY) {
+        return 0;
+    }
 
-int xDrawLoadedImage(loaded_image_t *img, SDL_Renderer *ren, signed short x,
-                     signed short y)
-{
-    return _renderScaledImage(img->tex, ren, x, y, img->w * img->scale,
-                              img->h * img->scale);
+    bindTexture(tumImageGetTexture(img));
+
+    return _renderCroppedImage(tumImageGetTexture(img), ren, x, y,
+                               img->src.x + c_x, img->src.y + c_y, c_w, c_h);
 }
 
-static int _drawScaledImage(SDL_Texture *tex, SDL_Renderer *ren, signed short x,
-                            signed short y, float scale)
+int xDrawLoadedImage(loaded_image_t *img, float scale, SDL_Renderer *ren,
+                     signed short x, signed short y)
 {
-    int w, h;
-    SDL_QueryTexture(tex, NULL, NULL, &w, &h);
-    if (!w || !h) {
-        return -1;
-    }
+    SDL_Rect dst = { .x = x,
+                     .y = y,
+                     .w = img->w * scale,
+                     .h = img->h * scale };
 
-    if (_renderScaledImage(tex, ren, x, y, w * scale, h * scale)) {
-        return -1;
+    if (atomic_load(&img->state) != IMAGE_READY) {
+        return 0;
     }
 
-    SDL_DestroyTexture(tex);
+    bindTexture(tumImageGetTexture(img));
 
-    return 0;
+    return SDL_RenderCopy(ren, tumImageGetTexture(img), &img->src, &dst);
 }
 
-static int _drawImage(SDL_Texture *tex, SDL_Renderer *ren, signed short x,
-                      signed short y)
+static int _drawSpriteBatch(sprite_batch_data_t *batch, int x_offset,
+                            int y_offset)
 {
-    return _drawScaledImage(tex, ren, x, y, 1);
+    SDL_Texture *tex = tumImageGetTexture(batch->image);
+    SDL_Rect src, dst;
+    unsigned i;
+
+    if (atomic_load(&batch->image->state) != IMAGE_READY) {
+        return 0;
+    }
+
+    bindTexture(tex);
+
+    /** Consecutive copies of one texture are merged by SDL's batching */
+    for (i = 0; i < batch->count; i++) {
+        src = batch->items[i].src;
+        src.x += batch->image->src.x;
+        src.y += batch->image->src.y;
+        dst = batch->items[i].dst;
+        dst.x += x_offset;
+        dst.y += y_offset;
+
+        if (SDL_RenderCopy(renderer, tex, &src, &dst)) {
+            return -1;
+        }
+    }
+
+    return 0;
 }
 
 static int _drawText(char *string, signed short x, signed short y,
-                     unsigned int colour, TTF_Font *font)
+                     SDL_Color colour, font_handle_t font)
 {
-    SDL_Color color = { RED_PORTION(colour), GREEN_PORTION(colour),
-                        BLUE_PORTION(colour), ZERO_ALPHA
-                      };
-    SDL_Surface *surface = TTF_RenderText_Solid(font, string, color);
-    tumFontPutFont(font);
+    SDL_Color color = { colour.r, colour.g, colour.b, ALPHA_SOLID };
+    SDL_Surface *surface =
+        TTF_RenderText_Solid(tumFontGetFont(font), string, color);
     SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
     SDL_Rect dst = { 0 };
     SDL_QueryTexture(texture, NULL, NULL, &dst.w, &dst.h);
     dst.x = x;
     dst.y = y;
+    SDL_SetTextureAlphaMod(texture, colour.a);
+    bindTexture(texture);
     SDL_RenderCopy(renderer, texture, NULL, &dst);
     SDL_DestroyTexture(texture);
+    /** A texture created next might reuse the address */
+    render_state.texture = NULL;
     SDL_FreeSurface(surface);
 
     return 0;
@@ -734,9 +1280,10 @@ static int _drawText(char *string, signed short x, signed short y,
 static int _getTextSize(char *string, int *width, int *height)
 {
     SDL_Color color = { 0 };
-    TTF_Font *font = tumFontGetCurFont();
-    SDL_Surface *surface = TTF_RenderText_Solid(font, string, color);
-    tumFontPutFont(font);
+    font_handle_t font = tumFontGetCurFontHandle();
+    SDL_Surface *surface =
+        TTF_RenderText_Solid(tumFontGetFont(font), string, color);
+    tumFontPutFontHandle(font);
     if (surface == NULL) {
         goto err_surface;
     }
@@ -763,9 +1310,10 @@ err_surface:
     return -1;
 }
 
-static int _drawArrow(signed short x1, signed short y1, signed short x2,
+/** Ends of the two lines forming an arrow's head, shared by both renderers */
+static void arrowHead(signed short x1, signed short y1, signed short x2,
                       signed short y2, signed short head_length,
-                      unsigned char thickness, unsigned int colour)
+                      coord_t head[2])
 {
     // Line vector
     unsigned short dx = x2 - x1;
@@ -776,52 +1324,178 @@ static int _drawArrow(signed short x1, signed short y1, signed short x2,
     signed short unit_dx = (signed short)(dx / length);
     signed short unit_dy = (signed short)(dy / length);
 
-    signed short head_x1 =
-        roundf(x2 - unit_dx * head_length - unit_dy * head_length);
-    signed short head_y1 =
-        roundf(y2 - unit_dy * head_length + unit_dx * head_length);
+    head[0].x = roundf(x2 - unit_dx * head_length - unit_dy * head_length);
+    head[0].y = roundf(y2 - unit_dy * head_length + unit_dx * head_length);
+
+    head[1].x = roundf(x2 - unit_dx * head_length + unit_dy * head_length);
+    head[1].y = roundf(y2 - unit_dy * head_length - unit_dx * head_length);
+}
+
+static int _drawArrow(signed short x1, signed short y1, signed short x2,
+                      signed short y2, signed short head_length,
+                      unsigned char thickness, SDL_Color colour)
+{
+    coord_t head[2];
+    unsigned int i;
 
-    signed short head_x2 =
-        roundf(x2 - unit_dx * head_length + unit_dy * head_length);
-    signed short head_y2 =
-        roundf(y2 - unit_dy * head_length - unit_dx * head_length);
+    arrowHead(x1, y1, x2, y2, head_length, head);
 
-    if (thickLineColor(renderer, x1, y1, x2, y2, thickness,
-                       SwapBytes((colour << ONE_BYTE) | ALPHA_SOLID))) {
+    if (_drawLine(x1, y1, x2, y2, thickness, colour)) {
         return -1;
     }
-    if (thickLineColor(renderer, head_x1, head_y1, x2, y2, thickness,
-                       SwapBytes((colour << ONE_BYTE) | ALPHA_SOLID))) {
-        return -1;
+
+    for (i = 0; i < 2; i++)
+        if (_drawLine(head[i].x, head[i].y, x2, y2, thickness, colour)) {
+            return -1;
+        }
+
+    return 0;
+}
+
+static int renderDrawJob(draw_job_t *job, int x_offset, int y_offset);
+static void releaseDrawJobList(draw_job_t *head);
+
+/** Replaces the layer's jobs with its last finished recording, if any */
+static void adoptLayerRecording(draw_layer_t *layer)
+{
+    draw_job_t *old_jobs = NULL;
+
+    pthread_mutex_lock(&layer->lock);
+    if (layer->has_pending) {
+        old_jobs = layer->jobs;
+        layer->jobs = layer->pending;
+        layer->pending = NULL;
+        layer->has_pending = 0;
+        atomic_store(&layer->dirty, 1);
     }
-    if (thickLineColor(renderer, head_x2, head_y2, x2, y2, thickness,
-                       SwapBytes((colour << ONE_BYTE) | ALPHA_SOLID))) {
+    pthread_mutex_unlock(&layer->lock);
+
+    releaseDrawJobList(old_jobs);
+}
+
+/**
+ * Renders to a texture standing in for the screen, or to the window if NULL.
+ * Changing the target resets the render scale, which maps the logical
+ * resolution onto the texture's.
+ */
+static int setScreenTarget(SDL_Texture *tex)
+{
+    if (SDL_SetRenderTarget(renderer, tex)) {
         return -1;
     }
 
+    if (tex) {
+        return SDL_RenderSetScale(renderer,
+                                  (float)resolution.render_w / resolution.w,
+                                  (float)resolution.render_h / resolution.h);
+    }
+
     return 0;
 }
 
-static int vHandleDrawJob(draw_job_t *job)
+static int _drawLayer(draw_layer_t *layer, signed short x, signed short y)
 {
+    SDL_Rect dst = { .x = x, .y = y, .w = layer->w, .h = layer->h };
+    tum_blend_mode_e mode = render_state.job;
+    draw_job_t *job;
     int ret = 0;
-    static int x_offset = 0;
-    static int y_offset = 0;
-    ;
-    if (!pthread_mutex_unlock(&global_offset.lock)) {
-        x_offset = global_offset.x;
-        y_offset = global_offset.y;
+
+    adoptLayerRecording(layer);
+
+    if (layer->tex == NULL) {
+        layer->tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                       SDL_TEXTUREACCESS_TARGET, layer->w,
+                                       layer->h);
+        if (layer->tex == NULL) {
+            PRINT_SDL_ERROR("Failed to create layer texture");
+            return -1;
+        }
+        SDL_SetTextureBlendMode(layer->tex, SDL_BLENDMODE_BLEND);
+        atomic_store(&layer->dirty, 1);
     }
-    else {
-        return -1;
+
+    if (atomic_exchange(&layer->dirty, 0)) {
+        /** The retained mode's screen texture might be the current target */
+        SDL_Texture *target = SDL_GetRenderTarget(renderer);
+        SDL_bool clipped = SDL_RenderIsClipEnabled(renderer);
+        SDL_Rect clip;
+
+        SDL_RenderGetClipRect(renderer, &clip);
+
+        if (SDL_SetRenderTarget(renderer, layer->tex)) {
+            PRINT_SDL_ERROR("Failed to render to layer");
+            return -1;
+        }
+
+        setRenderColour((SDL_Color) {
+            0, 0, 0, ZERO_ALPHA
+        });
+        SDL_RenderClear(renderer);
+
+        for (job = layer->jobs; job; job = job->next)
+            if (renderDrawJob(job, 0, 0)) {
+                ret = -1;
+            }
+        if (flushGeometry()) {
+            ret = -1;
+        }
+
+        setScreenTarget(target);
+        SDL_RenderSetClipRect(renderer, clipped ? &clip : NULL);
+        render_state.job = mode;
     }
 
-    if (job == NULL) {
-        return -1;
+    bindTexture(layer->tex);
+
+    if (SDL_RenderCopy(renderer, layer->tex, NULL, &dst)) {
+        ret = -1;
     }
 
-    if (job->data == NULL) {
-        return -1;
+    return ret;
+}
+
+/**
+ * Frees deleted layers once no queued job uses them, must be called from the
+ * drawing thread once all of a frame's jobs are done
+ */
+static void collectDeletedLayers(void)
+{
+    draw_layer_t **iterator, *layer;
+
+    pthread_mutex_lock(&layers_lock);
+
+    for (iterator = &layers; *iterator;) {
+        layer = *iterator;
+        if (!layer->deleted || atomic_load(&layer->ref_count)) {
+            iterator = &layer->next;
+            continue;
+        }
+
+        *iterator = layer->next;
+
+        releaseDrawJobList(layer->jobs);
+        releaseDrawJobList(layer->pending);
+        if (layer->tex) {
+            SDL_DestroyTexture(layer->tex);
+        }
+        pthread_mutex_destroy(&layer->lock);
+        free(layer);
+    }
+
+    pthread_mutex_unlock(&layers_lock);
+}
+
+/** Renders a job without consuming it, see releaseDrawJob() */
+static int renderDrawJob(draw_job_t *job, int x_offset, int y_offset)
+{
+    int ret = 0;
+
+    render_state.job = job->blend;
+
+    /** Anything but lines and triangles is drawn over the batched ones */
+    if (job->type != DRAW_LINE && job->type != DRAW_ARROW &&
+        job->type != DRAW_TRIANGLE) {
+        flushGeometry();
     }
 
     switch (job->type) {
@@ -836,7 +1510,8 @@ static int vHandleDrawJob(draw_job_t *job)
             break;
         case DRAW_ELLIPSE:
             ret = _drawEllipse(job->data->ellipse.x + x_offset,
-                               job->data->ellipse.y, job->data->ellipse.rx,
+                               job->data->ellipse.y + y_offset,
+                               job->data->ellipse.rx,
                                job->data->ellipse.ry,
                                job->data->ellipse.colour);
             break;
@@ -845,7 +1520,6 @@ static int vHandleDrawJob(draw_job_t *job)
                             job->data->text.x + x_offset,
                             job->data->text.y + y_offset,
                             job->data->text.colour, job->data->text.font);
-            free(job->data->text.str);
             break;
         case DRAW_RECT:
             ret = _drawRectangle(job->data->rect.x + x_offset,
@@ -881,18 +1555,11 @@ static int vHandleDrawJob(draw_job_t *job)
             ret = _drawTriangle(job->data->triangle.points, x_offset,
                                 y_offset, job->data->triangle.colour);
             break;
-        case DRAW_IMAGE:
-            job->data->image.tex =
-                loadImage(job->data->image.filename, renderer);
-            ret = _drawImage(job->data->image.tex, renderer,
-                             job->data->image.x + x_offset,
-                             job->data->image.y + y_offset);
-            break;
         case DRAW_LOADED_IMAGE:
-            ret = xDrawLoadedImage(job->data->loaded_image.img, renderer,
+            ret = xDrawLoadedImage(job->data->loaded_image.img,
+                                   job->data->loaded_image.scale, renderer,
                                    job->data->loaded_image.x + x_offset,
                                    job->data->loaded_image.y + y_offset);
-            vPutLoadedImage(job->data->loaded_image.img);
             break;
         case DRAW_LOADED_IMAGE_CROP:
             ret = xDrawLoadedImageCropped(
@@ -903,17 +1570,15 @@ static int vHandleDrawJob(draw_job_t *job)
                       job->data->loaded_image_crop.c_y,
                       job->data->loaded_image_crop.c_w,
                       job->data->loaded_image_crop.c_h);
-            vPutLoadedImage(job->data->loaded_image_crop.image);
-            break;
-        case DRAW_SCALED_IMAGE:
-            job->data->scaled_image.image.tex = loadImage(
-                                                    job->data->scaled_image.image.filename, renderer);
-            ret = _drawScaledImage(
-                      job->data->scaled_image.image.tex, renderer,
-                      job->data->scaled_image.image.x + x_offset,
-                      job->data->scaled_image.image.y + y_offset,
-                      job->data->scaled_image.scale);
-            free(job->data->scaled_image.image.filename);
+            break;
+        case DRAW_SPRITE_BATCH:
+            ret = _drawSpriteBatch(&job->data->sprite_batch, x_offset,
+                                   y_offset);
+            break;
+        case DRAW_LAYER:
+            ret = _drawLayer(job->data->layer.layer,
+                             job->data->layer.x + x_offset,
+                             job->data->layer.y + y_offset);
             break;
         case DRAW_ARROW:
             ret = _drawArrow(job->data->arrow.x1 + x_offset,
@@ -926,7 +1591,91 @@ static int vHandleDrawJob(draw_job_t *job)
         default:
             break;
     }
+
+    return ret;
+}
+
+/** Frees a job's data and drops the references it holds */
+static void releaseDrawJob(draw_job_t *job)
+{
+    switch (job->type) {
+        case DRAW_TEXT:
+            free(job->data->text.str);
+            SDL_FreeSurface(job->data->text.surf);
+            tumFontPutFontHandle(job->data->text.font);
+            break;
+        case DRAW_POLY:
+            free(job->data->poly.points);
+            break;
+        case DRAW_TRIANGLE:
+            free(job->data->triangle.points);
+            break;
+        case DRAW_LOADED_IMAGE:
+            tumImagePut(job->data->loaded_image.img);
+            break;
+        case DRAW_LOADED_IMAGE_CROP:
+            tumImagePut(job->data->loaded_image_crop.image);
+            break;
+        case DRAW_SPRITE_BATCH:
+            tumImagePut(job->data->sprite_batch.image);
+            free(job->data->sprite_batch.items);
+            break;
+        case DRAW_LAYER:
+            atomic_fetch_sub(&job->data->layer.layer->ref_count, 1);
+            break;
+        default:
+            break;
+    }
     free(job->data);
+}
+
+static void releaseDrawJobList(draw_job_t *head)
+{
+    draw_job_t *job;
+
+    while ((job = head) != NULL) {
+        head = job->next;
+        releaseDrawJob(job);
+        free(job);
+    }
+}
+
+/** renderDrawJob(), timed into the current frame's job timings */
+static int renderTimedDrawJob(draw_job_t *job, int x_offset, int y_offset)
+{
+    uint64_t start = tumUtilGetTimeNs();
+    int ret = renderDrawJob(job, x_offset, y_offset);
+
+    frame_timing.cur_frame.job_ns[job->type] += tumUtilGetTimeNs() - start;
+    frame_timing.cur_frame.job_count[job->type]++;
+
+    return ret;
+}
+
+static int vHandleDrawJob(draw_job_t *job)
+{
+    int ret = 0;
+    static int x_offset = 0;
+    static int y_offset = 0;
+    ;
+    if (!pthread_mutex_unlock(&global_offset.lock)) {
+        x_offset = global_offset.x;
+        y_offset = global_offset.y;
+    }
+    else {
+        return -1;
+    }
+
+    if (job == NULL) {
+        return -1;
+    }
+
+    if (job->data == NULL) {
+        return -1;
+    }
+
+    ret = renderTimedDrawJob(job, x_offset, y_offset);
+    releaseDrawJob(job);
 
     return ret;
 }
@@ -939,7 +1688,8 @@ static int vHandleDrawJob(draw_job_t *job)
     if (data == NULL)                                                      \
         logCriticalError("job->data alloc");                           \
     JOB->data = data;                                                      \
-    JOB->type = TYPE;
+    JOB->type = TYPE;                                                      \
+    JOB->blend = blend_mode;
 
 static void logCriticalError(char *msg)
 {
@@ -971,23 +1721,1413 @@ static float timespecDiffMilli(struct timespec *start, struct timespec *stop)
 #define FRAMELIMIT_PERIOD 1000.0 / FRAMELIMIT
 #endif //configFPS_LIMIT
 
-int tumDrawUpdateScreen(void)
+static unsigned int hashBytes(unsigned int hash, const void *bytes,
+                              size_t len)
 {
-    if (tumUtilIsCurGLThread()) {
-        PRINT_ERROR(
-            "Updating screen from thread that does not hold GL context");
-        goto err;
-    }
-
-#if (configFPS_LIMIT == 1)
-    static struct timespec last_time = { 0 }, cur_time = { 0 };
+    const unsigned char *b = bytes;
 
-    if (clock_gettime(CLOCK_MONOTONIC, &cur_time)) {
-        PRINT_ERROR("Failed to get monotonic clock");
-        goto err;
+    while (len--) {
+        hash = (hash ^ *b++) * 16777619U;
     }
 
-    if (timespecDiffMilli(&last_time, &cur_time) < (float)FRAMELIMIT_PERIOD) {
+    return hash;
+}
+
+/**
+ * Hashes everything that determines what a job draws. Pointers to per job
+ * copies are left out of the hash in favour of the data they point to.
+ */
+static unsigned int hashDrawJob(draw_job_t *job, int x_offset, int y_offset)
+{
+    union data_u data;
+    unsigned int hash = 2166136261U; // FNV-1a
+    unsigned int extra = 0;
+    int state;
+
+    memcpy(&data, job->data, sizeof(data));
+
+    switch (job->type) {
+        case DRAW_TEXT:
+            hash = hashBytes(hash, data.text.str, strlen(data.text.str));
+            data.text.str = NULL;
+            data.text.surf = NULL;
+            break;
+        case DRAW_POLY:
+            hash = hashBytes(hash, data.poly.points,
+                             data.poly.n * sizeof(coord_t));
+            data.poly.points = NULL;
+            break;
+        case DRAW_TRIANGLE:
+            hash = hashBytes(hash, data.triangle.points, 3 * sizeof(coord_t));
+            data.triangle.points = NULL;
+            break;
+        case DRAW_SPRITE_BATCH:
+            hash = hashBytes(hash, data.sprite_batch.items,
+                             data.sprite_batch.count *
+                             sizeof(sprite_batch_item_t));
+            data.sprite_batch.items = NULL;
+            state = atomic_load(&data.sprite_batch.image->state);
+            hash = hashBytes(hash, &state, sizeof(state));
+            break;
+        case DRAW_LOADED_IMAGE:
+            state = atomic_load(&data.loaded_image.img->state);
+            hash = hashBytes(hash, &state, sizeof(state));
+            break;
+        case DRAW_LOADED_IMAGE_CROP:
+            state = atomic_load(&data.loaded_image_crop.image->state);
+            hash = hashBytes(hash, &state, sizeof(state));
+            break;
+        case DRAW_LAYER:
+            /**
+             * A recording or invalidation landing after this is adopted
+             * while drawing, possibly clipped to other damage, but its
+             * generation then differs next frame, repainting all of it
+             */
+            extra = atomic_load(&data.layer.layer->generation);
+            hash = hashBytes(hash, &extra, sizeof(extra));
+            extra = data.layer.layer->tex == NULL;
+            hash = hashBytes(hash, &extra, sizeof(extra));
+            break;
+        default:
+            break;
+    }
+
+    hash = hashBytes(hash, &job->type, sizeof(job->type));
+    hash = hashBytes(hash, &job->blend, sizeof(job->blend));
+    hash = hashBytes(hash, &x_offset, sizeof(x_offset));
+    hash = hashBytes(hash, &y_offset, sizeof(y_offset));
+
+    return hashBytes(hash, &data, sizeof(data));
+}
+
+static void pointsBounds(coord_t *points, unsigned int n, SDL_Rect *bounds)
+{
+    int min_x = points[0].x, max_x = points[0].x;
+    int min_y = points[0].y, max_y = points[0].y;
+    unsigned int i;
+
+    for (i = 1; i < n; i++) {
+        min_x = points[i].x < min_x ? points[i].x : min_x;
+        max_x = points[i].x > max_x ? points[i].x : max_x;
+        min_y = points[i].y < min_y ? points[i].y : min_y;
+        max_y = points[i].y > max_y ? points[i].y : max_y;
+    }
+
+    *bounds = (SDL_Rect) {
+        min_x, min_y, max_x - min_x + 1, max_y - min_y + 1
+    };
+}
+
+static void lineBounds(int x1, int y1, int x2, int y2, int margin,
+                       SDL_Rect *bounds)
+{
+    bounds->x = (x1 < x2 ? x1 : x2) - margin;
+    bounds->y = (y1 < y2 ? y1 : y2) - margin;
+    bounds->w = abs(x2 - x1) + 2 * margin + 1;
+    bounds->h = abs(y2 - y1) + 2 * margin + 1;
+}
+
+/** Screen area a job can touch, without offsets. Empty if nothing is drawn. */
+static void drawJobBounds(draw_job_t *job, SDL_Rect *bounds)
+{
+    union data_u *data = job->data;
+    coord_t points[4];
+    loaded_image_t *img;
+    unsigned int i;
+    SDL_Rect dst;
+
+    *bounds = (SDL_Rect) {
+        0
+    };
+
+    switch (job->type) {
+        case DRAW_CLEAR:
+            *bounds = (SDL_Rect) {
+                0, 0, resolution.w, resolution.h
+            };
+            break;
+        case DRAW_ARC:
+            lineBounds(data->arc.x, data->arc.y, data->arc.x, data->arc.y,
+                       data->arc.radius + 1, bounds);
+            break;
+        case DRAW_ELLIPSE:
+            lineBounds(data->ellipse.x - data->ellipse.rx, data->ellipse.y -
+                       data->ellipse.ry, data->ellipse.x + data->ellipse.rx,
+                       data->ellipse.y + data->ellipse.ry, 1, bounds);
+            break;
+        case DRAW_CIRCLE:
+            lineBounds(data->circle.x, data->circle.y, data->circle.x,
+                       data->circle.y, data->circle.radius + 1, bounds);
+            break;
+        case DRAW_RECT:
+        case DRAW_FILLED_RECT:
+            *bounds = rectangleArea(data->rect.x, data->rect.y,
+                                    data->rect.w, data->rect.h);
+            break;
+        case DRAW_LINE:
+            lineBounds(data->line.x1, data->line.y1, data->line.x2,
+                       data->line.y2, data->line.thickness / 2 + 1, bounds);
+            break;
+        case DRAW_ARROW:
+            points[0].x = data->arrow.x1;
+            points[0].y = data->arrow.y1;
+            points[1].x = data->arrow.x2;
+            points[1].y = data->arrow.y2;
+            arrowHead(data->arrow.x1, data->arrow.y1, data->arrow.x2,
+                      data->arrow.y2, data->arrow.head_length, &points[2]);
+            pointsBounds(points, 4, bounds);
+            bounds->x -= data->arrow.thickness / 2 + 1;
+            bounds->y -= data->arrow.thickness / 2 + 1;
+            bounds->w += 2 * (data->arrow.thickness / 2 + 1);
+            bounds->h += 2 * (data->arrow.thickness / 2 + 1);
+            break;
+        case DRAW_POLY:
+            if (data->poly.n) {
+                pointsBounds(data->poly.points, data->poly.n, bounds);
+            }
+            break;
+        case DRAW_TRIANGLE:
+            pointsBounds(data->triangle.points, 3, bounds);
+            break;
+        case DRAW_TEXT:
+            bounds->x = data->text.x;
+            bounds->y = data->text.y;
+            TTF_SizeText(tumFontGetFont(data->text.font), data->text.str,
+                         &bounds->w, &bounds->h);
+            break;
+        case DRAW_LOADED_IMAGE:
+            img = data->loaded_image.img;
+            if (atomic_load(&img->state) == IMAGE_READY) {
+                *bounds = (SDL_Rect) {
+                    data->loaded_image.x, data->loaded_image.y,
+                    img->w * data->loaded_image.scale,
+                    img->h * data->loaded_image.scale
+                };
+            }
+            break;
+        case DRAW_LOADED_IMAGE_CROP:
+            if (atomic_load(&data->loaded_image_crop.image->state) ==
+                IMAGE_READY) {
+                *bounds = (SDL_Rect) {
+                    data->loaded_image_crop.x, data->loaded_image_crop.y,
+                    data->loaded_image_crop.c_w,
+                    data->loaded_image_crop.c_h
+                };
+            }
+            break;
+        case DRAW_SPRITE_BATCH:
+            for (i = 0; i < data->sprite_batch.count; i++) {
+                dst = data->sprite_batch.items[i].dst;
+                if (SDL_RectEmpty(bounds)) {
+                    *bounds = dst;
+                }
+                else {
+                    SDL_UnionRect(bounds, &dst, bounds);
+                }
+            }
+            break;
+        case DRAW_LAYER:
+            *bounds = (SDL_Rect) {
+                data->layer.x, data->layer.y, data->layer.layer->w,
+                data->layer.layer->h
+            };
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Adds a rectangle to the frame's damage, merging it into the damaged
+ * rectangle it grows the least once all TUM_DRAW_DAMAGE_RECTS are used
+ */
+static void addDamage(const SDL_Rect *rect)
+{
+    SDL_Rect screen = { 0, 0, resolution.w, resolution.h };
+    SDL_Rect damage = *rect, merged;
+    unsigned int i, best = 0;
+    long growth, best_growth = -1;
+
+    /** Scaled clip rectangles are rounded, which could miss edge pixels */
+    if (resolution.render_w != resolution.w ||
+        resolution.render_h != resolution.h) {
+        damage.x--;
+        damage.y--;
+        damage.w += 2;
+        damage.h += 2;
+    }
+
+    if (!SDL_IntersectRect(&damage, &screen, &damage)) {
+        return;
+    }
+
+    for (i = 0; i < retained.damage_count; i++) {
+        SDL_UnionRect(&retained.damage[i], &damage, &merged);
+        growth = (long)merged.w * merged.h -
+                 (long)retained.damage[i].w * retained.damage[i].h;
+        if (best_growth < 0 || growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+
+    /** Already covered, or no rectangles left */
+    if (best_growth == 0 ||
+        (best_growth > 0 && retained.damage_count == TUM_DRAW_DAMAGE_RECTS)) {
+        SDL_UnionRect(&retained.damage[best], &damage,
+                      &retained.damage[best]);
+        return;
+    }
+
+    retained.damage[retained.damage_count++] = damage;
+}
+
+/** Applies a resolution change requested since the last frame */
+static void applyResolution(void)
+{
+    int window_w, window_h, cur_w, cur_h;
+    float scale;
+
+    pthread_mutex_lock(&resolution.lock);
+    if (!resolution.changed) {
+        pthread_mutex_unlock(&resolution.lock);
+        return;
+    }
+    resolution.changed = 0;
+    resolution.w = resolution.width;
+    resolution.h = resolution.height;
+    window_w = resolution.window_width;
+    window_h = resolution.window_height;
+    scale = resolution.scale;
+    pthread_mutex_unlock(&resolution.lock);
+
+    if (!headless) {
+        SDL_GetWindowSize(window, &cur_w, &cur_h);
+        if (cur_w != window_w || cur_h != window_h) {
+            SDL_SetWindowSize(window, window_w, window_h);
+        }
+
+        if (SDL_RenderSetLogicalSize(renderer, resolution.w, resolution.h)) {
+            PRINT_SDL_ERROR("Failed to set logical size %d x %d",
+                            resolution.w, resolution.h);
+        }
+    }
+
+    resolution.render_w = resolution.w * scale + 0.5;
+    resolution.render_h = resolution.h * scale + 0.5;
+    if (resolution.render_w < 1) {
+        resolution.render_w = 1;
+    }
+    if (resolution.render_h < 1) {
+        resolution.render_h = 1;
+    }
+
+    /** Screen sized textures are created again at the new size */
+    if (resolution.tex) {
+        SDL_DestroyTexture(resolution.tex);
+        resolution.tex = NULL;
+    }
+    if (retained.tex) {
+        SDL_DestroyTexture(retained.tex);
+        retained.tex = NULL;
+    }
+}
+
+static unsigned char captureWanted(void)
+{
+    unsigned char wanted;
+
+    pthread_mutex_lock(&frame_capture.lock);
+    wanted = frame_capture.session || frame_capture.screenshot;
+    pthread_mutex_unlock(&frame_capture.lock);
+
+    return wanted || tumStreamIsOpen();
+}
+
+/**
+ * Gets the texture a frame is rendered into before being shown in the window,
+ * NULL if rendering straight to the window. Frames are rendered into a texture
+ * when rendering at a lower resolution or when capturing them.
+ */
+static SDL_Texture *screenTexture(void)
+{
+    if (resolution.render_w == resolution.w &&
+        resolution.render_h == resolution.h && !captureWanted()) {
+        return NULL;
+    }
+
+    if (resolution.tex == NULL) {
+        resolution.tex = SDL_CreateTexture(
+                             renderer, SDL_PIXELFORMAT_ARGB8888,
+                             SDL_TEXTUREACCESS_TARGET, resolution.render_w,
+                             resolution.render_h);
+        if (resolution.tex == NULL) {
+            PRINT_SDL_ERROR("Failed to create %d x %d screen texture",
+                            resolution.render_w, resolution.render_h);
+        }
+    }
+
+    return resolution.tex;
+}
+
+static void presentFrame(void)
+{
+    uint64_t start = tumUtilGetTimeNs();
+
+    SDL_RenderPresent(renderer);
+    tumDrawAddFrameTime(TUM_FRAME_PRESENT, tumUtilGetTimeNs() - start);
+}
+
+/**
+ * Shows a texture holding the frame, scaled to the window's logical area with
+ * the letterboxing around it cleared
+ */
+static void presentScreenTexture(SDL_Texture *tex)
+{
+    SDL_SetRenderTarget(renderer, NULL);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, ALPHA_SOLID);
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, tex, NULL, NULL);
+    presentFrame();
+}
+
+/** Streamed frames are read back a frame late, unless recording as well */
+#define STREAM_DELAY 1
+
+#if (configFPS_LIMIT == 1)
+#define CAPTURE_FPS FRAMELIMIT
+#else
+#define CAPTURE_FPS 60
+#endif //configFPS_LIMIT
+
+/** Reads back the oldest captured frame and queues it to be written */
+static void readbackCaptureSlot(void)
+{
+    capture_slot_t *slot =
+        &frame_capture.ring[(frame_capture.head + CAPTURE_RING -
+                             frame_capture.pending) % CAPTURE_RING];
+    tum_capture_frame_t *frame = tumCaptureGetFrame(slot->w, slot->h);
+
+    frame_capture.pending--;
+
+    if (frame == NULL) {
+        if (slot->screenshot) {
+            PRINT_ERROR("Dropped screenshot '%s'", slot->screenshot);
+        }
+        free(slot->screenshot);
+    }
+    else if (SDL_SetRenderTarget(renderer, slot->tex) ||
+             SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888,
+                                  frame->pixels,
+                                  frame->w * sizeof(uint32_t))) {
+        PRINT_SDL_ERROR("Failed to read back captured frame");
+        tumCaptureReleaseFrame(frame);
+        free(slot->screenshot);
+    }
+    else {
+        tumCaptureSubmitFrame(frame, slot->flags, slot->screenshot);
+    }
+
+    slot->screenshot = NULL;
+}
+
+static void flushCaptureRing(void)
+{
+    while (frame_capture.pending) {
+        readbackCaptureSlot();
+    }
+    SDL_SetRenderTarget(renderer, NULL);
+}
+
+/** Follows tumDrawCaptureStart() and tumDrawCaptureStop() */
+static void updateCaptureSession(void)
+{
+    pthread_mutex_lock(&frame_capture.lock);
+
+    if (frame_capture.open && frame_capture.open != frame_capture.session) {
+        flushCaptureRing();
+        tumCaptureClose();
+        frame_capture.open = 0;
+    }
+
+    if (frame_capture.session && !frame_capture.open) {
+        tumCaptureOpen(frame_capture.filename, frame_capture.format,
+                       CAPTURE_FPS);
+        frame_capture.open = frame_capture.session;
+        frame_capture.open_delay = frame_capture.delay;
+    }
+
+    pthread_mutex_unlock(&frame_capture.lock);
+}
+
+/** Takes the requested screenshot, if any, and gets what the frame is for */
+static int takeCaptureFlags(char **screenshot)
+{
+    int flags = 0;
+
+    pthread_mutex_lock(&frame_capture.lock);
+    *screenshot = frame_capture.screenshot;
+    frame_capture.screenshot = NULL;
+    pthread_mutex_unlock(&frame_capture.lock);
+
+    if (frame_capture.open) {
+        flags |= TUM_CAPTURE_RECORD;
+    }
+    if (tumStreamIsOpen()) {
+        flags |= TUM_CAPTURE_STREAM;
+    }
+
+    return flags;
+}
+
+/**
+ * Captures a presented frame held in a texture, the frame is copied on the GPU
+ * and the frame from open_delay, or STREAM_DELAY, frames ago is read back
+ */
+static void captureFrame(SDL_Texture *tex, int w, int h)
+{
+    capture_slot_t *slot = &frame_capture.ring[frame_capture.head];
+    char *screenshot = NULL;
+    unsigned int delay;
+    int flags;
+
+    updateCaptureSession();
+
+    if (tex == NULL) {
+        return;
+    }
+
+    flags = takeCaptureFlags(&screenshot);
+    if (!flags && screenshot == NULL) {
+        return;
+    }
+
+    delay = frame_capture.open ? frame_capture.open_delay :
+            flags ? STREAM_DELAY : 0;
+
+    if (slot->tex == NULL || slot->w != w || slot->h != h) {
+        if (slot->tex) {
+            SDL_DestroyTexture(slot->tex);
+        }
+        slot->tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                      SDL_TEXTUREACCESS_TARGET, w, h);
+        if (slot->tex == NULL) {
+            PRINT_SDL_ERROR("Failed to create capture texture");
+            free(screenshot);
+            return;
+        }
+        slot->w = w;
+        slot->h = h;
+    }
+
+    SDL_SetRenderTarget(renderer, slot->tex);
+    SDL_RenderCopy(renderer, tex, NULL, NULL);
+    slot->flags = flags;
+    slot->screenshot = screenshot;
+    frame_capture.head = (frame_capture.head + 1) % CAPTURE_RING;
+    frame_capture.pending++;
+
+    while (frame_capture.pending > delay) {
+        readbackCaptureSlot();
+    }
+
+    SDL_SetRenderTarget(renderer, NULL);
+}
+
+/**
+ * Headless counterpart to captureFrame(), the frame already is in memory and
+ * is queued right away
+ */
+static void captureFramebuffer(uint32_t *pixels, int w, int h)
+{
+    tum_capture_frame_t *frame;
+    char *screenshot = NULL;
+    int flags;
+
+    updateCaptureSession();
+
+    if (pixels == NULL) {
+        return;
+    }
+
+    flags = takeCaptureFlags(&screenshot);
+    if (!flags && screenshot == NULL) {
+        return;
+    }
+
+    frame = tumCaptureGetFrame(w, h);
+    if (frame == NULL) {
+        if (screenshot) {
+            PRINT_ERROR("Dropped screenshot '%s'", screenshot);
+        }
+        free(screenshot);
+        return;
+    }
+
+    memcpy(frame->pixels, pixels, w * h * sizeof(uint32_t));
+    tumCaptureSubmitFrame(frame, flags, screenshot);
+}
+
+static uint32_t saturateNs(uint64_t ns)
+{
+    return ns > UINT32_MAX ? UINT32_MAX : ns;
+}
+
+/**
+ * Completes the current frame's timings and pushes them into the ring buffer,
+ * everything not spent presenting since frame_start counts as draining
+ */
+static void finishFrameTiming(uint64_t frame_start)
+{
+    tum_frame_timing_t *frame = &frame_timing.cur_frame;
+    uint64_t phase_ns[TUM_FRAME_PHASES];
+    uint64_t total = tumUtilGetTimeNs() - frame_start;
+    unsigned int i;
+
+    for (i = 0; i < TUM_FRAME_PHASES; i++) {
+        phase_ns[i] = atomic_exchange(&frame_timing.phase_ns[i], 0);
+    }
+
+    if (total > phase_ns[TUM_FRAME_PRESENT]) {
+        phase_ns[TUM_FRAME_DRAIN] += total - phase_ns[TUM_FRAME_PRESENT];
+    }
+
+    for (i = 0; i < TUM_FRAME_PHASES; i++) {
+        frame->phase_ns[i] = saturateNs(phase_ns[i]);
+    }
+
+    frame->start_ns = frame_start;
+    frame->period_ns = frame_timing.last_start ?
+                       saturateNs(frame_start - frame_timing.last_start) : 0;
+    frame_timing.last_start = frame_start;
+
+    pthread_mutex_lock(&frame_timing.lock);
+    frame_timing.frames[frame_timing.head] = *frame;
+    frame_timing.head = (frame_timing.head + 1) % TUM_DRAW_FRAME_HISTORY;
+    if (frame_timing.count < TUM_DRAW_FRAME_HISTORY) {
+        frame_timing.count++;
+    }
+    pthread_mutex_unlock(&frame_timing.lock);
+
+    memset(frame, 0, sizeof(tum_frame_timing_t));
+}
+
+/** Fills in the state a job needs, see sort_job_t */
+static void sortJobState(sort_job_t *entry)
+{
+    union data_u *data = entry->job->data;
+    loaded_image_t *img = NULL;
+
+    entry->texture = NULL;
+    entry->colour = (SDL_Color) {
+        0
+    };
+
+    switch (entry->job->type) {
+        case DRAW_CLEAR:
+            entry->colour = data->clear.colour;
+            break;
+        case DRAW_ARC:
+            entry->colour = data->arc.colour;
+            break;
+        case DRAW_ELLIPSE:
+            entry->colour = data->ellipse.colour;
+            break;
+        case DRAW_RECT:
+        case DRAW_FILLED_RECT:
+            entry->colour = data->rect.colour;
+            break;
+        case DRAW_CIRCLE:
+            entry->colour = data->circle.colour;
+            break;
+        case DRAW_LINE:
+            entry->colour = data->line.colour;
+            break;
+        case DRAW_POLY:
+            entry->colour = data->poly.colour;
+            break;
+        case DRAW_TRIANGLE:
+            entry->colour = data->triangle.colour;
+            break;
+        case DRAW_ARROW:
+            entry->colour = data->arrow.colour;
+            break;
+        case DRAW_LOADED_IMAGE:
+            img = data->loaded_image.img;
+            break;
+        case DRAW_LOADED_IMAGE_CROP:
+            img = data->loaded_image_crop.image;
+            break;
+        case DRAW_SPRITE_BATCH:
+            img = data->sprite_batch.image;
+            break;
+        case DRAW_LAYER:
+            entry->texture = data->layer.layer;
+            break;
+        default:
+            break;
+    }
+
+    /** Images packed into one atlas page share its texture */
+    if (img) {
+        entry->texture = img->page ? (const void *)img->page : img;
+    }
+}
+
+/** Text is drawn from a texture of its own, thus never shares state */
+static unsigned char sameJobState(const sort_job_t *a, const sort_job_t *b)
+{
+    return a->job->type != DRAW_TEXT && b->job->type != DRAW_TEXT &&
+           a->job->blend == b->job->blend && a->texture == b->texture &&
+           !memcmp(&a->colour, &b->colour, sizeof(a->colour));
+}
+
+/**
+ * Reorders the queued jobs such that jobs needing the same state are drawn
+ * one after another. Each job is moved behind the closest earlier job sharing
+ * its state, within TUM_DRAW_SORT_WINDOW jobs, if it overlaps none of the
+ * jobs it is moved in front of. Jobs that overlap are thus still drawn in the
+ * order they were queued. Bounds are grown by a pixel as scaled rendering
+ * might round neighbouring jobs onto the same pixel.
+ */
+static void sortDrawJobs(void)
+{
+    draw_job_t *job, **link;
+    sort_job_t *entry, *tmp;
+    unsigned int *tmp_order;
+    unsigned int count = 0, capacity, i, k, pos, stop;
+
+    for (job = job_list_head.next; job; job = job->next, count++) {
+        if (count == job_sort.capacity) {
+            capacity = job_sort.capacity ? 2 * job_sort.capacity : 64;
+            tmp = realloc(job_sort.jobs, capacity * sizeof(sort_job_t));
+            if (tmp == NULL) {
+                PRINT_ERROR("Failed to grow sorted frame");
+                return;
+            }
+            job_sort.jobs = tmp;
+            tmp_order = realloc(job_sort.order,
+                                capacity * sizeof(unsigned int));
+            if (tmp_order == NULL) {
+                PRINT_ERROR("Failed to grow sorted frame");
+                return;
+            }
+            job_sort.order = tmp_order;
+            job_sort.capacity = capacity;
+        }
+
+        entry = &job_sort.jobs[count];
+        entry->job = job;
+        drawJobBounds(job, &entry->bounds);
+        if (!SDL_RectEmpty(&entry->bounds)) {
+            entry->bounds.x--;
+            entry->bounds.y--;
+            entry->bounds.w += 2;
+            entry->bounds.h += 2;
+        }
+        sortJobState(entry);
+    }
+
+    for (i = 0; i < count; i++) {
+        entry = &job_sort.jobs[i];
+        stop = i > TUM_DRAW_SORT_WINDOW ? i - TUM_DRAW_SORT_WINDOW : 0;
+
+        for (pos = i, k = i; k > stop; k--) {
+            tmp = &job_sort.jobs[job_sort.order[k - 1]];
+            if (sameJobState(tmp, entry)) {
+                pos = k;
+                break;
+            }
+            if (SDL_HasIntersection(&tmp->bounds, &entry->bounds)) {
+                break;
+            }
+        }
+
+        memmove(&job_sort.order[pos + 1], &job_sort.order[pos],
+                (i - pos) * sizeof(unsigned int));
+        job_sort.order[pos] = i;
+    }
+
+    link = &job_list_head.next;
+    for (i = 0; i < count; i++) {
+        *link = job_sort.jobs[job_sort.order[i]].job;
+        link = &(*link)->next;
+    }
+    *link = NULL;
+}
+
+/**
+ * Retained mode counterpart to the draw loop in tumDrawUpdateScreen(). Jobs
+ * are compared in submission order with the previous frame's jobs, the bounds
+ * of both the old and new version of each job that changed are damaged.
+ */
+static int drawRetainedFrame(void)
+{
+    SDL_Rect full = { 0, 0, resolution.w, resolution.h };
+    retained_job_t *tmp, *cur, *prev;
+    draw_job_t *job;
+    int x_offset, y_offset;
+    unsigned int i, j, count;
+    int ret = 0;
+
+    pthread_mutex_lock(&global_offset.lock);
+    x_offset = global_offset.x;
+    y_offset = global_offset.y;
+    pthread_mutex_unlock(&global_offset.lock);
+
+    for (retained.count = 0; (job = popDrawJob()) != NULL;
+         retained.count++) {
+        if (retained.count == retained.capacity) {
+            count = retained.capacity ? 2 * retained.capacity : 64;
+            tmp = realloc(retained.frame, count * sizeof(retained_job_t));
+            if (tmp == NULL) {
+                PRINT_ERROR("Failed to grow retained frame");
+                releaseDrawJob(job);
+                free(job);
+                ret = -1;
+                break;
+            }
+            retained.frame = tmp;
+            tmp = realloc(retained.prev_frame, count * sizeof(retained_job_t));
+            if (tmp == NULL) {
+                PRINT_ERROR("Failed to grow retained frame");
+                releaseDrawJob(job);
+                free(job);
+                ret = -1;
+                break;
+            }
+            retained.prev_frame = tmp;
+            retained.capacity = count;
+        }
+
+        cur = &retained.frame[retained.count];
+        cur->job = job;
+        cur->hash = hashDrawJob(job, x_offset, y_offset);
+        drawJobBounds(job, &cur->bounds);
+        cur->bounds.x += x_offset;
+        cur->bounds.y += y_offset;
+    }
+
+    retained.damage_count = 0;
+
+    if (retained.tex == NULL) {
+        retained.tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                         SDL_TEXTUREACCESS_TARGET,
+                                         resolution.render_w,
+                                         resolution.render_h);
+        if (retained.tex == NULL) {
+            PRINT_SDL_ERROR("Failed to create retained screen texture");
+            ret = -1;
+            goto out;
+        }
+        addDamage(&full);
+    }
+    else {
+        count = retained.count > retained.prev_count ? retained.count
+                : retained.prev_count;
+
+        for (i = 0; i < count; i++) {
+            cur = i < retained.count ? &retained.frame[i] : NULL;
+            prev = i < retained.prev_count ? &retained.prev_frame[i] : NULL;
+
+            if (cur && prev && cur->hash == prev->hash) {
+                continue;
+            }
+            if (cur) {
+                addDamage(&cur->bounds);
+            }
+            if (prev) {
+                addDamage(&prev->bounds);
+            }
+        }
+    }
+
+    if (retained.damage_count == 0) {
+        goto out;
+    }
+
+    if (setScreenTarget(retained.tex)) {
+        PRINT_SDL_ERROR("Failed to render to retained screen texture");
+        ret = -1;
+        goto out;
+    }
+
+    /** Every job touching a damaged rectangle is drawn again, in order */
+    for (i = 0; i < retained.damage_count; i++) {
+        SDL_RenderSetClipRect(renderer, &retained.damage[i]);
+
+        for (j = 0; j < retained.count; j++) {
+            cur = &retained.frame[j];
+            if (!SDL_HasIntersection(&cur->bounds, &retained.damage[i])) {
+                continue;
+            }
+
+            /** SDL_RenderClear() ignores the clip rectangle */
+            if (cur->job->type == DRAW_CLEAR) {
+                flushGeometry();
+                render_state.job = TUM_BLEND_NONE;
+                setDrawColour(cur->job->data->clear.colour);
+                SDL_RenderFillRect(renderer, &retained.damage[i]);
+            }
+            else if (renderTimedDrawJob(cur->job, x_offset, y_offset)) {
+                ret = -1;
+            }
+        }
+
+        if (flushGeometry()) {
+            ret = -1;
+        }
+    }
+
+    SDL_RenderSetClipRect(renderer, NULL);
+    presentScreenTexture(retained.tex);
+
+out:
+    for (i = 0; i < retained.count; i++) {
+        releaseDrawJob(retained.frame[i].job);
+        free(retained.frame[i].job);
+        retained.frame[i].job = NULL;
+    }
+
+    tmp = retained.prev_frame;
+    retained.prev_frame = retained.frame;
+    retained.prev_count = retained.count;
+    retained.frame = tmp;
+
+    /** Forces a full redraw of the next frame */
+    if (ret && retained.tex) {
+        SDL_DestroyTexture(retained.tex);
+        retained.tex = NULL;
+    }
+
+    return ret;
+}
+
+static void rasterDrawJob(const tum_raster_target_t *target, draw_job_t *job,
+                          int x_offset, int y_offset);
+
+static void rasterLayer(const tum_raster_target_t *target, draw_layer_t *layer,
+                        int x, int y)
+{
+    tum_raster_target_t clipped = *target;
+    draw_job_t *job;
+
+    /** Recorded content is clipped to the layer, as with a texture */
+    clipped.clip_x0 = x > clipped.clip_x0 ? x : clipped.clip_x0;
+    clipped.clip_y0 = y > clipped.clip_y0 ? y : clipped.clip_y0;
+    if (x + layer->w < clipped.clip_x1) {
+        clipped.clip_x1 = x + layer->w;
+    }
+    if (y + layer->h < clipped.clip_y1) {
+        clipped.clip_y1 = y + layer->h;
+    }
+    if (clipped.clip_x0 >= clipped.clip_x1 ||
+        clipped.clip_y0 >= clipped.clip_y1) {
+        return;
+    }
+
+    for (job = layer->jobs; job; job = job->next) {
+        rasterDrawJob(&clipped, job, x, y);
+    }
+}
+
+static void rasterImage(const tum_raster_target_t *target, loaded_image_t *img,
+                        int sx, int sy, int sw, int sh, int dx, int dy, int dw,
+                        int dh)
+{
+    SDL_Surface *surf;
+
+    if (atomic_load(&img->state) != IMAGE_READY) {
+        return;
+    }
+
+    surf = img->page ? img->page->surf : img->surf;
+    if (surf == NULL) {
+        return;
+    }
+
+    tumRasterBlit(target, surf->pixels, surf->pitch / sizeof(uint32_t),
+                  img->src.x + sx, img->src.y + sy, sw, sh, dx, dy, dw, dh);
+}
+
+/** Software counterpart to renderDrawJob() */
+static void rasterDrawJob(const tum_raster_target_t *screen, draw_job_t *job,
+                          int x_offset, int y_offset)
+{
+    tum_raster_target_t blended = *screen, *target = &blended;
+    union data_u *data = job->data;
+    loaded_image_t *img;
+    SDL_Rect *src, *dst;
+    SDL_Rect rect;
+    coord_t head[2];
+    unsigned int i;
+
+    blended.blend = job->blend;
+
+    switch (job->type) {
+        case DRAW_CLEAR:
+            blended.blend = TUM_BLEND_NONE;
+            tumRasterFill(target, argbColour(data->clear.colour));
+            break;
+        case DRAW_ARC:
+            tumRasterArc(target, data->arc.x + x_offset,
+                         data->arc.y + y_offset, data->arc.radius,
+                         data->arc.start, data->arc.end,
+                         argbColour(data->arc.colour));
+            break;
+        case DRAW_ELLIPSE:
+            tumRasterEllipse(target, data->ellipse.x + x_offset,
+                             data->ellipse.y + y_offset, data->ellipse.rx,
+                             data->ellipse.ry,
+                             argbColour(data->ellipse.colour));
+            break;
+        case DRAW_TEXT:
+            if (data->text.surf) {
+                tumRasterMask(target, data->text.surf->pixels,
+                              data->text.surf->pitch, data->text.surf->w,
+                              data->text.surf->h, data->text.x + x_offset,
+                              data->text.y + y_offset,
+                              argbColour(data->text.colour));
+            }
+            break;
+        case DRAW_RECT:
+            rect = rectangleArea(data->rect.x + x_offset,
+                                 data->rect.y + y_offset, data->rect.w,
+                                 data->rect.h);
+            tumRasterRect(target, rect.x, rect.y, rect.w, rect.h,
+                          argbColour(data->rect.colour));
+            break;
+        case DRAW_FILLED_RECT:
+            rect = rectangleArea(data->rect.x + x_offset,
+                                 data->rect.y + y_offset, data->rect.w,
+                                 data->rect.h);
+            tumRasterFilledRect(target, rect.x, rect.y, rect.w, rect.h,
+                                argbColour(data->rect.colour));
+            break;
+        case DRAW_CIRCLE:
+            tumRasterFilledCircle(target, data->circle.x + x_offset,
+                                  data->circle.y + y_offset,
+                                  data->circle.radius,
+                                  argbColour(data->circle.colour));
+            break;
+        case DRAW_LINE:
+            tumRasterLine(target, data->line.x1 + x_offset,
+                          data->line.y1 + y_offset, data->line.x2 + x_offset,
+                          data->line.y2 + y_offset, data->line.thickness,
+                          argbColour(data->line.colour));
+            break;
+        case DRAW_POLY:
+            tumRasterPolygon(target, data->poly.points, data->poly.n,
+                             x_offset, y_offset,
+                             argbColour(data->poly.colour));
+            break;
+        case DRAW_TRIANGLE:
+            tumRasterFilledTriangle(target, data->triangle.points, x_offset,
+                                    y_offset,
+                                    argbColour(data->triangle.colour));
+            break;
+        case DRAW_LOADED_IMAGE:
+            img = data->loaded_image.img;
+            rasterImage(target, img, 0, 0, img->src.w, img->src.h,
+                        data->loaded_image.x + x_offset,
+                        data->loaded_image.y + y_offset,
+                        img->w * data->loaded_image.scale,
+                        img->h * data->loaded_image.scale);
+            break;
+        case DRAW_LOADED_IMAGE_CROP:
+            rasterImage(target, data->loaded_image_crop.image,
+                        data->loaded_image_crop.c_x,
+                        data->loaded_image_crop.c_y,
+                        data->loaded_image_crop.c_w,
+                        data->loaded_image_crop.c_h,
+                        data->loaded_image_crop.x + x_offset,
+                        data->loaded_image_crop.y + y_offset,
+                        data->loaded_image_crop.c_w,
+                        data->loaded_image_crop.c_h);
+            break;
+        case DRAW_SPRITE_BATCH:
+            for (i = 0; i < data->sprite_batch.count; i++) {
+                src = &data->sprite_batch.items[i].src;
+                dst = &data->sprite_batch.items[i].dst;
+                rasterImage(target, data->sprite_batch.image, src->x, src->y,
+                            src->w, src->h, dst->x + x_offset,
+                            dst->y + y_offset, dst->w, dst->h);
+            }
+            break;
+        case DRAW_LAYER:
+            rasterLayer(target, data->layer.layer, data->layer.x + x_offset,
+                        data->layer.y + y_offset);
+            break;
+        case DRAW_ARROW:
+            arrowHead(data->arrow.x1 + x_offset, data->arrow.y1 + y_offset,
+                      data->arrow.x2 + x_offset, data->arrow.y2 + y_offset,
+                      data->arrow.head_length, head);
+            tumRasterLine(target, data->arrow.x1 + x_offset,
+                          data->arrow.y1 + y_offset, data->arrow.x2 + x_offset,
+                          data->arrow.y2 + y_offset, data->arrow.thickness,
+                          argbColour(data->arrow.colour));
+            for (i = 0; i < 2; i++)
+                tumRasterLine(target, head[i].x, head[i].y,
+                              data->arrow.x2 + x_offset,
+                              data->arrow.y2 + y_offset, data->arrow.thickness,
+                              argbColour(data->arrow.colour));
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Does what the raster workers cannot do in parallel, before they start:
+ * rendering text, SDL_ttf not being thread safe, and adopting layer recordings
+ */
+static void prepareSoftwareJob(draw_job_t *job)
+{
+    SDL_Color color = { 0 };
+    draw_job_t *iterator;
+
+    if (job->type == DRAW_TEXT && job->data->text.surf == NULL) {
+        job->data->text.surf = TTF_RenderText_Solid(
+                                   tumFontGetFont(job->data->text.font),
+                                   job->data->text.str, color);
+    }
+    else if (job->type == DRAW_LAYER) {
+        adoptLayerRecording(job->data->layer.layer);
+        for (iterator = job->data->layer.layer->jobs; iterator;
+             iterator = iterator->next) {
+            prepareSoftwareJob(iterator);
+        }
+    }
+}
+
+#define RASTER_TILES_X                                                         \
+    ((software.w + TUM_DRAW_RASTER_TILE_SIZE - 1) / TUM_DRAW_RASTER_TILE_SIZE)
+#define RASTER_TILES_Y                                                         \
+    ((software.h + TUM_DRAW_RASTER_TILE_SIZE - 1) / TUM_DRAW_RASTER_TILE_SIZE)
+
+static int binJob(raster_bin_t *bin, unsigned int job)
+{
+    unsigned int *tmp;
+
+    if (bin->count == bin->capacity) {
+        tmp = realloc(bin->jobs, (bin->capacity ? 2 * bin->capacity : 16) *
+                      sizeof(unsigned int));
+        if (tmp == NULL) {
+            return -1;
+        }
+        bin->jobs = tmp;
+        bin->capacity = bin->capacity ? 2 * bin->capacity : 16;
+    }
+
+    bin->jobs[bin->count++] = job;
+
+    return 0;
+}
+
+/**
+ * Sorts the frame's jobs into the bins of the tiles they can touch. Clears
+ * cover every tile, so the jobs before them are dropped from all bins.
+ */
+static int binSoftwareJobs(void)
+{
+    SDL_Rect screen = { 0, 0, software.w, software.h };
+    SDL_Rect bounds;
+    draw_job_t *job;
+    unsigned int i, tile;
+    int tx, ty, tx0, ty0, tx1, ty1;
+
+    if (software.bins == NULL) {
+        software.bins = calloc(RASTER_TILES_X * RASTER_TILES_Y,
+                               sizeof(raster_bin_t));
+        if (software.bins == NULL) {
+            PRINT_ERROR("Allocating raster bins failed");
+            return -1;
+        }
+    }
+
+    for (tile = 0; tile < RASTER_TILES_X * RASTER_TILES_Y; tile++) {
+        software.bins[tile].count = 0;
+    }
+
+    for (i = 0; i < software.count; i++) {
+        job = software.jobs[i];
+
+        if (job->type == DRAW_CLEAR) {
+            for (tile = 0; tile < RASTER_TILES_X * RASTER_TILES_Y; tile++) {
+                software.bins[tile].count = 0;
+            }
+        }
+
+        /** Text is drawn as rendered, which SDL_ttf might size differently */
+        if (job->type == DRAW_TEXT) {
+            if (job->data->text.surf == NULL) {
+                continue;
+            }
+            bounds = (SDL_Rect) {
+                job->data->text.x, job->data->text.y,
+                job->data->text.surf->w, job->data->text.surf->h
+            };
+        }
+        else {
+            drawJobBounds(job, &bounds);
+        }
+
+        bounds.x += software.x_offset;
+        bounds.y += software.y_offset;
+        if (!SDL_IntersectRect(&bounds, &screen, &bounds)) {
+            continue;
+        }
+
+        tx0 = bounds.x / TUM_DRAW_RASTER_TILE_SIZE;
+        ty0 = bounds.y / TUM_DRAW_RASTER_TILE_SIZE;
+        tx1 = (bounds.x + bounds.w - 1) / TUM_DRAW_RASTER_TILE_SIZE;
+        ty1 = (bounds.y + bounds.h - 1) / TUM_DRAW_RASTER_TILE_SIZE;
+
+        for (ty = ty0; ty <= ty1; ty++)
+            for (tx = tx0; tx <= tx1; tx++)
+                if (binJob(&software.bins[ty * RASTER_TILES_X + tx], i)) {
+                    PRINT_ERROR("Failed to grow raster bin");
+                    return -1;
+                }
+    }
+
+    return 0;
+}
+
+/** Rasterizes tiles of the current frame until none are left */
+static void rasterTiles(raster_bin_t *bins)
+{
+    tum_raster_target_t target = { .pixels = software.pixels,
+                                   .pitch = software.w
+                                 };
+    unsigned int tile, i;
+
+    while ((tile = atomic_fetch_add(&raster_pool.next_tile, 1)) <
+           RASTER_TILES_X * RASTER_TILES_Y) {
+        target.clip_x0 = (tile % RASTER_TILES_X) * TUM_DRAW_RASTER_TILE_SIZE;
+        target.clip_y0 = (tile / RASTER_TILES_X) * TUM_DRAW_RASTER_TILE_SIZE;
+        target.clip_x1 = target.clip_x0 + TUM_DRAW_RASTER_TILE_SIZE;
+        target.clip_y1 = target.clip_y0 + TUM_DRAW_RASTER_TILE_SIZE;
+        if (target.clip_x1 > software.w) {
+            target.clip_x1 = software.w;
+        }
+        if (target.clip_y1 > software.h) {
+            target.clip_y1 = software.h;
+        }
+
+        if (bins == NULL) {
+            for (i = 0; i < software.count; i++)
+                rasterDrawJob(&target, software.jobs[i], software.x_offset,
+                              software.y_offset);
+            continue;
+        }
+
+        for (i = 0; i < bins[tile].count; i++)
+            rasterDrawJob(&target, software.jobs[bins[tile].jobs[i]],
+                          software.x_offset, software.y_offset);
+    }
+}
+
+static void *rasterWorkerThread(void *arg)
+{
+    unsigned int generation = 0;
+    raster_bin_t *bins;
+
+    tumUtilBlockSignals();
+
+    for (;;) {
+        pthread_mutex_lock(&raster_pool.lock);
+        while (raster_pool.generation == generation) {
+            pthread_cond_wait(&raster_pool.start, &raster_pool.lock);
+        }
+        generation = raster_pool.generation;
+        bins = raster_pool.bins;
+        pthread_mutex_unlock(&raster_pool.lock);
+
+        rasterTiles(bins);
+
+        pthread_mutex_lock(&raster_pool.lock);
+        if (--raster_pool.busy == 0) {
+            pthread_cond_signal(&raster_pool.done);
+        }
+        pthread_mutex_unlock(&raster_pool.lock);
+    }
+
+    return NULL;
+}
+
+static void startRasterWorkers(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int threads = TUM_DRAW_RASTER_THREADS;
+    pthread_t thread;
+
+    /** The drawing thread rasterizes tiles as well */
+    if (threads == 0) {
+        threads = cpus > 1 ? cpus - 1 : 0;
+    }
+
+    for (; raster_pool.threads < threads; raster_pool.threads++) {
+        if (pthread_create(&thread, NULL, rasterWorkerThread, NULL)) {
+            PRINT_ERROR("Failed to create raster worker");
+            break;
+        }
+        pthread_detach(thread);
+    }
+}
+
+static void rasterFrame(void)
+{
+    raster_bin_t *bins = binSoftwareJobs() ? NULL : software.bins;
+
+    pthread_once(&raster_pool.once, startRasterWorkers);
+
+    atomic_store(&raster_pool.next_tile, 0);
+
+    pthread_mutex_lock(&raster_pool.lock);
+    raster_pool.busy = raster_pool.threads;
+    raster_pool.bins = bins;
+    raster_pool.generation++;
+    pthread_cond_broadcast(&raster_pool.start);
+    pthread_mutex_unlock(&raster_pool.lock);
+
+    rasterTiles(bins);
+
+    pthread_mutex_lock(&raster_pool.lock);
+    while (raster_pool.busy) {
+        pthread_cond_wait(&raster_pool.done, &raster_pool.lock);
+    }
+    pthread_mutex_unlock(&raster_pool.lock);
+}
+
+/** (Re)allocates the framebuffer and tile bins at the logical resolution */
+static int resizeSoftwareFramebuffer(void)
+{
+    unsigned int tile;
+    int ret = 0;
+
+    pthread_mutex_lock(&software.lock);
+
+    if (software.bins) {
+        for (tile = 0; tile < RASTER_TILES_X * RASTER_TILES_Y; tile++) {
+            free(software.bins[tile].jobs);
+        }
+        free(software.bins);
+        software.bins = NULL;
+    }
+
+    free(software.pixels);
+    software.w = resolution.w;
+    software.h = resolution.h;
+    software.pixels = calloc(software.w * software.h, sizeof(uint32_t));
+    if (software.pixels == NULL) {
+        PRINT_ERROR("Allocating software framebuffer failed");
+        ret = -1;
+    }
+
+    pthread_mutex_unlock(&software.lock);
+
+    if (software.tex) {
+        SDL_DestroyTexture(software.tex);
+        software.tex = NULL;
+    }
+
+    return ret;
+}
+
+/** Software rendering counterpart to the draw loop in tumDrawUpdateScreen() */
+static int drawSoftwareFrame(void)
+{
+    draw_job_t **tmp, *job;
+    unsigned int i;
+    int ret = 0;
+
+    if (software.pixels == NULL || software.w != resolution.w ||
+        software.h != resolution.h) {
+        if (resizeSoftwareFramebuffer()) {
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&global_offset.lock);
+    software.x_offset = global_offset.x;
+    software.y_offset = global_offset.y;
+    pthread_mutex_unlock(&global_offset.lock);
+
+    for (software.count = 0; (job = popDrawJob()) != NULL;
+         software.count++) {
+        if (software.count == software.capacity) {
+            tmp = realloc(software.jobs, (software.capacity ?
+                                          2 * software.capacity : 64) *
+                          sizeof(draw_job_t *));
+            if (tmp == NULL) {
+                PRINT_ERROR("Failed to grow software frame");
+                releaseDrawJob(job);
+                free(job);
+                ret = -1;
+                goto out;
+            }
+            software.jobs = tmp;
+            software.capacity = software.capacity ? 2 * software.capacity
+                                : 64;
+        }
+
+        prepareSoftwareJob(job);
+        software.jobs[software.count] = job;
+        frame_timing.cur_frame.job_count[job->type]++;
+    }
+
+    pthread_mutex_lock(&software.lock);
+    rasterFrame();
+    pthread_mutex_unlock(&software.lock);
+
+    /** Headless frames are only read using tumDrawReadSoftwareFramebuffer() */
+    if (headless) {
+        goto out;
+    }
+
+    if (software.tex == NULL) {
+        software.tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                         SDL_TEXTUREACCESS_STREAMING,
+                                         software.w, software.h);
+        if (software.tex == NULL) {
+            PRINT_SDL_ERROR("Failed to create software framebuffer texture");
+            ret = -1;
+            goto out;
+        }
+    }
+
+    SDL_UpdateTexture(software.tex, NULL, software.pixels,
+                      software.w * sizeof(uint32_t));
+    presentScreenTexture(software.tex);
+
+out:
+    for (i = 0; i < software.count; i++) {
+        releaseDrawJob(software.jobs[i]);
+        free(software.jobs[i]);
+    }
+    software.count = 0;
+
+    return ret;
+}
+
+int tumDrawUpdateScreen(void)
+{
+    if (tumUtilIsCurGLThread()) {
+        PRINT_ERROR(
+            "Updating screen from thread that does not hold GL context");
+        goto err;
+    }
+
+#if (configFPS_LIMIT == 1)
+    static struct timespec last_time = { 0 }, cur_time = { 0 };
+
+    if (clock_gettime(CLOCK_MONOTONIC, &cur_time)) {
+        PRINT_ERROR("Failed to get monotonic clock");
+        goto err;
+    }
+
+    if (timespecDiffMilli(&last_time, &cur_time) < (float)FRAMELIMIT_PERIOD) {
         goto err;
     }
 
@@ -998,7 +3138,65 @@ int tumDrawUpdateScreen(void)
         goto err;
     }
 
+    uint64_t frame_start = tumUtilGetTimeNs();
+
+    applyResolution();
+    tumImageFinishLoads();
+    tumImageUploadAtlas();
+    /** Whatever else drew since might have changed the renderer's state */
+    invalidateRenderState();
+
+    if (headless || atomic_load(&software.enabled)) {
+        int ret = drawSoftwareFrame();
+
+        if (headless) {
+            captureFramebuffer(ret ? NULL : software.pixels, software.w,
+                               software.h);
+        }
+        else {
+            captureFrame(ret ? NULL : software.tex, software.w, software.h);
+        }
+        collectDeletedLayers();
+        tumImageCollectDeferred();
+        tumFontCollectDeferred();
+        finishFrameTiming(frame_start);
+
+        return ret;
+    }
+
+    if (software.tex) {
+        SDL_DestroyTexture(software.tex);
+        software.tex = NULL;
+    }
+
+    if (atomic_load(&job_sort.enabled)) {
+        sortDrawJobs();
+    }
+
+    if (atomic_load(&retained.enabled)) {
+        int ret = drawRetainedFrame();
+
+        captureFrame(retained.tex, resolution.render_w, resolution.render_h);
+        collectDeletedLayers();
+        tumImageCollectDeferred();
+        tumFontCollectDeferred();
+        finishFrameTiming(frame_start);
+
+        return ret;
+    }
+
+    if (retained.tex) {
+        SDL_DestroyTexture(retained.tex);
+        retained.tex = NULL;
+    }
+
     draw_job_t *tmp_job;
+    SDL_Texture *screen = screenTexture();
+
+    if (screen && setScreenTarget(screen)) {
+        PRINT_SDL_ERROR("Failed to render to low resolution screen");
+        screen = NULL;
+    }
 
     while ((tmp_job = popDrawJob()) != NULL) {
         if (!tmp_job->data) {
@@ -1010,12 +3208,28 @@ int tumDrawUpdateScreen(void)
         free(tmp_job);
     }
 
-    SDL_RenderPresent(renderer);
+    flushGeometry();
+    collectDeletedLayers();
+    tumImageCollectDeferred();
+    tumFontCollectDeferred();
+
+    if (screen) {
+        presentScreenTexture(screen);
+    }
+    else {
+        presentFrame();
+    }
+    captureFrame(screen, resolution.render_w, resolution.render_h);
+    finishFrameTiming(frame_start);
 
     return 0;
 
 draw_error:
     free(tmp_job);
+    flushGeometry();
+    if (screen) {
+        SDL_SetRenderTarget(renderer, NULL);
+    }
 err:
     return -1;
 }
@@ -1027,6 +3241,8 @@ char *tumGetErrorMessage(void)
 
 int tumDrawInit(char *path) // Should be called from the Thread running main()
 {
+    int window_width, window_height;
+
     /* Relevant for Docker-based toolchain */
 #ifdef DOCKER
 #ifndef HOST_OS
@@ -1043,6 +3259,8 @@ int tumDrawInit(char *path) // Should be called from the Thread running main()
 #endif /* HOST_OS */
 #endif /* DOCKER */
     SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+    /** Lets consecutive copies from one atlas page become one draw call */
+    SDL_SetHint(SDL_HINT_RENDER_BATCHING, "1");
 
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_AUDIO)) {
         PRINT_SDL_ERROR("SDL_Init failed");
@@ -1058,13 +3276,19 @@ int tumDrawInit(char *path) // Should be called from the Thread running main()
         goto err_tum_font;
     }
 
+    pthread_mutex_lock(&resolution.lock);
+    window_width = resolution.window_width;
+    window_height = resolution.window_height;
+    pthread_mutex_unlock(&resolution.lock);
+
     window = SDL_CreateWindow(WINDOW_TITLE, SDL_WINDOWPOS_CENTERED,
-                              SDL_WINDOWPOS_CENTERED, screen_width,
-                              screen_height, SDL_WINDOW_OPENGL);
+                              SDL_WINDOWPOS_CENTERED, window_width,
+                              window_height,
+                              SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI);
 
     if (window == NULL) {
         PRINT_SDL_ERROR("Failed to create %d x %d window '%s'",
-                        screen_width, screen_height, WINDOW_TITLE);
+                        window_width, window_height, WINDOW_TITLE);
         goto err_window;
     }
 
@@ -1075,15 +3299,53 @@ int tumDrawInit(char *path) // Should be called from the Thread running main()
         goto err_create_context;
     }
 
-    if (SDL_GL_MakeCurrent(window, context) < 0) {
-        PRINT_SDL_ERROR("Claiming current context failed");
-        goto err_make_current;
+    if (SDL_GL_MakeCurrent(window, context) < 0) {
+        PRINT_SDL_ERROR("Claiming current context failed");
+        goto err_make_current;
+    }
+
+    if (SDL_GL_MakeCurrent(window, NULL) < 0) {
+        PRINT_SDL_ERROR("Releasing current context failed");
+        goto err_make_current;
+    }
+
+    tumDrawBindThread();
+
+    atexit(SDL_Quit);
+
+    return 0;
+
+err_make_current:
+    SDL_GL_DeleteContext(context);
+err_create_context:
+    SDL_DestroyWindow(window);
+err_window:
+    tumFontExit();
+err_tum_font:
+    TTF_Quit();
+err_ttf:
+    SDL_Quit();
+err_sdl:
+    return -1;
+}
+
+int tumDrawInitHeadless(char *path)
+{
+    if (SDL_Init(SDL_INIT_EVENTS)) {
+        PRINT_SDL_ERROR("SDL_Init failed");
+        goto err_sdl;
+    }
+    if (TTF_Init()) {
+        PRINT_ERROR("TTF_Init failed");
+        goto err_ttf;
+    }
+
+    if (tumFontInit(path)) {
+        PRINT_ERROR("TUM Font init failed");
+        goto err_tum_font;
     }
 
-    if (SDL_GL_MakeCurrent(window, NULL) < 0) {
-        PRINT_SDL_ERROR("Releasing current context failed");
-        goto err_make_current;
-    }
+    headless = 1;
 
     tumDrawBindThread();
 
@@ -1091,12 +3353,6 @@ int tumDrawInit(char *path) // Should be called from the Thread running main()
 
     return 0;
 
-err_make_current:
-    SDL_GL_DeleteContext(context);
-err_create_context:
-    SDL_DestroyWindow(window);
-err_window:
-    tumFontExit();
 err_tum_font:
     TTF_Quit();
 err_ttf:
@@ -1107,6 +3363,12 @@ err_sdl:
 
 int tumDrawBindThread(void) // Should be called from the Drawing Thread
 {
+    /** Without a renderer there is no context to be bound */
+    if (headless) {
+        tumUtilSetGLThread();
+        return 0;
+    }
+
     if (SDL_GL_MakeCurrent(window, context) < 0) {
         PRINT_SDL_ERROR("Releasing current context failed");
         goto err_make_current;
@@ -1132,17 +3394,35 @@ int tumDrawBindThread(void) // Should be called from the Drawing Thread
 
     SDL_RenderClear(renderer);
 
-    pthread_mutex_lock(&loaded_images_lock);
-    loaded_image_t *iterator = &loaded_images_list;
+    tumImageSetRenderer(renderer);
 
-    for (; iterator; iterator = iterator->next)
-        if (iterator->tex) {
-            SDL_DestroyTexture(iterator->tex);
-            iterator->tex = SDL_CreateTextureFromSurface(
-                                renderer, iterator->surf);
-        }
+    /** Layer and screen textures went with the old renderer */
+    draw_layer_t *layer;
+    unsigned int i;
+
+    retained.tex = NULL;
+    software.tex = NULL;
+    resolution.tex = NULL;
+    duplicate.tex = NULL;
 
-    pthread_mutex_unlock(&loaded_images_lock);
+    /** Frames not read back yet are lost */
+    for (i = 0; i < CAPTURE_RING; i++) {
+        frame_capture.ring[i].tex = NULL;
+        free(frame_capture.ring[i].screenshot);
+        frame_capture.ring[i].screenshot = NULL;
+    }
+    frame_capture.pending = 0;
+
+    /** The logical size is a property of the renderer */
+    pthread_mutex_lock(&resolution.lock);
+    resolution.changed = 1;
+    pthread_mutex_unlock(&resolution.lock);
+
+    pthread_mutex_lock(&layers_lock);
+    for (layer = layers; layer; layer = layer->next) {
+        layer->tex = NULL;
+    }
+    pthread_mutex_unlock(&layers_lock);
 
     tumUtilSetGLThread();
 
@@ -1159,6 +3439,19 @@ err_make_current:
 
 void tumDrawExit(void)
 {
+    /** Recordings are finished before exiting */
+    if ((renderer || headless) && tumUtilIsCurGLThread() == 0) {
+        pthread_mutex_lock(&frame_capture.lock);
+        frame_capture.session = 0;
+        pthread_mutex_unlock(&frame_capture.lock);
+        updateCaptureSession();
+    }
+    else if (frame_capture.open) {
+        tumCaptureClose();
+    }
+    tumCaptureFlush();
+    tumStreamClose();
+
     if (window) {
         SDL_DestroyWindow(window);
     }
@@ -1189,10 +3482,10 @@ int tumDrawText(char *str, signed short x, signed short y, unsigned int colour)
     }
 
     strcpy(job->data->text.str, str);
-    job->data->text.font = tumFontGetCurFont();
+    job->data->text.font = tumFontGetCurFontHandle();
     job->data->text.x = x;
     job->data->text.y = y;
-    job->data->text.colour = colour;
+    job->data->text.colour = unpackColour(colour);
 
     return 0;
 }
@@ -1214,7 +3507,7 @@ int tumDrawEllipse(signed short x, signed short y, signed short rx,
     job->data->ellipse.y = y;
     job->data->ellipse.rx = rx;
     job->data->ellipse.ry = ry;
-    job->data->ellipse.colour = colour;
+    job->data->ellipse.colour = unpackColour(colour);
 
     return 0;
 }
@@ -1229,7 +3522,7 @@ int tumDrawArc(signed short x, signed short y, signed short radius,
     job->data->arc.radius = radius;
     job->data->arc.start = start;
     job->data->arc.end = end;
-    job->data->arc.colour = colour;
+    job->data->arc.colour = unpackColour(colour);
 
     return 0;
 }
@@ -1243,7 +3536,7 @@ int tumDrawFilledBox(signed short x, signed short y, signed short w,
     job->data->rect.y = y;
     job->data->rect.w = w;
     job->data->rect.h = h;
-    job->data->rect.colour = colour;
+    job->data->rect.colour = unpackColour(colour);
 
     return 0;
 }
@@ -1257,461 +3550,793 @@ int tumDrawBox(signed short x, signed short y, signed short w, signed short h,
     job->data->rect.y = y;
     job->data->rect.w = w;
     job->data->rect.h = h;
-    job->data->rect.colour = colour;
+    job->data->rect.colour = unpackColour(colour);
+
+    return 0;
+}
+
+void tumDrawDuplicateBuffer(void)
+{
+    SDL_Rect viewport;
+    float scale_x, scale_y;
+    uint32_t *tmp;
+    int w, h;
+
+    if (headless) {
+        return;
+    }
+
+    /** Pixels are read in the window's physical pixels */
+    SDL_RenderGetViewport(renderer, &viewport);
+    SDL_RenderGetScale(renderer, &scale_x, &scale_y);
+    w = viewport.w * scale_x + 0.5;
+    h = viewport.h * scale_y + 0.5;
+
+    if (w != duplicate.w || h != duplicate.h) {
+        tmp = realloc(duplicate.pixels, w * h * sizeof(uint32_t));
+        if (tmp == NULL) {
+            PRINT_ERROR("Failed to allocate %d x %d screen copy", w, h);
+            return;
+        }
+        duplicate.pixels = tmp;
+        duplicate.w = w;
+        duplicate.h = h;
+
+        if (duplicate.tex) {
+            SDL_DestroyTexture(duplicate.tex);
+            duplicate.tex = NULL;
+        }
+    }
+
+    if (duplicate.tex == NULL) {
+        duplicate.tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                          SDL_TEXTUREACCESS_STREAMING, w, h);
+        if (duplicate.tex == NULL) {
+            PRINT_SDL_ERROR("Failed to create screen copy texture");
+            return;
+        }
+    }
+
+    if (SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888,
+                             duplicate.pixels, w * sizeof(uint32_t))) {
+        PRINT_SDL_ERROR("Failed to read screen");
+        return;
+    }
+
+    SDL_UpdateTexture(duplicate.tex, NULL, duplicate.pixels,
+                      w * sizeof(uint32_t));
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, duplicate.tex, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+int tumDrawClear(unsigned int colour)
+{
+    /** INIT_JOB(job, DRAW_CLEAR); */
+    draw_job_t *job = pushDrawJob();
+    union data_u *data = calloc(1, sizeof(union data_u));
+    if (data == NULL) {
+        logCriticalError("job->data alloc");
+    }
+    job->data = data;
+    job->type = DRAW_CLEAR;
+
+    job->data->clear.colour = unpackColour(colour);
+
+    return 0;
+}
+
+int tumDrawCircle(signed short x, signed short y, signed short radius,
+                  unsigned int colour)
+{
+    INIT_JOB(job, DRAW_CIRCLE);
+
+    job->data->circle.x = x;
+    job->data->circle.y = y;
+    job->data->circle.radius = radius;
+    job->data->circle.colour = unpackColour(colour);
+
+    return 0;
+}
+
+int tumDrawLine(signed short x1, signed short y1, signed short x2,
+                signed short y2, unsigned char thickness, unsigned int colour)
+{
+    INIT_JOB(job, DRAW_LINE);
+
+    job->data->line.x1 = x1;
+    job->data->line.y1 = y1;
+    job->data->line.x2 = x2;
+    job->data->line.y2 = y2;
+    job->data->line.thickness = thickness;
+    job->data->line.colour = unpackColour(colour);
+
+    return 0;
+}
+
+int tumDrawPoly(coord_t *points, int n, unsigned int colour)
+{
+    INIT_JOB(job, DRAW_POLY);
+
+    coord_t *points_cpy = (coord_t *)calloc(n, sizeof(coord_t));
+    if (!points_cpy) {
+        return -1;
+    }
+
+    memcpy(points_cpy, points, sizeof(coord_t) * n);
+
+    job->data->poly.points = points_cpy;
+    job->data->poly.n = n;
+    job->data->poly.colour = unpackColour(colour);
+
+    return 0;
+}
+
+int tumDrawTriangle(coord_t *points, unsigned int colour)
+{
+    INIT_JOB(job, DRAW_TRIANGLE);
+
+    coord_t *points_cpy = (coord_t *)calloc(3, sizeof(coord_t));
+    if (!points_cpy) {
+        return -1;
+    }
+
+    memcpy(points_cpy, points, sizeof(coord_t) * 3);
+
+    job->data->triangle.points = points_cpy;
+    job->data->triangle.colour = unpackColour(colour);
+
+    return 0;
+}
+
+int tumDrawLoadedImage(image_handle_t img, signed short x, signed short y)
+{
+    loaded_image_ref_t *ref = (loaded_image_ref_t *)img;
+
+    if (img == NULL) {
+        return -1;
+    }
+
+    INIT_JOB(job, DRAW_LOADED_IMAGE);
+
+    atomic_fetch_add(&ref->image->ref_count, 1);
+    job->data->loaded_image.img = ref->image;
+    job->data->loaded_image.scale = ref->scale;
+    job->data->loaded_image.x = x;
+    job->data->loaded_image.y = y;
+
+    return 0;
+}
+
+int tumDrawQueueImageCrop(loaded_image_t *img, int x, int y, int c_x,
+                          int c_y, int c_w, int c_h)
+{
+    INIT_JOB(job, DRAW_LOADED_IMAGE_CROP);
+
+    atomic_fetch_add(&img->ref_count, 1);
+    job->data->loaded_image_crop.image = img;
+    job->data->loaded_image_crop.x = x;
+    job->data->loaded_image_crop.y = y;
+    job->data->loaded_image_crop.c_x = c_x;
+    job->data->loaded_image_crop.c_y = c_y;
+    job->data->loaded_image_crop.c_w = c_w;
+    job->data->loaded_image_crop.c_h = c_h;
+
+    return 0;
+}
+
+int tumDrawQueueSpriteBatch(loaded_image_t *img, sprite_batch_item_t *items,
+                            unsigned count)
+{
+    INIT_JOB(job, DRAW_SPRITE_BATCH);
+
+    atomic_fetch_add(&img->ref_count, 1);
+    job->data->sprite_batch.image = img;
+    job->data->sprite_batch.items = items;
+    job->data->sprite_batch.count = count;
+
+    return 0;
+}
+
+/**
+ * The deprecated filename based functions go through the image cache, the
+ * image stays cached after the draw job released it and is not decoded again
+ * on the next frame
+ */
+static int drawCachedImage(char *filename, signed short x, signed short y,
+                           float scale)
+{
+    char abs_path[PATH_MAX + 1];
+    image_handle_t img;
+    int ret;
+
+    if (realpath(filename, (char *)abs_path) == NULL) {
+        return -1;
+    }
+
+    img = tumDrawLoadScaledImage(abs_path, scale);
+    if (img == NULL) {
+        return -1;
+    }
+
+    ret = tumDrawLoadedImage(img, x, y);
+    tumDrawFreeLoadedImage(&img);
+
+    return ret;
+}
+
+int __attribute_deprecated__ tumDrawImage(char *filename, signed short x,
+        signed short y)
+{
+    return drawCachedImage(filename, x, y, 1);
+}
+
+int __attribute_deprecated__ tumGetImageSize(char *filename, int *w, int *h)
+{
+    char full_filename[PATH_MAX + 1];
+    image_handle_t img;
+    int ret;
+
+    if (realpath(filename, full_filename) == NULL) {
+        return -1;
+    }
+
+    img = tumDrawLoadImage(full_filename);
+    if (img == NULL) {
+        return -1;
+    }
+
+    ret = tumDrawGetLoadedImageSize(img, w, h);
+    tumDrawFreeLoadedImage(&img);
+
+    return ret;
+}
+
+int __attribute_deprecated__ tumDrawScaledImage(char *filename, signed short x,
+        signed short y, float scale)
+{
+    return drawCachedImage(filename, x, y, scale);
+}
+
+int tumDrawArrow(signed short x1, signed short y1, signed short x2,
+                 signed short y2, signed short head_length,
+                 unsigned char thickness, unsigned int colour)
+{
+    INIT_JOB(job, DRAW_ARROW);
+
+    job->data->arrow.x1 = x1;
+    job->data->arrow.y1 = y1;
+    job->data->arrow.x2 = x2;
+    job->data->arrow.y2 = y2;
+    job->data->arrow.head_length = head_length;
+    job->data->arrow.thickness = thickness;
+    job->data->arrow.colour = unpackColour(colour);
+
+    return 0;
+}
+
+int tumDrawSetBlendMode(tum_blend_mode_e mode)
+{
+    if (mode != TUM_BLEND_BLEND && mode != TUM_BLEND_NONE &&
+        mode != TUM_BLEND_ADD) {
+        PRINT_ERROR("Invalid blend mode %d", mode);
+        return -1;
+    }
+
+    blend_mode = mode;
+
+    return 0;
+}
+
+tum_blend_mode_e tumDrawGetBlendMode(void)
+{
+    return blend_mode;
+}
+
+int tumDrawSetGlobalXOffset(int offset)
+{
+    int ret;
+
+    if (!(ret = pthread_mutex_lock(&global_offset.lock))) {
+        global_offset.x = offset;
+        pthread_mutex_unlock(&global_offset.lock);
+    }
+    else {
+        PRINT_ERROR("Could not set global X offset");
+    }
+
+    return ret;
+}
+
+int tumDrawSetGlobalYOffset(int offset)
+{
+    int ret;
+
+    if (!(ret = pthread_mutex_lock(&global_offset.lock))) {
+        global_offset.y = offset;
+        pthread_mutex_unlock(&global_offset.lock);
+    }
+    else {
+        PRINT_ERROR("Could not set global Y offset");
+    }
 
-    return 0;
+    return ret;
 }
 
-void tumDrawDuplicateBuffer(void)
+int tumDrawGetGlobalXOffset(int *offset)
 {
-    SDL_Surface *screen_shot =
-        SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32,
-                             0x00ff0000, 0x0000ff00, 0x000000ff,
-                             0xff000000);
-    SDL_RenderReadPixels(renderer, NULL, 0, screen_shot->pixels,
-                         screen_shot->pitch);
-    SDL_Texture *tex = SDL_CreateTextureFromSurface(renderer, screen_shot);
-    SDL_RenderClear(renderer);
-    SDL_Rect dest = { .w = SCREEN_WIDTH, .h = SCREEN_HEIGHT };
-    SDL_RenderCopy(renderer, tex, NULL, &dest);
-    SDL_RenderPresent(renderer);
+    int ret;
+
+    if (!(ret = pthread_mutex_lock(&global_offset.lock))) {
+        *offset = global_offset.x;
+        pthread_mutex_unlock(&global_offset.lock);
+    }
+    else {
+        PRINT_ERROR("Could not get global X offset");
+    }
+
+    return ret;
 }
 
-int tumDrawClear(unsigned int colour)
+int tumDrawGetGlobalYOffset(int *offset)
 {
-    /** INIT_JOB(job, DRAW_CLEAR); */
-    draw_job_t *job = pushDrawJob();
-    union data_u *data = calloc(1, sizeof(union data_u));
-    if (data == NULL) {
-        logCriticalError("job->data alloc");
-    }
-    job->data = data;
-    job->type = DRAW_CLEAR;
+    int ret;
 
-    job->data->clear.colour = colour;
+    if (!(ret = pthread_mutex_lock(&global_offset.lock))) {
+        *offset = global_offset.y;
+        pthread_mutex_unlock(&global_offset.lock);
+    }
+    else {
+        PRINT_ERROR("Could not get global Y offset");
+    }
 
-    return 0;
+    return ret;
 }
 
-int tumDrawCircle(signed short x, signed short y, signed short radius,
-                  unsigned int colour)
+layer_handle_t tumDrawLayerCreate(int w, int h)
 {
-    INIT_JOB(job, DRAW_CIRCLE);
+    draw_layer_t *ret = calloc(1, sizeof(draw_layer_t));
+    if (ret == NULL) {
+        PRINT_ERROR("Allocating layer failed");
+        return NULL;
+    }
 
-    job->data->circle.x = x;
-    job->data->circle.y = y;
-    job->data->circle.radius = radius;
-    job->data->circle.colour = colour;
+    ret->w = w ? w : tumDrawGetScreenWidth();
+    ret->h = h ? h : tumDrawGetScreenHeight();
+    pthread_mutex_init(&ret->lock, NULL);
 
-    return 0;
+    pthread_mutex_lock(&layers_lock);
+    ret->next = layers;
+    layers = ret;
+    pthread_mutex_unlock(&layers_lock);
+
+    return ret;
 }
 
-int tumDrawLine(signed short x1, signed short y1, signed short x2,
-                signed short y2, unsigned char thickness, unsigned int colour)
+void tumDrawLayerDelete(layer_handle_t layer)
 {
-    INIT_JOB(job, DRAW_LINE);
-
-    job->data->line.x1 = x1;
-    job->data->line.y1 = y1;
-    job->data->line.x2 = x2;
-    job->data->line.y2 = y2;
-    job->data->line.thickness = thickness;
-    job->data->line.colour = colour;
+    if (layer == NULL) {
+        return;
+    }
 
-    return 0;
+    /** Freed at the end of the frame that draws its last queued job */
+    pthread_mutex_lock(&layers_lock);
+    ((draw_layer_t *)layer)->deleted = 1;
+    pthread_mutex_unlock(&layers_lock);
 }
 
-int tumDrawPoly(coord_t *points, int n, unsigned int colour)
+int tumDrawLayerBegin(layer_handle_t layer)
 {
-    INIT_JOB(job, DRAW_POLY);
+    draw_layer_t *l = (draw_layer_t *)layer;
 
-    coord_t *points_cpy = (coord_t *)calloc(n, sizeof(coord_t));
-    if (!points_cpy) {
+    if (l == NULL) {
         return -1;
     }
 
-    memcpy(points_cpy, points, sizeof(coord_t) * n);
+    if (recording_layer) {
+        PRINT_ERROR("Already recording a layer");
+        return -1;
+    }
 
-    job->data->poly.points = points_cpy;
-    job->data->poly.n = n;
-    job->data->poly.colour = colour;
+    l->recording.next = NULL;
+    l->recording_tail = &l->recording;
+    recording_layer = l;
 
     return 0;
 }
 
-int tumDrawTriangle(coord_t *points, unsigned int colour)
+int tumDrawLayerEnd(layer_handle_t layer)
 {
-    INIT_JOB(job, DRAW_TRIANGLE);
+    draw_layer_t *l = (draw_layer_t *)layer;
+    draw_job_t *old_pending;
 
-    coord_t *points_cpy = (coord_t *)calloc(3, sizeof(coord_t));
-    if (!points_cpy) {
+    if (l == NULL || recording_layer != l) {
+        PRINT_ERROR("Layer is not being recorded");
         return -1;
     }
 
-    memcpy(points_cpy, points, sizeof(coord_t) * 3);
+    recording_layer = NULL;
 
-    job->data->triangle.points = points_cpy;
-    job->data->triangle.colour = colour;
+    pthread_mutex_lock(&l->lock);
+    old_pending = l->pending;
+    l->pending = l->recording.next;
+    l->has_pending = 1;
+    atomic_fetch_add(&l->generation, 1);
+    pthread_mutex_unlock(&l->lock);
+
+    /** A recording that was never drawn */
+    releaseDrawJobList(old_pending);
 
     return 0;
 }
 
-image_handle_t tumDrawLoadScaledImage(char *filename, float scale)
+int tumDrawLayerInvalidate(layer_handle_t layer)
 {
-    loaded_image_t *ret = calloc(1, sizeof(loaded_image_t));
-    if (ret == NULL) {
-        PRINT_ERROR("Failed to allocate loaded image");
-        goto err_alloc;
-    }
-
-    ret->filename = strdup(filename);
-    if (ret->filename == NULL) {
-        PRINT_ERROR("Failed to duplicate filename");
-        goto err_filename;
+    if (layer == NULL) {
+        return -1;
     }
 
-    ret->file = tumUtilFindResource(filename, "rb");
-    if (ret->file == NULL) {
-        PRINT_ERROR("Failed to open file '%s'", filename);
-        goto err_file_open;
-    }
+    atomic_store(&((draw_layer_t *)layer)->dirty, 1);
+    atomic_fetch_add(&((draw_layer_t *)layer)->generation, 1);
 
-    ret->ops = SDL_RWFromFP(ret->file, SDL_TRUE);
-    if (ret->ops == NULL) {
-        PRINT_SDL_ERROR("Failed open from FP");
-        goto err_ops;
-    }
+    return 0;
+}
 
-    ret->surf = IMG_Load_RW(ret->ops, 0);
-    if (ret->surf == NULL) {
-        PRINT_SDL_ERROR("Failed to load image");
-        goto err_surf;
+int tumDrawLayer(layer_handle_t layer, signed short x, signed short y)
+{
+    if (layer == NULL) {
+        return -1;
     }
 
-    ret->tex = SDL_CreateTextureFromSurface(renderer, ret->surf);
-    if (ret->tex == NULL) {
-        PRINT_SDL_ERROR("Failed to create texture from surface");
-        goto err_tex;
+    /** Layers cannot be rendered while rendering another layer */
+    if (recording_layer) {
+        PRINT_ERROR("Layers cannot be drawn into layers");
+        return -1;
     }
 
-    SDL_QueryTexture(ret->tex, NULL, NULL, &ret->w, &ret->h);
+    INIT_JOB(job, DRAW_LAYER);
 
-    ret->scale = scale;
+    atomic_fetch_add(&((draw_layer_t *)layer)->ref_count, 1);
+    job->data->layer.layer = layer;
+    job->data->layer.x = x;
+    job->data->layer.y = y;
 
-    pthread_mutex_lock(&loaded_images_lock);
+    return 0;
+}
 
-    loaded_image_t *iterator = &loaded_images_list;
-    for (; iterator->next; iterator = iterator->next)
-        ;
-    iterator->next = ret;
+void tumDrawSetRetainedMode(unsigned char enable)
+{
+    atomic_store(&retained.enabled, enable ? 1 : 0);
+}
 
-    pthread_mutex_unlock(&loaded_images_lock);
+void tumDrawSetJobSorting(unsigned char enable)
+{
+    atomic_store(&job_sort.enabled, enable ? 1 : 0);
+}
 
-    return ret;
+const char *tumDrawGetJobTypeName(unsigned int type)
+{
+    if (type >= DRAW_JOB_TYPES) {
+        return NULL;
+    }
 
-err_tex:
-    SDL_FreeSurface(ret->surf);
-err_surf:
-    SDL_RWclose(ret->ops);
-err_ops:
-    fclose(ret->file);
-err_file_open:
-    free(ret->filename);
-err_filename:
-    free(ret);
-err_alloc:
-    return NULL;
+    return draw_job_type_names[type];
 }
 
-image_handle_t tumDrawLoadImage(char *filename)
+void tumDrawAddFrameTime(tum_frame_phase_e phase, uint64_t ns)
 {
-    return tumDrawLoadScaledImage(filename, 1);
+    if (phase >= TUM_FRAME_PHASES) {
+        return;
+    }
+
+    atomic_fetch_add_explicit(&frame_timing.phase_ns[phase], ns,
+                              memory_order_relaxed);
 }
 
-int tumDrawFreeLoadedImage(image_handle_t *img)
+unsigned int tumDrawGetFrameTimings(tum_frame_timing_t *frames,
+                                    unsigned int count)
 {
-    int ret = 0;
-    loaded_image_t **loaded_img = (loaded_image_t **)img;
+    unsigned int i, first;
 
-    if (!(*loaded_img)->ref_count) {
-        ret = freeLoadedImage(loaded_img);
-    }
-    else {
-        (*loaded_img)->pending_free = 1;
+    if (frames == NULL) {
+        return 0;
     }
 
-    return ret;
-}
+    pthread_mutex_lock(&frame_timing.lock);
 
-int tumDrawLoadedImage(image_handle_t img, signed short x, signed short y)
-{
-    if (img == NULL) {
-        return -1;
+    if (count > frame_timing.count) {
+        count = frame_timing.count;
     }
 
-    INIT_JOB(job, DRAW_LOADED_IMAGE);
+    first = (frame_timing.head + TUM_DRAW_FRAME_HISTORY - count) %
+            TUM_DRAW_FRAME_HISTORY;
 
-    ((loaded_image_t *)img)->ref_count++;
-    job->data->loaded_image.img = img;
-    job->data->loaded_image.x = x;
-    job->data->loaded_image.y = y;
+    for (i = 0; i < count; i++) {
+        frames[i] = frame_timing.frames[(first + i) % TUM_DRAW_FRAME_HISTORY];
+    }
 
-    return 0;
+    pthread_mutex_unlock(&frame_timing.lock);
+
+    return count;
 }
 
-int tumDrawSetLoadedImageScale(image_handle_t img, float scale)
+static int writeFrameTimingsCSV(FILE *file, tum_frame_timing_t *frames,
+                                unsigned int count)
 {
-    if (img == NULL) {
-        return -1;
+    unsigned int i, j;
+
+    fprintf(file, "start_ns,period_ns,record_ns,drain_ns,present_ns,"
+            "events_ns");
+    for (j = 0; j < DRAW_JOB_TYPES; j++) {
+        fprintf(file, ",%s_ns,%s_count", draw_job_type_names[j],
+                draw_job_type_names[j]);
     }
+    fprintf(file, ",state_changes,state_changes_avoided\n");
 
-    ((loaded_image_t *)img)->scale = scale;
+    for (i = 0; i < count; i++) {
+        fprintf(file, "%llu,%u", (unsigned long long)frames[i].start_ns,
+                frames[i].period_ns);
+        for (j = 0; j < TUM_FRAME_PHASES; j++) {
+            fprintf(file, ",%u", frames[i].phase_ns[j]);
+        }
+        for (j = 0; j < DRAW_JOB_TYPES; j++) {
+            fprintf(file, ",%u,%u", frames[i].job_ns[j],
+                    frames[i].job_count[j]);
+        }
+        if (fprintf(file, ",%u,%u\n", frames[i].state_changes,
+                    frames[i].state_changes_avoided) < 0) {
+            return -1;
+        }
+    }
 
     return 0;
 }
 
-float tumDrawGetLoadedImageScale(image_handle_t img)
+int tumDrawDumpFrameTimings(const char *filename, int flags)
 {
-    if (img == NULL) {
-        return -1;
+    frame_dump_header_t header = { .magic = FRAME_DUMP_MAGIC,
+                                   .version = FRAME_DUMP_VERSION,
+                                   .frame_size = sizeof(tum_frame_timing_t) };
+    tum_frame_timing_t *frames;
+    FILE *file;
+    int ret = -1;
+
+    frames = malloc(TUM_DRAW_FRAME_HISTORY * sizeof(tum_frame_timing_t));
+    if (frames == NULL) {
+        PRINT_ERROR("Allocating frame timings failed");
+        goto err_alloc;
     }
 
-    return ((loaded_image_t *)img)->scale;
-}
+    header.count = tumDrawGetFrameTimings(frames, TUM_DRAW_FRAME_HISTORY);
 
-int tumDrawGetLoadedImageWidth(image_handle_t img)
-{
-    if (img == NULL) {
-        return -1;
+    file = fopen(filename, (flags & TUM_FRAME_DUMP_BINARY) ? "wb" : "w");
+    if (file == NULL) {
+        PRINT_ERROR("Failed to open frame timing dump '%s'", filename);
+        goto err_open;
     }
 
-    return ((loaded_image_t *)img)->w * ((loaded_image_t *)img)->scale;
-}
+    if (flags & TUM_FRAME_DUMP_BINARY) {
+        if (fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(frames, sizeof(tum_frame_timing_t), header.count, file) ==
+            header.count) {
+            ret = 0;
+        }
+    }
+    else {
+        ret = writeFrameTimingsCSV(file, frames, header.count);
+    }
 
-int tumDrawGetLoadedImageHeight(image_handle_t img)
-{
-    if (img == NULL) {
-        return -1;
+    if (fclose(file) || ret) {
+        PRINT_ERROR("Failed to write frame timing dump '%s'", filename);
+        ret = -1;
     }
 
-    return ((loaded_image_t *)img)->h * ((loaded_image_t *)img)->scale;
+err_open:
+    free(frames);
+err_alloc:
+    return ret;
 }
 
-int tumDrawGetLoadedImageSize(image_handle_t img, int *w, int *h)
+void tumDrawSetSoftwareRendering(unsigned char enable)
 {
-    if (img == NULL) {
-        return -1;
-    }
+    atomic_store(&software.enabled, enable ? 1 : 0);
+}
 
-    *w = tumDrawGetLoadedImageWidth(img);
-    *h = tumDrawGetLoadedImageHeight(img);
+int tumDrawReadSoftwareFramebuffer(uint32_t *pixels)
+{
+    int ret = -1;
 
-    if (*w == -1 || *h == -1) {
+    if (pixels == NULL) {
         return -1;
     }
 
-    return 0;
+    pthread_mutex_lock(&software.lock);
+    if (software.pixels) {
+        memcpy(pixels, software.pixels,
+               software.w * software.h * sizeof(uint32_t));
+        ret = 0;
+    }
+    pthread_mutex_unlock(&software.lock);
+
+    return ret;
 }
 
-int __attribute_deprecated__ tumDrawImage(char *filename, signed short x,
-        signed short y)
+int tumDrawSetResolution(int width, int height)
 {
-    INIT_JOB(job, DRAW_IMAGE);
-
-    char abs_path[PATH_MAX + 1];
-
-    if (realpath(filename, (char *)abs_path) == NULL) {
+    if (width <= 0 || height <= 0) {
+        PRINT_ERROR("Invalid resolution %d x %d", width, height);
         return -1;
     }
 
-    job->data->image.filename = calloc(strlen(abs_path) + 1, sizeof(char));
-    strcpy(job->data->image.filename, abs_path);
-    job->data->image.x = x;
-    job->data->image.y = y;
+    pthread_mutex_lock(&resolution.lock);
+    resolution.width = width;
+    resolution.height = height;
+    resolution.changed = 1;
+    pthread_mutex_unlock(&resolution.lock);
 
     return 0;
 }
 
-int __attribute_deprecated__ tumGetImageSize(char *filename, int *w, int *h)
+int tumDrawGetScreenWidth(void)
 {
-    char full_filename[PATH_MAX + 1];
-    realpath(filename, full_filename);
-    return _getImageSize(full_filename, w, h);
+    int width;
+
+    pthread_mutex_lock(&resolution.lock);
+    width = resolution.width;
+    pthread_mutex_unlock(&resolution.lock);
+
+    return width;
 }
 
-int __attribute_deprecated__ tumDrawScaledImage(char *filename, signed short x,
-        signed short y, float scale)
+int tumDrawGetScreenHeight(void)
 {
-    INIT_JOB(job, DRAW_SCALED_IMAGE);
+    int height;
 
-    char abs_path[PATH_MAX + 1];
+    pthread_mutex_lock(&resolution.lock);
+    height = resolution.height;
+    pthread_mutex_unlock(&resolution.lock);
 
-    if (realpath(filename, (char *)abs_path) == NULL) {
+    return height;
+}
+
+int tumDrawSetWindowSize(int width, int height)
+{
+    if (width <= 0 || height <= 0) {
+        PRINT_ERROR("Invalid window size %d x %d", width, height);
         return -1;
     }
 
-    job->data->scaled_image.image.filename =
-        calloc(strlen(abs_path) + 1, sizeof(char));
-    strcpy(job->data->scaled_image.image.filename, abs_path);
-    job->data->scaled_image.image.x = x;
-    job->data->scaled_image.image.y = y;
-    job->data->scaled_image.scale = scale;
+    pthread_mutex_lock(&resolution.lock);
+    resolution.window_width = width;
+    resolution.window_height = height;
+    resolution.changed = 1;
+    pthread_mutex_unlock(&resolution.lock);
 
     return 0;
 }
 
-int tumDrawArrow(signed short x1, signed short y1, signed short x2,
-                 signed short y2, signed short head_length,
-                 unsigned char thickness, unsigned int colour)
+int tumDrawSetRenderScale(float scale)
 {
-    INIT_JOB(job, DRAW_ARROW);
+    if (!(scale > 0 && scale <= 1)) {
+        PRINT_ERROR("Invalid render scale %f", scale);
+        return -1;
+    }
 
-    job->data->arrow.x1 = x1;
-    job->data->arrow.y1 = y1;
-    job->data->arrow.x2 = x2;
-    job->data->arrow.y2 = y2;
-    job->data->arrow.head_length = head_length;
-    job->data->arrow.thickness = thickness;
-    job->data->arrow.colour = colour;
+    pthread_mutex_lock(&resolution.lock);
+    resolution.scale = scale;
+    resolution.changed = 1;
+    pthread_mutex_unlock(&resolution.lock);
 
     return 0;
 }
 
-int tumDrawAnimationDrawFrame(sequence_handle_t sequence, unsigned ms_timestep,
-                              int x, int y)
+int tumDrawCaptureStart(const char *filename, tum_capture_format_e format,
+                        unsigned int delay)
 {
-    if (sequence == NULL) {
-        PRINT_ERROR("Trying to draw invalid sequence");
-        goto err;
-    }
+    char *copy;
 
-    animated_sequence_instance_t *anim =
-        (animated_sequence_instance_t *)sequence;
-
-    anim->cur_frame_timestamp += ms_timestep;
+    if (filename == NULL ||
+        (format != TUM_CAPTURE_PNG && format != TUM_CAPTURE_Y4M)) {
+        return -1;
+    }
 
-    if (anim->cur_frame_timestamp >
-        (anim->prev_frame_timestamp + anim->frame_period_ms)) {
-        anim->current_frame += ((anim->cur_frame_timestamp -
-                                 anim->prev_frame_timestamp) /
-                                anim->frame_period_ms);
-        anim->current_frame %= anim->sequence->frames;
-        anim->prev_frame_timestamp += (((anim->cur_frame_timestamp -
-                                         anim->prev_frame_timestamp) /
-                                        anim->frame_period_ms) *
-                                       anim->frame_period_ms);
+    if (delay > TUM_DRAW_CAPTURE_MAX_DELAY) {
+        PRINT_ERROR("Capture delay %u exceeds %d", delay,
+                    TUM_DRAW_CAPTURE_MAX_DELAY);
+        return -1;
     }
 
-    INIT_JOB(job, DRAW_LOADED_IMAGE_CROP);
+    copy = strdup(filename);
+    if (copy == NULL) {
+        PRINT_ERROR("Failed to allocate capture filename");
+        return -1;
+    }
 
-    anim->image->spritesheet->image->ref_count++;
-    job->data->loaded_image_crop.image = anim->image->spritesheet->image;
-    job->data->loaded_image_crop.x = x;
-    job->data->loaded_image_crop.y = y;
-    job->data->loaded_image_crop.c_w =
-        anim->image->spritesheet->sprite_width;
-    job->data->loaded_image_crop.c_h =
-        anim->image->spritesheet->sprite_height;
-
-    switch (anim->sequence->direction) {
-        case SPRITE_SEQUENCE_HORIZONTAL_POS:
-            job->data->loaded_image_crop.c_x =
-                (anim->current_frame + anim->sequence->start_col) *
-                anim->image->spritesheet->sprite_width;
-            job->data->loaded_image_crop.c_y =
-                anim->sequence->start_row *
-                anim->image->spritesheet->sprite_height;
-            break;
-        case SPRITE_SEQUENCE_HORIZONTAL_NEG:
-            job->data->loaded_image_crop.c_x =
-                (anim->sequence->start_col - anim->current_frame) *
-                anim->image->spritesheet->sprite_width;
-            job->data->loaded_image_crop.c_y =
-                anim->sequence->start_row *
-                anim->image->spritesheet->sprite_height;
-            break;
-        case SPRITE_SEQUENCY_VERTICAL_POS:
-            job->data->loaded_image_crop.c_x =
-                anim->sequence->start_col *
-                anim->image->spritesheet->sprite_height;
-            job->data->loaded_image_crop.c_y =
-                (anim->current_frame + anim->sequence->start_row) *
-                anim->image->spritesheet->sprite_width;
-            break;
-        case SPRITE_SEQUENCY_VERTICAL_NEG:
-            job->data->loaded_image_crop.c_x =
-                anim->sequence->start_col *
-                anim->image->spritesheet->sprite_height;
-            job->data->loaded_image_crop.c_y =
-                (anim->sequence->start_row - anim->current_frame) *
-                anim->image->spritesheet->sprite_width;
-            break;
-        default:
-            break;
+    pthread_mutex_lock(&frame_capture.lock);
+    if (frame_capture.session) {
+        PRINT_ERROR("Already capturing to '%s'", frame_capture.filename);
+        pthread_mutex_unlock(&frame_capture.lock);
+        free(copy);
+        return -1;
+    }
+    free(frame_capture.filename);
+    frame_capture.filename = copy;
+    frame_capture.format = format;
+    frame_capture.delay = delay;
+    if (++frame_capture.sessions == 0) {
+        frame_capture.sessions++;
     }
+    frame_capture.session = frame_capture.sessions;
+    pthread_mutex_unlock(&frame_capture.lock);
 
     return 0;
-
-err:
-    return -1;
 }
 
-int tumDrawSetGlobalXOffset(int offset)
+int tumDrawCaptureStop(void)
 {
-    int ret;
+    int ret = 0;
 
-    if (!(ret = pthread_mutex_lock(&global_offset.lock))) {
-        global_offset.x = offset;
-        pthread_mutex_unlock(&global_offset.lock);
+    pthread_mutex_lock(&frame_capture.lock);
+    if (frame_capture.session) {
+        frame_capture.session = 0;
     }
     else {
-        PRINT_ERROR("Could not set global X offset");
+        ret = -1;
     }
+    pthread_mutex_unlock(&frame_capture.lock);
 
     return ret;
 }
 
-int tumDrawSetGlobalYOffset(int offset)
+int tumDrawScreenshot(const char *filename)
 {
-    int ret;
+    char *copy;
 
-    if (!(ret = pthread_mutex_lock(&global_offset.lock))) {
-        global_offset.y = offset;
-        pthread_mutex_unlock(&global_offset.lock);
+    if (filename == NULL) {
+        return -1;
     }
-    else {
-        PRINT_ERROR("Could not set global Y offset");
+
+    copy = strdup(filename);
+    if (copy == NULL) {
+        PRINT_ERROR("Failed to allocate screenshot filename");
+        return -1;
     }
 
-    return ret;
+    pthread_mutex_lock(&frame_capture.lock);
+    if (frame_capture.screenshot) {
+        pthread_mutex_unlock(&frame_capture.lock);
+        PRINT_ERROR("Screenshot '%s' is still pending", filename);
+        free(copy);
+        return -1;
+    }
+    frame_capture.screenshot = copy;
+    pthread_mutex_unlock(&frame_capture.lock);
+
+    return 0;
 }
 
-int tumDrawGetGlobalXOffset(int *offset)
+unsigned int tumDrawCaptureGetDropped(void)
 {
-    int ret;
+    return tumCaptureGetDropped();
+}
 
-    if (!(ret = pthread_mutex_lock(&global_offset.lock))) {
-        *offset = global_offset.x;
-        pthread_mutex_unlock(&global_offset.lock);
-    }
-    else {
-        PRINT_ERROR("Could not get global X offset");
+int tumDrawStreamStart(tum_stream_type_e type, const char *address,
+                       int flags)
+{
+    if (tumStreamIsOpen()) {
+        PRINT_ERROR("Already streaming");
+        return -1;
     }
 
-    return ret;
+    return tumStreamOpen(type, address, flags);
 }
 
-int tumDrawGetGlobalYOffset(int *offset)
+void tumDrawStreamStop(void)
 {
-    int ret;
-
-    if (!(ret = pthread_mutex_lock(&global_offset.lock))) {
-        *offset = global_offset.y;
-        pthread_mutex_unlock(&global_offset.lock);
-    }
-    else {
-        PRINT_ERROR("Could not get global Y offset");
-    }
+    tumStreamClose();
+}
 
-    return ret;
+unsigned int tumDrawStreamGetDropped(void)
+{
+    return tumStreamGetDropped();
 }
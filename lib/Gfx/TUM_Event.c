@@ -23,6 +23,10 @@
 
 #include <linux/unistd.h>
 #include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "TUM_Event.h"
 #include "task.h"
@@ -34,28 +38,90 @@
 #include "TUM_Draw.h"
 #include "TUM_Utils.h"
 
-typedef struct mouse {
-    xSemaphoreHandle lock;
-    signed char left_button;
-    signed char right_button;
-    signed char middle_button;
-    signed short x;
-    signed short y;
-} mouse_t;
-
 QueueHandle_t buttonInputQueue = NULL;
 
-mouse_t mouse;
-
 xSemaphoreHandle fetch_lock;
 
-static int initMouse(void)
-{
-    mouse.lock = xSemaphoreCreateMutex();
-    if (!mouse.lock) {
-        return -1;
-    }
+/**
+ * Double buffered seqlock holding the published input state. seq is odd while
+ * the fetching task writes the inactive buffer, the active buffer is
+ * state[(seq >> 1) & 1]. A reader only has to retry if a whole publish and
+ * the start of the next one happened while it was copying, as such a reader
+ * that preempts the writer never spins waiting on it. head holds the position
+ * in the event stream each state is up to date with.
+ */
+static struct {
+    atomic_uint seq;
+    tum_event_snapshot_t state[2];
+    unsigned int head[2];
+} snapshot;
 
+/**
+ * Input event stream, writers are serialised by fetch_lock. write_pos is
+ * advanced before a slot is overwritten and head once it is complete, readers
+ * check write_pos after copying a slot to detect it having been overwritten.
+ */
+static tum_event_t event_ring[TUM_EVENT_RING_SIZE];
+static atomic_uint event_write_pos;
+static atomic_uint event_head;
+
+typedef struct event_sub {
+    unsigned int mask;
+    unsigned int cursor;
+    unsigned int lost;
+    tum_event_snapshot_t state;
+    xSemaphoreHandle signal;
+    struct event_sub *next;
+} event_sub_t;
+
+static event_sub_t *event_subs = NULL;
+
+/** Input state as seen by the fetching task, protected by fetch_lock */
+static unsigned char input_buttons[SDL_NUM_SCANCODES] = { 0 };
+static tum_event_snapshot_t input_state = { 0 };
+/** Event types pushed since the last fan out, protected by fetch_lock */
+static unsigned int input_pending = 0;
+
+/**
+ * Recording file layout, all fields in host byte order: a record_header_t,
+ * holding the input state at the start of the recording, followed by one
+ * tum_event_t per event, event ticks being relative to the start of the
+ * recording.
+ */
+#define RECORD_MAGIC "TUMI"
+#define RECORD_VERSION 2
+
+typedef struct record_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t event_size;
+    uint32_t tick_rate;
+    uint32_t state_size;
+    tum_event_snapshot_t state;
+} record_header_t;
+
+#define MOUSE_BUTTONS (TUM_MOUSE_LEFT | TUM_MOUSE_RIGHT | TUM_MOUSE_MIDDLE)
+
+_Static_assert(sizeof(tum_event_t) == 12, "tum_event_t must stay packed");
+
+static struct {
+    FILE *file;
+    TickType_t start;
+} record = { 0 };
+
+static struct {
+    tum_event_t *events;
+    size_t count;
+    size_t next;
+    TickType_t start;
+    unsigned char headless;
+    atomic_uint finished;
+} replay = { 0 };
+
+static xSemaphoreHandle event_subs_lock = NULL;
+
+static int initFetchLock(void)
+{
     fetch_lock = xSemaphoreCreateMutex();
     if (!fetch_lock) {
         return -1;
@@ -64,79 +130,327 @@ static int initMouse(void)
     return 0;
 }
 
+static void publishSnapshot(tum_event_snapshot_t *state)
+{
+    unsigned int seq =
+        atomic_load_explicit(&snapshot.seq, memory_order_relaxed);
+
+    atomic_store_explicit(&snapshot.seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    snapshot.state[((seq >> 1) + 1) & 1] = *state;
+    snapshot.head[((seq >> 1) + 1) & 1] =
+        atomic_load_explicit(&event_head, memory_order_relaxed);
+
+    atomic_store_explicit(&snapshot.seq, seq + 2, memory_order_release);
+}
+
+/** Returns the position in the event stream the snapshot is up to date with */
+static unsigned int readSnapshot(tum_event_snapshot_t *snap)
+{
+    unsigned int before, after, head;
+
+    do {
+        before = atomic_load_explicit(&snapshot.seq, memory_order_acquire);
+        *snap = snapshot.state[(before >> 1) & 1];
+        head = snapshot.head[(before >> 1) & 1];
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&snapshot.seq, memory_order_relaxed);
+    } while (after - (before & ~1U) >= 3);
+
+    return head;
+}
+
+void tumEventGetSnapshot(tum_event_snapshot_t *snap)
+{
+    readSnapshot(snap);
+}
+
+static void setKey(tum_event_snapshot_t *state, SDL_Scancode scancode,
+                   unsigned char pressed)
+{
+    if (pressed) {
+        state->keys[scancode / 32] |= 1U << (scancode % 32);
+    }
+    else {
+        state->keys[scancode / 32] &= ~(1U << (scancode % 32));
+    }
+}
+
+static void pushEvent(tum_event_t *event)
+{
+    unsigned int head =
+        atomic_load_explicit(&event_head, memory_order_relaxed);
+
+    atomic_store_explicit(&event_write_pos, head + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    event_ring[head & (TUM_EVENT_RING_SIZE - 1)] = *event;
+
+    atomic_store_explicit(&event_head, head + 1, memory_order_release);
+}
+
+static void applyEvent(tum_event_snapshot_t *state, tum_event_t *event)
+{
+    switch (event->type) {
+        case TUM_EVENT_KEY_PRESSED:
+            setKey(state, event->scancode, 1);
+            break;
+        case TUM_EVENT_KEY_RELEASED:
+            setKey(state, event->scancode, 0);
+            break;
+        case TUM_EVENT_MOUSE_PRESSED:
+            state->mouse_buttons |= event->button;
+            break;
+        case TUM_EVENT_MOUSE_RELEASED:
+            state->mouse_buttons &= ~event->button;
+            break;
+        case TUM_EVENT_MOUSE_MOTION:
+            state->mouse_x = event->x;
+            state->mouse_y = event->y;
+            break;
+        case TUM_EVENT_MOUSE_WHEEL:
+            state->wheel_x += event->x;
+            state->wheel_y += event->y;
+            break;
+        default:
+            break;
+    }
+}
+
+static void notifySubscribers(unsigned int mask)
+{
+    event_sub_t *sub;
+
+    xSemaphoreTake(event_subs_lock, portMAX_DELAY);
+    for (sub = event_subs; sub; sub = sub->next)
+        if (sub->mask & mask) {
+            xSemaphoreGive(sub->signal);
+        }
+    xSemaphoreGive(event_subs_lock);
+}
+
+static unsigned char mouseButtonBit(unsigned char button)
+{
+    switch (button) {
+        case SDL_BUTTON_LEFT:
+            return TUM_MOUSE_LEFT;
+        case SDL_BUTTON_RIGHT:
+            return TUM_MOUSE_RIGHT;
+        case SDL_BUTTON_MIDDLE:
+            return TUM_MOUSE_MIDDLE;
+        default:
+            return 0;
+    }
+}
+
+static void recordEvent(tum_event_t *ev)
+{
+    tum_event_t rec = *ev;
+
+    rec.tick -= record.start;
+
+    if (fwrite(&rec, sizeof(rec), 1, record.file) != 1) {
+        PRINT_ERROR("Failed to write input recording, stopping");
+        fclose(record.file);
+        record.file = NULL;
+    }
+}
+
+static unsigned int emitEvent(tum_event_t *ev)
+{
+    if (ev->type == TUM_EVENT_KEY_PRESSED) {
+        input_buttons[ev->scancode] = 1;
+    }
+    else if (ev->type == TUM_EVENT_KEY_RELEASED) {
+        input_buttons[ev->scancode] = 0;
+    }
+
+    applyEvent(&input_state, ev);
+    pushEvent(ev);
+
+    if (record.file) {
+        recordEvent(ev);
+    }
+
+    return TUM_EVENT_MASK(ev->type);
+}
+
+static unsigned int replayEvents(void)
+{
+    TickType_t elapsed = xTaskGetTickCount() - replay.start;
+    unsigned int pushed = 0;
+    tum_event_t ev;
+
+    while (replay.next < replay.count &&
+           replay.events[replay.next].tick <= elapsed) {
+        ev = replay.events[replay.next++];
+        ev.tick += replay.start;
+        pushed |= emitEvent(&ev);
+    }
+
+    if (replay.next == replay.count) {
+        free(replay.events);
+        replay.events = NULL;
+        replay.headless = 0;
+        atomic_store(&replay.finished, 1);
+    }
+
+    return pushed;
+}
+
+/** Must be called from the thread holding the GL context */
+/** Emits the events taking the input state to a recording's initial state */
+static unsigned int restoreInputState(tum_event_snapshot_t *state,
+                                      TickType_t tick)
+{
+    tum_event_t ev = { .tick = tick };
+    unsigned int pushed = 0;
+    unsigned char pressed;
+    unsigned short scancode;
+
+    for (scancode = 0; scancode < SDL_NUM_SCANCODES; scancode++) {
+        pressed = TUM_EVENT_KEY_DOWN(state, scancode);
+        if (pressed != TUM_EVENT_KEY_DOWN(&input_state, scancode)) {
+            ev.type = pressed ? TUM_EVENT_KEY_PRESSED :
+                                TUM_EVENT_KEY_RELEASED;
+            ev.scancode = scancode;
+            pushed |= emitEvent(&ev);
+        }
+    }
+    ev.scancode = 0;
+
+    ev.button = input_state.mouse_buttons & ~state->mouse_buttons;
+    if (ev.button) {
+        ev.type = TUM_EVENT_MOUSE_RELEASED;
+        pushed |= emitEvent(&ev);
+    }
+
+    ev.button = state->mouse_buttons & ~input_state.mouse_buttons;
+    if (ev.button) {
+        ev.type = TUM_EVENT_MOUSE_PRESSED;
+        pushed |= emitEvent(&ev);
+    }
+    ev.button = 0;
+
+    if (state->mouse_x != input_state.mouse_x ||
+        state->mouse_y != input_state.mouse_y) {
+        ev.type = TUM_EVENT_MOUSE_MOTION;
+        ev.x = state->mouse_x;
+        ev.y = state->mouse_y;
+        pushed |= emitEvent(&ev);
+    }
+
+    return pushed;
+}
+
 static void SDLFetchEvents(void)
 {
     SDL_Event event = { 0 };
-    static unsigned char buttons[SDL_NUM_SCANCODES] = { 0 };
-    unsigned char send = 0;
+    tum_event_t ev = { 0 };
+    tum_event_t motion = { 0 };
+    unsigned int pushed = 0;
+
+    ev.tick = motion.tick = xTaskGetTickCount();
 
-    while (SDL_PollEvent(&event)) {
+    while (!replay.headless && SDL_PollEvent(&event)) {
         if ((event.type == SDL_QUIT) ||
             (event.key.keysym.scancode == SDL_SCANCODE_Q)) {
             exit(EXIT_SUCCESS);
         }
+        /** Live input is dropped while a recording is replayed */
+        else if (replay.events) {
+            continue;
+        }
         else if (event.type == SDL_KEYDOWN) {
-            xSemaphoreTake(mouse.lock, 0);
-            buttons[event.key.keysym.scancode] = 1;
-            xSemaphoreGive(mouse.lock);
-            send = 1;
+            /** Auto repeat is not an edge */
+            if (event.key.repeat) {
+                continue;
+            }
+            ev.type = TUM_EVENT_KEY_PRESSED;
+            ev.scancode = event.key.keysym.scancode;
         }
         else if (event.type == SDL_KEYUP) {
-            xSemaphoreTake(mouse.lock, 0);
-            buttons[event.key.keysym.scancode] = 0;
-            xSemaphoreGive(mouse.lock);
-            send = 1;
+            ev.type = TUM_EVENT_KEY_RELEASED;
+            ev.scancode = event.key.keysym.scancode;
         }
         else if (event.type == SDL_MOUSEMOTION) {
-            xSemaphoreTake(mouse.lock, 0);
-            mouse.x = event.motion.x;
-            mouse.y = event.motion.y;
-            xSemaphoreGive(mouse.lock);
+            /** Consecutive motion is pushed once, as the last position */
+            motion.type = TUM_EVENT_MOUSE_MOTION;
+            motion.x = event.motion.x;
+            motion.y = event.motion.y;
+            continue;
         }
         else if (event.type == SDL_MOUSEBUTTONDOWN) {
-            xSemaphoreTake(mouse.lock, 0);
-            switch (event.button.button) {
-                case SDL_BUTTON_LEFT:
-                    mouse.left_button = 1;
-                    break;
-                case SDL_BUTTON_RIGHT:
-                    mouse.right_button = 1;
-                    break;
-                case SDL_BUTTON_MIDDLE:
-                    mouse.middle_button = 1;
-                    break;
-                default:
-                    break;
-            }
-            send = 1;
-            xSemaphoreGive(mouse.lock);
+            ev.type = TUM_EVENT_MOUSE_PRESSED;
+            ev.button = mouseButtonBit(event.button.button);
         }
         else if (event.type == SDL_MOUSEBUTTONUP) {
-            xSemaphoreTake(mouse.lock, 0);
-            switch (event.button.button) {
-                case SDL_BUTTON_LEFT:
-                    mouse.left_button = 0;
-                    break;
-                case SDL_BUTTON_RIGHT:
-                    mouse.right_button = 0;
-                    break;
-                case SDL_BUTTON_MIDDLE:
-                    mouse.middle_button = 0;
-                    break;
-                default:
-                    break;
-            }
-            send = 1;
-            xSemaphoreGive(mouse.lock);
+            ev.type = TUM_EVENT_MOUSE_RELEASED;
+            ev.button = mouseButtonBit(event.button.button);
+        }
+        else if (event.type == SDL_MOUSEWHEEL) {
+            ev.type = TUM_EVENT_MOUSE_WHEEL;
+            ev.x = event.wheel.x;
+            ev.y = event.wheel.y;
+        }
+        else {
+            continue;
+        }
+
+        if (motion.type == TUM_EVENT_MOUSE_MOTION) {
+            pushed |= emitEvent(&motion);
+            motion.type = 0;
         }
+
+        pushed |= emitEvent(&ev);
+        ev.x = ev.y = ev.button = ev.scancode = 0;
+    }
+
+    if (motion.type == TUM_EVENT_MOUSE_MOTION) {
+        pushed |= emitEvent(&motion);
+    }
+
+    input_pending |= pushed;
+}
+
+/**
+ * Injects due replay events and publishes everything pushed since the last
+ * call to the snapshot, subscribers and buttonInputQueue
+ */
+static void fanOutEvents(void)
+{
+    unsigned int pushed;
+
+    if (replay.events) {
+        input_pending |= replayEvents();
+    }
+
+    pushed = input_pending;
+    input_pending = 0;
+
+    if (pushed) {
+        publishSnapshot(&input_state);
+        notifySubscribers(pushed);
     }
 
-    if (send) {
-        xQueueOverwrite(buttonInputQueue, &buttons);
-        send = 0;
+    if (pushed & (TUM_EVENT_MASK_KEYS |
+                  TUM_EVENT_MASK(TUM_EVENT_MOUSE_PRESSED) |
+                  TUM_EVENT_MASK(TUM_EVENT_MOUSE_RELEASED))) {
+        xQueueOverwrite(buttonInputQueue, &input_buttons);
     }
 }
 
+static void fetchEvents(void)
+{
+    uint64_t start = tumUtilGetTimeNs();
+
+    SDLFetchEvents();
+    fanOutEvents();
+
+    tumDrawAddFrameTime(TUM_FRAME_EVENTS, tumUtilGetTimeNs() - start);
+}
+
 #define FETCH_BLOCK_S 0
 #define FETCH_NONBLOCK_S 1
 #define FETCH_NO_GL_CHECK_S 2
@@ -152,13 +466,13 @@ int tumEventFetchEvents(int flags)
 
     if ((flags >> FETCH_BLOCK_S) & 0x01) {
         xSemaphoreTake(fetch_lock, portMAX_DELAY);
-        SDLFetchEvents();
+        fetchEvents();
         xSemaphoreGive(fetch_lock);
         return 0;
     }
     else {
         if (xSemaphoreTake(fetch_lock, 0) == pdTRUE) {
-            SDLFetchEvents();
+            fetchEvents();
             xSemaphoreGive(fetch_lock);
             return 0;
         }
@@ -166,71 +480,371 @@ int tumEventFetchEvents(int flags)
     return -1;
 }
 
+/**
+ * Skips the events a subscription fell too far behind on. The events skipped
+ * can no longer be applied to the subscription's state, which is instead
+ * reloaded from the snapshot, reading on from the position the snapshot is up
+ * to date with.
+ */
+static void resyncSubscriber(event_sub_t *sub, unsigned int head)
+{
+    unsigned int cursor = readSnapshot(&sub->state);
+
+    /**
+     * More events than the ring holds since the snapshot was published, a
+     * snapshot newer than head is fine as head is read again
+     */
+    if ((int)(head - cursor) > TUM_EVENT_RING_SIZE) {
+        cursor = head - TUM_EVENT_RING_SIZE;
+    }
+
+    sub->lost += cursor - sub->cursor;
+    sub->cursor = cursor;
+}
+
+/** Must only be called by the subscription's own task */
+static int readEvent(event_sub_t *sub, tum_event_t *event)
+{
+    unsigned int head;
+
+    for (;;) {
+        head = atomic_load_explicit(&event_head, memory_order_acquire);
+        if (sub->cursor == head) {
+            return -1;
+        }
+
+        if (head - sub->cursor > TUM_EVENT_RING_SIZE) {
+            resyncSubscriber(sub, head);
+            continue;
+        }
+
+        *event = event_ring[sub->cursor & (TUM_EVENT_RING_SIZE - 1)];
+        atomic_thread_fence(memory_order_acquire);
+
+        /** Slot was overwritten while copying it */
+        if (atomic_load_explicit(&event_write_pos, memory_order_relaxed) -
+            sub->cursor >
+            TUM_EVENT_RING_SIZE) {
+            continue;
+        }
+
+        sub->cursor++;
+        return 0;
+    }
+}
+
+event_sub_handle_t tumEventSubscribe(unsigned int mask)
+{
+    event_sub_t *sub = calloc(1, sizeof(event_sub_t));
+    if (sub == NULL) {
+        PRINT_ERROR("Failed to allocate event subscription");
+        goto err_alloc;
+    }
+
+    sub->signal = xSemaphoreCreateBinary();
+    if (sub->signal == NULL) {
+        PRINT_ERROR("Failed to create event subscription signal");
+        goto err_signal;
+    }
+
+    sub->mask = mask;
+    sub->cursor = readSnapshot(&sub->state);
+
+    xSemaphoreTake(event_subs_lock, portMAX_DELAY);
+    sub->next = event_subs;
+    event_subs = sub;
+    xSemaphoreGive(event_subs_lock);
+
+    return (event_sub_handle_t)sub;
+
+err_signal:
+    free(sub);
+err_alloc:
+    return NULL;
+}
+
+void tumEventUnsubscribe(event_sub_handle_t sub)
+{
+    event_sub_t **iterator;
+
+    if (sub == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(event_subs_lock, portMAX_DELAY);
+    for (iterator = &event_subs; *iterator; iterator = &(*iterator)->next)
+        if (*iterator == sub) {
+            *iterator = ((event_sub_t *)sub)->next;
+            break;
+        }
+    xSemaphoreGive(event_subs_lock);
+
+    vSemaphoreDelete(((event_sub_t *)sub)->signal);
+    free(sub);
+}
+
+int tumEventReceive(event_sub_handle_t sub, tum_event_t *event,
+                    TickType_t xTicksToWait)
+{
+    event_sub_t *s = (event_sub_t *)sub;
+    TimeOut_t timeout;
+
+    if (s == NULL || event == NULL) {
+        return -1;
+    }
+
+    vTaskSetTimeOutState(&timeout);
+
+    for (;;) {
+        while (!readEvent(s, event)) {
+            applyEvent(&s->state, event);
+            if (s->mask & TUM_EVENT_MASK(event->type)) {
+                return 0;
+            }
+        }
+
+        if (xTaskCheckForTimeOut(&timeout, &xTicksToWait) == pdTRUE) {
+            return -1;
+        }
+
+        xSemaphoreTake(s->signal, xTicksToWait);
+    }
+}
+
+void tumEventGetSubscriberState(event_sub_handle_t sub,
+                                tum_event_snapshot_t *state)
+{
+    if (sub && state) {
+        *state = ((event_sub_t *)sub)->state;
+    }
+}
+
+unsigned int tumEventGetLostCount(event_sub_handle_t sub)
+{
+    return sub ? ((event_sub_t *)sub)->lost : 0;
+}
+
+int tumEventRecordStart(const char *filename)
+{
+    record_header_t header = { .magic = RECORD_MAGIC,
+                               .version = RECORD_VERSION,
+                               .event_size = sizeof(tum_event_t),
+                               .tick_rate = configTICK_RATE_HZ,
+                               .state_size = sizeof(tum_event_snapshot_t) };
+    FILE *file;
+
+    file = fopen(filename, "wb");
+    if (file == NULL) {
+        PRINT_ERROR("Failed to open input recording '%s'", filename);
+        goto err_open;
+    }
+
+    /** No events may be fetched between taking the state and the start */
+    xSemaphoreTake(fetch_lock, portMAX_DELAY);
+    header.state = input_state;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        xSemaphoreGive(fetch_lock);
+        PRINT_ERROR("Failed to write input recording header");
+        goto err_write;
+    }
+
+    if (record.file) {
+        fclose(record.file);
+    }
+    record.file = file;
+    record.start = xTaskGetTickCount();
+    xSemaphoreGive(fetch_lock);
+
+    return 0;
+
+err_write:
+    fclose(file);
+err_open:
+    return -1;
+}
+
+void tumEventRecordStop(void)
+{
+    xSemaphoreTake(fetch_lock, portMAX_DELAY);
+    if (record.file) {
+        fclose(record.file);
+        record.file = NULL;
+    }
+    xSemaphoreGive(fetch_lock);
+}
+
+/** Events are indexed into the input state, as such must be checked */
+static int validEvent(tum_event_t *ev)
+{
+    switch (ev->type) {
+        case TUM_EVENT_KEY_PRESSED:
+        case TUM_EVENT_KEY_RELEASED:
+            return ev->scancode < SDL_NUM_SCANCODES;
+        case TUM_EVENT_MOUSE_PRESSED:
+        case TUM_EVENT_MOUSE_RELEASED:
+            /** Buttons without a bit are recorded as 0 */
+            return !(ev->button & ~MOUSE_BUTTONS);
+        case TUM_EVENT_MOUSE_MOTION:
+        case TUM_EVENT_MOUSE_WHEEL:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int tumEventReplayStart(const char *filename, int flags)
+{
+    record_header_t header;
+    tum_event_t *events = NULL;
+    long size;
+    size_t count, i;
+    FILE *file;
+
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        PRINT_ERROR("Failed to open input recording '%s'", filename);
+        goto err_open;
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, RECORD_MAGIC, sizeof(header.magic)) ||
+        header.version != RECORD_VERSION ||
+        header.event_size != sizeof(tum_event_t) ||
+        header.state_size != sizeof(tum_event_snapshot_t)) {
+        PRINT_ERROR("'%s' is not a valid input recording", filename);
+        goto err_header;
+    }
+
+    if (header.tick_rate != configTICK_RATE_HZ) {
+        PRINT_ERROR("Input recording made at %u Hz tick rate, running at %u Hz",
+                    (unsigned int)header.tick_rate,
+                    (unsigned int)configTICK_RATE_HZ);
+        goto err_header;
+    }
+
+    if (fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 ||
+        fseek(file, sizeof(header), SEEK_SET)) {
+        PRINT_ERROR("Failed to get size of input recording");
+        goto err_header;
+    }
+
+    count = (size - sizeof(header)) / sizeof(tum_event_t);
+    if (count == 0) {
+        PRINT_ERROR("Input recording '%s' is empty", filename);
+        goto err_header;
+    }
+
+    events = malloc(count * sizeof(tum_event_t));
+    if (events == NULL) {
+        PRINT_ERROR("Failed to allocate %zu replay events", count);
+        goto err_header;
+    }
+
+    if (fread(events, sizeof(tum_event_t), count, file) != count) {
+        PRINT_ERROR("Failed to read input recording");
+        goto err_read;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (!validEvent(&events[i])) {
+            PRINT_ERROR("Input recording '%s' has an invalid event at %zu",
+                        filename, i);
+            goto err_read;
+        }
+    }
+
+    fclose(file);
+
+    header.state.mouse_buttons &= MOUSE_BUTTONS;
+
+    xSemaphoreTake(fetch_lock, portMAX_DELAY);
+    free(replay.events);
+    replay.events = events;
+    replay.count = count;
+    replay.next = 0;
+    replay.start = xTaskGetTickCount();
+    replay.headless = !!(flags & TUM_EVENT_REPLAY_HEADLESS);
+    atomic_store(&replay.finished, 0);
+    input_pending |= restoreInputState(&header.state, replay.start);
+    xSemaphoreGive(fetch_lock);
+
+    return 0;
+
+err_read:
+    free(events);
+err_header:
+    fclose(file);
+err_open:
+    return -1;
+}
+
+int tumEventReplayFinished(void)
+{
+    return atomic_load(&replay.finished);
+}
+
 signed short tumEventGetMouseX(void)
 {
-    signed short ret;
+    tum_event_snapshot_t snap;
 
-    xSemaphoreTake(mouse.lock, portMAX_DELAY);
-    ret = mouse.x;
-    xSemaphoreGive(mouse.lock);
-    if (ret >= 0 && ret <= SCREEN_WIDTH) {
-        return ret;
+    tumEventGetSnapshot(&snap);
+
+    if (snap.mouse_x >= 0 && snap.mouse_x <= tumDrawGetScreenWidth()) {
+        return snap.mouse_x;
     }
     return 0;
 }
 
 signed short tumEventGetMouseY(void)
 {
-    signed short ret;
+    tum_event_snapshot_t snap;
 
-    xSemaphoreTake(mouse.lock, portMAX_DELAY);
-    ret = mouse.y;
-    xSemaphoreGive(mouse.lock);
+    tumEventGetSnapshot(&snap);
 
-    if (ret >= 0 && ret <= SCREEN_HEIGHT) {
-        return ret;
+    if (snap.mouse_y >= 0 && snap.mouse_y <= tumDrawGetScreenHeight()) {
+        return snap.mouse_y;
     }
     return 0;
 }
 
 signed char tumEventGetMouseLeft(void)
 {
-    signed char ret;
+    tum_event_snapshot_t snap;
 
-    xSemaphoreTake(mouse.lock, portMAX_DELAY);
-    ret = mouse.left_button;
-    xSemaphoreGive(mouse.lock);
+    tumEventGetSnapshot(&snap);
 
-    return ret;
+    return !!(snap.mouse_buttons & TUM_MOUSE_LEFT);
 }
 
 signed char tumEventGetMouseRight(void)
 {
-    signed char ret;
+    tum_event_snapshot_t snap;
 
-    xSemaphoreTake(mouse.lock, portMAX_DELAY);
-    ret = mouse.right_button;
-    xSemaphoreGive(mouse.lock);
+    tumEventGetSnapshot(&snap);
 
-    return ret;
+    return !!(snap.mouse_buttons & TUM_MOUSE_RIGHT);
 }
 
 signed char tumEventGetMouseMiddle(void)
 {
-    signed char ret;
+    tum_event_snapshot_t snap;
 
-    xSemaphoreTake(mouse.lock, portMAX_DELAY);
-    ret = mouse.middle_button;
-    xSemaphoreGive(mouse.lock);
+    tumEventGetSnapshot(&snap);
 
-    return ret;
+    return !!(snap.mouse_buttons & TUM_MOUSE_MIDDLE);
 }
 
 int tumEventInit(void)
 {
-    if (initMouse()) {
-        PRINT_ERROR("Init mouse failed");
-        goto err_init_mouse;
+    if (initFetchLock()) {
+        PRINT_ERROR("Init fetch lock failed");
+        goto err_init_fetch_lock;
+    }
+
+    event_subs_lock = xSemaphoreCreateMutex();
+    if (!event_subs_lock) {
+        PRINT_ERROR("Creating event subscription lock failed");
+        goto err_subs_lock;
     }
 
     buttonInputQueue =
@@ -249,13 +863,19 @@ int tumEventInit(void)
     return 0;
 
 err_queue:
-    vSemaphoreDelete(mouse.lock);
-err_init_mouse:
+    vSemaphoreDelete(event_subs_lock);
+err_subs_lock:
+    vSemaphoreDelete(fetch_lock);
+err_init_fetch_lock:
     return -1;
 }
 
 void tumEventExit(void)
 {
+    tumEventRecordStop();
+    free(replay.events);
+    replay.events = NULL;
     vQueueDelete(buttonInputQueue);
-    vSemaphoreDelete(mouse.lock);
+    vSemaphoreDelete(event_subs_lock);
+    vSemaphoreDelete(fetch_lock);
 }
@@ -23,6 +23,7 @@
  */
 
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <pthread.h>
 
 #include "TUM_Font.h"
@@ -34,8 +35,7 @@
 
 struct tum_font_ref {
     TTF_Font *font;
-    unsigned ref_count;
-    unsigned pending_free;
+    atomic_uint ref_count;
 };
 
 typedef struct tum_font {
@@ -46,11 +46,20 @@ typedef struct tum_font {
     struct tum_font *next;
 } tum_font_t;
 
+/**
+ * list_lock protects the font list, the retired list and changes of the
+ * current font. Getting and putting a font, done for every text draw, only
+ * touches atomics. A size replaced by tumFontSetSize() is moved to the retired
+ * list and freed by the drawing thread, see tumFontCollectDeferred(), once no
+ * reference and no tumFontGetCurFontHandle() in progress can still reach it.
+ */
 pthread_mutex_t list_lock = PTHREAD_MUTEX_INITIALIZER;
 static struct tum_font font_list = { 0 };
+static struct tum_font retired_list = { 0 };
+static atomic_uint font_getters;
 
 static const char *fonts_dir;
-static struct tum_font *cur_default_font = NULL;
+static _Atomic(struct tum_font *) cur_default_font = NULL;
 
 static char *getFontPath(char *font_name)
 {
@@ -95,9 +104,6 @@ static struct tum_font *tumFontCreateFont(char *font_name, ssize_t size)
         goto err_font_open;
     }
 
-    ret->font.ref_count = 0;
-    ret->font.pending_free = 0;
-
     return ret;
 
 err_font_open:
@@ -117,7 +123,7 @@ int tumFontInit(char *path)
         return -1;
     }
 
-    cur_default_font = font_list.next;
+    atomic_store(&cur_default_font, font_list.next);
 
     return 0;
 }
@@ -129,10 +135,9 @@ void tumFontDeleteFont(struct tum_font *font)
     free(font);
 }
 
-void tumFontExit(void)
+static void tumFontDeleteList(struct tum_font *list)
 {
-    pthread_mutex_lock(&list_lock);
-    struct tum_font *iterator = font_list.next;
+    struct tum_font *iterator = list->next;
     struct tum_font *delete = NULL;
 
     while (iterator) {
@@ -142,103 +147,140 @@ void tumFontExit(void)
         tumFontDeleteFont(delete);
     }
 
-    pthread_mutex_unlock(&list_lock);
+    list->next = NULL;
 }
 
-void tumFontPutFontHandle(font_handle_t font)
+void tumFontExit(void)
 {
     pthread_mutex_lock(&list_lock);
-    struct tum_font *iterator = &font_list;
-    struct tum_font *delete = NULL;
+    tumFontDeleteList(&font_list);
+    tumFontDeleteList(&retired_list);
+    pthread_mutex_unlock(&list_lock);
+}
 
-    for (; iterator; iterator = iterator->next) {
-        if (iterator == font) {
-            iterator->font.ref_count--;
-            if (iterator->font.ref_count == 0 &&
-                iterator->font.pending_free) {
-                if (iterator->next) {
-                    if (delete) {
-                        delete->next = iterator->next;
-                    }
-                    else {
-                        font_list.next = iterator->next;
-                    }
-                }
-                tumFontDeleteFont(iterator);
-            }
-            pthread_mutex_unlock(&list_lock);
-            return;
+/** Must be called with list_lock held, returns NULL if font is not in list */
+static struct tum_font *tumFontUnlink(struct tum_font *list,
+                                      struct tum_font *font)
+{
+    struct tum_font *iterator = list;
+
+    for (; iterator->next; iterator = iterator->next)
+        if (iterator->next == font) {
+            iterator->next = font->next;
+            font->next = NULL;
+            return font;
         }
-        delete = iterator;
-    }
-    pthread_mutex_unlock(&list_lock);
 
+    return NULL;
 }
 
-void tumFontPutFont(TTF_Font *font)
+/** Must be called with list_lock held */
+static void tumFontPush(struct tum_font *list, struct tum_font *font)
 {
+    font->next = list->next;
+    list->next = font;
+}
+
+void tumFontCollectDeferred(void)
+{
+    struct tum_font **iterator, *font;
+
+    /**
+     * A getter that loaded a retired font before it was replaced might not
+     * have taken its reference yet, try again next frame
+     */
+    if (atomic_load(&font_getters)) {
+        return;
+    }
+
     pthread_mutex_lock(&list_lock);
-    struct tum_font *iterator = &font_list;
-    struct tum_font *delete = NULL;
 
-    for (; iterator; iterator = iterator->next) {
-        if (iterator->font.font == font) {
-            iterator->font.ref_count--;
-            if (iterator->font.ref_count == 0 &&
-                iterator->font.pending_free) {
-                if (iterator->next) {
-                    if (delete) {
-                        delete->next = iterator->next;
-                    }
-                    else {
-                        font_list.next = iterator->next;
-                    }
-                }
-                tumFontDeleteFont(iterator);
-            }
-            pthread_mutex_unlock(&list_lock);
-            return;
+    for (iterator = &retired_list.next; *iterator;) {
+        font = *iterator;
+        if (atomic_load(&font->font.ref_count)) {
+            iterator = &font->next;
+            continue;
         }
-        delete = iterator;
+
+        *iterator = font->next;
+        tumFontDeleteFont(font);
     }
+
     pthread_mutex_unlock(&list_lock);
 }
 
-TTF_Font *tumFontGetCurFont(void)
+void tumFontPutFontHandle(font_handle_t font)
 {
-    TTF_Font *ret;
+    struct tum_font *f = (struct tum_font *)font;
 
-    pthread_mutex_lock(&list_lock);
+    if (f == NULL) {
+        return;
+    }
 
-    cur_default_font->font.ref_count++;
-    ret = cur_default_font->font.font;
+    atomic_fetch_sub(&f->font.ref_count, 1);
+}
 
-    pthread_mutex_unlock(&list_lock);
+/** Must be called with list_lock held */
+static struct tum_font *tumFontFindTTF(struct tum_font *list, TTF_Font *font)
+{
+    struct tum_font *iterator = list->next;
 
-    return ret;
+    for (; iterator; iterator = iterator->next)
+        if (iterator->font.font == font) {
+            break;
+        }
+
+    return iterator;
 }
 
-ssize_t tumFontGetCurFontSize(void)
+void tumFontPutFont(TTF_Font *font)
 {
+    struct tum_font *iterator;
+
     pthread_mutex_lock(&list_lock);
-    ssize_t ret = cur_default_font->size;
+    iterator = tumFontFindTTF(&font_list, font);
+    if (iterator == NULL) {
+        iterator = tumFontFindTTF(&retired_list, font);
+    }
     pthread_mutex_unlock(&list_lock);
+
+    tumFontPutFontHandle(iterator);
+}
+
+font_handle_t tumFontGetCurFontHandle(void)
+{
+    struct tum_font *ret;
+
+    atomic_fetch_add(&font_getters, 1);
+    ret = atomic_load(&cur_default_font);
+    atomic_fetch_add(&ret->font.ref_count, 1);
+    atomic_fetch_sub(&font_getters, 1);
+
     return ret;
 }
 
-char *tumFontGetCurFontName(void)
+TTF_Font *tumFontGetCurFont(void)
+{
+    return ((struct tum_font *)tumFontGetCurFontHandle())->font.font;
+}
+
+TTF_Font *tumFontGetFont(font_handle_t font)
+{
+    return font ? ((struct tum_font *)font)->font.font : NULL;
+}
+
+ssize_t tumFontGetCurFontSize(void)
 {
     pthread_mutex_lock(&list_lock);
-    char *ret = strdup(cur_default_font->name);
+    ssize_t ret = atomic_load(&cur_default_font)->size;
     pthread_mutex_unlock(&list_lock);
     return ret;
 }
 
-font_handle_t tumFontGetCurFontHandle(void)
+char *tumFontGetCurFontName(void)
 {
     pthread_mutex_lock(&list_lock);
-    cur_default_font->font.ref_count++;
-    font_handle_t ret = cur_default_font;
+    char *ret = strdup(atomic_load(&cur_default_font)->name);
     pthread_mutex_unlock(&list_lock);
     return ret;
 }
@@ -282,7 +324,7 @@ int tumFontSelectFontFromName(char *font_name)
     for (; iterator; iterator = iterator->next)
         if (iterator->name)
             if (!strcmp(iterator->name, font_name)) {
-                cur_default_font = iterator;
+                atomic_store(&cur_default_font, iterator);
                 pthread_mutex_unlock(&list_lock);
                 return 0;
             }
@@ -299,11 +341,19 @@ int tumFontSelectFontFromHandle(font_handle_t font_handle)
 
     for (; iterator; iterator = iterator->next)
         if (iterator == font_handle) {
-            cur_default_font = iterator;
+            atomic_store(&cur_default_font, iterator);
             pthread_mutex_unlock(&list_lock);
             return 0;
         }
 
+    /** A size replaced by tumFontSetSize() that is still held */
+    if (tumFontUnlink(&retired_list, font_handle)) {
+        tumFontPush(&font_list, font_handle);
+        atomic_store(&cur_default_font, (struct tum_font *)font_handle);
+        pthread_mutex_unlock(&list_lock);
+        return 0;
+    }
+
     pthread_mutex_unlock(&list_lock);
 
     return -1;
@@ -311,38 +361,51 @@ int tumFontSelectFontFromHandle(font_handle_t font_handle)
 
 int tumFontSetSize(ssize_t font_size)
 {
-    if (cur_default_font == NULL) {
-        goto err_;
-    }
+    struct tum_font *cur, *new_font;
 
     pthread_mutex_lock(&list_lock);
 
-    if (cur_default_font->size == font_size) {
+    cur = atomic_load(&cur_default_font);
+    if (cur == NULL) {
+        goto err_;
+    }
+
+    if (cur->size == font_size) {
         pthread_mutex_unlock(&list_lock);
         return 0;
     }
 
-    if (!cur_default_font->font.ref_count) {
-        TTF_CloseFont(cur_default_font->font.font);
-        TTF_Font *new_font =
-            TTF_OpenFont(cur_default_font->path, font_size);
-
-        if (new_font == NULL) {
-            goto err_;
+    /**
+     * Pending text draws keep using the old size, which is retired and freed
+     * once they are done. Setting a size that is not yet freed reuses it.
+     */
+    for (new_font = font_list.next; new_font; new_font = new_font->next)
+        if (new_font->size == font_size && !strcmp(new_font->name, cur->name)) {
+            break;
         }
 
-        cur_default_font->font.font = new_font;
-        cur_default_font->size = font_size;
+    if (new_font == NULL) {
+        for (new_font = retired_list.next; new_font; new_font = new_font->next)
+            if (new_font->size == font_size &&
+                !strcmp(new_font->name, cur->name)) {
+                tumFontUnlink(&retired_list, new_font);
+                tumFontPush(&font_list, new_font);
+                break;
+            }
     }
-    else {
-        cur_default_font->font.pending_free = 1;
-        cur_default_font =
-            tumFontAppendFont(cur_default_font->name, font_size);
-        if (!cur_default_font) {
+
+    if (new_font == NULL) {
+        new_font = tumFontAppendFont(cur->name, font_size);
+        if (new_font == NULL) {
             goto err_;
         }
     }
 
+    atomic_store(&cur_default_font, new_font);
+
+    tumFontUnlink(&font_list, cur);
+    tumFontPush(&retired_list, cur);
+
     pthread_mutex_unlock(&list_lock);
 
     return 0;
@@ -0,0 +1,1040 @@
+/**
+ * @file TUM_Image.c
+ * @brief Image cache used by TUM Draw
+ *
+ * @verbatim
+   ----------------------------------------------------------------------
+    Copyright (C) Alexander Hoffman, 2019
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+@endverbatim
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL2/SDL.h"
+#include "SDL2/SDL_image.h"
+
+#include "TUM_Image.h"
+#include "TUM_Utils.h"
+
+#define PRINT_SDL_ERROR(msg, ...)                                              \
+    PRINT_ERROR("[SDL Error] %s\n" #msg, (char *)SDL_GetError(),           \
+                ##__VA_ARGS__)
+
+static pthread_mutex_t loaded_images_lock = PTHREAD_MUTEX_INITIALIZER;
+static loaded_image_t loaded_images_list = { 0 };
+/** Set by the drawing thread, see tumImageSetRenderer() */
+static SDL_Renderer *image_renderer = NULL;
+static atlas_page_t *atlas_pages = NULL; // Protected by loaded_images_lock
+
+/**
+ * Image cache, protected by loaded_images_lock. Loading a filename that is
+ * already loaded, or being loaded, shares the same image. Images whose handles
+ * were all freed are kept in the LRU list, oldest first, until their total
+ * size exceeds TUM_DRAW_IMAGE_CACHE_BUDGET.
+ */
+static struct {
+    loaded_image_t *buckets[TUM_DRAW_IMAGE_CACHE_BUCKETS];
+    loaded_image_t *lru_head;
+    loaded_image_t *lru_tail;
+    size_t unused_bytes;
+    loaded_image_t *deferred;
+} image_cache = { 0 };
+
+/**
+ * Images queued for asynchronous decoding, head to tail, and those decoded
+ * and awaiting storing in the ready list. Both are linked using load_next.
+ * done is signalled whenever an image's loading state advances.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_cond_t done;
+    pthread_once_t started;
+    loaded_image_t *head;
+    loaded_image_t *tail;
+    loaded_image_t *ready;
+} image_loader = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .started = PTHREAD_ONCE_INIT,
+};
+
+
+SDL_Texture *tumImageGetTexture(loaded_image_t *img)
+{
+    if (img->page) {
+        return img->page->tex;
+    }
+
+    /** Created on first use, as loads may finish on any task */
+    if (img->tex == NULL && image_renderer && img->surf) {
+        img->tex = SDL_CreateTextureFromSurface(image_renderer, img->surf);
+        if (img->tex == NULL) {
+            PRINT_SDL_ERROR("Failed to create texture from surface");
+        }
+    }
+
+    return img->tex;
+}
+
+static int atlasFit(atlas_page_t *page, unsigned int i, int w, int h)
+{
+    int y = 0;
+    int remaining = w;
+
+    if (page->skyline[i].x + w > TUM_DRAW_ATLAS_PAGE_SIZE) {
+        return -1;
+    }
+
+    for (; remaining > 0 && i < page->nodes; i++) {
+        if (page->skyline[i].y > y) {
+            y = page->skyline[i].y;
+        }
+        if (y + h > TUM_DRAW_ATLAS_PAGE_SIZE) {
+            return -1;
+        }
+        remaining -= page->skyline[i].w;
+    }
+
+    return y;
+}
+
+static int atlasPack(atlas_page_t *page, int w, int h, SDL_Rect *rect)
+{
+    atlas_node_t *skyline = page->skyline;
+    int best_y = INT_MAX;
+    int best_i = -1;
+    unsigned int i;
+    int y, shrink;
+
+    for (i = 0; i < page->nodes; i++) {
+        y = atlasFit(page, i, w, h);
+        if (y >= 0 && y < best_y) {
+            best_y = y;
+            best_i = i;
+        }
+    }
+
+    if (best_i < 0) {
+        return -1;
+    }
+
+    rect->x = skyline[best_i].x;
+    rect->y = best_y;
+
+    memmove(&skyline[best_i + 1], &skyline[best_i],
+            (page->nodes - best_i) * sizeof(atlas_node_t));
+    skyline[best_i].y = best_y + h;
+    skyline[best_i].w = w;
+    page->nodes++;
+
+    /** Cut the nodes now covered by the new one */
+    for (i = best_i + 1; i < page->nodes;) {
+        shrink = skyline[i - 1].x + skyline[i - 1].w - skyline[i].x;
+        if (shrink <= 0) {
+            break;
+        }
+
+        skyline[i].x += shrink;
+        skyline[i].w -= shrink;
+        if (skyline[i].w > 0) {
+            break;
+        }
+
+        memmove(&skyline[i], &skyline[i + 1],
+                (page->nodes - i - 1) * sizeof(atlas_node_t));
+        page->nodes--;
+    }
+
+    for (i = 0; i + 1 < page->nodes;) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].w += skyline[i + 1].w;
+            memmove(&skyline[i + 1], &skyline[i + 2],
+                    (page->nodes - i - 2) * sizeof(atlas_node_t));
+            page->nodes--;
+        }
+        else {
+            i++;
+        }
+    }
+
+    return 0;
+}
+
+static atlas_page_t *atlasCreatePage(void)
+{
+    atlas_page_t *page = calloc(1, sizeof(atlas_page_t));
+    if (page == NULL) {
+        PRINT_ERROR("Failed to allocate atlas page");
+        goto err_alloc;
+    }
+
+    /**
+     * Every node is at least one pixel wide, atlasPack() inserts the new node
+     * before cutting those it covers, needing one more
+     */
+    page->skyline =
+        calloc(TUM_DRAW_ATLAS_PAGE_SIZE + 1, sizeof(atlas_node_t));
+    if (page->skyline == NULL) {
+        PRINT_ERROR("Failed to allocate atlas skyline");
+        goto err_skyline;
+    }
+    page->skyline[0].w = TUM_DRAW_ATLAS_PAGE_SIZE;
+    page->nodes = 1;
+
+    page->surf = SDL_CreateRGBSurfaceWithFormat(0, TUM_DRAW_ATLAS_PAGE_SIZE,
+                 TUM_DRAW_ATLAS_PAGE_SIZE, 32,
+                 SDL_PIXELFORMAT_ARGB8888);
+    if (page->surf == NULL) {
+        PRINT_SDL_ERROR("Failed to create atlas surface");
+        goto err_surf;
+    }
+
+    return page;
+
+err_surf:
+    free(page->skyline);
+err_skyline:
+    free(page);
+err_alloc:
+    return NULL;
+}
+
+static void atlasFreePage(atlas_page_t *page)
+{
+    atlas_page_t **iterator;
+
+    for (iterator = &atlas_pages; *iterator; iterator = &(*iterator)->next)
+        if (*iterator == page) {
+            *iterator = page->next;
+            break;
+        }
+
+    if (page->tex) {
+        SDL_DestroyTexture(page->tex);
+    }
+    SDL_FreeSurface(page->surf);
+    free(page->skyline);
+    free(page);
+}
+
+/** Must be called with loaded_images_lock held */
+static int atlasAdd(loaded_image_t *img)
+{
+    atlas_page_t *page;
+    SDL_Rect rect = { 0 };
+    int w = img->surf->w + TUM_DRAW_ATLAS_PADDING;
+    int h = img->surf->h + TUM_DRAW_ATLAS_PADDING;
+
+    for (page = atlas_pages; page; page = page->next)
+        if (!atlasPack(page, w, h, &rect)) {
+            break;
+        }
+
+    if (page == NULL) {
+        page = atlasCreatePage();
+        if (page == NULL) {
+            return -1;
+        }
+        atlasPack(page, w, h, &rect);
+        page->next = atlas_pages;
+        atlas_pages = page;
+    }
+
+    rect.w = img->surf->w;
+    rect.h = img->surf->h;
+
+    SDL_SetSurfaceBlendMode(img->surf, SDL_BLENDMODE_NONE);
+    if (SDL_BlitSurface(img->surf, NULL, page->surf, &rect)) {
+        PRINT_SDL_ERROR("Failed to copy image into atlas");
+        if (page->images == 0) {
+            atlasFreePage(page);
+        }
+        return -1;
+    }
+
+    page->images++;
+    page->dirty = 1;
+    img->page = page;
+    img->src = rect;
+
+    return 0;
+}
+
+/** Space of a freed image is only reclaimed once its page is empty */
+static void atlasRemove(loaded_image_t *img)
+{
+    atlas_page_t *page = img->page;
+
+    SDL_FillRect(page->surf, &img->src, 0);
+    page->dirty = 1;
+
+    if (--page->images == 0) {
+        atlasFreePage(page);
+    }
+}
+
+void tumImageUploadAtlas(void)
+{
+    atlas_page_t *page;
+
+    if (image_renderer == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&loaded_images_lock);
+
+    for (page = atlas_pages; page; page = page->next) {
+        if (!page->dirty) {
+            continue;
+        }
+
+        if (page->tex == NULL) {
+            page->tex = SDL_CreateTexture(image_renderer,
+                                          SDL_PIXELFORMAT_ARGB8888,
+                                          SDL_TEXTUREACCESS_STATIC,
+                                          TUM_DRAW_ATLAS_PAGE_SIZE,
+                                          TUM_DRAW_ATLAS_PAGE_SIZE);
+            if (page->tex == NULL) {
+                PRINT_SDL_ERROR("Failed to create atlas texture");
+                continue;
+            }
+            SDL_SetTextureBlendMode(page->tex, SDL_BLENDMODE_BLEND);
+        }
+
+        if (SDL_UpdateTexture(page->tex, NULL, page->surf->pixels,
+                              page->surf->pitch)) {
+            PRINT_SDL_ERROR("Failed to upload atlas page");
+            continue;
+        }
+
+        page->dirty = 0;
+    }
+
+    pthread_mutex_unlock(&loaded_images_lock);
+}
+
+
+static unsigned int imageCacheHash(const char *filename)
+{
+    unsigned int hash = 2166136261U; // FNV-1a
+
+    for (; *filename; filename++) {
+        hash = (hash ^ (unsigned char)*filename) * 16777619U;
+    }
+
+    return hash;
+}
+
+static void imageCacheInsert(loaded_image_t *img)
+{
+    loaded_image_t **bucket;
+
+    img->hash = imageCacheHash(img->filename);
+    bucket = &image_cache.buckets[img->hash % TUM_DRAW_IMAGE_CACHE_BUCKETS];
+
+    img->hash_next = *bucket;
+    *bucket = img;
+    img->cached = 1;
+}
+
+static void imageCacheRemove(loaded_image_t *img)
+{
+    loaded_image_t **iterator =
+        &image_cache.buckets[img->hash % TUM_DRAW_IMAGE_CACHE_BUCKETS];
+
+    for (; *iterator; iterator = &(*iterator)->hash_next)
+        if (*iterator == img) {
+            *iterator = img->hash_next;
+            break;
+        }
+
+    img->cached = 0;
+}
+
+static void imageCacheLRURemove(loaded_image_t *img)
+{
+    if (img->lru_prev) {
+        img->lru_prev->lru_next = img->lru_next;
+    }
+    else {
+        image_cache.lru_head = img->lru_next;
+    }
+
+    if (img->lru_next) {
+        img->lru_next->lru_prev = img->lru_prev;
+    }
+    else {
+        image_cache.lru_tail = img->lru_prev;
+    }
+
+    img->lru_prev = img->lru_next = NULL;
+    img->in_lru = 0;
+    image_cache.unused_bytes -= img->bytes;
+}
+
+static void imageCacheLRUAppend(loaded_image_t *img)
+{
+    img->bytes = (size_t)img->w * img->h * sizeof(uint32_t);
+    img->lru_prev = image_cache.lru_tail;
+    img->lru_next = NULL;
+
+    if (image_cache.lru_tail) {
+        image_cache.lru_tail->lru_next = img;
+    }
+    else {
+        image_cache.lru_head = img;
+    }
+    image_cache.lru_tail = img;
+
+    img->in_lru = 1;
+    image_cache.unused_bytes += img->bytes;
+}
+
+static loaded_image_t *imageCacheLookup(const char *filename)
+{
+    unsigned int hash = imageCacheHash(filename);
+    loaded_image_t *iterator =
+        image_cache.buckets[hash % TUM_DRAW_IMAGE_CACHE_BUCKETS];
+
+    for (; iterator; iterator = iterator->hash_next)
+        if (iterator->hash == hash &&
+            atomic_load(&iterator->state) != IMAGE_FAILED &&
+            !strcmp(iterator->filename, filename)) {
+            if (iterator->in_lru) {
+                imageCacheLRURemove(iterator);
+            }
+            iterator->users++;
+            return iterator;
+        }
+
+    return NULL;
+}
+
+static void destroyLoadedImage(loaded_image_t *img);
+
+/** Queued draw jobs may still use the image until the frame ends */
+static void imageCacheDefer(loaded_image_t *img)
+{
+    img->deferred = 1;
+    img->deferred_next = image_cache.deferred;
+    image_cache.deferred = img;
+}
+
+static void imageCacheEvict(void)
+{
+    loaded_image_t *img;
+
+    while (image_cache.unused_bytes > TUM_DRAW_IMAGE_CACHE_BUDGET &&
+           image_cache.lru_head) {
+        img = image_cache.lru_head;
+        imageCacheLRURemove(img);
+        imageCacheRemove(img);
+        imageCacheDefer(img);
+    }
+}
+
+/**
+ * Drops a handle's use of an image, must be called with loaded_images_lock
+ * held. Failed images are never found again, as such are not kept.
+ */
+static void releaseLoadedImage(loaded_image_t *img)
+{
+    if (img->users == 0 || --img->users) {
+        return;
+    }
+
+    if (atomic_load(&img->state) == IMAGE_FAILED) {
+        imageCacheDefer(img);
+        return;
+    }
+
+    imageCacheLRUAppend(img);
+    imageCacheEvict();
+}
+
+/** Must be called with loaded_images_lock held */
+static void failLoadedImage(loaded_image_t *img)
+{
+    atomic_store(&img->state, IMAGE_FAILED);
+
+    if (img->cached) {
+        imageCacheRemove(img);
+    }
+
+    /** All handles were freed while loading */
+    if (img->in_lru) {
+        imageCacheLRURemove(img);
+        imageCacheDefer(img);
+    }
+}
+
+void tumImageCollectDeferred(void)
+{
+    loaded_image_t **iterator, *img;
+
+    pthread_mutex_lock(&loaded_images_lock);
+
+    for (iterator = &image_cache.deferred; *iterator;) {
+        img = *iterator;
+        if (atomic_load(&img->ref_count)) {
+            iterator = &img->deferred_next;
+            continue;
+        }
+
+        *iterator = img->deferred_next;
+        destroyLoadedImage(img);
+    }
+
+    pthread_mutex_unlock(&loaded_images_lock);
+}
+
+/** Must be called with loaded_images_lock held */
+static void destroyLoadedImage(loaded_image_t *img)
+{
+    loaded_image_t *iterator = &loaded_images_list;
+
+    for (; iterator->next; iterator = iterator->next)
+        if (iterator->next == img) {
+            iterator->next = img->next;
+            break;
+        }
+
+    if (img->in_lru) {
+        imageCacheLRURemove(img);
+    }
+    if (img->cached) {
+        imageCacheRemove(img);
+    }
+
+    if (img->page) {
+        atlasRemove(img);
+    }
+    else if (img->tex) {
+        SDL_DestroyTexture(img->tex);
+    }
+    SDL_FreeSurface(img->surf);
+    if (img->ops) {
+        SDL_RWclose(img->ops);
+    }
+    free(img->filename);
+    free(img);
+}
+
+void tumImagePut(loaded_image_t *img)
+{
+    atomic_fetch_sub(&img->ref_count, 1);
+}
+
+static loaded_image_t *allocLoadedImage(char *filename)
+{
+    loaded_image_t *ret = calloc(1, sizeof(loaded_image_t));
+    if (ret == NULL) {
+        PRINT_ERROR("Failed to allocate loaded image");
+        goto err_alloc;
+    }
+
+    ret->filename = strdup(filename);
+    if (ret->filename == NULL) {
+        PRINT_ERROR("Failed to duplicate filename");
+        goto err_filename;
+    }
+
+    atomic_store(&ret->state, IMAGE_LOADING);
+    ret->users = 1;
+
+    return ret;
+
+err_filename:
+    free(ret);
+err_alloc:
+    return NULL;
+}
+
+/**
+ * Returns the cached image of a file, or inserts a placeholder that the
+ * caller, flagged by owner, must load. Concurrent loads of the same file thus
+ * decode it only once.
+ */
+static loaded_image_t *acquireLoadedImage(char *filename, int *owner)
+{
+    loaded_image_t *ret;
+
+    pthread_mutex_lock(&loaded_images_lock);
+
+    ret = imageCacheLookup(filename);
+    *owner = ret == NULL;
+    if (ret == NULL) {
+        ret = allocLoadedImage(filename);
+        if (ret) {
+            ret->next = loaded_images_list.next;
+            loaded_images_list.next = ret;
+            imageCacheInsert(ret);
+        }
+    }
+
+    pthread_mutex_unlock(&loaded_images_lock);
+
+    return ret;
+}
+
+static void putLoadedImageUser(loaded_image_t *img)
+{
+    pthread_mutex_lock(&loaded_images_lock);
+    releaseLoadedImage(img);
+    pthread_mutex_unlock(&loaded_images_lock);
+}
+
+/** Wakes the loads waiting on an image, see waitLoadedImage() */
+static void signalLoadedImages(void)
+{
+    pthread_mutex_lock(&image_loader.lock);
+    pthread_cond_broadcast(&image_loader.done);
+    pthread_mutex_unlock(&image_loader.lock);
+}
+
+/** Sets the final state of an image, once stored or failed */
+static void completeLoadedImage(loaded_image_t *img, int failed)
+{
+    if (failed) {
+        pthread_mutex_lock(&loaded_images_lock);
+        failLoadedImage(img);
+        pthread_mutex_unlock(&loaded_images_lock);
+    }
+    else {
+        atomic_store(&img->state, IMAGE_READY);
+    }
+
+    signalLoadedImages();
+}
+
+/** Reads and decodes the image file, safe to be called from any thread */
+static int decodeLoadedImage(loaded_image_t *img)
+{
+    img->file = tumUtilFindResource(img->filename, "rb");
+    if (img->file == NULL) {
+        PRINT_ERROR("Failed to open file '%s'", img->filename);
+        goto err_file_open;
+    }
+
+    img->ops = SDL_RWFromFP(img->file, SDL_TRUE);
+    if (img->ops == NULL) {
+        PRINT_SDL_ERROR("Failed open from FP");
+        goto err_ops;
+    }
+
+    img->surf = IMG_Load_RW(img->ops, 0);
+    if (img->surf == NULL) {
+        PRINT_SDL_ERROR("Failed to load image");
+        goto err_surf;
+    }
+
+    /** Software rendering reads the pixels as ARGB8888 */
+    if (img->surf->format->format != SDL_PIXELFORMAT_ARGB8888) {
+        SDL_Surface *converted =
+            SDL_ConvertSurfaceFormat(img->surf, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(img->surf);
+        img->surf = converted;
+        if (img->surf == NULL) {
+            PRINT_SDL_ERROR("Failed to convert image");
+            goto err_surf;
+        }
+    }
+
+    img->w = img->surf->w;
+    img->h = img->surf->h;
+    img->src.w = img->w;
+    img->src.h = img->h;
+
+    return 0;
+
+err_surf:
+    SDL_RWclose(img->ops);
+    img->ops = NULL;
+    goto err_file_open;
+err_ops:
+    fclose(img->file);
+err_file_open:
+    img->file = NULL;
+    return -1;
+}
+
+/**
+ * Moves the decoded image into an atlas page, or keeps it as a surface that
+ * its texture is created from when first drawn. Touches no textures, as such
+ * is safe to be called from any thread.
+ */
+static void storeLoadedImage(loaded_image_t *img)
+{
+    pthread_mutex_lock(&loaded_images_lock);
+
+    /** Packed images live on in their atlas page only */
+    if (img->w <= TUM_DRAW_ATLAS_MAX_IMAGE_SIZE &&
+        img->h <= TUM_DRAW_ATLAS_MAX_IMAGE_SIZE && !atlasAdd(img)) {
+        SDL_FreeSurface(img->surf);
+        img->surf = NULL;
+    }
+
+    pthread_mutex_unlock(&loaded_images_lock);
+}
+
+static void *imageLoaderThread(void *arg)
+{
+    loaded_image_t *img;
+
+    tumUtilBlockSignals();
+
+    for (;;) {
+        pthread_mutex_lock(&image_loader.lock);
+        while (image_loader.head == NULL) {
+            pthread_cond_wait(&image_loader.cond, &image_loader.lock);
+        }
+        img = image_loader.head;
+        image_loader.head = img->load_next;
+        if (image_loader.head == NULL) {
+            image_loader.tail = NULL;
+        }
+        pthread_mutex_unlock(&image_loader.lock);
+
+        atomic_store(&img->state, decodeLoadedImage(img) ?
+                     IMAGE_DECODE_FAILED :
+                     IMAGE_DECODED);
+
+        pthread_mutex_lock(&image_loader.lock);
+        img->load_next = image_loader.ready;
+        image_loader.ready = img;
+        pthread_cond_broadcast(&image_loader.done);
+        pthread_mutex_unlock(&image_loader.lock);
+    }
+
+    return NULL;
+}
+
+static void startImageLoaders(void)
+{
+    pthread_t thread;
+    int i;
+
+    for (i = 0; i < TUM_DRAW_LOADER_THREADS; i++) {
+        if (pthread_create(&thread, NULL, imageLoaderThread, NULL)) {
+            PRINT_ERROR("Failed to create image loader thread");
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+/**
+ * Stores an image decoded by a loader thread and drops the reference the
+ * loading held
+ */
+static void finishLoadedImage(loaded_image_t *img)
+{
+    int failed = atomic_load(&img->state) != IMAGE_DECODED;
+
+    if (!failed) {
+        storeLoadedImage(img);
+    }
+
+    completeLoadedImage(img, failed);
+    tumImagePut(img);
+}
+
+void tumImageFinishLoads(void)
+{
+    loaded_image_t *img, *next;
+
+    pthread_mutex_lock(&image_loader.lock);
+    img = image_loader.ready;
+    image_loader.ready = NULL;
+    pthread_mutex_unlock(&image_loader.lock);
+
+    for (; img; img = next) {
+        next = img->load_next;
+        img->load_next = NULL;
+        finishLoadedImage(img);
+    }
+}
+
+/** Must be called with image_loader.lock held */
+static int takeReadyImage(loaded_image_t *img)
+{
+    loaded_image_t **iterator = &image_loader.ready;
+
+    for (; *iterator; iterator = &(*iterator)->load_next)
+        if (*iterator == img) {
+            *iterator = img->load_next;
+            img->load_next = NULL;
+            return 1;
+        }
+
+    return 0;
+}
+
+/**
+ * Waits for another load of an image to finish. An image already decoded by a
+ * loader thread is finished here instead of waiting for the next frame.
+ *
+ * @return 0 if the image is ready, -1 if loading it failed
+ */
+static int waitLoadedImage(loaded_image_t *img)
+{
+    int state;
+
+    pthread_mutex_lock(&image_loader.lock);
+
+    for (;;) {
+        state = atomic_load(&img->state);
+        if (state == IMAGE_READY || state == IMAGE_FAILED) {
+            break;
+        }
+
+        if (state != IMAGE_LOADING && takeReadyImage(img)) {
+            pthread_mutex_unlock(&image_loader.lock);
+            finishLoadedImage(img);
+            pthread_mutex_lock(&image_loader.lock);
+            continue;
+        }
+
+        pthread_cond_wait(&image_loader.done, &image_loader.lock);
+    }
+
+    pthread_mutex_unlock(&image_loader.lock);
+
+    return state == IMAGE_READY ? 0 : -1;
+}
+
+
+static image_handle_t allocImageRef(loaded_image_t *img, float scale)
+{
+    loaded_image_ref_t *ret = calloc(1, sizeof(loaded_image_ref_t));
+    if (ret == NULL) {
+        PRINT_ERROR("Failed to allocate image handle");
+        putLoadedImageUser(img);
+        return NULL;
+    }
+
+    ret->image = img;
+    ret->scale = scale;
+
+    return ret;
+}
+
+/** Decodes and stores a placeholder from acquireLoadedImage() */
+static int loadLoadedImage(loaded_image_t *img)
+{
+    int ret = decodeLoadedImage(img);
+
+    if (!ret) {
+        storeLoadedImage(img);
+    }
+
+    completeLoadedImage(img, ret);
+
+    return ret;
+}
+
+image_handle_t tumDrawLoadScaledImage(char *filename, float scale)
+{
+    loaded_image_t *img;
+    int owner;
+
+    for (;;) {
+        img = acquireLoadedImage(filename, &owner);
+        if (img == NULL) {
+            return NULL;
+        }
+
+        if (owner) {
+            if (loadLoadedImage(img)) {
+                putLoadedImageUser(img);
+                return NULL;
+            }
+            break;
+        }
+
+        if (!waitLoadedImage(img)) {
+            break;
+        }
+
+        /** The other load failed, failed images are not found again */
+        putLoadedImageUser(img);
+    }
+
+    return allocImageRef(img, scale);
+}
+
+image_handle_t tumDrawLoadScaledImageAsync(char *filename, float scale)
+{
+    loaded_image_t *img;
+    int owner;
+
+    img = acquireLoadedImage(filename, &owner);
+    if (img == NULL) {
+        return NULL;
+    }
+
+    if (owner) {
+        pthread_once(&image_loader.started, startImageLoaders);
+
+        /** Loading holds a reference until finishLoadedImage() */
+        atomic_store(&img->ref_count, 1);
+
+        pthread_mutex_lock(&image_loader.lock);
+        if (image_loader.tail) {
+            image_loader.tail->load_next = img;
+        }
+        else {
+            image_loader.head = img;
+        }
+        image_loader.tail = img;
+        pthread_cond_signal(&image_loader.cond);
+        pthread_mutex_unlock(&image_loader.lock);
+    }
+
+    return allocImageRef(img, scale);
+}
+
+image_handle_t tumDrawLoadImage(char *filename)
+{
+    return tumDrawLoadScaledImage(filename, 1);
+}
+
+image_handle_t tumDrawLoadImageAsync(char *filename)
+{
+    return tumDrawLoadScaledImageAsync(filename, 1);
+}
+
+int tumDrawGetLoadedImageState(image_handle_t img)
+{
+    if (img == NULL) {
+        return -1;
+    }
+
+    switch (atomic_load(&((loaded_image_ref_t *)img)->image->state)) {
+        case IMAGE_READY:
+            return 1;
+        case IMAGE_FAILED:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+int tumDrawFreeLoadedImage(image_handle_t *img)
+{
+    loaded_image_ref_t *ref;
+
+    if (img == NULL || *img == NULL) {
+        return -1;
+    }
+
+    ref = (loaded_image_ref_t *)*img;
+
+    putLoadedImageUser(ref->image);
+    free(ref);
+
+    *img = NULL;
+
+    return 0;
+}
+
+int tumDrawSetLoadedImageScale(image_handle_t img, float scale)
+{
+    if (img == NULL) {
+        return -1;
+    }
+
+    ((loaded_image_ref_t *)img)->scale = scale;
+
+    return 0;
+}
+
+float tumDrawGetLoadedImageScale(image_handle_t img)
+{
+    if (img == NULL) {
+        return -1;
+    }
+
+    return ((loaded_image_ref_t *)img)->scale;
+}
+
+int tumDrawGetLoadedImageWidth(image_handle_t img)
+{
+    loaded_image_ref_t *ref = (loaded_image_ref_t *)img;
+
+    if (img == NULL) {
+        return -1;
+    }
+
+    return ref->image->w * ref->scale;
+}
+
+int tumDrawGetLoadedImageHeight(image_handle_t img)
+{
+    loaded_image_ref_t *ref = (loaded_image_ref_t *)img;
+
+    if (img == NULL) {
+        return -1;
+    }
+
+    return ref->image->h * ref->scale;
+}
+
+int tumDrawGetLoadedImageSize(image_handle_t img, int *w, int *h)
+{
+    if (img == NULL) {
+        return -1;
+    }
+
+    *w = tumDrawGetLoadedImageWidth(img);
+    *h = tumDrawGetLoadedImageHeight(img);
+
+    if (*w == -1 || *h == -1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void tumImageSetRenderer(SDL_Renderer *ren)
+{
+    loaded_image_t *iterator;
+    atlas_page_t *page;
+
+    pthread_mutex_lock(&loaded_images_lock);
+
+    image_renderer = ren;
+
+    /** Textures went with the old renderer, recreated when next drawn */
+    for (iterator = loaded_images_list.next; iterator;
+         iterator = iterator->next)
+        if (iterator->tex) {
+            SDL_DestroyTexture(iterator->tex);
+            iterator->tex = NULL;
+        }
+
+    for (page = atlas_pages; page; page = page->next) {
+        page->tex = NULL;
+        page->dirty = 1;
+    }
+
+    pthread_mutex_unlock(&loaded_images_lock);
+}
@@ -0,0 +1,872 @@
+/**
+ * @file TUM_Raster.c
+ * @brief Software rasterizer used by TUM Draw's software rendering
+ *
+ * @verbatim
+   ----------------------------------------------------------------------
+    Copyright (C) Alexander Hoffman, 2019
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+@endverbatim
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TUM_Raster.h"
+#include "TUM_Utils.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) &&     \
+    !TUM_RASTER_NO_SIMD
+#include <immintrin.h>
+#define RASTER_X86 1
+#else
+#define RASTER_X86 0
+#endif
+
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1 << FIXED_SHIFT)
+#define FIXED_HALF (FIXED_ONE / 2)
+
+/** Fixed point (14 bit fraction) unit vectors of each whole degree */
+#define ANGLE_SHIFT 14
+
+static struct {
+    pthread_once_t once;
+    const char *name;
+    void (*fill)(uint32_t *dst, int n, uint32_t argb);
+    void (*blend)(uint32_t *dst, const uint32_t *src, int n);
+    int cos[360];
+    int sin[360];
+} raster = { .once = PTHREAD_ONCE_INIT };
+
+/**
+ * Blending, d = (s * a + d * (255 - a)) / 255 rounded to nearest, is done
+ * exactly using 16 bit integer arithmetic by all kernels. The destination's
+ * alpha is blended as if the source's alpha channel was 0xFF.
+ */
+static inline uint32_t div255(uint32_t v)
+{
+    v += 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+static inline uint32_t blendPixel(uint32_t dst, uint32_t src)
+{
+    uint32_t a = src >> 24, ia = 255 - a;
+    uint32_t ret = 0;
+    int shift;
+
+    src |= 0xFF000000;
+
+    for (shift = 0; shift < 32; shift += 8)
+        ret |= div255(((src >> shift) & 0xFF) * a +
+                      ((dst >> shift) & 0xFF) * ia)
+               << shift;
+
+    return ret;
+}
+
+static void fillScalar(uint32_t *dst, int n, uint32_t argb)
+{
+    if ((argb >> 24) == 0xFF) {
+        while (n--) {
+            *dst++ = argb;
+        }
+    }
+    else if (argb >> 24) {
+        for (; n; n--, dst++) {
+            *dst = blendPixel(*dst, argb);
+        }
+    }
+}
+
+static void blendScalar(uint32_t *dst, const uint32_t *src, int n)
+{
+    for (; n; n--, dst++, src++) {
+        if ((*src >> 24) == 0xFF) {
+            *dst = *src;
+        }
+        else if (*src >> 24) {
+            *dst = blendPixel(*dst, *src);
+        }
+    }
+}
+
+/**
+ * Additive blending, d = d + s * a / 255 saturated, leaving the destination's
+ * alpha as is. Rarely used, thus only done in plain C.
+ */
+static inline uint32_t addPixel(uint32_t dst, uint32_t src)
+{
+    uint32_t a = src >> 24;
+    uint32_t ret = dst & 0xFF000000;
+    uint32_t c;
+    int shift;
+
+    for (shift = 0; shift < 24; shift += 8) {
+        c = ((dst >> shift) & 0xFF) + div255(((src >> shift) & 0xFF) * a);
+        ret |= (c > 0xFF ? 0xFF : c) << shift;
+    }
+
+    return ret;
+}
+
+static void addFillScalar(uint32_t *dst, int n, uint32_t argb)
+{
+    if (argb >> 24) {
+        for (; n; n--, dst++) {
+            *dst = addPixel(*dst, argb);
+        }
+    }
+}
+
+static void addBlendScalar(uint32_t *dst, const uint32_t *src, int n)
+{
+    for (; n; n--, dst++, src++) {
+        *dst = addPixel(*dst, *src);
+    }
+}
+
+static void copyOpaqueScalar(uint32_t *dst, const uint32_t *src, int n)
+{
+    while (n--) {
+        *dst++ = *src++ | 0xFF000000;
+    }
+}
+
+#if RASTER_X86
+static inline __m128i div255SSE2(__m128i v)
+{
+    v = _mm_add_epi16(v, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+}
+
+static void fillSSE2(uint32_t *dst, int n, uint32_t argb)
+{
+    uint32_t a = argb >> 24;
+    __m128i zero = _mm_setzero_si128();
+    __m128i c, sa, ia, d, lo, hi;
+
+    if (a == 0xFF) {
+        c = _mm_set1_epi32(argb);
+        for (; n >= 4; n -= 4, dst += 4) {
+            _mm_storeu_si128((__m128i *)dst, c);
+        }
+    }
+    else if (a) {
+        c = _mm_unpacklo_epi8(_mm_set1_epi32(argb | 0xFF000000), zero);
+        sa = _mm_mullo_epi16(c, _mm_set1_epi16(a));
+        ia = _mm_set1_epi16(255 - a);
+        for (; n >= 4; n -= 4, dst += 4) {
+            d = _mm_loadu_si128((__m128i *)dst);
+            lo = _mm_unpacklo_epi8(d, zero);
+            hi = _mm_unpackhi_epi8(d, zero);
+            lo = div255SSE2(_mm_add_epi16(_mm_mullo_epi16(lo, ia), sa));
+            hi = div255SSE2(_mm_add_epi16(_mm_mullo_epi16(hi, ia), sa));
+            _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(lo, hi));
+        }
+    }
+
+    fillScalar(dst, n, argb);
+}
+
+/** Blends 8 16 bit channels, the alpha being each pixel's 4th channel */
+static inline __m128i blendHalfSSE2(__m128i s, __m128i d)
+{
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+
+    s = _mm_or_si128(s, _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0));
+
+    return div255SSE2(
+               _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, ia)));
+}
+
+static void blendSSE2(uint32_t *dst, const uint32_t *src, int n)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i alpha = _mm_set1_epi32(0xFF000000);
+    __m128i s, d, opaque;
+
+    for (; n >= 4; n -= 4, dst += 4, src += 4) {
+        s = _mm_loadu_si128((const __m128i *)src);
+        opaque = _mm_cmpeq_epi32(_mm_and_si128(s, alpha), alpha);
+        if (_mm_movemask_epi8(opaque) == 0xFFFF) {
+            _mm_storeu_si128((__m128i *)dst, s);
+            continue;
+        }
+        d = _mm_loadu_si128((__m128i *)dst);
+        _mm_storeu_si128((__m128i *)dst,
+                         _mm_packus_epi16(
+                             blendHalfSSE2(_mm_unpacklo_epi8(s, zero),
+                                           _mm_unpacklo_epi8(d, zero)),
+                             blendHalfSSE2(_mm_unpackhi_epi8(s, zero),
+                                           _mm_unpackhi_epi8(d, zero))));
+    }
+
+    blendScalar(dst, src, n);
+}
+
+/**
+ * The AVX2 kernels are the SSE2 kernels on twice as many pixels, unpacking and
+ * packing work within 128 bit lanes so the pixel order is kept
+ */
+__attribute__((target("avx2"))) static inline __m256i div255AVX2(__m256i v)
+{
+    v = _mm256_add_epi16(v, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)),
+                             8);
+}
+
+__attribute__((target("avx2"))) static void fillAVX2(uint32_t *dst, int n,
+        uint32_t argb)
+{
+    uint32_t a = argb >> 24;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i c, sa, ia, d, lo, hi;
+
+    if (a == 0xFF) {
+        c = _mm256_set1_epi32(argb);
+        for (; n >= 8; n -= 8, dst += 8) {
+            _mm256_storeu_si256((__m256i *)dst, c);
+        }
+    }
+    else if (a) {
+        c = _mm256_unpacklo_epi8(_mm256_set1_epi32(argb | 0xFF000000), zero);
+        sa = _mm256_mullo_epi16(c, _mm256_set1_epi16(a));
+        ia = _mm256_set1_epi16(255 - a);
+        for (; n >= 8; n -= 8, dst += 8) {
+            d = _mm256_loadu_si256((__m256i *)dst);
+            lo = _mm256_unpacklo_epi8(d, zero);
+            hi = _mm256_unpackhi_epi8(d, zero);
+            lo = div255AVX2(_mm256_add_epi16(_mm256_mullo_epi16(lo, ia), sa));
+            hi = div255AVX2(_mm256_add_epi16(_mm256_mullo_epi16(hi, ia), sa));
+            _mm256_storeu_si256((__m256i *)dst, _mm256_packus_epi16(lo, hi));
+        }
+    }
+
+    fillSSE2(dst, n, argb);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+blendHalfAVX2(__m256i s, __m256i d)
+{
+    __m256i a =
+        _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+
+    s = _mm256_or_si256(s, _mm256_set1_epi64x(0x00FF000000000000LL));
+
+    return div255AVX2(_mm256_add_epi16(_mm256_mullo_epi16(s, a),
+                                       _mm256_mullo_epi16(d, ia)));
+}
+
+__attribute__((target("avx2"))) static void
+blendAVX2(uint32_t *dst, const uint32_t *src, int n)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i alpha = _mm256_set1_epi32(0xFF000000);
+    __m256i s, d, opaque;
+
+    for (; n >= 8; n -= 8, dst += 8, src += 8) {
+        s = _mm256_loadu_si256((const __m256i *)src);
+        opaque = _mm256_cmpeq_epi32(_mm256_and_si256(s, alpha), alpha);
+        if (_mm256_movemask_epi8(opaque) == -1) {
+            _mm256_storeu_si256((__m256i *)dst, s);
+            continue;
+        }
+        d = _mm256_loadu_si256((__m256i *)dst);
+        _mm256_storeu_si256((__m256i *)dst,
+                            _mm256_packus_epi16(
+                                blendHalfAVX2(_mm256_unpacklo_epi8(s, zero),
+                                              _mm256_unpacklo_epi8(d, zero)),
+                                blendHalfAVX2(_mm256_unpackhi_epi8(s, zero),
+                                              _mm256_unpackhi_epi8(d, zero))));
+    }
+
+    blendSSE2(dst, src, n);
+}
+#endif // RASTER_X86
+
+static void rasterInit(void)
+{
+    int i;
+
+    raster.name = "c";
+    raster.fill = fillScalar;
+    raster.blend = blendScalar;
+
+#if RASTER_X86
+    raster.name = "sse2";
+    raster.fill = fillSSE2;
+    raster.blend = blendSSE2;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        raster.name = "avx2";
+        raster.fill = fillAVX2;
+        raster.blend = blendAVX2;
+    }
+#endif
+
+    /** Rounding hides any last bit differences between libm versions */
+    for (i = 0; i < 360; i++) {
+        raster.cos[i] = lround(cos(i * M_PI / 180) * (1 << ANGLE_SHIFT));
+        raster.sin[i] = lround(sin(i * M_PI / 180) * (1 << ANGLE_SHIFT));
+    }
+}
+
+static inline void rasterOnce(void)
+{
+    pthread_once(&raster.once, rasterInit);
+}
+
+const char *tumRasterGetKernelName(void)
+{
+    rasterOnce();
+
+    return raster.name;
+}
+
+static inline uint32_t *pixelAt(const tum_raster_target_t *t, int x, int y)
+{
+    return t->pixels + (size_t)y * t->pitch + x;
+}
+
+/** Fills n pixels using the target's blend mode */
+static inline void fillPixels(const tum_raster_target_t *t, uint32_t *dst,
+                              int n, uint32_t argb)
+{
+    switch (t->blend) {
+        case TUM_BLEND_NONE:
+            raster.fill(dst, n, argb | 0xFF000000);
+            break;
+        case TUM_BLEND_ADD:
+            addFillScalar(dst, n, argb);
+            break;
+        default:
+            raster.fill(dst, n, argb);
+            break;
+    }
+}
+
+/** Draws n pixels of an image using the target's blend mode */
+static inline void blendPixels(const tum_raster_target_t *t, uint32_t *dst,
+                               const uint32_t *src, int n)
+{
+    switch (t->blend) {
+        case TUM_BLEND_NONE:
+            copyOpaqueScalar(dst, src, n);
+            break;
+        case TUM_BLEND_ADD:
+            addBlendScalar(dst, src, n);
+            break;
+        default:
+            raster.blend(dst, src, n);
+            break;
+    }
+}
+
+/** Fills the pixels [x0, x1) of row y */
+static inline void span(const tum_raster_target_t *t, int x0, int x1, int y,
+                        uint32_t argb)
+{
+    if (y < t->clip_y0 || y >= t->clip_y1) {
+        return;
+    }
+
+    if (x0 < t->clip_x0) {
+        x0 = t->clip_x0;
+    }
+    if (x1 > t->clip_x1) {
+        x1 = t->clip_x1;
+    }
+
+    if (x0 >= x1) {
+        return;
+    }
+
+    if (t->record) {
+        t->record(x0, x1, y, t->record_arg);
+    }
+    else {
+        fillPixels(t, pixelAt(t, x0, y), x1 - x0, argb);
+    }
+}
+
+static inline void plot(const tum_raster_target_t *t, int x, int y,
+                        uint32_t argb)
+{
+    if (x >= t->clip_x0 && x < t->clip_x1 && y >= t->clip_y0 &&
+        y < t->clip_y1) {
+        if (t->record) {
+            t->record(x, x + 1, y, t->record_arg);
+        }
+        else if (t->blend == TUM_BLEND_BLEND) {
+            fillScalar(pixelAt(t, x, y), 1, argb);
+        }
+        else {
+            fillPixels(t, pixelAt(t, x, y), 1, argb);
+        }
+    }
+}
+
+static uint64_t isqrt(uint64_t v)
+{
+    uint64_t ret = 0, bit = 1ULL << 62;
+
+    while (bit > v) {
+        bit >>= 2;
+    }
+
+    for (; bit; bit >>= 2) {
+        if (v >= ret + bit) {
+            v -= ret + bit;
+            ret = (ret >> 1) + bit;
+        }
+        else {
+            ret >>= 1;
+        }
+    }
+
+    return ret;
+}
+
+/** Rounds a 16.16 fixed point value up to the next integer */
+static inline int fixedCeil(int64_t v)
+{
+    return (int)((v + FIXED_ONE - 1) >> FIXED_SHIFT);
+}
+
+void tumRasterFill(const tum_raster_target_t *target, uint32_t argb)
+{
+    int y;
+
+    rasterOnce();
+
+    for (y = target->clip_y0; y < target->clip_y1; y++) {
+        span(target, target->clip_x0, target->clip_x1, y, argb);
+    }
+}
+
+void tumRasterFilledRect(const tum_raster_target_t *target, int x, int y,
+                         int w, int h, uint32_t argb)
+{
+    int row;
+
+    rasterOnce();
+
+    for (row = y; row < y + h; row++) {
+        span(target, x, x + w, row, argb);
+    }
+}
+
+void tumRasterRect(const tum_raster_target_t *target, int x, int y, int w,
+                   int h, uint32_t argb)
+{
+    int row;
+
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    rasterOnce();
+
+    span(target, x, x + w, y, argb);
+    if (h > 1) {
+        span(target, x, x + w, y + h - 1, argb);
+    }
+
+    for (row = y + 1; row < y + h - 1; row++) {
+        plot(target, x, row, argb);
+        if (w > 1) {
+            plot(target, x + w - 1, row, argb);
+        }
+    }
+}
+
+/** Bresenham, horizontal runs are filled as spans */
+static void thinLine(const tum_raster_target_t *t, int x1, int y1, int x2,
+                     int y2, uint32_t argb)
+{
+    int dx = abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+    int dy = -abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+    int err = dx + dy, e2;
+
+    if (y1 == y2) {
+        span(t, x1 < x2 ? x1 : x2, (x1 < x2 ? x2 : x1) + 1, y1, argb);
+        return;
+    }
+
+    for (;;) {
+        plot(t, x1, y1, argb);
+        if (x1 == x2 && y1 == y2) {
+            break;
+        }
+        e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            x1 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y1 += sy;
+        }
+    }
+}
+
+/**
+ * Fills a polygon of at most 8 16.16 fixed point corners using the even-odd
+ * rule, covering the pixels whose centres lie inside
+ */
+#define MAX_FILL_CORNERS 8
+
+static void fillPolygonFixed(const tum_raster_target_t *t, const int64_t *xs,
+                             const int64_t *ys, unsigned int n, uint32_t argb)
+{
+    int64_t crossings[MAX_FILL_CORNERS], yc, tmp;
+    int64_t min_y = ys[0], max_y = ys[0];
+    unsigned int i, j, count;
+    int y, y0, y1;
+
+    for (i = 1; i < n; i++) {
+        min_y = ys[i] < min_y ? ys[i] : min_y;
+        max_y = ys[i] > max_y ? ys[i] : max_y;
+    }
+
+    /** Rows whose centres lie within [min_y, max_y) */
+    y0 = fixedCeil(min_y - FIXED_HALF);
+    y1 = fixedCeil(max_y - FIXED_HALF);
+    y0 = y0 < t->clip_y0 ? t->clip_y0 : y0;
+    y1 = y1 > t->clip_y1 ? t->clip_y1 : y1;
+
+    for (y = y0; y < y1; y++) {
+        yc = ((int64_t)y << FIXED_SHIFT) + FIXED_HALF;
+
+        for (i = 0, count = 0; i < n; i++) {
+            j = (i + 1) % n;
+            if ((ys[i] <= yc) == (ys[j] <= yc)) {
+                continue;
+            }
+            crossings[count++] = xs[i] + (yc - ys[i]) * (xs[j] - xs[i]) /
+                                 (ys[j] - ys[i]);
+        }
+
+        for (i = 1; i < count; i++)
+            for (j = i; j && crossings[j - 1] > crossings[j]; j--) {
+                tmp = crossings[j];
+                crossings[j] = crossings[j - 1];
+                crossings[j - 1] = tmp;
+            }
+
+        for (i = 0; i + 1 < count; i += 2)
+            span(t, fixedCeil(crossings[i] - FIXED_HALF),
+                 fixedCeil(crossings[i + 1] - FIXED_HALF), y, argb);
+    }
+}
+
+static inline int64_t pixelCentre(int v)
+{
+    return ((int64_t)v << FIXED_SHIFT) + FIXED_HALF;
+}
+
+void tumRasterLine(const tum_raster_target_t *target, int x1, int y1, int x2,
+                   int y2, unsigned int thickness, uint32_t argb)
+{
+    int64_t xs[4], ys[4], len, nx, ny;
+    int dx = x2 - x1, dy = y2 - y1;
+
+    rasterOnce();
+
+    if (thickness <= 1) {
+        thinLine(target, x1, y1, x2, y2, argb);
+        return;
+    }
+
+    if (!dx && !dy) {
+        tumRasterFilledRect(target, x1 - thickness / 2, y1 - thickness / 2,
+                            thickness, thickness, argb);
+        return;
+    }
+
+    /** Half the thickness along the line's normal, in 16.16 fixed point */
+    len = isqrt((uint64_t)((int64_t)dx * dx + (int64_t)dy * dy)
+                << (2 * FIXED_SHIFT));
+    nx = (int64_t) - dy * thickness * (1LL << (2 * FIXED_SHIFT - 1)) / len;
+    ny = (int64_t)dx * thickness * (1LL << (2 * FIXED_SHIFT - 1)) / len;
+
+    xs[0] = pixelCentre(x1) + nx;
+    ys[0] = pixelCentre(y1) + ny;
+    xs[1] = pixelCentre(x2) + nx;
+    ys[1] = pixelCentre(y2) + ny;
+    xs[2] = pixelCentre(x2) - nx;
+    ys[2] = pixelCentre(y2) - ny;
+    xs[3] = pixelCentre(x1) - nx;
+    ys[3] = pixelCentre(y1) - ny;
+
+    fillPolygonFixed(target, xs, ys, 4, argb);
+}
+
+void tumRasterFilledCircle(const tum_raster_target_t *target, int x, int y,
+                           int radius, uint32_t argb)
+{
+    int dy, dx;
+
+    if (radius < 0) {
+        return;
+    }
+
+    rasterOnce();
+
+    for (dy = -radius; dy <= radius; dy++) {
+        dx = isqrt((int64_t)radius * radius - (int64_t)dy * dy);
+        span(target, x - dx, x + dx + 1, y + dy, argb);
+    }
+}
+
+/** Half width of an ellipse dy rows from its centre, rounded */
+static inline int ellipseHalfWidth(int rx, int ry, int dy)
+{
+    uint64_t v = (uint64_t)rx * rx * ((int64_t)ry * ry - (int64_t)dy * dy);
+
+    return (isqrt(v) + ry / 2) / ry;
+}
+
+/**
+ * Walks the one pixel wide outline of an ellipse as horizontal runs, each
+ * row drawing from its own half width in to just outside the next row's, so
+ * that steep parts of the outline have no gaps
+ */
+static void ellipseOutline(const tum_raster_target_t *t, int x, int y, int rx,
+                           int ry, uint32_t argb,
+                           void (*run)(const tum_raster_target_t *, int, int,
+                                       int, int, uint32_t, const void *),
+                           const void *arg)
+{
+    int dy, outer, inner;
+
+    for (dy = 0; dy <= ry; dy++) {
+        outer = ellipseHalfWidth(rx, ry, dy);
+        inner = dy < ry ? ellipseHalfWidth(rx, ry, dy + 1) + 1 : 0;
+        inner = inner > outer ? outer : inner;
+
+        run(t, x, y + dy, inner, outer, argb, arg);
+        if (dy) {
+            run(t, x, y - dy, inner, outer, argb, arg);
+        }
+    }
+}
+
+/** Draws the columns [inner, outer] left and right of x */
+static void ellipseRun(const tum_raster_target_t *t, int x, int y, int inner,
+                       int outer, uint32_t argb, const void *arg)
+{
+    (void)arg;
+
+    if (inner == 0) {
+        span(t, x - outer, x + outer + 1, y, argb);
+    }
+    else {
+        span(t, x - outer, x - inner + 1, y, argb);
+        span(t, x + inner, x + outer + 1, y, argb);
+    }
+}
+
+void tumRasterEllipse(const tum_raster_target_t *target, int x, int y, int rx,
+                      int ry, uint32_t argb)
+{
+    if (rx < 0 || ry < 0) {
+        return;
+    }
+
+    rasterOnce();
+
+    if (rx == 0 || ry == 0) {
+        thinLine(target, x - rx, y - ry, x + rx, y + ry, argb);
+        return;
+    }
+
+    ellipseOutline(target, x, y, rx, ry, argb, ellipseRun, NULL);
+}
+
+typedef struct arc_sector {
+    int64_t sx, sy; // Unit vector of the start angle
+    int64_t ex, ey; // Unit vector of the end angle
+    int sweep;
+    int centre_y;
+} arc_sector_t;
+
+static inline int inSector(const arc_sector_t *s, int64_t dx, int64_t dy)
+{
+    /** Positive if the second vector is clockwise of the first on screen */
+    int64_t from_start = s->sx * dy - s->sy * dx;
+    int64_t to_end = dx * s->ey - dy * s->ex;
+
+    if (s->sweep <= 180) {
+        return from_start >= 0 && to_end >= 0;
+    }
+
+    return !(from_start < 0 && to_end < 0);
+}
+
+static void arcRun(const tum_raster_target_t *t, int x, int y, int inner,
+                   int outer, uint32_t argb, const void *arg)
+{
+    const arc_sector_t *s = arg;
+    int dx, dy = y - s->centre_y;
+
+    for (dx = inner; dx <= outer; dx++) {
+        if (inSector(s, dx, dy)) {
+            plot(t, x + dx, y, argb);
+        }
+        if (dx && inSector(s, -dx, dy)) {
+            plot(t, x - dx, y, argb);
+        }
+    }
+}
+
+void tumRasterArc(const tum_raster_target_t *target, int x, int y, int radius,
+                  int start, int end, uint32_t argb)
+{
+    arc_sector_t sector;
+
+    if (radius < 0) {
+        return;
+    }
+
+    rasterOnce();
+
+    start = ((start % 360) + 360) % 360;
+    end = ((end % 360) + 360) % 360;
+
+    if (start == end || radius == 0) {
+        tumRasterEllipse(target, x, y, radius, radius, argb);
+        return;
+    }
+
+    sector.sx = raster.cos[start];
+    sector.sy = raster.sin[start];
+    sector.ex = raster.cos[end];
+    sector.ey = raster.sin[end];
+    sector.sweep = (end - start + 360) % 360;
+    sector.centre_y = y;
+
+    ellipseOutline(target, x, y, radius, radius, argb, arcRun, &sector);
+}
+
+void tumRasterPolygon(const tum_raster_target_t *target, const coord_t *points,
+                      unsigned int n, int x_offset, int y_offset,
+                      uint32_t argb)
+{
+    unsigned int i, j;
+
+    rasterOnce();
+
+    for (i = 0; i < n; i++) {
+        j = (i + 1) % n;
+        thinLine(target, points[i].x + x_offset, points[i].y + y_offset,
+                 points[j].x + x_offset, points[j].y + y_offset, argb);
+    }
+}
+
+void tumRasterFilledTriangle(const tum_raster_target_t *target,
+                             const coord_t *points, int x_offset, int y_offset,
+                             uint32_t argb)
+{
+    int64_t xs[3], ys[3];
+    unsigned int i;
+
+    rasterOnce();
+
+    for (i = 0; i < 3; i++) {
+        xs[i] = pixelCentre(points[i].x + x_offset);
+        ys[i] = pixelCentre(points[i].y + y_offset);
+    }
+
+    fillPolygonFixed(target, xs, ys, 3, argb);
+}
+
+void tumRasterBlit(const tum_raster_target_t *target, const uint32_t *src,
+                   int src_pitch, int sx, int sy, int sw, int sh, int dx,
+                   int dy, int dw, int dh)
+{
+    int x0 = dx, y0 = dy, x1 = dx + dw, y1 = dy + dh;
+    uint32_t *row = NULL;
+    int x, y, src_y;
+
+    if (sw <= 0 || sh <= 0 || dw <= 0 || dh <= 0) {
+        return;
+    }
+
+    rasterOnce();
+
+    x0 = x0 < target->clip_x0 ? target->clip_x0 : x0;
+    y0 = y0 < target->clip_y0 ? target->clip_y0 : y0;
+    x1 = x1 > target->clip_x1 ? target->clip_x1 : x1;
+    y1 = y1 > target->clip_y1 ? target->clip_y1 : y1;
+
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    if (sw == dw && sh == dh) {
+        for (y = y0; y < y1; y++)
+            blendPixels(target, pixelAt(target, x0, y),
+                        src + (size_t)(sy + y - dy) * src_pitch + sx + x0 -
+                        dx,
+                        x1 - x0);
+        return;
+    }
+
+    /** Scaled rows are gathered, sampling at the destination pixel centres */
+    row = malloc((x1 - x0) * sizeof(uint32_t));
+    if (row == NULL) {
+        PRINT_ERROR("Allocating blit row failed");
+        return;
+    }
+
+    for (y = y0; y < y1; y++) {
+        src_y = sy + (int)(((int64_t)2 * (y - dy) + 1) * sh / (2 * dh));
+        for (x = x0; x < x1; x++)
+            row[x - x0] =
+                src[(size_t)src_y * src_pitch + sx +
+                                  (int)(((int64_t)2 * (x - dx) + 1) * sw / (2 * dw))];
+        blendPixels(target, pixelAt(target, x0, y), row, x1 - x0);
+    }
+
+    free(row);
+}
+
+void tumRasterMask(const tum_raster_target_t *target, const uint8_t *mask,
+                   int mask_pitch, int w, int h, int x, int y, uint32_t argb)
+{
+    const uint8_t *line;
+    int row, col, start;
+
+    rasterOnce();
+
+    for (row = 0; row < h; row++) {
+        line = mask + (size_t)row * mask_pitch;
+        for (col = 0; col < w;) {
+            if (!line[col]) {
+                col++;
+                continue;
+            }
+            for (start = col; col < w && line[col]; col++)
+                ;
+            span(target, x + start, x + col, y + row, argb);
+        }
+    }
+}
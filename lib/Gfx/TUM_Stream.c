@@ -0,0 +1,597 @@
+/**
+ * @file TUM_Stream.c
+ * @brief Streams captured frames to a consumer on the same machine
+ *
+ * @verbatim
+   ----------------------------------------------------------------------
+    Copyright (C) Alexander Hoffman, 2019
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+@endverbatim
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "SDL2/SDL.h"
+#include "SDL2/SDL_image.h"
+
+#include "TUM_Stream.h"
+#include "TUM_Utils.h"
+
+/** Time after which a blocked write checks if the stream is being closed */
+#define STREAM_POLL_MS 100
+#define STREAM_REQUEST_TIMEOUT_MS 1000
+#define STREAM_REQUEST_LENGTH 1024
+
+#define HTTP_BOUNDARY "tumframe"
+#define HTTP_RESPONSE                                                          \
+    "HTTP/1.0 200 OK\r\n"                                                      \
+    "Cache-Control: no-cache\r\n"                                              \
+    "Connection: close\r\n"                                                    \
+    "Content-Type: multipart/x-mixed-replace; boundary=" HTTP_BOUNDARY       \
+    "\r\n\r\n"
+#define HTTP_PART_LENGTH 128
+
+typedef struct stream_buffer {
+    uint32_t *pixels;
+    size_t capacity;
+    int w;
+    int h;
+} stream_buffer_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // Signalled when a frame is pushed or on closing
+    pthread_t thread;
+    atomic_uint open;
+    atomic_uint stop;
+    tum_stream_type_e type;
+    int flags;
+    char *path;
+    int listen_fd;
+    int fd; // Consumer, -1 if none is connected
+    stream_buffer_t pending; // Pushed, not yet taken by the stream thread
+    unsigned char has_pending;
+    stream_buffer_t sending; // Stream thread only from here on
+    stream_buffer_t last; // Last frame sent, w is 0 if nothing was sent yet
+    uint32_t number;
+    uint8_t *out;
+    size_t out_capacity;
+    atomic_uint dropped;
+} stream = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .listen_fd = -1,
+    .fd = -1,
+};
+
+static int reserveBuffer(stream_buffer_t *buf, int w, int h)
+{
+    uint32_t *tmp;
+
+    if (buf->capacity < (size_t)w * h) {
+        tmp = realloc(buf->pixels, (size_t)w * h * sizeof(uint32_t));
+        if (tmp == NULL) {
+            return -1;
+        }
+        buf->pixels = tmp;
+        buf->capacity = (size_t)w * h;
+    }
+
+    buf->w = w;
+    buf->h = h;
+
+    return 0;
+}
+
+static int reserveOutput(size_t size)
+{
+    uint8_t *tmp;
+
+    if (stream.out_capacity < size) {
+        tmp = realloc(stream.out, size);
+        if (tmp == NULL) {
+            PRINT_ERROR("Failed to allocate %zu bytes for streaming", size);
+            return -1;
+        }
+        stream.out = tmp;
+        stream.out_capacity = size;
+    }
+
+    return 0;
+}
+
+/** Writes all bytes, giving up if the consumer is gone or closing */
+static int streamWrite(const void *bytes, size_t len)
+{
+    const uint8_t *iterator = bytes;
+    struct pollfd pfd = { .fd = stream.fd, .events = POLLOUT };
+    ssize_t n;
+
+    while (len) {
+        if (stream.type == TUM_STREAM_FIFO) {
+            n = write(stream.fd, iterator, len);
+        }
+        else {
+            n = send(stream.fd, iterator, len, MSG_NOSIGNAL);
+        }
+
+        if (n > 0) {
+            iterator += n;
+            len -= n;
+        }
+        else if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (atomic_load(&stream.stop)) {
+                return -1;
+            }
+            poll(&pfd, 1, STREAM_POLL_MS);
+        }
+        else {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void disconnectConsumer(void)
+{
+    if (stream.fd >= 0) {
+        close(stream.fd);
+        stream.fd = -1;
+    }
+}
+
+/** Reads and ignores the request, any GET is answered with the stream */
+static int answerHTTPRequest(void)
+{
+    struct pollfd pfd = { .fd = stream.fd, .events = POLLIN };
+    char request[STREAM_REQUEST_LENGTH];
+
+    if (poll(&pfd, 1, STREAM_REQUEST_TIMEOUT_MS) <= 0 ||
+        read(stream.fd, request, sizeof(request)) <= 0) {
+        return -1;
+    }
+
+    return streamWrite(HTTP_RESPONSE, strlen(HTTP_RESPONSE));
+}
+
+/** Connects a waiting consumer, if any, without blocking */
+static int connectConsumer(void)
+{
+    if (stream.type == TUM_STREAM_FIFO) {
+        /** Fails with ENXIO until a reader opens the pipe */
+        stream.fd = open(stream.path, O_WRONLY | O_NONBLOCK);
+        if (stream.fd < 0) {
+            return -1;
+        }
+    }
+    else {
+        stream.fd = accept(stream.listen_fd, NULL, NULL);
+        if (stream.fd < 0) {
+            return -1;
+        }
+        fcntl(stream.fd, F_SETFL, fcntl(stream.fd, F_GETFL) | O_NONBLOCK);
+
+        if (stream.type == TUM_STREAM_HTTP && answerHTTPRequest()) {
+            disconnectConsumer();
+            return -1;
+        }
+    }
+
+    /** A new consumer starts with a full frame */
+    stream.last.w = 0;
+    stream.number = 0;
+
+    return 0;
+}
+
+static inline void packRGB(uint8_t *dst, const uint32_t *src, int n)
+{
+    for (; n; n--, src++, dst += 3) {
+        dst[0] = (*src >> 16) & 0xFF;
+        dst[1] = (*src >> 8) & 0xFF;
+        dst[2] = *src & 0xFF;
+    }
+}
+
+static int sendRaw(void)
+{
+    size_t size = (size_t)stream.sending.w * stream.sending.h * 3;
+
+    if (reserveOutput(size)) {
+        return -1;
+    }
+
+    packRGB(stream.out, stream.sending.pixels,
+            stream.sending.w * stream.sending.h);
+
+    return streamWrite(stream.out, size);
+}
+
+/**
+ * Sends the part of each row between its first and last pixel that differ
+ * from the last frame sent, or every row if there is no such frame
+ */
+static int sendDelta(void)
+{
+    int w = stream.sending.w, h = stream.sending.h, x0, x1, y;
+    int key = stream.last.w != w || stream.last.h != h;
+    tum_stream_header_t header = { .magic = { 'T', 'U', 'M', 'S' },
+                                   .w = w,
+                                   .h = h,
+                                   .number = stream.number
+                                 };
+    tum_stream_span_t span;
+    const uint32_t *cur, *prev;
+    uint8_t *iterator;
+
+    if (reserveOutput(sizeof(header) +
+                      (size_t)h * (sizeof(span) + (size_t)w * 3))) {
+        return -1;
+    }
+
+    iterator = stream.out + sizeof(header);
+
+    for (y = 0; y < h; y++) {
+        cur = stream.sending.pixels + (size_t)y * w;
+        prev = stream.last.pixels + (size_t)y * w;
+
+        x0 = 0;
+        x1 = w - 1;
+        if (!key) {
+            while (x0 < w && cur[x0] == prev[x0]) {
+                x0++;
+            }
+            if (x0 == w) {
+                continue;
+            }
+            while (cur[x1] == prev[x1]) {
+                x1--;
+            }
+        }
+
+        span = (tum_stream_span_t) {
+            .y = y, .x = x0, .n = x1 - x0 + 1
+        };
+        memcpy(iterator, &span, sizeof(span));
+        iterator += sizeof(span);
+        packRGB(iterator, cur + x0, span.n);
+        iterator += span.n * 3;
+        header.spans++;
+    }
+
+    memcpy(stream.out, &header, sizeof(header));
+
+    return streamWrite(stream.out, iterator - stream.out);
+}
+
+/** Returns 1 if the frame was not sent but the consumer is still fine */
+static int sendJPEG(void)
+{
+    size_t capacity = (size_t)stream.sending.w * stream.sending.h * 3 +
+                      STREAM_REQUEST_LENGTH;
+    SDL_Surface *surf;
+    SDL_RWops *rw;
+    char part[HTTP_PART_LENGTH];
+    Sint64 size = -1;
+
+    /** Unchanged frames are not sent again */
+    if (stream.last.w == stream.sending.w &&
+        stream.last.h == stream.sending.h &&
+        !memcmp(stream.last.pixels, stream.sending.pixels,
+                (size_t)stream.sending.w * stream.sending.h *
+                sizeof(uint32_t))) {
+        return 1;
+    }
+
+    if (reserveOutput(capacity)) {
+        return 1;
+    }
+
+    surf = SDL_CreateRGBSurfaceWithFormatFrom(
+               stream.sending.pixels, stream.sending.w, stream.sending.h, 32,
+               stream.sending.w * sizeof(uint32_t), SDL_PIXELFORMAT_ARGB8888);
+    if (surf == NULL) {
+        PRINT_ERROR("Failed to create surface for streaming");
+        return 1;
+    }
+
+    rw = SDL_RWFromMem(stream.out, capacity);
+    if (rw) {
+        if (IMG_SaveJPG_RW(surf, rw, 0, TUM_DRAW_STREAM_JPEG_QUALITY) == 0) {
+            size = SDL_RWtell(rw);
+        }
+        SDL_RWclose(rw);
+    }
+    SDL_FreeSurface(surf);
+
+    if (size < 0) {
+        PRINT_ERROR("Failed to encode streamed frame");
+        return 1;
+    }
+
+    snprintf(part, sizeof(part),
+             "--" HTTP_BOUNDARY "\r\nContent-Type: image/jpeg\r\n"
+             "Content-Length: %lld\r\n\r\n", (long long)size);
+
+    if (streamWrite(part, strlen(part)) || streamWrite(stream.out, size) ||
+        streamWrite("\r\n", 2)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void sendFrame(void)
+{
+    stream_buffer_t tmp;
+    int ret;
+
+    if (stream.fd < 0 && connectConsumer()) {
+        return;
+    }
+
+    switch (stream.type) {
+        case TUM_STREAM_HTTP:
+            ret = sendJPEG();
+            break;
+        default:
+            ret = stream.flags & TUM_STREAM_DELTA ? sendDelta() : sendRaw();
+            break;
+    }
+
+    if (ret < 0) {
+        disconnectConsumer();
+        return;
+    }
+    if (ret > 0) {
+        return;
+    }
+
+    stream.number++;
+
+    /** The frame sent is what the next delta is relative to */
+    tmp = stream.last;
+    stream.last = stream.sending;
+    stream.sending = tmp;
+}
+
+static void *streamThread(void *arg)
+{
+    stream_buffer_t tmp;
+
+    /** A closed pipe gives EPIPE */
+    tumUtilBlockSignals();
+
+    pthread_mutex_lock(&stream.lock);
+    for (;;) {
+        while (!stream.has_pending && !atomic_load(&stream.stop)) {
+            pthread_cond_wait(&stream.cond, &stream.lock);
+        }
+        if (atomic_load(&stream.stop)) {
+            break;
+        }
+
+        tmp = stream.sending;
+        stream.sending = stream.pending;
+        stream.pending = tmp;
+        stream.has_pending = 0;
+        pthread_mutex_unlock(&stream.lock);
+
+        sendFrame();
+
+        pthread_mutex_lock(&stream.lock);
+    }
+    pthread_mutex_unlock(&stream.lock);
+
+    disconnectConsumer();
+
+    return NULL;
+}
+
+static int listenUnix(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        PRINT_ERROR("Socket path '%s' is too long", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        PRINT_ERROR("Failed to create socket '%s'", path);
+        return -1;
+    }
+
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 1)) {
+        PRINT_ERROR("Failed to listen on socket '%s'", path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int listenHTTP(const char *port)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET,
+               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    char *end;
+    long num = strtol(port, &end, 10);
+    int fd, reuse = 1;
+
+    if (*port == '\0' || *end != '\0' || num <= 0 || num > UINT16_MAX) {
+        PRINT_ERROR("Invalid port '%s'", port);
+        return -1;
+    }
+    addr.sin_port = htons(num);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        PRINT_ERROR("Failed to create socket for port %ld", num);
+        return -1;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 1)) {
+        PRINT_ERROR("Failed to listen on port %ld", num);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int tumStreamOpen(tum_stream_type_e type, const char *address, int flags)
+{
+    if (address == NULL || atomic_load(&stream.open)) {
+        return -1;
+    }
+
+    stream.type = type;
+    stream.flags = flags;
+    stream.listen_fd = -1;
+
+    switch (type) {
+        case TUM_STREAM_FIFO:
+            if (mkfifo(address, 0666) && errno != EEXIST) {
+                PRINT_ERROR("Failed to create pipe '%s'", address);
+                return -1;
+            }
+            break;
+        case TUM_STREAM_UNIX:
+            stream.listen_fd = listenUnix(address);
+            break;
+        case TUM_STREAM_HTTP:
+            stream.listen_fd = listenHTTP(address);
+            break;
+        default:
+            return -1;
+    }
+
+    if (type != TUM_STREAM_FIFO) {
+        if (stream.listen_fd < 0) {
+            return -1;
+        }
+        fcntl(stream.listen_fd, F_SETFL,
+              fcntl(stream.listen_fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    stream.path = strdup(address);
+    if (stream.path == NULL) {
+        PRINT_ERROR("Failed to allocate stream address");
+        goto err_path;
+    }
+
+    atomic_store(&stream.stop, 0);
+    stream.has_pending = 0;
+
+    if (pthread_create(&stream.thread, NULL, streamThread, NULL)) {
+        PRINT_ERROR("Failed to create stream thread");
+        goto err_thread;
+    }
+
+    atomic_store(&stream.open, 1);
+
+    return 0;
+
+err_thread:
+    free(stream.path);
+    stream.path = NULL;
+err_path:
+    if (stream.listen_fd >= 0) {
+        close(stream.listen_fd);
+        stream.listen_fd = -1;
+    }
+    return -1;
+}
+
+void tumStreamClose(void)
+{
+    if (!atomic_exchange(&stream.open, 0)) {
+        return;
+    }
+
+    pthread_mutex_lock(&stream.lock);
+    atomic_store(&stream.stop, 1);
+    pthread_cond_signal(&stream.cond);
+    pthread_mutex_unlock(&stream.lock);
+
+    pthread_join(stream.thread, NULL);
+
+    if (stream.listen_fd >= 0) {
+        close(stream.listen_fd);
+        stream.listen_fd = -1;
+        if (stream.type == TUM_STREAM_UNIX) {
+            unlink(stream.path);
+        }
+    }
+
+    free(stream.path);
+    stream.path = NULL;
+}
+
+unsigned char tumStreamIsOpen(void)
+{
+    return atomic_load(&stream.open) ? 1 : 0;
+}
+
+void tumStreamPushFrame(const uint32_t *pixels, int w, int h)
+{
+    pthread_mutex_lock(&stream.lock);
+
+    if (stream.has_pending) {
+        atomic_fetch_add(&stream.dropped, 1);
+    }
+
+    if (reserveBuffer(&stream.pending, w, h)) {
+        PRINT_ERROR("Failed to allocate %d x %d stream buffer", w, h);
+        stream.has_pending = 0;
+    }
+    else {
+        memcpy(stream.pending.pixels, pixels,
+               (size_t)w * h * sizeof(uint32_t));
+        stream.has_pending = 1;
+        pthread_cond_signal(&stream.cond);
+    }
+
+    pthread_mutex_unlock(&stream.lock);
+}
+
+unsigned int tumStreamGetDropped(void)
+{
+    return atomic_load(&stream.dropped);
+}
@@ -33,6 +33,8 @@
 #include <libgen.h>
 #include <assert.h>
 #include <dirent.h>
+#include <time.h>
+#include <signal.h>
 
 #include "TUM_Utils.h"
 #include "EmulatorConfig.h"
@@ -76,6 +78,23 @@ void tumUtilSetGLThread(void)
     pthread_mutex_unlock(&GL_thread_lock);
 }
 
+void tumUtilBlockSignals(void)
+{
+    sigset_t set;
+
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+uint64_t tumUtilGetTimeNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
 char *tumUtilPrependPath(char *path, char *file)
 {
     char *ret = calloc(1, sizeof(char) * (strlen(path) + strlen(file) + 2));
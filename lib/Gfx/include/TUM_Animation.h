@@ -0,0 +1,226 @@
+/**
+ * @file TUM_Animation.h
+ * @brief Spritesheet animations drawn using TUM Draw, either one sequence at
+ * a time or many sprites at once through an animation manager
+ *
+ * @verbatim
+ ----------------------------------------------------------------------
+ Copyright (C) Alexander Hoffman, 2019
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ any later version.
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ----------------------------------------------------------------------
+ @endverbatim
+ */
+
+#ifndef __TUM_ANIMATION_H__
+#define __TUM_ANIMATION_H__
+
+#include "TUM_Draw.h"
+
+/**
+ * @defgroup tum_animation TUM Animation API
+ *
+ * @brief Animates sprites from spritesheets loaded as images
+ *
+ * @{
+ */
+
+/**
+ * @brief Defines the direction that the animation appears on the spritesheet
+ */
+enum sprite_sequence_direction {
+    SPRITE_SEQUENCE_HORIZONTAL_POS,
+    SPRITE_SEQUENCE_HORIZONTAL_NEG,
+    SPRITE_SEQUENCY_VERTICAL_POS,
+    SPRITE_SEQUENCY_VERTICAL_NEG,
+};
+
+/**
+ * @brief Handle used to reference a loaded animation spritesheet, an invalid
+ * spritesheet will have a NULL handle
+ *
+ * Sprite sheets are loaded as images and contain many individua sprites that
+ * are cycled to make animations. Thus a sequence of frames must be defined using
+ * tumDrawAnimationAddSequence() and this must be added to an animation that
+ * has been created by passing in a loaded sprite sheet.
+ */
+typedef void *animation_handle_t;
+
+/**
+ * @brief Returns an instance of an animation;
+ *
+ * After an animation has been created and a sequence added, an instance of the
+ * sequence must be created. This allows for the same animation sequence to
+ * be run within the same frame.
+ */
+typedef void *sequence_handle_t;
+
+/**
+ * @brief Handle used to reference an animation manager, see
+ * tumDrawAnimationManagerCreate()
+ */
+typedef void *animation_manager_handle_t;
+
+/**
+ * @brief Creates an animation object with an attached spritesheet that must be
+ * loaded prior as an image.
+ *
+ * @param spritesheet The loaded image that contains the spritesheet
+ * @param sprite_cols The number of colums in the sprite sheet
+ * @param sprite_rows The number of rows in the sprite sheet
+ * @return A handle to the created animation object
+ */
+animation_handle_t tumDrawAnimationCreate(image_handle_t spritesheet,
+        unsigned sprite_cols, unsigned sprite_rows);
+
+/**
+ * @brief Adds an animation sequence to a previously created animation
+ *
+ * An animation is the combination of a sprite sheet and one of more sequences.
+ * Sequences detail how the spritesheet should be parsed, in accordance to time,
+ * to create a desired animation. Thus after creating an animation (with an
+ * appropriate spritesheet) one or more sequences must be added to the animation
+ * in order for the animation to be able to render actual animations.
+ *
+ * @param animation Handle to the prviously created animation object
+ * @param name Ascii name to be given to the sequence. Used to reference the
+ * sequence
+ * @param start_row The row at which the start sprite can be found (0 indexed)
+ * @param start_col The col at which the start sprite can be found (0 indexed)
+ * @param sprite_step_direction Defines the direction with which the sprite
+ * frames can be found on the spritesheet
+ * @param frames The number of sprite frames that make up the animation
+ * @return 0 on success
+ */
+int tumDrawAnimationAddSequence(animation_handle_t animation, char *name,
+                                unsigned start_row, unsigned start_col,
+                                enum sprite_sequence_direction sprite_step_direction,
+                                unsigned frames);
+/**
+ * @brief Creates an instance of an animation from a loaded animation object
+ * and a sequence name of a sequence previously added to the animation object
+ *
+ * @param animation The animation object countaining the target spritesheet and
+ * animation sequence
+ * @param sequence_name Ascii string name of the sequence to be instantiated
+ * @param frame_period_ms The number of milliseconds that should transpire
+ * between sprite frames
+ * @return A handle to the instantiated animation sequence, NULL otherwise
+ */
+sequence_handle_t tumDrawAnimationSequenceInstantiate(animation_handle_t animation,
+        char *sequence_name, unsigned frame_period_ms);
+
+/**
+ * @brief Draws the target intantiated animation sequence at a given location
+ *
+ * Animation sequences update which frame to show based upon how much time has
+ * passed since they were last rendered. This is tracked incrementally and as
+ * such each call to this function should pass in the number of milliseconds that
+ * has transpired since the last call to tumDrawAnimationDrawFrame() so that
+ * the sprite frame can be selected appropriately.
+ *
+ * @param sequence Sequence instance that is to be rendered
+ * @param ms_timestep The number of milliseconds that have transpired since the
+ * last call to this function for the given animation sequence
+ * @param x The X axis location, in pixels, refernced from the top left of the
+ * sprite frame
+ * @param y The Y axis location, in pixels, refernced from the top left of the
+ * sprite frame
+ * @return 0 on success
+ */
+int tumDrawAnimationDrawFrame(sequence_handle_t sequence, unsigned ms_timestep,
+                              int x, int y);
+
+/**
+ * @brief Creates an animation manager
+ *
+ * An animation manager holds many animated sprites, each an instance of an
+ * animation sequence at a position. All sprites are advanced together using
+ * tumDrawAnimationManagerTick() and drawn using tumDrawAnimationManagerDraw(),
+ * which creates a single draw job per spritesheet instead of one per sprite.
+ * A manager should only be used from one task.
+ *
+ * @return Handle to the manager, NULL on error
+ */
+animation_manager_handle_t tumDrawAnimationManagerCreate(void);
+
+/**
+ * @brief Deletes an animation manager and all of its sprites
+ *
+ * @param manager Handle to the manager
+ */
+void tumDrawAnimationManagerDelete(animation_manager_handle_t manager);
+
+/**
+ * @brief Adds an animated sprite to an animation manager
+ *
+ * @param manager Handle to the manager
+ * @param animation Animation containing the sequence
+ * @param sequence_name Name of the sequence the sprite plays
+ * @param frame_period_ms The period, in milliseconds, of each frame
+ * @param x The X axis location, in pixels, of the sprite's top left corner
+ * @param y The Y axis location, in pixels, of the sprite's top left corner
+ * @return Id of the sprite within the manager, -1 on error
+ */
+int tumDrawAnimationManagerAdd(animation_manager_handle_t manager,
+                               animation_handle_t animation,
+                               char *sequence_name, unsigned frame_period_ms,
+                               int x, int y);
+
+/**
+ * @brief Removes a sprite from an animation manager, its id can be reused by
+ * a following tumDrawAnimationManagerAdd()
+ *
+ * @param manager Handle to the manager
+ * @param id Id of the sprite
+ * @return 0 on success
+ */
+int tumDrawAnimationManagerRemove(animation_manager_handle_t manager, int id);
+
+/**
+ * @brief Moves a sprite of an animation manager
+ *
+ * @param manager Handle to the manager
+ * @param id Id of the sprite
+ * @param x The X axis location, in pixels, of the sprite's top left corner
+ * @param y The Y axis location, in pixels, of the sprite's top left corner
+ * @return 0 on success
+ */
+int tumDrawAnimationManagerSetPosition(animation_manager_handle_t manager,
+                                       int id, int x, int y);
+
+/**
+ * @brief Advances all sprites of an animation manager
+ *
+ * @param manager Handle to the manager
+ * @param ms_timestep The number of milliseconds that have transpired since the
+ * last tick
+ */
+void tumDrawAnimationManagerTick(animation_manager_handle_t manager,
+                                 unsigned ms_timestep);
+
+/**
+ * @brief Draws the current frame of all sprites of an animation manager
+ *
+ * Sprites are drawn grouped by spritesheet, one batch per spritesheet, within
+ * a spritesheet in the order they are stored and the spritesheets in the order
+ * of their first sprite. Given sprites A and C of one spritesheet and B of
+ * another, added in that order, C is thus drawn below B. As removing a sprite
+ * also moves the last sprite into its place, overlapping sprites of different
+ * spritesheets should not rely on their order.
+ *
+ * @param manager Handle to the manager
+ * @return 0 on success
+ */
+int tumDrawAnimationManagerDraw(animation_manager_handle_t manager);
+
+/** @} */
+#endif // __TUM_ANIMATION_H__
@@ -0,0 +1,120 @@
+/**
+ * @file TUM_Capture.h
+ * @brief Frame capture encoder used by TUM Draw, writing captured frames to
+ * disk on a background thread
+ *
+ * @verbatim
+ ----------------------------------------------------------------------
+ Copyright (C) Alexander Hoffman, 2019
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ any later version.
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ----------------------------------------------------------------------
+ @endverbatim
+ */
+
+#ifndef __TUM_CAPTURE_H__
+#define __TUM_CAPTURE_H__
+
+#include <stdint.h>
+
+#include "TUM_Draw.h"
+
+/**
+ * @defgroup tum_capture TUM Capture API
+ *
+ * @brief Encodes captured frames into PNG files or a Y4M video
+ *
+ * Frames are read back into buffers taken from a pool of
+ * TUM_DRAW_CAPTURE_BUFFERS buffers, which are reused once the encoder thread
+ * has written them. Should the encoder fall that far behind, frames are
+ * dropped instead of stalling the drawing thread.
+ *
+ * Recordings, frames and screenshots are handled by the encoder in the order
+ * they are queued.
+ *
+ * @{
+ */
+
+/**
+ * @brief A buffer holding a captured frame
+ */
+typedef struct tum_capture_frame {
+    uint32_t *pixels; /**< ARGB8888 pixels, row by row */
+    int w; /**< Width of the frame */
+    int h; /**< Height of the frame */
+    unsigned int capacity; /**< Number of pixels allocated */
+} tum_capture_frame_t;
+
+/** Flag for tumCaptureSubmitFrame(), adds the frame to the recording */
+#define TUM_CAPTURE_RECORD 0x1
+
+/** Flag for tumCaptureSubmitFrame(), hands the frame to @ref tum_stream */
+#define TUM_CAPTURE_STREAM 0x2
+
+/**
+ * @brief Queues the start of a recording, ending any previous one
+ *
+ * @param filename The Y4M file, or the prefix of the numbered PNG files
+ * @param format Format the frames are written in
+ * @param fps Frame rate stored in a Y4M file
+ * @return 0 on success, -1 on error
+ */
+int tumCaptureOpen(const char *filename, tum_capture_format_e format,
+                   unsigned int fps);
+
+/**
+ * @brief Queues the end of the current recording
+ */
+void tumCaptureClose(void);
+
+/**
+ * @brief Takes a buffer from the pool
+ *
+ * @param w Width of the frame
+ * @param h Height of the frame
+ * @return Buffer large enough for the frame, NULL if the frame has to be
+ * dropped
+ */
+tum_capture_frame_t *tumCaptureGetFrame(int w, int h);
+
+/**
+ * @brief Returns a buffer taken from the pool without queueing it
+ *
+ * @param frame Buffer returned by tumCaptureGetFrame()
+ */
+void tumCaptureReleaseFrame(tum_capture_frame_t *frame);
+
+/**
+ * @brief Queues a frame to be written, the buffer is returned to the pool
+ * once written
+ *
+ * @param frame Buffer returned by tumCaptureGetFrame()
+ * @param flags TUM_CAPTURE_RECORD and/or TUM_CAPTURE_STREAM
+ * @param screenshot Allocated name of a PNG file the frame is also written
+ * to, freed by the encoder, or NULL
+ */
+void tumCaptureSubmitFrame(tum_capture_frame_t *frame, int flags,
+                           char *screenshot);
+
+/**
+ * @brief Gets the number of frames dropped since the start of the program
+ *
+ * @return Frames that were dropped as no buffer was free
+ */
+unsigned int tumCaptureGetDropped(void);
+
+/**
+ * @brief Waits until everything queued has been written
+ */
+void tumCaptureFlush(void);
+
+/** @} */
+#endif // __TUM_CAPTURE_H__
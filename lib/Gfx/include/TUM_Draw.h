@@ -49,6 +49,8 @@
  * @{
  */
 
+#include <stdint.h>
+
 #include "EmulatorConfig.h"
 
 /**
@@ -59,25 +61,138 @@
 #endif //WINDOW_TITLE
 
 /**
- * Sets the width (in pixels) of the screen
+ * Sets the initial width (in pixels) of the screen, see tumDrawSetResolution()
  */
 #ifndef SCREEN_WIDTH
 #define SCREEN_WIDTH 640
 #endif //SCREEN_WIDTH
 
 /**
- * Sets the height (in pixels) of the screen
+ * Sets the initial height (in pixels) of the screen, see tumDrawSetResolution()
  */
 #ifndef SCREEN_HEIGHT
 #define SCREEN_HEIGHT 480
 #endif //SCREEN_HEIGHT
 
+/**
+ * Width and height (in pixels) of the texture atlas pages that loaded images
+ * are packed into
+ */
+#ifndef TUM_DRAW_ATLAS_PAGE_SIZE
+#define TUM_DRAW_ATLAS_PAGE_SIZE 1024
+#endif //TUM_DRAW_ATLAS_PAGE_SIZE
+
+/**
+ * Loaded images larger than this (in pixels) in either dimension get their own
+ * texture instead of being packed into an atlas page. 0 disables packing.
+ */
+#ifndef TUM_DRAW_ATLAS_MAX_IMAGE_SIZE
+#define TUM_DRAW_ATLAS_MAX_IMAGE_SIZE 256
+#endif //TUM_DRAW_ATLAS_MAX_IMAGE_SIZE
+
+/**
+ * Transparent gap (in pixels) kept between packed images so that scaled
+ * images do not sample their neighbours
+ */
+#ifndef TUM_DRAW_ATLAS_PADDING
+#define TUM_DRAW_ATLAS_PADDING 1
+#endif //TUM_DRAW_ATLAS_PADDING
+
+/**
+ * Number of threads decoding images loaded using tumDrawLoadImageAsync()
+ */
+#ifndef TUM_DRAW_LOADER_THREADS
+#define TUM_DRAW_LOADER_THREADS 2
+#endif //TUM_DRAW_LOADER_THREADS
+
+/**
+ * Bytes of images, no longer referenced by any handle, that the image cache
+ * keeps loaded in case they are loaded again. 0 frees images immediately.
+ */
+#ifndef TUM_DRAW_IMAGE_CACHE_BUDGET
+#define TUM_DRAW_IMAGE_CACHE_BUDGET (32 * 1024 * 1024)
+#endif //TUM_DRAW_IMAGE_CACHE_BUDGET
+
+/** Number of hash buckets of the image cache */
+#ifndef TUM_DRAW_IMAGE_CACHE_BUCKETS
+#define TUM_DRAW_IMAGE_CACHE_BUCKETS 256
+#endif //TUM_DRAW_IMAGE_CACHE_BUCKETS
+
+/**
+ * Maximum number of damaged rectangles redrawn per frame in retained mode,
+ * further damage is merged into the existing rectangles
+ */
+#ifndef TUM_DRAW_DAMAGE_RECTS
+#define TUM_DRAW_DAMAGE_RECTS 8
+#endif //TUM_DRAW_DAMAGE_RECTS
+
+/**
+ * Number of jobs a job may be moved in front of to be drawn next to a job
+ * sharing its state, see tumDrawSetJobSorting()
+ */
+#ifndef TUM_DRAW_SORT_WINDOW
+#define TUM_DRAW_SORT_WINDOW 32
+#endif //TUM_DRAW_SORT_WINDOW
+
+/**
+ * Number of circles, ellipses and arcs whose pixels are kept between frames,
+ * such that shapes drawn every frame are not rasterized again
+ */
+#ifndef TUM_DRAW_SHAPE_CACHE_SIZE
+#define TUM_DRAW_SHAPE_CACHE_SIZE 256
+#endif //TUM_DRAW_SHAPE_CACHE_SIZE
+
+/** Largest radius of a cached shape, larger shapes are drawn by SDL2_gfx */
+#ifndef TUM_DRAW_SHAPE_MAX_RADIUS
+#define TUM_DRAW_SHAPE_MAX_RADIUS 1024
+#endif //TUM_DRAW_SHAPE_MAX_RADIUS
+
+/** Number of frames whose timings are kept, see tumDrawGetFrameTimings() */
+#ifndef TUM_DRAW_FRAME_HISTORY
+#define TUM_DRAW_FRAME_HISTORY 256
+#endif //TUM_DRAW_FRAME_HISTORY
+
+/**
+ * Threads rasterizing tiles besides the drawing thread when using software
+ * rendering, 0 uses one thread less than there are CPUs
+ */
+#ifndef TUM_DRAW_RASTER_THREADS
+#define TUM_DRAW_RASTER_THREADS 0
+#endif //TUM_DRAW_RASTER_THREADS
+
+/** Width and height of the tiles a frame is split into by software rendering */
+#ifndef TUM_DRAW_RASTER_TILE_SIZE
+#define TUM_DRAW_RASTER_TILE_SIZE 64
+#endif //TUM_DRAW_RASTER_TILE_SIZE
+
+/**
+ * Number of buffers captured frames are read back into while waiting to be
+ * written, see tumDrawCaptureStart()
+ */
+#ifndef TUM_DRAW_CAPTURE_BUFFERS
+#define TUM_DRAW_CAPTURE_BUFFERS 8
+#endif //TUM_DRAW_CAPTURE_BUFFERS
+
+/** Maximum number of frames captured frames are read back late by */
+#ifndef TUM_DRAW_CAPTURE_MAX_DELAY
+#define TUM_DRAW_CAPTURE_MAX_DELAY 3
+#endif //TUM_DRAW_CAPTURE_MAX_DELAY
+
+/** Quality (0 - 100) of the JPEGs streamed over HTTP */
+#ifndef TUM_DRAW_STREAM_JPEG_QUALITY
+#define TUM_DRAW_STREAM_JPEG_QUALITY 80
+#endif //TUM_DRAW_STREAM_JPEG_QUALITY
+
 /**
  * @name Hex RGB colours
  *
  * RRGGBB colours used by TUM Draw backend, colour standard is the same as the
  * common html standard
  *
+ * A colour's top byte is its alpha, AARRGGBB, where 0 is treated as opaque
+ * such that the plain RRGGBB colours below are drawn solid. Translucent
+ * colours are built using TUM_ALPHA(), eg. TUM_ALPHA(Red, 0x80).
+ *
  * @{
  */
 #define TUMBlue (unsigned int)(0x0065bd)
@@ -103,17 +218,21 @@
 #define Orange (unsigned int)(0xFFA500)
 #define Pink (unsigned int)(0xFFC0CB)
 #define Skyblue (unsigned int)(0x87CEEB)
+
+/** Gives an RRGGBB colour the alpha a, 0x01 (almost invisible) - 0xFF */
+#define TUM_ALPHA(colour, a)                                                   \
+    (((unsigned int)(colour) & 0xFFFFFF) | ((unsigned int)(a) & 0xFF) << 24)
 /**@}*/
 
 /**
- * @brief Defines the direction that the animation appears on the spritesheet
+ * @brief How drawn pixels are combined with those already drawn, see
+ * tumDrawSetBlendMode()
  */
-enum sprite_sequence_direction {
-    SPRITE_SEQUENCE_HORIZONTAL_POS,
-    SPRITE_SEQUENCE_HORIZONTAL_NEG,
-    SPRITE_SEQUENCY_VERTICAL_POS,
-    SPRITE_SEQUENCY_VERTICAL_NEG,
-};
+typedef enum {
+    TUM_BLEND_BLEND = 0, /**< Mixed according to the alpha, the default */
+    TUM_BLEND_NONE, /**< Replace what was drawn, ignoring the alpha */
+    TUM_BLEND_ADD, /**< Added, weighted by the alpha, eg. for glows */
+} tum_blend_mode_e;
 
 /**
  * @brief Holds a pixel co-ordinate
@@ -130,24 +249,9 @@ typedef struct coord {
 typedef void *image_handle_t;
 
 /**
- * @brief Handle used to reference a loaded animation spritesheet, an invalid
- * spritesheet will have a NULL handle
- *
- * Sprite sheets are loaded as images and contain many individua sprites that
- * are cycled to make animations. Thus a sequence of frames must be defined using
- * tumDrawAnimationAddSequence() and this must be added to an animation that
- * has been created by passing in a loaded sprite sheet.
+ * @brief Handle used to reference a layer, see tumDrawLayerCreate()
  */
-typedef void *animation_handle_t;
-
-/**
- * @brief Returns an instance of an animation;
- *
- * After an animation has been created and a sequence added, an instance of the
- * sequence must be created. This allows for the same animation sequence to
- * be run within the same frame.
- */
-typedef void *sequence_handle_t;
+typedef void *layer_handle_t;
 
 /**
  * @brief Returns a string error message from the TUM Draw back end
@@ -165,6 +269,21 @@ char *tumGetErrorMessage(void);
  */
 int tumDrawInit(char *path);
 
+/**
+ * @brief Initializes the TUM Draw backend without a window
+ *
+ * No window or renderer is created and nothing is ever presented, frames are
+ * always drawn using software rendering, see tumDrawSetSoftwareRendering(),
+ * and read using tumDrawReadSoftwareFramebuffer(). Captures and streams work
+ * as usual. Suitable for running without a display, eg. for pixel exact
+ * tests. Use instead of tumDrawInit().
+ *
+ * @param path Path to the folder's location where the program's binary is
+ * located
+ * @return 0 on success
+ */
+int tumDrawInitHeadless(char *path);
+
 /**
  * @brief Transfers the drawing ability to the calling thread/taskd
  *
@@ -200,6 +319,292 @@ void tumDrawExit(void);
  */
 int tumDrawUpdateScreen(void);
 
+/**
+ * @brief Sets the logical resolution, ie. the coordinate space that is drawn
+ * in, which is scaled to fit the window
+ *
+ * Defaults to SCREEN_WIDTH x SCREEN_HEIGHT and takes effect with the next
+ * frame. The aspect ratio is kept by letterboxing the window.
+ *
+ * @param width Width of the screen in logical pixels
+ * @param height Height of the screen in logical pixels
+ * @return 0 on success, -1 on an invalid resolution
+ */
+int tumDrawSetResolution(int width, int height);
+
+/**
+ * @brief Gets the width of the logical resolution, see tumDrawSetResolution()
+ *
+ * @return Width of the screen in logical pixels
+ */
+int tumDrawGetScreenWidth(void);
+
+/**
+ * @brief Gets the height of the logical resolution, see tumDrawSetResolution()
+ *
+ * @return Height of the screen in logical pixels
+ */
+int tumDrawGetScreenHeight(void);
+
+/**
+ * @brief Sets the size of the window, defaulting to SCREEN_WIDTH x
+ * SCREEN_HEIGHT
+ *
+ * On HiDPI displays the window has more physical pixels than its size, the
+ * logical resolution is scaled to all of them.
+ *
+ * @param width Width of the window
+ * @param height Height of the window
+ * @return 0 on success, -1 on an invalid size
+ */
+int tumDrawSetWindowSize(int width, int height);
+
+/**
+ * @brief Sets the resolution frames are rendered at, relative to the logical
+ * resolution
+ *
+ * A scale below 1.0 renders frames into a lower resolution texture which is
+ * then upscaled to the window, reducing the cost of complex scenes at the
+ * expense of sharpness. Software rendering always renders at the logical
+ * resolution.
+ *
+ * @param scale Scale in the range (0, 1], 1.0 by default
+ * @return 0 on success, -1 on an invalid scale
+ */
+int tumDrawSetRenderScale(float scale);
+
+/**
+ * @brief Enables or disables software rendering
+ *
+ * With software rendering the draw jobs are rasterized on the CPU, see
+ * @ref tum_raster, into an ARGB8888 framebuffer which is then shown in the
+ * window. Frames are split into tiles of TUM_DRAW_RASTER_TILE_SIZE that are
+ * rasterized in parallel by TUM_DRAW_RASTER_THREADS threads.
+ *
+ * The output is identical on every machine, making it suitable for pixel
+ * exact tests using tumDrawReadSoftwareFramebuffer(). Text is rendered by
+ * SDL_ttf and as such depends on its version. Software rendering takes
+ * precedence over retained mode and is always used after
+ * tumDrawInitHeadless().
+ *
+ * @param enable Non-zero to enable software rendering
+ */
+void tumDrawSetSoftwareRendering(unsigned char enable);
+
+/**
+ * @brief Copies the last frame drawn using software rendering
+ *
+ * @param pixels tumDrawGetScreenWidth() * tumDrawGetScreenHeight() ARGB8888
+ * pixels, row by row
+ * @return 0 on success, -1 if no frame has been rendered in software yet
+ */
+int tumDrawReadSoftwareFramebuffer(uint32_t *pixels);
+
+/**
+ * @brief Phases of a frame that are timed, see tum_frame_timing_t
+ */
+typedef enum {
+    TUM_FRAME_RECORD = 0, /**< Queueing draw jobs, summed over all tasks */
+    TUM_FRAME_DRAIN, /**< Executing the draw jobs in tumDrawUpdateScreen() */
+    TUM_FRAME_PRESENT, /**< SDL_RenderPresent(), including waiting for VSYNC */
+    TUM_FRAME_EVENTS, /**< Fetching SDL events */
+    TUM_FRAME_PHASES,
+} tum_frame_phase_e;
+
+/** Number of draw job types timed individually */
+#define TUM_DRAW_JOB_TYPES 16
+
+/**
+ * @brief Timings of a single frame, a frame ending with each
+ * tumDrawUpdateScreen() that draws something
+ *
+ * Recording and event fetching are attributed to the frame during which they
+ * happened. A frame bound by the CPU shows large record or drain times, one
+ * bound by draw calls large times in job_ns and one bound by VSYNC a large
+ * present time.
+ */
+typedef struct tum_frame_timing {
+    uint64_t start_ns; /**< Monotonic time the frame's update started */
+    uint32_t period_ns; /**< Time since the previous frame's update started */
+    uint32_t phase_ns[TUM_FRAME_PHASES]; /**< Time spent in each phase */
+    uint32_t job_ns[TUM_DRAW_JOB_TYPES]; /**< Time spent per job type */
+    uint16_t job_count[TUM_DRAW_JOB_TYPES]; /**< Jobs executed per type */
+    uint16_t state_changes; /**< Renderer state changes, ie. draw colour,
+                                 blend mode or texture */
+    uint16_t state_changes_avoided; /**< Redundant state changes skipped */
+} tum_frame_timing_t;
+
+/**
+ * @brief Gets the name of a job type, as used in tum_frame_timing_t
+ *
+ * @param type Index into tum_frame_timing_t's job_ns or job_count
+ * @return Name of the job type, eg. "circle", NULL if invalid
+ */
+const char *tumDrawGetJobTypeName(unsigned int type);
+
+/**
+ * @brief Adds time to a phase of the current frame
+ *
+ * Used by the TUM libraries to attribute their time, may be used to time
+ * other phases of an application's frame as well
+ *
+ * @param phase The phase to which the time is added
+ * @param ns Time in nanoseconds
+ */
+void tumDrawAddFrameTime(tum_frame_phase_e phase, uint64_t ns);
+
+/**
+ * @brief Copies the timings of the most recent frames
+ *
+ * @param frames Array into which the timings are copied, oldest first
+ * @param count Maximum number of frames to copy
+ * @return Number of frames copied, at most TUM_DRAW_FRAME_HISTORY
+ */
+unsigned int tumDrawGetFrameTimings(tum_frame_timing_t *frames,
+                                    unsigned int count);
+
+/** Flag for tumDrawDumpFrameTimings(), dumps raw tum_frame_timing_t */
+#define TUM_FRAME_DUMP_BINARY 0x1
+
+/**
+ * @brief Writes the timings of the last TUM_DRAW_FRAME_HISTORY frames to a file
+ *
+ * By default a CSV file with a header line is written. Using
+ * TUM_FRAME_DUMP_BINARY the file holds the magic "TUMF", a uint16_t version,
+ * a uint16_t sizeof(tum_frame_timing_t) and a uint32_t frame count, followed
+ * by the tum_frame_timing_t structs, all in host byte order.
+ *
+ * @param filename File to be written
+ * @param flags TUM_FRAME_DUMP_BINARY or 0
+ * @return 0 on success
+ */
+int tumDrawDumpFrameTimings(const char *filename, int flags);
+
+/**
+ * @brief Enables or disables retained mode
+ *
+ * In retained mode the screen is kept in a texture between frames. Each
+ * tumDrawUpdateScreen() compares the queued draw jobs with those of the
+ * previous frame and only redraws the areas covered by jobs that changed,
+ * are new or are gone. Frames without changes are not presented at all.
+ *
+ * Tasks still queue the complete scene each frame, jobs are compared in the
+ * order they were queued. A scene that changes little, eg. a mostly static UI,
+ * is then redrawn at a fraction of the cost of a full frame.
+ *
+ * @param enable Non-zero to enable retained mode
+ */
+void tumDrawSetRetainedMode(unsigned char enable);
+
+/**
+ * @brief Enables or disables sorting of each frame's jobs by their state
+ *
+ * Before drawing a frame jobs are reordered such that jobs sharing a texture
+ * or layer, blend mode and colour are drawn one after another, saving
+ * renderer state changes. A job is only moved in front of jobs it does not
+ * overlap, up to TUM_DRAW_SORT_WINDOW jobs, such that the frame looks the
+ * same as if drawn in the order queued. Worthwhile for scenes made of many
+ * small, interleaved jobs, eg. sprites and their labels.
+ *
+ * The state changes made and avoided are part of each frame's timings. Not
+ * used with software rendering, which has no renderer state.
+ *
+ * @param enable Non-zero to enable sorting
+ */
+void tumDrawSetJobSorting(unsigned char enable);
+
+/**
+ * @brief Formats frames can be captured in, see tumDrawCaptureStart()
+ */
+typedef enum {
+    TUM_CAPTURE_PNG = 0, /**< A numbered PNG file per frame */
+    TUM_CAPTURE_Y4M, /**< A single uncompressed YUV4MPEG2 (4:2:0) video */
+} tum_capture_format_e;
+
+/**
+ * @brief Starts recording every frame shown to disk
+ *
+ * Frames are copied on the GPU and read back delay frames later, once the GPU
+ * has finished with them, instead of stalling the pipeline. They are then
+ * written by a background thread, see @ref tum_capture. Frames are recorded at
+ * the resolution they are rendered at.
+ *
+ * @param filename The Y4M file, or the prefix of the PNG files, eg. "run"
+ * gives run_000000.png, run_000001.png, ...
+ * @param format Format the frames are written in
+ * @param delay Frames by which reading back is delayed, at most
+ * TUM_DRAW_CAPTURE_MAX_DELAY
+ * @return 0 on success, -1 on error
+ */
+int tumDrawCaptureStart(const char *filename, tum_capture_format_e format,
+                        unsigned int delay);
+
+/**
+ * @brief Stops the recording started by tumDrawCaptureStart()
+ *
+ * Frames that have not been read back yet are read back with the next frame
+ * and written in the background, tumDrawExit() waits for them to be written.
+ *
+ * @return 0 on success, -1 if not recording
+ */
+int tumDrawCaptureStop(void);
+
+/**
+ * @brief Writes the next frame shown to a PNG file
+ *
+ * @param filename Name of the PNG file
+ * @return 0 on success, -1 on error
+ */
+int tumDrawScreenshot(const char *filename);
+
+/**
+ * @brief Gets the number of captured frames that were dropped as the encoder
+ * could not keep up
+ *
+ * @return Number of frames dropped since the start of the program
+ */
+unsigned int tumDrawCaptureGetDropped(void);
+
+/**
+ * @brief Connections frames can be streamed over, see tumDrawStreamStart()
+ */
+typedef enum {
+    TUM_STREAM_FIFO = 0, /**< A named pipe, created if it does not exist */
+    TUM_STREAM_UNIX, /**< A Unix socket, listened on for a consumer */
+    TUM_STREAM_HTTP, /**< MJPEG over HTTP, served on 127.0.0.1 */
+} tum_stream_type_e;
+
+/** Flag for tumDrawStreamStart(), sends only what changed between frames */
+#define TUM_STREAM_DELTA 0x1
+
+/**
+ * @brief Streams every frame shown to a consumer, eg. a remote dashboard
+ *
+ * Frames are captured as with tumDrawCaptureStart(), read back one frame late,
+ * and sent from a background thread. If the consumer can not keep up frames
+ * are dropped. The formats sent are described in @ref tum_stream.
+ *
+ * @param type Connection to stream over
+ * @param address Path of the named pipe or Unix socket, or the port to serve
+ * HTTP on, eg. "8080"
+ * @param flags TUM_STREAM_DELTA or 0, ignored for HTTP
+ * @return 0 on success, -1 on error
+ */
+int tumDrawStreamStart(tum_stream_type_e type, const char *address,
+                       int flags);
+
+/**
+ * @brief Stops the stream started by tumDrawStreamStart()
+ */
+void tumDrawStreamStop(void);
+
+/**
+ * @brief Gets the number of frames dropped as the consumer could not keep up
+ *
+ * @return Number of frames dropped since the start of the program
+ */
+unsigned int tumDrawStreamGetDropped(void);
+
 /**
  * @brief Sets the screen to a solid colour
  *
@@ -211,7 +616,8 @@ int tumDrawClear(unsigned int colour);
 /*
  * @brief Copies a screenshot of the current frame to the next frame
  *
- * Experimental, performance can not be guarenteed.
+ * Reads the frame back synchronously, stalling the GPU pipeline. Use
+ * tumDrawScreenshot() to capture frames. Does nothing when headless.
  */
 void tumDrawDuplicateBuffer(void);
 
@@ -353,6 +759,16 @@ int tumDrawTriangle(coord_t *points, unsigned int colour);
  * Relative paths are relative to the executed binary's location on the
  * file system
  *
+ * Images no larger than TUM_DRAW_ATLAS_MAX_IMAGE_SIZE are packed into shared
+ * texture atlas pages, consecutive draws of images on the same page are
+ * batched into a single draw call.
+ *
+ * Images are cached by filename, loading an image that is already loaded
+ * shares the decoded image without touching the file. Should the image still
+ * be loading, for example by tumDrawLoadImageAsync(), the call waits for it to
+ * finish. Each load returns its own handle, with its own scale, that must be
+ * released using tumDrawFreeLoadedImage().
+ *
  * @param filename Name of the image file to be loaded
  * @return Returns a image_handle_t handle to the image
  */
@@ -372,9 +788,49 @@ image_handle_t tumDrawLoadImage(char *filename);
 image_handle_t tumDrawLoadScaledImage(char *filename, float scale);
 
 /**
- * @brief Closes a loaded image and frees all memory used by the image structure
+ * @brief Loads an image in the background, returning immediately
+ *
+ * The file is found and decoded by one of TUM_DRAW_LOADER_THREADS loader
+ * threads, the image is finished by the next tumDrawUpdateScreen(). Until then
+ * drawing the image does nothing and its size is reported as 0, use
+ * tumDrawGetLoadedImageState() to check if it is ready. The handle can be
+ * freed using tumDrawFreeLoadedImage() at any time.
+ *
+ * See tumDrawLoadImage() for information on filenames.
+ *
+ * @param filename Name of the image file to be loaded
+ * @return Returns a image_handle_t handle to the image, NULL on error
+ */
+image_handle_t tumDrawLoadImageAsync(char *filename);
+
+/**
+ * @brief Loads and scales an image in the background, see
+ * tumDrawLoadImageAsync() and tumDrawLoadScaledImage()
+ *
+ * @param filename Name of the image file to be loaded
+ * @param scale Scaling factor with which the image should be drawn
+ * @return Returns a image_handle_t handle to the image, NULL on error
+ */
+image_handle_t tumDrawLoadScaledImageAsync(char *filename, float scale);
+
+/**
+ * @brief Checks if a loaded image can be drawn
+ *
+ * Images loaded using tumDrawLoadImage() are always ready.
+ *
+ * @param img Handle to the image
+ * @return 1 if ready, 0 if still loading, -1 if loading failed
+ */
+int tumDrawGetLoadedImageState(image_handle_t img);
+
+/**
+ * @brief Releases a handle returned by one of the image loading functions
+ *
+ * Once all handles to an image are released it is kept by the image cache
+ * until TUM_DRAW_IMAGE_CACHE_BUDGET forces it out, then it is closed and all
+ * memory used by the image structure is freed.
  *
- * @param img Handle to the loaded image
+ * @param img Handle to the loaded image, set to NULL
  * @return 0 on success
  */
 int tumDrawFreeLoadedImage(image_handle_t *img);
@@ -485,74 +941,92 @@ int tumDrawArrow(signed short x1, signed short y1, signed short x2,
                  unsigned char thickness, unsigned int colour);
 
 /**
- * @brief Creates an animation object with an attached spritesheet that must be
- * loaded prior as an image.
+ * @brief Creates a layer, an off screen texture holding static content
+ *
+ * Content that does not change from frame to frame, eg. backgrounds, is
+ * recorded into a layer once using tumDrawLayerBegin() and tumDrawLayerEnd().
+ * It is then rendered into the layer's texture once and each tumDrawLayer()
+ * afterwards costs a single texture copy.
+ *
+ * @param w Width of the layer in pixels, 0 for the screen's width
+ * @param h Height of the layer in pixels, 0 for the screen's height
+ * @return Handle to the layer, NULL on error
+ */
+layer_handle_t tumDrawLayerCreate(int w, int h);
+
+/**
+ * @brief Deletes a layer, already queued draws of the layer are still done
  *
- * @param spritesheet The loaded image that contains the spritesheet
- * @param sprite_cols The number of colums in the sprite sheet
- * @param sprite_rows The number of rows in the sprite sheet
- * @return A handle to the created animation object
+ * @param layer Handle to the layer
  */
-animation_handle_t tumDrawAnimationCreate(image_handle_t spritesheet,
-        unsigned sprite_cols, unsigned sprite_rows);
+void tumDrawLayerDelete(layer_handle_t layer);
 
 /**
- * @brief Adds an animation sequence to a previously created animation
+ * @brief Starts recording the content of a layer
  *
- * An animation is the combination of a sprite sheet and one of more sequences.
- * Sequences detail how the spritesheet should be parsed, in accordance to time,
- * to create a desired animation. Thus after creating an animation (with an
- * appropriate spritesheet) one or more sequences must be added to the animation
- * in order for the animation to be able to render actual animations.
+ * Until tumDrawLayerEnd() is called all draw functions called by the calling
+ * task are recorded into the layer instead of being drawn to the screen. Their
+ * coordinates are relative to the layer's top left corner. Other tasks keep
+ * drawing to the screen.
  *
- * @param animation Handle to the prviously created animation object
- * @param name Ascii name to be given to the sequence. Used to reference the
- * sequence
- * @param start_row The row at which the start sprite can be found (0 indexed)
- * @param start_col The col at which the start sprite can be found (0 indexed)
- * @param sprite_step_direction Defines the direction with which the sprite
- * frames can be found on the spritesheet
- * @param frames The number of sprite frames that make up the animation
+ * @param layer Handle to the layer
  * @return 0 on success
  */
-int tumDrawAnimationAddSequence(animation_handle_t animation, char *name,
-                                unsigned start_row, unsigned start_col,
-                                enum sprite_sequence_direction sprite_step_direction,
-                                unsigned frames);
+int tumDrawLayerBegin(layer_handle_t layer);
+
 /**
- * @brief Creates an instance of an animation from a loaded animation object
- * and a sequence name of a sequence previously added to the animation object
+ * @brief Ends recording a layer, the recording replaces the layer's previous
+ * content once the layer is next drawn
  *
- * @param animation The animation object countaining the target spritesheet and
- * animation sequence
- * @param sequence_name Ascii string name of the sequence to be instantiated
- * @param frame_period_ms The number of milliseconds that should transpire
- * between sprite frames
- * @return A handle to the instantiated animation sequence, NULL otherwise
+ * @param layer Handle to the layer
+ * @return 0 on success
  */
-sequence_handle_t tumDrawAnimationSequenceInstantiate(animation_handle_t animation,
-        char *sequence_name, unsigned frame_period_ms);
+int tumDrawLayerEnd(layer_handle_t layer);
 
 /**
- * @brief Draws the target intantiated animation sequence at a given location
+ * @brief Renders the layer's recording again the next time it is drawn
+ *
+ * Needed if the recorded content depends on something that changed since,
+ * eg. a loaded image that finished loading asynchronously.
  *
- * Animation sequences update which frame to show based upon how much time has
- * passed since they were last rendered. This is tracked incrementally and as
- * such each call to this function should pass in the number of milliseconds that
- * has transpired since the last call to tumDrawAnimationDrawFrame() so that
- * the sprite frame can be selected appropriately.
+ * @param layer Handle to the layer
+ * @return 0 on success
+ */
+int tumDrawLayerInvalidate(layer_handle_t layer);
+
+/**
+ * @brief Draws a layer's content on the screen
  *
- * @param sequence Sequence instance that is to be rendered
- * @param ms_timestep The number of milliseconds that have transpired since the
- * last call to this function for the given animation sequence
- * @param x The X axis location, in pixels, refernced from the top left of the
- * sprite frame
- * @param y The Y axis location, in pixels, refernced from the top left of the
- * sprite frame
+ * @param layer Handle to the layer
+ * @param x X coordinate of the top left corner of the layer
+ * @param y Y coordinate of the top left corner of the layer
  * @return 0 on success
  */
-int tumDrawAnimationDrawFrame(sequence_handle_t sequence, unsigned ms_timestep,
-                              int x, int y);
+int tumDrawLayer(layer_handle_t layer, signed short x, signed short y);
+
+/**
+ * @brief Sets the blend mode of everything the calling task draws from now on
+ *
+ * Each task has its own blend mode, which is stored with every job it queues.
+ * Jobs are drawn in order, consecutive jobs sharing a blend mode do not
+ * change the renderer's state in between.
+ *
+ * Shapes larger than TUM_DRAW_SHAPE_MAX_RADIUS are drawn by SDL2_gfx, which
+ * only knows TUM_BLEND_NONE and TUM_BLEND_BLEND, they are blended while
+ * TUM_BLEND_ADD is set. So are thick lines and triangles if SDL is older than
+ * 2.0.18. A clear always replaces the screen's content.
+ *
+ * @param mode Blend mode
+ * @return 0 on success, -1 if the mode is invalid
+ */
+int tumDrawSetBlendMode(tum_blend_mode_e mode);
+
+/**
+ * @brief Gets the calling task's blend mode
+ *
+ * @return The blend mode set using tumDrawSetBlendMode()
+ */
+tum_blend_mode_e tumDrawGetBlendMode(void);
 
 /**
  * @brief Sets the global draw position offset's X axis value
@@ -587,4 +1061,8 @@ int tumDrawGetGlobalXOffset(int *offset);
 int tumDrawGetGlobalYOffset(int *offset);
 
 /** @} */
+
+/** Animations used to be part of TUM Draw, keep them available */
+#include "TUM_Animation.h"
+
 #endif
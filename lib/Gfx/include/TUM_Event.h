@@ -24,6 +24,10 @@
 #ifndef __TUM_EVENT_H__
 #define __TUM_EVENT_H__
 
+#include <stdint.h>
+
+#include <SDL2/SDL_scancode.h>
+
 #include "FreeRTOS.h"
 #include "queue.h"
 
@@ -43,9 +47,105 @@
  * SDL_scancode.h are used as the indicies when accessing the stored data in
  * the table.
  *
+ * The complete input state, keyboard, mouse position, buttons and wheel, can
+ * also be read in one consistent copy using tumEventGetSnapshot(). Snapshots
+ * are lock free and can be taken from any number of tasks at any rate.
+ *
+ * Tasks that must not miss short key presses subscribe to the input event
+ * stream using tumEventSubscribe(). Every key, mouse button, motion and wheel
+ * change is recorded as a tick timestamped tum_event_t in a ring buffer that
+ * each subscriber reads at its own pace with tumEventReceive(), blocking until
+ * input arrives if wanted.
+ *
  * @{
  */
 
+/**
+ * @name Mouse button bits
+ *
+ * @brief Bits of tum_event_snapshot_t::mouse_buttons
+ *
+ * @{
+ */
+#define TUM_MOUSE_LEFT 0b1
+#define TUM_MOUSE_RIGHT 0b10
+#define TUM_MOUSE_MIDDLE 0b100
+/** @} */
+
+/**
+ * @brief A consistent copy of the input state, see tumEventGetSnapshot()
+ */
+typedef struct tum_event_snapshot {
+    /** Bitmap of pressed keys indexed by scancode, see TUM_EVENT_KEY_DOWN */
+    uint32_t keys[(SDL_NUM_SCANCODES + 31) / 32];
+    signed short mouse_x; /**< Mouse X coord (in pixels) */
+    signed short mouse_y; /**< Mouse Y coord (in pixels) */
+    unsigned char mouse_buttons; /**< Pressed mouse buttons, see TUM_MOUSE_LEFT */
+    signed int wheel_x; /**< Horizontal wheel movement summed since init */
+    signed int wheel_y; /**< Vertical wheel movement summed since init */
+} tum_event_snapshot_t;
+
+/**
+ * @brief Checks if a key is pressed in a snapshot
+ *
+ * @param SNAPSHOT Reference to a tum_event_snapshot_t
+ * @param SCANCODE SDL scancode of the key
+ */
+#define TUM_EVENT_KEY_DOWN(SNAPSHOT, SCANCODE)                                 \
+    (((SNAPSHOT)->keys[(SCANCODE) / 32] >> ((SCANCODE) % 32)) & 0x1)
+
+/**
+ * Number of events buffered for subscribers, must be a power of two. A
+ * subscriber that falls further behind loses the oldest events.
+ */
+#ifndef TUM_EVENT_RING_SIZE
+#define TUM_EVENT_RING_SIZE 256
+#endif //TUM_EVENT_RING_SIZE
+
+/**
+ * @brief Types of events in the input event stream
+ */
+typedef enum {
+    TUM_EVENT_KEY_PRESSED = 0,
+    TUM_EVENT_KEY_RELEASED,
+    TUM_EVENT_MOUSE_PRESSED,
+    TUM_EVENT_MOUSE_RELEASED,
+    TUM_EVENT_MOUSE_MOTION,
+    TUM_EVENT_MOUSE_WHEEL,
+} tum_event_type_e;
+
+/** Subscription mask bit of an event type */
+#define TUM_EVENT_MASK(TYPE) (1U << (TYPE))
+/** Subscription mask of all keyboard events */
+#define TUM_EVENT_MASK_KEYS                                                    \
+    (TUM_EVENT_MASK(TUM_EVENT_KEY_PRESSED) |                                   \
+     TUM_EVENT_MASK(TUM_EVENT_KEY_RELEASED))
+/** Subscription mask of all mouse events */
+#define TUM_EVENT_MASK_MOUSE                                                   \
+    (TUM_EVENT_MASK(TUM_EVENT_MOUSE_PRESSED) |                                 \
+     TUM_EVENT_MASK(TUM_EVENT_MOUSE_RELEASED) |                                \
+     TUM_EVENT_MASK(TUM_EVENT_MOUSE_MOTION) |                                  \
+     TUM_EVENT_MASK(TUM_EVENT_MOUSE_WHEEL))
+/** Subscription mask of all events */
+#define TUM_EVENT_MASK_ALL (TUM_EVENT_MASK_KEYS | TUM_EVENT_MASK_MOUSE)
+
+/**
+ * @brief A single input event
+ */
+typedef struct tum_event {
+    TickType_t tick; /**< Tick count when the event was fetched */
+    uint8_t type; /**< See tum_event_type_e */
+    uint8_t button; /**< Mouse button events, see TUM_MOUSE_LEFT */
+    uint16_t scancode; /**< Key events, the key's SDL scancode */
+    int16_t x; /**< Mouse position, or horizontal wheel movement */
+    int16_t y; /**< Mouse position, or vertical wheel movement */
+} tum_event_t;
+
+/**
+ * @brief Handle to an input event stream subscription
+ */
+typedef void *event_sub_handle_t;
+
 /**
  * @brief Initializes the TUM Event backend
  *
@@ -93,6 +193,70 @@ signed char tumEventGetMouseRight(void);
  */
 signed char tumEventGetMouseMiddle(void);
 
+/**
+ * @brief Copies the most recently fetched input state
+ *
+ * The state is published once per call of tumEventFetchEvents() that received
+ * input. Taking a snapshot never blocks and never waits on the fetching task.
+ *
+ * @param snap Reference to where the snapshot is to be stored
+ */
+void tumEventGetSnapshot(tum_event_snapshot_t *snap);
+
+/**
+ * @brief Subscribes the calling task to the input event stream
+ *
+ * The subscription receives events fetched from now on. A subscription
+ * belongs to a single task, only that task should call the other
+ * subscription functions with it.
+ *
+ * @param mask Events to be returned by tumEventReceive(), see TUM_EVENT_MASK
+ * @return Handle to the subscription, NULL on error
+ */
+event_sub_handle_t tumEventSubscribe(unsigned int mask);
+
+/**
+ * @brief Ends a subscription and frees its resources
+ *
+ * @param sub Handle to the subscription
+ */
+void tumEventUnsubscribe(event_sub_handle_t sub);
+
+/**
+ * @brief Retrieves the next event of a subscription
+ *
+ * @param sub Handle to the subscription
+ * @param event Reference to where the event is to be stored
+ * @param xTicksToWait Ticks to wait for an event, 0 to return immediately
+ * @return 0 if an event was retrieved, -1 otherwise
+ */
+int tumEventReceive(event_sub_handle_t sub, tum_event_t *event,
+                    TickType_t xTicksToWait);
+
+/**
+ * @brief Returns the input state derived from the events retrieved so far
+ *
+ * The state also follows events excluded by the subscription's mask, as such
+ * the key bitmap and mouse state always agree with the edges the task has
+ * seen, unlike a tumEventGetSnapshot() taken at the same time. Should the
+ * subscription lose events the state is reloaded from the snapshot, such that
+ * a lost release never leaves a key held.
+ *
+ * @param sub Handle to the subscription
+ * @param state Reference to where the state is to be stored
+ */
+void tumEventGetSubscriberState(event_sub_handle_t sub,
+                                tum_event_snapshot_t *state);
+
+/**
+ * @brief Returns the number of events a subscription lost by falling more than
+ * TUM_EVENT_RING_SIZE events behind
+ *
+ * @param sub Handle to the subscription
+ * @return Number of lost events
+ */
+unsigned int tumEventGetLostCount(event_sub_handle_t sub);
+
 /**
  * @name Event fetching flags
  *
@@ -142,6 +306,59 @@ signed char tumEventGetMouseMiddle(void);
  */
 int tumEventFetchEvents(int flags);
 
+/**
+ * @brief Replay flag, SDL events are not polled during the replay. Allows
+ * replaying without a window, eg. on a build server.
+ */
+#define TUM_EVENT_REPLAY_HEADLESS 0b1
+
+/**
+ * @brief Starts recording all fetched input events to a file
+ *
+ * Events are stored in a compact binary format with their tick relative to
+ * the start of the recording, following the input state at the start of the
+ * recording, see tumEventReplayStart().
+ *
+ * @param filename Path of the file to be (over)written
+ * @return 0 on success
+ */
+int tumEventRecordStart(const char *filename);
+
+/**
+ * @brief Stops and closes the input recording
+ */
+void tumEventRecordStop(void);
+
+/**
+ * @brief Replays an input recording made using tumEventRecordStart()
+ *
+ * Recorded events are injected by the following event fetches once their
+ * recorded tick, relative to the start of the replay, has passed. They reach
+ * the snapshot, the event stream and tumEventGetMouseX() etc. exactly as live
+ * input would. Live input, with the exception of quitting, is ignored until
+ * the replay finishes.
+ *
+ * Keys, mouse buttons and the mouse position are first brought to their state
+ * at the start of the recording, by injecting the press, release and motion
+ * events needed. The summed wheel movement is left as is. Recordings holding
+ * events that are out of range are rejected.
+ *
+ * Events must still be fetched using tumEventFetchEvents() for the replay to
+ * advance.
+ *
+ * @param filename Path of the recording
+ * @param flags 0 or TUM_EVENT_REPLAY_HEADLESS
+ * @return 0 on success
+ */
+int tumEventReplayStart(const char *filename, int flags);
+
+/**
+ * @brief Checks if the last replay has injected all of its events
+ *
+ * @return 1 if finished, 0 if still replaying or no replay was started
+ */
+int tumEventReplayFinished(void);
+
 /*!<
  * @brief FreeRTOS queue used to obtain a current copy of the keyboard lookup table
  *
@@ -109,6 +109,12 @@ int tumFontInit(char *path);
  */
 void tumFontExit(void);
 
+/**
+ * @brief Frees sizes replaced by tumFontSetSize() whose last reference has been
+ * put. Called by the drawing thread at the end of each frame.
+ */
+void tumFontCollectDeferred(void);
+
 /**
  * @brief Retrieved a reference to the current SDL2 TTF font, increasing the
  * reference count of the respective tum_font object. Objects can not be
@@ -123,28 +129,37 @@ TTF_Font *tumFontGetCurFont(void);
 
 /**
  * @brief Finds the tum_font object associated with the loaded SDL2 TFF font,
- * decreasing the reference count to the object with each call, once an object's
- * reference count has reached zero and the font backed has flagged the tum_font
- * object as no longer being needed it is then free'd.
+ * decreasing the reference count to the object with each call.
+ *
+ * Finding the object requires walking the font list, tumFontPutFontHandle()
+ * should be preferred.
  *
  * @param font SDL2 TTF font reference, retrieved originally via tumFontGetCurFont()
  */
 void tumFontPutFont(TTF_Font *font);
 
 /**
- * @brief Finds the tum_font object associated with the loaded SDL2 TFF font,
- * decreasing the reference count to the object with each call, once an object's
- * reference count has reached zero and the font backed has flagged the tum_font
- * object as no longer being needed it is then free'd.
+ * @brief Decreases the reference count of a font handle, without locking. A
+ * size replaced by tumFontSetSize() is freed at the end of the frame after its
+ * last reference is put.
  *
  * @param font Font handle, retrieved originally via tumFontGetCurFontHandle()
  */
 void tumFontPutFontHandle(font_handle_t font);
 
+/**
+ * @brief Returns the SDL2 TTF font of a font handle
+ *
+ * @param font Font handle, retrieved originally via tumFontGetCurFontHandle()
+ * @return SDL2 TTF font reference, valid while the handle is held
+ */
+TTF_Font *tumFontGetFont(font_handle_t font);
+
 /**
  * @brief Retrieved a handle to the current font, unlike tumFontGetCurFont()
  * the handle contains the TUM_Font's metadata structure for the font instance
- * where as tumFontGetCurFont() returns a SDL2 TTF Font reference.
+ * where as tumFontGetCurFont() returns a SDL2 TTF Font reference. Does not
+ * lock, as such is cheap enough to be called for every text draw.
  *
  * @return Handle to the currently active font
  */
@@ -186,10 +201,10 @@ int tumFontSelectFontFromHandle(font_handle_t font_handle);
 
 /**
  * @brief Sets the size of the current font to be used. The font is set by making
- * a copy of the current font if the current font's configuration (font + size)
- * is being referenced by pending draw jobs. All subsequent text draw jobs
- * will use the currently active font and the specified size until the size
- * and/or font are changed again.
+ * a copy of the current font in the new size, the previous size is freed once
+ * no longer referenced. Pending draw jobs keep using the font they were
+ * created with. All subsequent text draw jobs will use the currently active
+ * font and the specified size until the size and/or font are changed again.
  *
  * @param font_size New size that the currently active font should take
  * @return 0 on success
@@ -0,0 +1,203 @@
+/**
+ * @file TUM_Image.h
+ * @brief Image cache used by TUM Draw, loading images asynchronously and
+ * packing small ones into texture atlas pages
+ *
+ * @verbatim
+ ----------------------------------------------------------------------
+ Copyright (C) Alexander Hoffman, 2019
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ any later version.
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ----------------------------------------------------------------------
+ @endverbatim
+ */
+
+#ifndef __TUM_IMAGE_H__
+#define __TUM_IMAGE_H__
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include <SDL2/SDL.h>
+
+#include "TUM_Draw.h"
+
+/**
+ * @defgroup tum_image TUM Image API
+ *
+ * @brief Loads, caches and uploads the images drawn by TUM Draw
+ *
+ * Each image file is decoded only once, no matter how many handles load it,
+ * and is kept in the cache after its last handle is freed until the cache
+ * exceeds TUM_DRAW_IMAGE_CACHE_BUDGET. Decoding and packing into the atlas
+ * may happen on any thread, as loads finish on the loading task, a waiting
+ * task or the drawing thread. Textures are only ever created, uploaded and
+ * destroyed by the drawing thread, an image's own texture when it is first
+ * drawn.
+ *
+ * A queued draw job holds a reference, see tumImagePut(), such that an image
+ * is only destroyed once no job uses it anymore.
+ *
+ * @{
+ */
+
+/**
+ * Texture atlas page. Small loaded images are packed into pages using a
+ * skyline bottom-left packer so that sprites share one texture and their
+ * copies can be batched by the renderer. Pixels are kept in surf and uploaded
+ * to tex by the drawing thread once the page has changed.
+ */
+typedef struct atlas_node {
+    int x;
+    int y;
+    int w;
+} atlas_node_t;
+
+typedef struct atlas_page {
+    SDL_Surface *surf;
+    SDL_Texture *tex;
+    atlas_node_t *skyline;
+    unsigned int nodes;
+    unsigned int images;
+    unsigned char dirty;
+    struct atlas_page *next;
+} atlas_page_t;
+
+/** Loading states of a loaded image */
+enum image_state {
+    IMAGE_READY = 0,
+    IMAGE_LOADING, // Queued for or being decoded by a loader thread
+    IMAGE_DECODED, // Surface ready, awaiting tumImageFinishLoads() or a waiter
+    IMAGE_DECODE_FAILED, // Awaiting tumImageFinishLoads() or a waiter
+    IMAGE_FAILED,
+};
+
+typedef struct loaded_image {
+    atomic_int state;
+    char *filename;
+    FILE *file;
+    SDL_Texture *tex;
+    atlas_page_t *page; // Set if the image is packed into an atlas page
+    SDL_Rect src; // Area of the image within tex or the page
+    SDL_RWops *ops;
+    SDL_Surface *surf;
+    int w;
+    int h;
+    atomic_uint ref_count; // Queued draw jobs and pending loads
+
+    unsigned int users; // Handles given out by the image cache
+    unsigned int hash;
+    unsigned char cached; // Found in the image cache
+    unsigned char in_lru; // Unused, waiting in the image cache's LRU list
+    unsigned char deferred; // Evicted, waiting to be destroyed at frame end
+    size_t bytes; // Accounted size while in the LRU list
+
+    struct loaded_image *next;
+    struct loaded_image *load_next;
+    struct loaded_image *hash_next;
+    struct loaded_image *lru_prev;
+    struct loaded_image *lru_next;
+    struct loaded_image *deferred_next;
+} loaded_image_t;
+
+/**
+ * Handle given out by each image load, the decoded image is shared by all
+ * loads of the same file while the scale belongs to the handle
+ */
+typedef struct loaded_image_ref {
+    loaded_image_t *image;
+    float scale;
+} loaded_image_ref_t;
+
+/**
+ * @brief A crop of a loaded image and where it is drawn, see
+ * tumDrawQueueSpriteBatch()
+ */
+typedef struct sprite_batch_item {
+    SDL_Rect src;
+    SDL_Rect dst;
+} sprite_batch_item_t;
+
+/**
+ * @brief Sets the renderer that image and atlas textures are created with
+ *
+ * All textures of the previous renderer are forgotten and recreated.
+ * Must be called from the drawing thread.
+ *
+ * @param ren The new renderer, NULL when headless, in which case images are
+ * only kept as surfaces
+ */
+void tumImageSetRenderer(SDL_Renderer *ren);
+
+/**
+ * @brief Gets the texture an image is drawn from, its own or that of its
+ * atlas page. Creates the image's own texture on first use, as such must be
+ * called from the drawing thread.
+ *
+ * @param img The image
+ * @return The texture, the image's area within it is img->src
+ */
+SDL_Texture *tumImageGetTexture(loaded_image_t *img);
+
+/**
+ * @brief Drops a draw job's reference to an image
+ *
+ * @param img The image
+ */
+void tumImagePut(loaded_image_t *img);
+
+/**
+ * @brief Finishes the images decoded by the loader threads that no task waited
+ * for, called by the drawing thread each frame
+ */
+void tumImageFinishLoads(void);
+
+/**
+ * @brief Uploads changed atlas pages, must be called from the drawing thread
+ */
+void tumImageUploadAtlas(void);
+
+/**
+ * @brief Destroys evicted images no longer used by any draw job, must be
+ * called from the drawing thread once all of a frame's jobs are done
+ */
+void tumImageCollectDeferred(void);
+
+/**
+ * @brief Queues a draw job drawing a crop of an image, implemented by TUM
+ * Draw
+ *
+ * @param img The image, referenced until the job is done
+ * @param x X coordinate the crop is drawn at
+ * @param y Y coordinate the crop is drawn at
+ * @param c_x X coordinate of the crop within the image
+ * @param c_y Y coordinate of the crop within the image
+ * @param c_w Width of the crop
+ * @param c_h Height of the crop
+ * @return 0 on success
+ */
+int tumDrawQueueImageCrop(loaded_image_t *img, int x, int y, int c_x,
+                          int c_y, int c_w, int c_h);
+
+/**
+ * @brief Queues a single draw job drawing many crops of an image,
+ * implemented by TUM Draw
+ *
+ * @param img The image, referenced until the job is done
+ * @param items Allocated crops, freed by the job once queued
+ * @param count Number of crops
+ * @return 0 on success, items are not freed on error
+ */
+int tumDrawQueueSpriteBatch(loaded_image_t *img, sprite_batch_item_t *items,
+                            unsigned count);
+
+/** @} */
+#endif // __TUM_IMAGE_H__
@@ -0,0 +1,235 @@
+/**
+ * @file TUM_Raster.h
+ * @brief Software rasterizer used by TUM Draw's software rendering, drawing
+ * into ARGB8888 framebuffers on the CPU
+ *
+ * @verbatim
+ ----------------------------------------------------------------------
+ Copyright (C) Alexander Hoffman, 2019
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ any later version.
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ----------------------------------------------------------------------
+ @endverbatim
+ */
+
+#ifndef __TUM_RASTER_H__
+#define __TUM_RASTER_H__
+
+#include <stdint.h>
+
+#include "TUM_Draw.h"
+
+/**
+ * @defgroup tum_raster TUM Raster API
+ *
+ * @brief Rasterizes TUM Draw's primitives into an ARGB8888 framebuffer
+ *
+ * All rasterization is done using integer arithmetic only, such that a frame
+ * is rendered identically on every machine, independent of whether the SSE2,
+ * AVX2 or plain C kernels are used. Colours are ARGB8888 and combined with
+ * the framebuffer according to the target's blend mode, by default a colour
+ * with an alpha below 0xFF is blended onto the framebuffer.
+ *
+ * Each primitive only touches the pixels within the target's clip rectangle,
+ * allowing a frame to be split into tiles that are rasterized in parallel.
+ *
+ * @{
+ */
+
+/**
+ * @brief Set this to skip the SSE2/AVX2 kernels, the output is the same
+ */
+#ifndef TUM_RASTER_NO_SIMD
+#define TUM_RASTER_NO_SIMD 0
+#endif //TUM_RASTER_NO_SIMD
+
+/**
+ * @brief A framebuffer, or the part of one, to be rasterized into
+ */
+typedef struct tum_raster_target {
+    uint32_t *pixels; /**< ARGB8888 pixels */
+    int pitch; /**< Pixels from the start of one row to the next */
+    int clip_x0; /**< Left most column that may be drawn */
+    int clip_y0; /**< Top most row that may be drawn */
+    int clip_x1; /**< Column right of the right most column that may be drawn */
+    int clip_y1; /**< Row below the bottom most row that may be drawn */
+    tum_blend_mode_e blend; /**< How drawn pixels are combined, see
+                                 tumDrawSetBlendMode() */
+    void (*record)(int x0, int x1, int y,
+                   void *arg); /**< If set, called with each run of pixels
+                                    [x0, x1) in row y instead of drawing it,
+                                    pixels may then be NULL. Images are not
+                                    recorded. */
+    void *record_arg; /**< Passed to record */
+} tum_raster_target_t;
+
+/**
+ * @brief Gets the name of the kernels in use, eg. "avx2"
+ *
+ * @return Static string naming the kernels
+ */
+const char *tumRasterGetKernelName(void);
+
+/**
+ * @brief Fills the target's clip rectangle
+ *
+ * @param target Target to be drawn into
+ * @param argb Colour
+ */
+void tumRasterFill(const tum_raster_target_t *target, uint32_t argb);
+
+/**
+ * @brief Fills a rectangle
+ *
+ * @param target Target to be drawn into
+ * @param x X coordinate of the left most column
+ * @param y Y coordinate of the top most row
+ * @param w Width in pixels
+ * @param h Height in pixels
+ * @param argb Colour
+ */
+void tumRasterFilledRect(const tum_raster_target_t *target, int x, int y,
+                         int w, int h, uint32_t argb);
+
+/**
+ * @brief Draws the one pixel wide outline of a rectangle
+ *
+ * @param target Target to be drawn into
+ * @param x X coordinate of the left most column
+ * @param y Y coordinate of the top most row
+ * @param w Width in pixels
+ * @param h Height in pixels
+ * @param argb Colour
+ */
+void tumRasterRect(const tum_raster_target_t *target, int x, int y, int w,
+                   int h, uint32_t argb);
+
+/**
+ * @brief Draws a line between two pixels
+ *
+ * @param target Target to be drawn into
+ * @param x1 X coordinate of the start
+ * @param y1 Y coordinate of the start
+ * @param x2 X coordinate of the end
+ * @param y2 Y coordinate of the end
+ * @param thickness Width of the line in pixels
+ * @param argb Colour
+ */
+void tumRasterLine(const tum_raster_target_t *target, int x1, int y1, int x2,
+                   int y2, unsigned int thickness, uint32_t argb);
+
+/**
+ * @brief Fills a circle
+ *
+ * @param target Target to be drawn into
+ * @param x X coordinate of the centre
+ * @param y Y coordinate of the centre
+ * @param radius Radius in pixels
+ * @param argb Colour
+ */
+void tumRasterFilledCircle(const tum_raster_target_t *target, int x, int y,
+                           int radius, uint32_t argb);
+
+/**
+ * @brief Draws the one pixel wide outline of an ellipse
+ *
+ * @param target Target to be drawn into
+ * @param x X coordinate of the centre
+ * @param y Y coordinate of the centre
+ * @param rx Horizontal radius in pixels
+ * @param ry Vertical radius in pixels
+ * @param argb Colour
+ */
+void tumRasterEllipse(const tum_raster_target_t *target, int x, int y, int rx,
+                      int ry, uint32_t argb);
+
+/**
+ * @brief Draws a one pixel wide arc of a circle
+ *
+ * Angles are in degrees, 0 pointing right and increasing clockwise. An arc
+ * starting and ending at the same angle is a full circle.
+ *
+ * @param target Target to be drawn into
+ * @param x X coordinate of the centre
+ * @param y Y coordinate of the centre
+ * @param radius Radius in pixels
+ * @param start Angle at which the arc starts
+ * @param end Angle at which the arc ends
+ * @param argb Colour
+ */
+void tumRasterArc(const tum_raster_target_t *target, int x, int y, int radius,
+                  int start, int end, uint32_t argb);
+
+/**
+ * @brief Draws the one pixel wide outline of a closed polygon
+ *
+ * @param target Target to be drawn into
+ * @param points Corners of the polygon
+ * @param n Number of corners
+ * @param x_offset Offset added to each corner's X coordinate
+ * @param y_offset Offset added to each corner's Y coordinate
+ * @param argb Colour
+ */
+void tumRasterPolygon(const tum_raster_target_t *target, const coord_t *points,
+                      unsigned int n, int x_offset, int y_offset,
+                      uint32_t argb);
+
+/**
+ * @brief Fills a triangle, covering the pixels whose centres lie inside it
+ *
+ * @param target Target to be drawn into
+ * @param points The three corners
+ * @param x_offset Offset added to each corner's X coordinate
+ * @param y_offset Offset added to each corner's Y coordinate
+ * @param argb Colour
+ */
+void tumRasterFilledTriangle(const tum_raster_target_t *target,
+                             const coord_t *points, int x_offset, int y_offset,
+                             uint32_t argb);
+
+/**
+ * @brief Blends an area of an ARGB8888 image onto the target, using the
+ * nearest source pixel if the image is scaled
+ *
+ * @param target Target to be drawn into
+ * @param src The image's pixels
+ * @param src_pitch Pixels from the start of one image row to the next
+ * @param sx X coordinate of the area within the image
+ * @param sy Y coordinate of the area within the image
+ * @param sw Width of the area within the image
+ * @param sh Height of the area within the image
+ * @param dx X coordinate at which the area is drawn
+ * @param dy Y coordinate at which the area is drawn
+ * @param dw Width with which the area is drawn
+ * @param dh Height with which the area is drawn
+ */
+void tumRasterBlit(const tum_raster_target_t *target, const uint32_t *src,
+                   int src_pitch, int sx, int sy, int sw, int sh, int dx,
+                   int dy, int dw, int dh);
+
+/**
+ * @brief Draws the non-zero pixels of an 8 bit mask, eg. rendered text, in a
+ * colour
+ *
+ * @param target Target to be drawn into
+ * @param mask The mask's pixels
+ * @param mask_pitch Bytes from the start of one mask row to the next
+ * @param w Width of the mask
+ * @param h Height of the mask
+ * @param x X coordinate at which the mask is drawn
+ * @param y Y coordinate at which the mask is drawn
+ * @param argb Colour
+ */
+void tumRasterMask(const tum_raster_target_t *target, const uint8_t *mask,
+                   int mask_pitch, int w, int h, int x, int y, uint32_t argb);
+
+/** @} */
+#endif // __TUM_RASTER_H__
@@ -0,0 +1,115 @@
+/**
+ * @file TUM_Stream.h
+ * @brief Streams captured frames to a consumer on the same machine, used by
+ * TUM Draw's tumDrawStreamStart()
+ *
+ * @verbatim
+ ----------------------------------------------------------------------
+ Copyright (C) Alexander Hoffman, 2019
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ any later version.
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ----------------------------------------------------------------------
+ @endverbatim
+ */
+
+#ifndef __TUM_STREAM_H__
+#define __TUM_STREAM_H__
+
+#include <stdint.h>
+
+#include "TUM_Draw.h"
+
+/**
+ * @defgroup tum_stream TUM Stream API
+ *
+ * @brief Sends frames to a single consumer from a background thread
+ *
+ * The newest frame handed over is sent once the previous one has been sent,
+ * frames arriving in the meantime replace it and are counted as dropped. A
+ * slow consumer thus sees a lower frame rate instead of slowing down the
+ * emulator. Frames are discarded while no consumer is connected.
+ *
+ * Over a named pipe or Unix socket frames are sent as raw RGB24, w * h * 3
+ * bytes per frame, eg. for
+ * `ffplay -f rawvideo -pixel_format rgb24 -video_size 640x480 -i pipe`.
+ * With TUM_STREAM_DELTA each frame is instead sent as a
+ * tum_stream_header_t followed by its spans, each a tum_stream_span_t
+ * followed by the span's RGB24 pixels. The first frame sent to a consumer,
+ * and any frame whose size changed, holds every row. Later frames only hold
+ * the part of each row that changed since the previous frame. All fields are
+ * in host byte order.
+ *
+ * Over HTTP each frame that changed is sent as a JPEG, as part of a
+ * multipart/x-mixed-replace response, which browsers show as a video.
+ *
+ * @{
+ */
+
+/**
+ * @brief Header preceding each frame sent with TUM_STREAM_DELTA
+ */
+typedef struct tum_stream_header {
+    char magic[4]; /**< "TUMS" */
+    uint16_t w; /**< Width of the frame */
+    uint16_t h; /**< Height of the frame */
+    uint32_t number; /**< Frames sent to this consumer before this one */
+    uint32_t spans; /**< Number of spans following the header */
+} tum_stream_header_t;
+
+/**
+ * @brief A run of changed pixels within a row, followed by n RGB24 pixels
+ */
+typedef struct tum_stream_span {
+    uint16_t y; /**< Row */
+    uint16_t x; /**< Column of the first pixel */
+    uint16_t n; /**< Number of pixels */
+} tum_stream_span_t;
+
+/**
+ * @brief Starts streaming, see tumDrawStreamStart()
+ *
+ * @param type Kind of connection
+ * @param address Path of the pipe or socket, or the port to serve HTTP on
+ * @param flags TUM_STREAM_DELTA or 0
+ * @return 0 on success, -1 on error
+ */
+int tumStreamOpen(tum_stream_type_e type, const char *address, int flags);
+
+/**
+ * @brief Stops streaming, disconnecting the consumer
+ */
+void tumStreamClose(void);
+
+/**
+ * @brief Checks if a stream is open
+ *
+ * @return Non-zero if frames should be handed to tumStreamPushFrame()
+ */
+unsigned char tumStreamIsOpen(void);
+
+/**
+ * @brief Hands a frame to the stream, replacing any frame not yet sent
+ *
+ * @param pixels ARGB8888 pixels, row by row
+ * @param w Width of the frame
+ * @param h Height of the frame
+ */
+void tumStreamPushFrame(const uint32_t *pixels, int w, int h);
+
+/**
+ * @brief Gets the number of frames replaced before they could be sent
+ *
+ * @return Frames dropped since the start of the program
+ */
+unsigned int tumStreamGetDropped(void);
+
+/** @} */
+#endif // __TUM_STREAM_H__
@@ -24,6 +24,7 @@
 #ifndef __TUM_UTILS_H__
 #define __TUM_UTILS_H__
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -44,6 +45,21 @@ int tumUtilIsCurGLThread(void);
  */
 void tumUtilSetGLThread(void);
 
+/**
+ * @brief Blocks all signals for the calling thread
+ *
+ * Signals belong to the FreeRTOS tasks, as the POSIX port schedules using
+ * them. Must be called by each helper thread the emulator starts.
+ */
+void tumUtilBlockSignals(void);
+
+/**
+ * @brief Reads the monotonic clock
+ *
+ * @return Nanoseconds since an unspecified starting point
+ */
+uint64_t tumUtilGetTimeNs(void);
+
 /**
  * @brief Prepends a path string to a filename
  *
@@ -0,0 +1,165 @@
+/**
+ * @file shm_peer.c
+ * @author Alex Hoffman
+ * @date 19 October 2020
+ * @brief Standalone peer for testing AsyncIO shared memory connections
+ *
+ * @verbatim
+   ----------------------------------------------------------------------
+    Copyright (C) Alexander Hoffman, 2020
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+@endverbatim
+ *
+ * Sends frames to a shared memory connection opened by the emulator, or by
+ * another peer, using aIOSharedMemPut(). Each line read from stdin is sent
+ * as one frame, or with -c a number of numbered frames are sent at a fixed
+ * interval. With -l the peer also opens a connection of its own and prints
+ * every frame it receives, such that two peers can be run against each other.
+ *
+ * Usage:
+ *   shm_peer [-n name] [-c count] [-i interval_ms] [-l name]
+ *
+ * The name defaults to FreeRTOS_SHM_1, the segment opened by the emulator's
+ * demo. AsyncIO's own logging goes to stdout, received frames to stderr.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "AsyncIO.h"
+
+#define SHM_PEER_DEFAULT_NAME "FreeRTOS_SHM_1"
+#define SHM_PEER_BUFFER_SIZE 1000
+#define SHM_PEER_DEFAULT_INTERVAL_MS 1000
+
+static volatile sig_atomic_t shm_peer_stop = 0;
+
+static void shmPeerSignal(int signal)
+{
+    shm_peer_stop = 1;
+}
+
+static void shmPeerRecv(size_t recv_size, char *buffer, void *args)
+{
+    fprintf(stderr, "Recv (%zu bytes): %s\n", recv_size, buffer);
+}
+
+static int shmPeerSend(char *name, char *buffer, size_t size)
+{
+    if (aIOSharedMemPut(name, buffer, size)) {
+        fprintf(stderr, "Failed to send %zu bytes to '%s'\n", size, name);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void shmPeerUsage(char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-n name] [-c count] [-i interval_ms] [-l name]\n",
+            name);
+}
+
+int main(int argc, char *argv[])
+{
+    char *name = SHM_PEER_DEFAULT_NAME;
+    char *listen_name = NULL;
+    unsigned long count = 0, interval_ms = SHM_PEER_DEFAULT_INTERVAL_MS;
+    char line[SHM_PEER_BUFFER_SIZE + 1];
+    struct sigaction act = { .sa_handler = shmPeerSignal };
+    struct timespec interval;
+    aIO_handle_t conn = NULL;
+    sigset_t set;
+    unsigned long i;
+    size_t len;
+    int opt, ret = EXIT_SUCCESS;
+
+    while ((opt = getopt(argc, argv, "n:c:i:l:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                name = optarg;
+                break;
+            case 'c':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'i':
+                interval_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                listen_name = optarg;
+                break;
+            default:
+                shmPeerUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    /** No SA_RESTART, a signal interrupts reading stdin and sleeping */
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+
+    /** The handler thread inherits the mask, signals go to this thread */
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    if (listen_name) {
+        conn = aIOOpenSharedMem(listen_name, SHM_PEER_BUFFER_SIZE,
+                                shmPeerRecv, NULL);
+        if (conn == NULL) {
+            fprintf(stderr, "Failed to open '%s'\n", listen_name);
+            return EXIT_FAILURE;
+        }
+    }
+
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+
+    interval.tv_sec = interval_ms / 1000;
+    interval.tv_nsec = (interval_ms % 1000) * 1000000;
+
+    if (count) {
+        for (i = 0; i < count && !shm_peer_stop; i++) {
+            len = snprintf(line, sizeof(line), "SHM peer frame %lu", i);
+            if (shmPeerSend(name, line, len)) {
+                ret = EXIT_FAILURE;
+            }
+            nanosleep(&interval, NULL);
+        }
+    }
+    else {
+        while (!shm_peer_stop && fgets(line, sizeof(line), stdin)) {
+            len = strcspn(line, "\n");
+            if (len && shmPeerSend(name, line, len)) {
+                ret = EXIT_FAILURE;
+            }
+        }
+    }
+
+    /** Keep receiving until interrupted */
+    while (conn && !shm_peer_stop) {
+        pause();
+    }
+
+    aIODeinit();
+
+    return ret;
+}
@@ -0,0 +1,309 @@
+/**
+ * @file stream_view.c
+ * @brief Standalone consumer for checking frames streamed by TUM Draw
+ *
+ * @verbatim
+   ----------------------------------------------------------------------
+    Copyright (C) Alexander Hoffman, 2020
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+@endverbatim
+ *
+ * Connects to a stream started using tumDrawStreamStart() over a Unix socket,
+ * or with -f a named pipe, and decodes the TUMS delta frames sent with
+ * TUM_STREAM_DELTA, or with -r raw RGB24 frames of the given size. Each frame
+ * is checked against the format described in TUM_Stream.h and applied to a
+ * copy of the emulator's screen, a line per frame is printed to stdout.
+ *
+ * Usage:
+ *   stream_view [-f] [-r WxH] [-c count] [-o file.ppm] path
+ *
+ * With -c the consumer disconnects after count frames, with -o the last frame
+ * is written as a binary PPM on exit. The exit status is non-zero if the
+ * stream was malformed, such that the viewer can be used in scripted checks.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "TUM_Stream.h"
+
+static volatile sig_atomic_t stream_view_stop = 0;
+
+static void streamViewSignal(int signal)
+{
+    stream_view_stop = 1;
+}
+
+/** Returns 1 on success, 0 at the end of the stream and -1 on error */
+static int streamViewRead(int fd, void *buffer, size_t len)
+{
+    char *iterator = buffer;
+    ssize_t n;
+
+    while (len) {
+        n = read(fd, iterator, len);
+        if (n == 0 || (n < 0 && errno == EINTR && stream_view_stop)) {
+            return iterator == (char *)buffer ? 0 : -1;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        iterator += n;
+        len -= n;
+    }
+
+    return 1;
+}
+
+static int streamViewConnect(char *path, int fifo)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (fifo) {
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Failed to open pipe '%s'\n", path);
+        }
+        return fd;
+    }
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path '%s' is too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        fprintf(stderr, "Failed to connect to socket '%s'\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    return fd;
+}
+
+/** Reads a TUMS frame into screen, (re)allocated as the frame's size changes */
+static int streamViewDelta(int fd, uint8_t **screen, int *w, int *h,
+                           uint32_t number)
+{
+    tum_stream_header_t header;
+    tum_stream_span_t span;
+    unsigned char *rows = NULL;
+    uint8_t *tmp;
+    uint32_t i;
+    int ret;
+
+    ret = streamViewRead(fd, &header, sizeof(header));
+    if (ret <= 0) {
+        return ret;
+    }
+
+    if (memcmp(header.magic, "TUMS", sizeof(header.magic))) {
+        fprintf(stderr, "Frame %u: bad magic\n", number);
+        return -1;
+    }
+    if (header.number != number) {
+        fprintf(stderr, "Frame %u: numbered %u\n", number, header.number);
+        return -1;
+    }
+
+    /** The first frame, or one of a new size, must hold every row */
+    if (*screen == NULL || header.w != *w || header.h != *h) {
+        tmp = realloc(*screen, (size_t)header.w * header.h * 3);
+        rows = calloc(header.h ? header.h : 1, sizeof(unsigned char));
+        if ((tmp == NULL && header.w && header.h) || rows == NULL) {
+            fprintf(stderr, "Frame %u: failed to allocate %u x %u\n",
+                    number, header.w, header.h);
+            free(rows);
+            return -1;
+        }
+        *screen = tmp;
+        *w = header.w;
+        *h = header.h;
+    }
+
+    for (i = 0; i < header.spans; i++) {
+        if (streamViewRead(fd, &span, sizeof(span)) <= 0) {
+            fprintf(stderr, "Frame %u: truncated span %u\n", number, i);
+            goto err;
+        }
+        if (span.y >= *h || span.n == 0 || span.x + span.n > *w) {
+            fprintf(stderr, "Frame %u: span %u (%u, %u) + %u out of bounds\n",
+                    number, i, span.x, span.y, span.n);
+            goto err;
+        }
+        if (rows) {
+            if (span.x || span.n != *w || rows[span.y]) {
+                fprintf(stderr, "Frame %u: row %u is not complete\n",
+                        number, span.y);
+                goto err;
+            }
+            rows[span.y] = 1;
+        }
+        if (streamViewRead(fd, *screen + ((size_t)span.y * *w + span.x) * 3,
+                           (size_t)span.n * 3) <= 0) {
+            fprintf(stderr, "Frame %u: truncated pixels\n", number);
+            goto err;
+        }
+    }
+
+    if (rows && header.spans != header.h) {
+        fprintf(stderr, "Frame %u: %u of %u rows in a full frame\n", number,
+                header.spans, header.h);
+        goto err;
+    }
+
+    printf("Frame %u: %u x %u, %u spans\n", number, header.w, header.h,
+           header.spans);
+
+    free(rows);
+    return 1;
+
+err:
+    free(rows);
+    return -1;
+}
+
+static int streamViewRaw(int fd, uint8_t *screen, int w, int h,
+                         uint32_t number)
+{
+    int ret = streamViewRead(fd, screen, (size_t)w * h * 3);
+
+    if (ret < 0) {
+        fprintf(stderr, "Frame %u: truncated\n", number);
+    }
+    else if (ret > 0) {
+        printf("Frame %u: %d x %d\n", number, w, h);
+    }
+
+    return ret;
+}
+
+static int streamViewWritePPM(char *filename, uint8_t *screen, int w, int h)
+{
+    FILE *file = fopen(filename, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open '%s'\n", filename);
+        return -1;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", w, h);
+    if (fwrite(screen, 3, (size_t)w * h, file) != (size_t)w * h) {
+        fprintf(stderr, "Failed to write '%s'\n", filename);
+        fclose(file);
+        return -1;
+    }
+
+    return fclose(file) ? -1 : 0;
+}
+
+static void streamViewUsage(char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-f] [-r WxH] [-c count] [-o file.ppm] path\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sigaction act = { .sa_handler = streamViewSignal };
+    unsigned long count = 0;
+    char *output = NULL;
+    uint8_t *screen = NULL;
+    uint32_t number = 0;
+    int fifo = 0, raw = 0, w = 0, h = 0;
+    int fd, opt, ret = 1;
+
+    while ((opt = getopt(argc, argv, "fr:c:o:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                fifo = 1;
+                break;
+            case 'r':
+                if (sscanf(optarg, "%dx%d", &w, &h) != 2 || w <= 0 ||
+                    h <= 0) {
+                    streamViewUsage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                raw = 1;
+                break;
+            case 'c':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                streamViewUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1) {
+        streamViewUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /** No SA_RESTART, a signal interrupts the blocking read */
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+
+    if (raw) {
+        screen = malloc((size_t)w * h * 3);
+        if (screen == NULL) {
+            fprintf(stderr, "Failed to allocate %d x %d\n", w, h);
+            return EXIT_FAILURE;
+        }
+    }
+
+    fd = streamViewConnect(argv[optind], fifo);
+    if (fd < 0) {
+        free(screen);
+        return EXIT_FAILURE;
+    }
+
+    while (!stream_view_stop && (!count || number < count)) {
+        ret = raw ? streamViewRaw(fd, screen, w, h, number) :
+              streamViewDelta(fd, &screen, &w, &h, number);
+        if (ret <= 0) {
+            break;
+        }
+        number++;
+    }
+
+    close(fd);
+
+    if (output && number && streamViewWritePPM(output, screen, w, h)) {
+        ret = -1;
+    }
+
+    free(screen);
+
+    return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -51,6 +51,9 @@
 #define MSG_QUEUE_MAX_MSG_COUNT 10
 #define TCP_BUFFER_SIZE 2000
 #define TCP_TEST_PORT 2222
+#define SHM_BUFFER_SIZE 1000
+#define SERIAL_BUFFER_SIZE 256
+#define SERIAL_BAUD 115200
 
 #ifdef TRACE_FUNCTIONS
 #include "tracer.h"
@@ -58,11 +61,15 @@
 
 static char *mq_one_name = "FreeRTOS_MQ_one_1";
 static char *mq_two_name = "FreeRTOS_MQ_two_1";
+static char *shm_name = "FreeRTOS_SHM_1";
 aIO_handle_t mq_one = NULL;
 aIO_handle_t mq_two = NULL;
 aIO_handle_t udp_soc_one = NULL;
 aIO_handle_t udp_soc_two = NULL;
 aIO_handle_t tcp_soc = NULL;
+aIO_handle_t shm = NULL;
+aIO_handle_t serial = NULL;
+aIO_handle_t serial_peer = NULL;
 
 const unsigned char next_state_signal = NEXT_TASK;
 const unsigned char prev_state_signal = PREV_TASK;
@@ -74,6 +81,8 @@ static TaskHandle_t DemoTask2 = NULL;
 static TaskHandle_t UDPDemoTask = NULL;
 static TaskHandle_t TCPDemoTask = NULL;
 static TaskHandle_t MQDemoTask = NULL;
+static TaskHandle_t SHMDemoTask = NULL;
+static TaskHandle_t SerialDemoTask = NULL;
 static TaskHandle_t DemoSendTask = NULL;
 
 static QueueHandle_t StateQueue = NULL;
@@ -445,6 +454,8 @@ void vDemoSendTask(void *pvParameters)
     static char *test_str_1 = "UDP test 1";
     static char *test_str_2 = "UDP test 2";
     static char *test_str_3 = "TCP test";
+    static char *test_str_4 = "SHM test";
+    static char *test_str_5 = "Serial test";
 
     while (1) {
         prints("*****TICK******\n");
@@ -464,6 +475,11 @@ void vDemoSendTask(void *pvParameters)
         if (tcp_soc)
             aIOSocketPut(TCP, NULL, TCP_TEST_PORT, test_str_3,
                          strlen(test_str_3));
+        if (shm)
+            aIOSharedMemPut(shm_name, test_str_4,
+                            strlen(test_str_4));
+        if (serial_peer)
+            aIOSerialPut(serial_peer, test_str_5, strlen(test_str_5));
 
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
@@ -505,6 +521,52 @@ void vTCPDemoTask(void *pvParameters)
     }
 }
 
+void SHMHandler(size_t read_size, char *buffer, void *args)
+{
+    prints("SHM Recv: %s\n", buffer);
+}
+
+void vSHMDemoTask(void *pvParameters)
+{
+    shm = aIOOpenSharedMem(shm_name, SHM_BUFFER_SIZE, SHMHandler, NULL);
+
+    prints("SHM '%s' opened\n", shm_name);
+    prints("Any process on this host can send to it using\n");
+    prints("*** aIOSharedMemPut(\"%s\", buffer, size) ***\n", shm_name);
+    prints("or from a shell using\n");
+    prints("*** shm_peer -n %s ***\n", shm_name);
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+}
+
+void SerialHandler(size_t read_size, char *buffer, void *args)
+{
+    prints("Serial Recv: %s\n", buffer);
+}
+
+void vSerialDemoTask(void *pvParameters)
+{
+    serial = aIOOpenSerial(NULL, SERIAL_BAUD, SERIAL_BUFFER_SIZE,
+                           SerialHandler, NULL);
+
+    if (serial) {
+        /** Loop the PTY back on itself for the send task */
+        serial_peer = aIOOpenSerial(aIOSerialGetPeerName(serial), 0,
+                                    SERIAL_BUFFER_SIZE, NULL, NULL);
+
+        /** The loop back reads the slave, a second reader such as screen */
+        /**     would compete with it for the bytes */
+        prints("Serial PTY opened at %d baud, looped back through %s\n",
+               SERIAL_BAUD, aIOSerialGetPeerName(serial));
+    }
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+}
+
 void vDemoTask1(void *pvParameters)
 {
     image_handle_t ball_spritesheet =
@@ -779,6 +841,14 @@ int main(int argc, char *argv[])
     xTaskCreate(vDemoSendTask, "SendTask", mainGENERIC_STACK_SIZE * 2, NULL,
                 configMAX_PRIORITIES - 1, &DemoSendTask);
 
+    /** POSIX SHARED MEMORY */
+    xTaskCreate(vSHMDemoTask, "SHMTask", mainGENERIC_STACK_SIZE * 2, NULL,
+                configMAX_PRIORITIES - 1, &SHMDemoTask);
+
+    /** SERIAL */
+    xTaskCreate(vSerialDemoTask, "SerialTask", mainGENERIC_STACK_SIZE * 2,
+                NULL, configMAX_PRIORITIES - 1, &SerialDemoTask);
+
     vTaskSuspend(DemoTask1);
     vTaskSuspend(DemoTask2);
 